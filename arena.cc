@@ -0,0 +1,138 @@
+/* File: arena.cc
+ * --------------
+ * Implementation of the arena. Every block and large allocation of
+ * every arena is also entered in a table of address ranges, shared by
+ * all threads, so that FreeNodeMemory() can tell memory an arena handed
+ * out from memory that came from the heap.
+ */
+
+#include <stdlib.h>
+#include <map>
+#include <mutex>
+#include "arena.h"
+
+static const size_t BlockSize = 64 * 1024;
+
+static thread_local Arena *nodeArena = NULL;
+
+// The table, and its lock, are made on first use and never destroyed,
+// so that an arena in a static object can be made or destroyed at any
+// point of the program's start or exit
+typedef map<const char *, const char *> RangeMap;     // start to end
+
+static mutex &RangesLock()
+{
+    static mutex *lock = new mutex;
+    return *lock;
+}
+
+static RangeMap &Ranges()
+{
+    static RangeMap *ranges = new RangeMap;
+    return *ranges;
+}
+
+static void AddRange(const char *start, size_t size)
+{
+    lock_guard<mutex> guard(RangesLock());
+    Ranges()[start] = start + size;
+}
+
+static void RemoveRange(const char *start)
+{
+    lock_guard<mutex> guard(RangesLock());
+    Ranges().erase(start);
+}
+
+// Returns true if p is in memory that some arena has
+static bool InAnyArena(const void *p)
+{
+    lock_guard<mutex> guard(RangesLock());
+    RangeMap &ranges = Ranges();
+    RangeMap::iterator it = ranges.upper_bound((const char *)p);
+    return it != ranges.begin() && (const char *)p < (--it)->second;
+}
+
+Arena::Arena()
+{
+    current = -1;
+    next = NULL;
+    blockFree = 0;
+    used = 0;
+    numResets = 0;
+}
+
+Arena::~Arena()
+{
+    for (int i = 0; i < blocks.size(); i++) {
+        RemoveRange(blocks[i]);
+        free(blocks[i]);
+    }
+    for (int i = 0; i < large.size(); i++) {
+        RemoveRange(large[i]);
+        free(large[i]);
+    }
+}
+
+/* Function: AllocateSlow()
+ * ------------------------
+ * Called when the current block has no room: moves on to the next block,
+ * one kept from before a Reset() or a new one. Something that would take
+ * more than a quarter of a block gets a block of its own, so that the
+ * rest of the current one isn't wasted.
+ */
+void *Arena::AllocateSlow(size_t size, size_t align)
+{
+    if (size + align > BlockSize / 4) {
+        char *p = (char *)malloc(size + align);
+        if (!p) throw bad_alloc();
+        AddRange(p, size + align);
+        large.push_back(p);
+        used += size;
+        return p + (-(size_t)p & (align - 1));
+    }
+    if (++current == blocks.size()) {
+        char *block = (char *)malloc(BlockSize);
+        if (!block) throw bad_alloc();
+        AddRange(block, BlockSize);
+        blocks.push_back(block);
+    }
+    next = blocks[current];
+    blockFree = BlockSize;
+    return Allocate(size, align);
+}
+
+void Arena::Reset()
+{
+    for (int i = 0; i < large.size(); i++) {
+        RemoveRange(large[i]);
+        free(large[i]);
+    }
+    large.clear();
+    current = -1;
+    next = NULL;
+    blockFree = 0;
+    used = 0;
+    numResets++;
+}
+
+void SetNodeArena(Arena *arena)
+{
+    nodeArena = arena;
+}
+
+Arena *GetNodeArena()
+{
+    return nodeArena;
+}
+
+void *AllocateNodeMemory(size_t size)
+{
+    if (nodeArena) return nodeArena->Allocate(size);
+    return ::operator new(size);
+}
+
+void FreeNodeMemory(void *p)
+{
+    if (!InAnyArena(p)) ::operator delete(p);
+}
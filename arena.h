@@ -0,0 +1,104 @@
+/* File: arena.h
+ * -------------
+ * An Arena hands out memory by bumping a pointer through large blocks,
+ * and takes it all back at once with Reset(), which rewinds to the first
+ * block rather than freeing anything. Nothing allocated from it is freed
+ * on its own, and no destructors are run by Reset().
+ *
+ * The AST is allocated from one: while an arena is set on a thread
+ * (SetNodeArena()), every Node, and every List and the storage behind
+ * it, come from that arena, and deleting one of them runs its
+ * destructor but leaves the memory to the arena. The tree of a
+ * compilation then costs one Reset() to release, however large it is.
+ * A CompileContext sets its arena for the parse (see context.h).
+ */
+
+#ifndef _H_arena
+#define _H_arena
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+class Arena
+{
+  public:
+    Arena();
+    ~Arena();
+
+    // Returns size bytes aligned to align, a power of 2
+    void *Allocate(size_t size, size_t align = MaxAlign) {
+        size_t skip = -(size_t)next & (align - 1);
+        if (skip + size > blockFree) return AllocateSlow(size, align);
+        void *p = next + skip;
+        next += skip + size;
+        blockFree -= skip + size;
+        used += size;
+        return p;
+    }
+
+    // Takes back everything allocated, keeping the blocks for reuse
+    void Reset();
+
+    size_t BytesUsed() const { return used; }
+    int NumResets() const { return numResets; }
+
+  private:
+    static const size_t MaxAlign = alignof(max_align_t);
+
+    vector<char *> blocks;          // BlockSize each, kept by Reset()
+    vector<char *> large;           // too big for a block; freed by Reset()
+    int current;                    // the block being bumped through
+    char *next;                     // the free part of it
+    size_t blockFree;               // and its size
+    size_t used;
+    int numResets;
+
+    void *AllocateSlow(size_t size, size_t align);
+};
+
+// Sets the arena that the AST nodes made on the calling thread come
+// from, or NULL for the heap
+void SetNodeArena(Arena *arena);
+Arena *GetNodeArena();
+
+// Allocate and free the memory of AST nodes and lists, from the node
+// arena if one is set, or else the heap. FreeNodeMemory() goes by where
+// p came from, not by the arena set now: it leaves memory that any
+// arena handed out to that arena, and frees the rest to the heap.
+void *AllocateNodeMemory(size_t size);
+void FreeNodeMemory(void *p);
+
+/* Class: ArenaAllocator
+ * ---------------------
+ * A standard allocator for containers in the AST, such as the deque in a
+ * List: it allocates from the arena it was made with, and gives nothing
+ * back to it, or from the heap if that arena is NULL.
+ */
+template<class T> class ArenaAllocator
+{
+  public:
+    typedef T value_type;
+
+    ArenaAllocator(Arena *a = NULL) : arena(a) {}
+    template<class U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) {
+        if (arena) return (T *)arena->Allocate(n * sizeof(T), alignof(T));
+        return (T *)::operator new(n * sizeof(T));
+    }
+    void deallocate(T *p, size_t n) {
+        if (!arena) ::operator delete(p);
+    }
+
+    template<class U> bool operator==(const ArenaAllocator<U> &other) const
+        { return arena == other.arena; }
+    template<class U> bool operator!=(const ArenaAllocator<U> &other) const
+        { return arena != other.arena; }
+
+    Arena *arena;
+};
+
+#endif
@@ -5,23 +5,41 @@
 #include "ast.h"
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "ast_expr.h"
+#include "ast_stmt.h"
 #include "symtable.h"
+#include "context.h"
+#include "flatast.h"
 #include <string.h> // strdup
-#include <stdio.h>  // printf
+#include <stdlib.h> // free
+#include <stdio.h>  // fprintf
+#include "utility.h" // PrintDebug, DebugFile
 
 
-SymbolTable *Node::symtab = new SymbolTable;
-bool Node::isFnDecl = false;
-MyStack *Node::stack = new MyStack;
+static thread_local vector<Node *> *nodeLog = NULL;
+static thread_local const CompileContext *printContext = NULL;
 
-Node::Node(yyltype loc) {
-    location = new yyltype(loc);
+void SetNodeLog(vector<Node *> *log) {
+    nodeLog = log;
+}
+
+void SetPrintContext(const CompileContext *ctx) {
+    printContext = ctx;
+}
+
+Node::Node(const SourceSpan &loc) : span(loc) {
     parent = NULL;
+    if (nodeLog) nodeLog->push_back(this);
 }
 
 Node::Node() {
-    location = NULL;
     parent = NULL;
+    if (nodeLog) nodeLog->push_back(this);
+}
+
+yyltype *Node::GetLocation(const CompileContext *ctx, yyltype *loc) const {
+    if (!HasLocation()) return NULL;
+    return ctx->Locate(span, loc);
 }
 
 /* The Print method is used to print the parse tree nodes.
@@ -34,20 +52,101 @@ Node::Node() {
  */
 void Node::Print(int indentLevel, const char *label) { 
     const int numSpaces = 3;
-    printf("\n");
-    if (GetLocation()) 
-        printf("%*d", numSpaces, GetLocation()->first_line);
+    fprintf(DebugFile(), "\n");
+    if (HasLocation() && printContext)
+        fprintf(DebugFile(), "%*d", numSpaces, printContext->LineOf(span.first));
     else 
-        printf("%*s", numSpaces, "");
-    printf("%*s%s%s: ", indentLevel*numSpaces, "", 
+        fprintf(DebugFile(), "%*s", numSpaces, "");
+    fprintf(DebugFile(), "%*s%s%s: ", indentLevel*numSpaces, "", 
            label? label : "", GetPrintNameForNode());
    PrintChildren(indentLevel);
 } 
 	 
-Identifier::Identifier(yyltype loc, const char *n) : Node(loc) {
-    name = strdup(n);
+/* Only the error nodes are left with this Lower(), and a tree with any
+ * of them in it is never checked, so is never lowered.
+ */
+unsigned int Node::Lower(FlatAst *flat) {
+    Failure("%s has no flat form", GetPrintNameForNode());
+    return FlatAst::None;
+}
+	 
+Identifier::Identifier(const SourceSpan &loc, const char *n) : Node(loc) {
+    name = n;
 } 
 
 void Identifier::PrintChildren(int indentLevel) {
-    printf("%s", name);
+    fprintf(DebugFile(), "%s", name);
+}
+
+// Each node class, by GetPrintNameForNode(), and its size
+struct NodeClass {
+    const char *name;
+    size_t size;
+};
+
+static const NodeClass nodeClasses[] = {
+    { "ActualsError", sizeof(ActualsError) },
+    { "ArithmeticExpr", sizeof(ArithmeticExpr) },
+    { "ArrayAccess", sizeof(ArrayAccess) },
+    { "ArrayType", sizeof(ArrayType) },
+    { "AssignExpr", sizeof(AssignExpr) },
+    { "BoolConstant", sizeof(BoolConstant) },
+    { "BreakStmt", sizeof(BreakStmt) },
+    { "Call", sizeof(Call) },
+    { "Case", sizeof(Case) },
+    { "ConditionalExpr", sizeof(ConditionalExpr) },
+    { "ContinueStmt", sizeof(ContinueStmt) },
+    { "DeclStmt", sizeof(DeclStmt) },
+    { "Default", sizeof(Default) },
+    { "Empty", sizeof(EmptyExpr) },
+    { "EqualityExpr", sizeof(EqualityExpr) },
+    { "Error", sizeof(Error) },
+    { "ExprError", sizeof(ExprError) },
+    { "FieldAccess", sizeof(FieldAccess) },
+    { "FloatConstant", sizeof(FloatConstant) },
+    { "FnDecl", sizeof(FnDecl) },
+    { "ForStmt", sizeof(ForStmt) },
+    { "FormalsError", sizeof(FormalsError) },
+    { "Identifier", sizeof(Identifier) },
+    { "IfStmt", sizeof(IfStmt) },
+    { "IfStmtExprError", sizeof(IfStmtExprError) },
+    { "IntConstant", sizeof(IntConstant) },
+    { "LogicalExpr", sizeof(LogicalExpr) },
+    { "NamedType", sizeof(NamedType) },
+    { "Operator", sizeof(Operator) },
+    { "PostfixExpr", sizeof(PostfixExpr) },
+    { "Program", sizeof(Program) },
+    { "RelationalExpr", sizeof(RelationalExpr) },
+    { "ReturnStmt", sizeof(ReturnStmt) },
+    { "StmtBlock", sizeof(StmtBlock) },
+    { "SwitchStmt", sizeof(SwitchStmt) },
+    { "SwitchStmtError", sizeof(SwitchStmtError) },
+    { "Type", sizeof(Type) },
+    { "TypeQualifier", sizeof(TypeQualifier) },
+    { "VarDecl", sizeof(VarDecl) },
+    { "VarDeclError", sizeof(VarDeclError) },
+    { "VarExpr", sizeof(VarExpr) },
+    { "WhileStmt", sizeof(WhileStmt) },
+};
+static const int NumNodeClasses = sizeof(nodeClasses) / sizeof(nodeClasses[0]);
+
+size_t NodeClassSize(const char *name) {
+    for (int i = 0; i < NumNodeClasses; i++)
+        if (strcmp(nodeClasses[i].name, name) == 0) return nodeClasses[i].size;
+    return 0;
+}
+
+/* Function: PrintNodeSizes()
+ * --------------------------
+ * Prints, with -d nodesizes, the size of a Node, of the location it
+ * keeps, and of each node class, on one line.
+ */
+void PrintNodeSizes() {
+    char line[2048];
+    int len = snprintf(line, sizeof(line), "Node=%zu location=%zu",
+                       sizeof(Node), sizeof(SourceSpan));
+    for (int i = 0; i < NumNodeClasses && len < sizeof(line); i++)
+        len += snprintf(line + len, sizeof(line) - len, " %s=%zu",
+                        nodeClasses[i].name, nodeClasses[i].size);
+    PrintDebug("nodesizes", "%s", line);
 }
@@ -7,10 +7,12 @@
  * more correctly, of instances of concrete subclassses such as VarDecl,
  * ForStmt, and AssignExpr).
  * 
- * Location: Each node maintains its lexical location (line and columns in 
- * file), that location can be NULL for those nodes that don't care/use 
- * locations. The location is typcially set by the node constructor.  The 
- * location is used to provide the context when reporting semantic errors.
+ * Location: Each node maintains its lexical location, as the span of
+ * source text from its first lexeme to its last (see location.h), kept
+ * in the node itself. Nodes that don't care/use locations have none.
+ * The location is typcially set by the node constructor. The line and
+ * columns are worked out from the span by the context of the
+ * compilation (GetLocation()) when reporting semantic errors.
  *
  * Parent: Each node has a pointer to its parent. For a Program node, the 
  * parent is NULL, for all other nodes it is the pointer to the node one level
@@ -20,6 +22,12 @@
  * set up links in both directions. The parent link is typically not used 
  * during parsing, but is more important in later phases.
  *
+ * Memory: Nodes and the Lists of them are allocated
+ * from the node arena of the thread, if one is set (see arena.h), so a
+ * whole tree is released at once when its compilation is done. Deleting
+ * a node still runs its destructor, but only gives memory back to the
+ * heap if it came from there.
+ *
  * Printing: This functionaility is saved from pp2 of the node classes to 
  * print out the AST tree for debugging purpose.  Each node class is 
  * responsible for printing itself/children by overriding the virtual 
@@ -39,30 +47,34 @@
 
 #include <stdlib.h>   // for NULL
 #include "location.h"
+#include "arena.h"
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
-class SymbolTable;
-class MyStack;
+class CompileContext;
 class FnDecl;
+class FlatAst;
 
 class Node  {
   protected:
-    yyltype *location;
     Node *parent;
+    SourceSpan span;                // last, so subclasses can pack into its padding
 
   public:
-    static SymbolTable *symtab; 
-    static bool isFnDecl;
-    static MyStack *stack;
-
-
-    Node(yyltype loc);
+    Node(const SourceSpan &loc);
     Node();
     virtual ~Node() {}
+
+    static void *operator new(size_t size) { return AllocateNodeMemory(size); }
+    static void operator delete(void *p)   { FreeNodeMemory(p); }
     
-    yyltype *GetLocation()   { return location; }
+    bool HasLocation() const            { return span.first != NoOffset; }
+    const SourceSpan &GetSpan() const   { return span; }
+    // Fills in loc with the lines and columns of the node in the source
+    // of ctx and returns it, or returns NULL if the node has no location
+    yyltype *GetLocation(const CompileContext *ctx, yyltype *loc) const;
     void SetParent(Node *p)  { parent = p; }
     Node *GetParent()        { return parent; }
 
@@ -73,19 +85,39 @@ class Node  {
     void Print(int indentLevel, const char *label = NULL); 
     virtual void PrintChildren(int indentLevel)  {}
 
-    virtual void Check() {}
+    // Semantic checking. All checker state (symbol table, statement
+    // stack, diagnostics) lives in the context of the compilation.
+    virtual void Check(CompileContext *ctx) {}
+
+    // Adds the node, and its children before it, to a flat AST (see
+    // flatast.h), and returns its index there. A Type returns its TypeId.
+    virtual unsigned int Lower(FlatAst *flat);
 };
    
 
+// Print() numbers each line with the line of the node in the source of
+// the context set here on the calling thread, if any
+void SetPrintContext(const CompileContext *ctx);
+
+// While a log is set, every node constructed on the calling thread is
+// added to it, so that -d timing can count nodes by class (see stats.h)
+void SetNodeLog(vector<Node *> *log);
+
+// The size of the node class with the given print name, or 0 if there
+// is none, for -d timing; and a line of them all, for -d nodesizes
+size_t NodeClassSize(const char *printName);
+void PrintNodeSizes();
+
+
 class Identifier : public Node 
 {
   protected:
-    char *name;
+    const char *name;               // an atom, owned by the context's AtomTable
     
   public:
-    Identifier(yyltype loc, const char *name);
+    Identifier(const SourceSpan &loc, const char *name);
     const char *GetPrintNameForNode()   { return "Identifier"; }
-    char *GetName() const { return name; }
+    const char *GetName() const { return name; }
     void PrintChildren(int indentLevel);
     friend ostream& operator<<(ostream& out, Identifier *id) { return out << id->name; }
 };
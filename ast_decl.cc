@@ -6,15 +6,22 @@
 #include "ast_type.h"
 #include "ast_stmt.h"
 #include "symtable.h"        
+#include "context.h"
+#include "flatast.h"
          
-Decl::Decl(Identifier *n) : Node(*n->GetLocation()) {
+Decl::Decl(Identifier *n) : Node(n->GetSpan()) {
     Assert(n != NULL);
     (id=n)->SetParent(this); 
 }
 
+Decl::~Decl() {
+    delete id;
+}
+
 VarDecl::VarDecl(Identifier *n, Type *t, Expr *e) : Decl(n) {
     Assert(n != NULL && t != NULL);
     (type=t)->SetParent(this);
+    assignTo = NULL;
     if (e) (assignTo=e)->SetParent(this);
     typeq = NULL;
 }
@@ -22,6 +29,7 @@ VarDecl::VarDecl(Identifier *n, Type *t, Expr *e) : Decl(n) {
 VarDecl::VarDecl(Identifier *n, TypeQualifier *tq, Expr *e) : Decl(n) {
     Assert(n != NULL && tq != NULL);
     (typeq=tq)->SetParent(this);
+    assignTo = NULL;
     if (e) (assignTo=e)->SetParent(this);
     type = NULL;
 }
@@ -30,9 +38,21 @@ VarDecl::VarDecl(Identifier *n, Type *t, TypeQualifier *tq, Expr *e) : Decl(n) {
     Assert(n != NULL && t != NULL && tq != NULL);
     (type=t)->SetParent(this);
     (typeq=tq)->SetParent(this);
+    assignTo = NULL;
     if (e) (assignTo=e)->SetParent(this);
 }
   
+VarDecl::~VarDecl() {
+    if (type && !type->IsBuiltin()) delete type;
+    if (typeq && !typeq->IsBuiltin()) delete typeq;
+    delete assignTo;
+}
+
+void VarDecl::DiscardBody() {
+    delete assignTo;
+    assignTo = NULL;
+}
+  
 void VarDecl::PrintChildren(int indentLevel) { 
    if (typeq) typeq->Print(indentLevel+1);
    if (type) type->Print(indentLevel+1);
@@ -41,29 +61,37 @@ void VarDecl::PrintChildren(int indentLevel) {
 
 }
 
-void VarDecl::Check(){
-    Symbol *sym = Node::symtab->find(this->GetIdentifier()->GetName());
+void VarDecl::Check(CompileContext *ctx){
+    Symbol *sym = ctx->symtab->find(this->GetIdentifier()->GetName());
     if(sym&&sym->someInfo==0){
-        ReportError::DeclConflict(this, sym->decl);
-        Node::symtab->remove(*sym);
+        ReportError::DeclConflict(ctx, this, sym->decl);
+        ctx->symtab->remove(*sym);
     }
     if(this->assignTo){
-        Type *actual_type = this->assignTo->CheckExpr();
+        Type *actual_type = this->assignTo->CheckExpr(ctx);
 	if(actual_type->IsError())
 	    return;
         if(!actual_type->IsEquivalentTo(this->type)){
-            ReportError::InvalidInitialization(this->GetIdentifier(), this->type, actual_type);
+            ReportError::InvalidInitialization(ctx, this->GetIdentifier(), this->type, actual_type);
         }
     }
-    sym = new Symbol(this->GetIdentifier()->GetName(), this, E_VarDecl);
-    Node::symtab->insert(*sym);
+    Symbol bound(this->GetIdentifier()->GetName(), this, E_VarDecl);
+    ctx->symtab->insert(bound);
     
 }
 
+unsigned int VarDecl::Lower(FlatAst *flat) {
+    FlatAst::Index name = flat->AddIdentifier(id);
+    FlatAst::TypeId t = (type ? type->Lower(flat) : FlatAst::NoType);
+    FlatAst::Index init = (assignTo ? assignTo->Lower(flat) : FlatAst::None);
+    return flat->Add(F_VarDecl, span, name, t, init, FlatAst::Qualifier(typeq));
+}
+
 FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl*> *d) : Decl(n) {
     Assert(n != NULL && r!= NULL && d != NULL);
     (returnType=r)->SetParent(this);
     (formals=d)->SetParentAll(this);
+    formals->Freeze();
     body = NULL;
     returnTypeq = NULL;
 }
@@ -73,6 +101,22 @@ FnDecl::FnDecl(Identifier *n, Type *r, TypeQualifier *rq, List<VarDecl*> *d) : D
     (returnType=r)->SetParent(this);
     (returnTypeq=rq)->SetParent(this);
     (formals=d)->SetParentAll(this);
+    formals->Freeze();
+    body = NULL;
+}
+
+FnDecl::~FnDecl() {
+    if (formals) {
+        formals->DeleteAll();
+        delete formals;
+    }
+    if (returnType && !returnType->IsBuiltin()) delete returnType;
+    if (returnTypeq && !returnTypeq->IsBuiltin()) delete returnTypeq;
+    delete body;
+}
+
+void FnDecl::DiscardBody() {
+    delete body;
     body = NULL;
 }
 
@@ -87,40 +131,49 @@ void FnDecl::PrintChildren(int indentLevel) {
     if (body) body->Print(indentLevel+1, "(body) ");
 }
 
-void FnDecl::Check(){
-    Symbol *sym = Node::symtab->find(this->GetIdentifier()->GetName());
+void FnDecl::Check(CompileContext *ctx){
+    Symbol *sym = ctx->symtab->find(this->GetIdentifier()->GetName());
     if(sym&&sym->someInfo==0){
-        ReportError::DeclConflict(this, sym->decl);
-        Node::symtab->remove(*sym);
+        ReportError::DeclConflict(ctx, this, sym->decl);
+        ctx->symtab->remove(*sym);
     }
     
-    sym = new Symbol(this->GetIdentifier()->GetName(), this, E_FunctionDecl);
-    Node::symtab->insert(*sym);
-    Node::symtab->push();
-    Node::symtab->setReturnType(this->GetType());
-    Node::isFnDecl = true;
+    Symbol bound(this->GetIdentifier()->GetName(), this, E_FunctionDecl);
+    ctx->symtab->insert(bound);
+    ctx->symtab->push();
+    ctx->symtab->setReturnType(this->GetType());
+    ctx->isFnDecl = true;
     if ( this->GetFormals()->NumElements() > 0 ) {
         for ( int i = 0; i < this->GetFormals()->NumElements(); ++i ) {
             VarDecl *vd = this->GetFormals()->Nth(i);
-            vd->Check();
+            vd->Check(ctx);
         }
     }
     StmtBlock* body_stmt = dynamic_cast<StmtBlock *>(this->GetBody());
 
     
 
-    body_stmt->Check();
+    body_stmt->Check(ctx);
 
     
-    Type *returned = Node::symtab->getType(); 
+    Type *returned = ctx->symtab->getType(); 
     if(!returned->IsEquivalentTo(Type::voidType)){
-        ReportError::ReturnMissing(this);
+        ReportError::ReturnMissing(ctx, this);
 
     }
-    Node::symtab->pop();
+    ctx->symtab->pop();
 
     
     
 
 }
 
+// The return type, which the grammar only lets be a built-in one, is
+// kept in the tag
+unsigned int FnDecl::Lower(FlatAst *flat) {
+    FlatAst::TypeId ret = returnType->Lower(flat);
+    Assert(ret < NumBuiltinTypes);
+    FlatAst::Index name = flat->AddIdentifier(id), f = flat->AddList(formals);
+    FlatAst::Index b = (body ? body->Lower(flat) : FlatAst::None);
+    return flat->Add(F_FnDecl, span, name, f, b, ret);
+}
@@ -23,7 +23,7 @@ class NamedType;
 class Identifier;
 class Stmt;
 
-void yyerror(const char *msg);
+void yyerror(CompileContext *ctx, const char *msg);
 
 class Decl : public Node 
 {
@@ -33,11 +33,17 @@ class Decl : public Node
   public:
     Decl() : id(NULL) {}
     Decl(Identifier *name);
+    ~Decl();
     Identifier *GetIdentifier() const { return id; }
     friend ostream& operator<<(ostream& out, Decl *d) { return out << d->id; }
 
 
-    virtual void Check(){}
+    virtual void Check(CompileContext *ctx){}
+
+    // Frees the parts of a checked declaration that checking later
+    // declarations never looks at (a function body, an initializer),
+    // keeping what its global symbol refers to
+    virtual void DiscardBody() {}
 
 };
 
@@ -53,18 +59,21 @@ class VarDecl : public Decl
     VarDecl(Identifier *name, Type *type, Expr *assignTo = NULL);
     VarDecl(Identifier *name, TypeQualifier *typeq, Expr *assignTo = NULL);
     VarDecl(Identifier *name, Type *type, TypeQualifier *typeq, Expr *assignTo = NULL);
+    ~VarDecl();
     const char *GetPrintNameForNode() { return "VarDecl"; }
     void PrintChildren(int indentLevel);
     Type *GetType() const { return type; }
 
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual void DiscardBody();
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class VarDeclError : public VarDecl
 {
   public:
-    VarDeclError() : VarDecl() { yyerror(this->GetPrintNameForNode()); };
+    VarDeclError(CompileContext *ctx) : VarDecl() { yyerror(ctx, this->GetPrintNameForNode()); };
     const char *GetPrintNameForNode() { return "VarDeclError"; }
 };
 
@@ -80,6 +89,7 @@ class FnDecl : public Decl
     FnDecl() : Decl(), formals(NULL), returnType(NULL), returnTypeq(NULL), body(NULL) {}
     FnDecl(Identifier *name, Type *returnType, List<VarDecl*> *formals);
     FnDecl(Identifier *name, Type *returnType, TypeQualifier *returnTypeq, List<VarDecl*> *formals);
+    ~FnDecl();
     void SetFunctionBody(Stmt *b);
     const char *GetPrintNameForNode() { return "FnDecl"; }
     void PrintChildren(int indentLevel);
@@ -88,13 +98,15 @@ class FnDecl : public Decl
     List<VarDecl*> *GetFormals() {return formals;}
     Stmt *GetBody(){return body;}
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual void DiscardBody();
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class FormalsError : public FnDecl
 {
   public:
-    FormalsError() : FnDecl() { yyerror(this->GetPrintNameForNode()); }
+    FormalsError(CompileContext *ctx) : FnDecl() { yyerror(ctx, this->GetPrintNameForNode()); }
     const char *GetPrintNameForNode() { return "FormalsError"; }
 };
 
@@ -8,43 +8,65 @@
 #include "ast_type.h"
 #include "ast_decl.h"
 #include "symtable.h"
+#include "context.h"
+#include "flatast.h"
 
-IntConstant::IntConstant(yyltype loc, int val) : Expr(loc) {
+IntConstant::IntConstant(const SourceSpan &loc, int val) : Expr(loc) {
     value = val;
 }
 
 void IntConstant::PrintChildren(int indentLevel) { 
-    printf("%d", value);
+    fprintf(DebugFile(), "%d", value);
 }
 
-FloatConstant::FloatConstant(yyltype loc, double val) : Expr(loc) {
+unsigned int IntConstant::Lower(FlatAst *flat) {
+    return flat->Add(F_IntConstant, span, flat->AddInt(value));
+}
+
+FloatConstant::FloatConstant(const SourceSpan &loc, double val) : Expr(loc) {
     value = val;
 }
 
 void FloatConstant::PrintChildren(int indentLevel) { 
-    printf("%g", value);
+    fprintf(DebugFile(), "%g", value);
+}
+
+unsigned int FloatConstant::Lower(FlatAst *flat) {
+    return flat->Add(F_FloatConstant, span, flat->AddFloat(value));
 }
 
-BoolConstant::BoolConstant(yyltype loc, bool val) : Expr(loc) {
+BoolConstant::BoolConstant(const SourceSpan &loc, bool val) : Expr(loc) {
     value = val;
 }
 
 void BoolConstant::PrintChildren(int indentLevel) { 
-    printf("%s", value ? "true" : "false");
+    fprintf(DebugFile(), "%s", value ? "true" : "false");
+}
+
+unsigned int BoolConstant::Lower(FlatAst *flat) {
+    return flat->Add(F_BoolConstant, span, FlatAst::None, FlatAst::None, FlatAst::None, value);
 }
 
-VarExpr::VarExpr(yyltype loc, Identifier *ident) : Expr(loc) {
+unsigned int EmptyExpr::Lower(FlatAst *flat) {
+    return flat->Add(F_Empty, span);
+}
+
+VarExpr::VarExpr(const SourceSpan &loc, Identifier *ident) : Expr(loc) {
     Assert(ident != NULL);
     this->id = ident;
 }
-void VarExpr::Check() {
-    this->CheckExpr();
+
+VarExpr::~VarExpr() {
+    delete id;
+}
+void VarExpr::Check(CompileContext *ctx) {
+    this->CheckExpr(ctx);
 }
 
-Type *VarExpr::CheckExpr() {
-    Symbol *sym = Node::symtab->find(this->GetIdentifier()->GetName());
+Type *VarExpr::CheckExpr(CompileContext *ctx) {
+    Symbol *sym = ctx->symtab->find(this->GetIdentifier()->GetName());
     if(!sym){
-        ReportError::IdentifierNotDeclared(this->GetIdentifier(), LookingForVariable);
+        ReportError::IdentifierNotDeclared(ctx, this->GetIdentifier(), LookingForVariable);
         return Type::errorType;
     }
     VarDecl *vd = dynamic_cast<VarDecl*>(sym->decl);
@@ -58,21 +80,37 @@ void VarExpr::PrintChildren(int indentLevel) {
     id->Print(indentLevel+1);
 }
 
-Operator::Operator(yyltype loc, const char *tok) : Node(loc) {
-    Assert(tok != NULL);
-    strncpy(tokenString, tok, sizeof(tokenString));
+unsigned int VarExpr::Lower(FlatAst *flat) {
+    return flat->Add(F_VarExpr, span, flat->AddIdentifier(id));
+}
+
+Operator::Operator(const SourceSpan &loc, opcodeT op) : Node(loc) {
+    Assert(op >= 0 && op < NumOpcodes);
+    opcode = op;
 }
 
 void Operator::PrintChildren(int indentLevel) {
-    printf("%s",tokenString);
+    fprintf(DebugFile(), "%s", GetSpelling());
 }
 
-bool Operator::IsOp(const char *op) const {
-    return strcmp(tokenString, op) == 0;
+const char *Operator::GetSpelling() const {
+    return Spelling(opcode);
+}
+
+const char *Operator::Spelling(opcodeT op) {
+    static const char *spellings[NumOpcodes] = {
+        "+", "-", "*", "/",
+        "++", "--",
+        "<", ">", "<=", ">=",
+        "==", "!=",
+        "&&", "||",
+        "=", "+=", "-=", "*=", "/="
+    };
+    return spellings[op];
 }
 
 CompoundExpr::CompoundExpr(Expr *l, Operator *o, Expr *r) 
-  : Expr(Join(l->GetLocation(), r->GetLocation())) {
+  : Expr(Join(l->GetSpan(), r->GetSpan())) {
     Assert(l != NULL && o != NULL && r != NULL);
     (op=o)->SetParent(this);
     (left=l)->SetParent(this); 
@@ -80,7 +118,7 @@ CompoundExpr::CompoundExpr(Expr *l, Operator *o, Expr *r)
 }
 
 CompoundExpr::CompoundExpr(Operator *o, Expr *r) 
-  : Expr(Join(o->GetLocation(), r->GetLocation())) {
+  : Expr(Join(o->GetSpan(), r->GetSpan())) {
     Assert(o != NULL && r != NULL);
     left = NULL; 
     (op=o)->SetParent(this);
@@ -88,12 +126,19 @@ CompoundExpr::CompoundExpr(Operator *o, Expr *r)
 }
 
 CompoundExpr::CompoundExpr(Expr *l, Operator *o) 
-  : Expr(Join(l->GetLocation(), o->GetLocation())) {
+  : Expr(Join(l->GetSpan(), o->GetSpan())) {
     Assert(l != NULL && o != NULL);
+    right = NULL;
     (left=l)->SetParent(this);
     (op=o)->SetParent(this);
 }
 
+CompoundExpr::~CompoundExpr() {
+    delete op;
+    delete left;
+    delete right;
+}
+
 
 void CompoundExpr::PrintChildren(int indentLevel) {
    if (left) left->Print(indentLevel+1);
@@ -101,13 +146,19 @@ void CompoundExpr::PrintChildren(int indentLevel) {
    if (right) right->Print(indentLevel+1);
 }
 
-Type* ArithmeticExpr::CheckExpr(){
+unsigned int CompoundExpr::LowerOperands(FlatAst *flat, int kind) {
+    FlatAst::Index l = (left ? left->Lower(flat) : FlatAst::None);
+    FlatAst::Index r = (right ? right->Lower(flat) : FlatAst::None);
+    return flat->Add((flatKindT)kind, span, l, r, flat->AddOperator(op));
+}
+
+Type* ArithmeticExpr::CheckExpr(CompileContext *ctx){
     bool is_unary = false;
     Type* l_type = NULL;
     Type* r_type = NULL;
     if(left){
-        l_type = left->CheckExpr();
-        r_type = right->CheckExpr();
+        l_type = left->CheckExpr(ctx);
+        r_type = right->CheckExpr(ctx);
         if(l_type->IsError() || r_type->IsError()){
             return Type::errorType;
         }
@@ -141,13 +192,13 @@ Type* ArithmeticExpr::CheckExpr(){
 	}
 
         if (!l_type->IsEquivalentTo(r_type)){
-            ReportError::IncompatibleOperands(op, l_type, r_type);
+            ReportError::IncompatibleOperands(ctx, op, l_type, r_type);
             return Type::errorType;
         }
     }
     else{
         is_unary = true;
-        r_type = right->CheckExpr();
+        r_type = right->CheckExpr(ctx);
         if(r_type->IsError()){
             return Type::errorType;
         }
@@ -159,30 +210,34 @@ Type* ArithmeticExpr::CheckExpr(){
     }
     else{
         if(is_unary){
-            ReportError::IncompatibleOperand(op, r_type);
+            ReportError::IncompatibleOperand(ctx, op, r_type);
         }
         else{
-            ReportError::IncompatibleOperands(op, l_type, r_type);
+            ReportError::IncompatibleOperands(ctx, op, l_type, r_type);
         }
         
         return Type::errorType;
     }
 }
 
-void ArithmeticExpr::Check(){
-    this->CheckExpr();
+void ArithmeticExpr::Check(CompileContext *ctx){
+    this->CheckExpr(ctx);
 }
 
-Type *RelationalExpr::CheckExpr(){
-    Type *l_type = left->CheckExpr();
-    Type *r_type = right->CheckExpr();
+unsigned int ArithmeticExpr::Lower(FlatAst *flat) {
+    return LowerOperands(flat, F_Arithmetic);
+}
+
+Type *RelationalExpr::CheckExpr(CompileContext *ctx){
+    Type *l_type = left->CheckExpr(ctx);
+    Type *r_type = right->CheckExpr(ctx);
 
     if(l_type->IsError() || r_type->IsError()){
         return Type::errorType;
     }
 
     if (!l_type->IsEquivalentTo(r_type)){
-        ReportError::IncompatibleOperands(op, l_type, r_type);
+        ReportError::IncompatibleOperands(ctx, op, l_type, r_type);
         return Type::errorType;
     }
     if (r_type->IsNumeric())
@@ -190,26 +245,30 @@ Type *RelationalExpr::CheckExpr(){
         return Type::boolType;
     }
     else{
-        ReportError::IncompatibleOperands(op, l_type, r_type);
+        ReportError::IncompatibleOperands(ctx, op, l_type, r_type);
         return Type::errorType;
     }
 
 }
 
-void RelationalExpr::Check(){
-    this->CheckExpr();
+void RelationalExpr::Check(CompileContext *ctx){
+    this->CheckExpr(ctx);
 }
 
-Type *EqualityExpr::CheckExpr(){
-    Type *l_type = left->CheckExpr();
-    Type *r_type = right->CheckExpr();
+unsigned int RelationalExpr::Lower(FlatAst *flat) {
+    return LowerOperands(flat, F_Relational);
+}
+
+Type *EqualityExpr::CheckExpr(CompileContext *ctx){
+    Type *l_type = left->CheckExpr(ctx);
+    Type *r_type = right->CheckExpr(ctx);
 
     if(l_type->IsError() || r_type->IsError()){
         return Type::errorType;
     }
 
     if (!l_type->IsEquivalentTo(r_type)){
-        ReportError::IncompatibleOperands(op, l_type, r_type);
+        ReportError::IncompatibleOperands(ctx, op, l_type, r_type);
         return Type::errorType;
     }
     
@@ -217,29 +276,33 @@ Type *EqualityExpr::CheckExpr(){
     
 }
 
-void EqualityExpr::Check(){
-    this->CheckExpr();
+void EqualityExpr::Check(CompileContext *ctx){
+    this->CheckExpr(ctx);
+}
+
+unsigned int EqualityExpr::Lower(FlatAst *flat) {
+    return LowerOperands(flat, F_Equality);
 }
 
-Type *LogicalExpr::CheckExpr(){
+Type *LogicalExpr::CheckExpr(CompileContext *ctx){
     bool is_unary = false;
     Type* l_type = NULL;
     Type* r_type = NULL;
     if(left){
-        l_type = left->CheckExpr();
-        r_type = right->CheckExpr();
+        l_type = left->CheckExpr(ctx);
+        r_type = right->CheckExpr(ctx);
         if(l_type->IsError() || r_type->IsError()){
             return Type::errorType;
         }
 
         if (!l_type->IsEquivalentTo(r_type)){
-            ReportError::IncompatibleOperands(op, l_type, r_type);
+            ReportError::IncompatibleOperands(ctx, op, l_type, r_type);
             return Type::errorType;
         }
     }
     else{
         is_unary = true;
-        r_type = right->CheckExpr();
+        r_type = right->CheckExpr(ctx);
         if(r_type->IsError()){
             return Type::errorType;
         }
@@ -251,42 +314,50 @@ Type *LogicalExpr::CheckExpr(){
     }
     else{
         if(is_unary){
-            ReportError::IncompatibleOperand(op, r_type);
+            ReportError::IncompatibleOperand(ctx, op, r_type);
         }
         else{
-            ReportError::IncompatibleOperands(op, l_type, r_type);
+            ReportError::IncompatibleOperands(ctx, op, l_type, r_type);
         }
         
         return Type::errorType;
     }
 }
 
-void LogicalExpr::Check(){
-    this->CheckExpr();
+void LogicalExpr::Check(CompileContext *ctx){
+    this->CheckExpr(ctx);
+}
+
+unsigned int LogicalExpr::Lower(FlatAst *flat) {
+    return LowerOperands(flat, F_Logical);
 }
 
-Type *AssignExpr::CheckExpr(){
-    Type *l_type = left->CheckExpr();
-    Type *r_type = right->CheckExpr();
+Type *AssignExpr::CheckExpr(CompileContext *ctx){
+    Type *l_type = left->CheckExpr(ctx);
+    Type *r_type = right->CheckExpr(ctx);
 
     if(l_type->IsError() || r_type->IsError()){
         return Type::errorType;
     }
 
     if (!l_type->IsEquivalentTo(r_type)){
-        ReportError::IncompatibleOperands(op, l_type, r_type);
+        ReportError::IncompatibleOperands(ctx, op, l_type, r_type);
         return Type::errorType;
     }
     
     return r_type;
 }
 
-void AssignExpr::Check(){
-    this->CheckExpr();
+void AssignExpr::Check(CompileContext *ctx){
+    this->CheckExpr(ctx);
 }
 
-Type *PostfixExpr::CheckExpr(){
-    Type *r_type = left->CheckExpr();
+unsigned int AssignExpr::Lower(FlatAst *flat) {
+    return LowerOperands(flat, F_Assign);
+}
+
+Type *PostfixExpr::CheckExpr(CompileContext *ctx){
+    Type *r_type = left->CheckExpr(ctx);
     if(r_type->IsError()){
         return Type::errorType;
     }
@@ -294,33 +365,43 @@ Type *PostfixExpr::CheckExpr(){
         return r_type;
     }
     else{
-        ReportError::IncompatibleOperand(op, r_type);
+        ReportError::IncompatibleOperand(ctx, op, r_type);
         return Type::errorType;
     }
 
 }
 
-void PostfixExpr::Check(){
-    this->CheckExpr();
+void PostfixExpr::Check(CompileContext *ctx){
+    this->CheckExpr(ctx);
+}
+
+unsigned int PostfixExpr::Lower(FlatAst *flat) {
+    return LowerOperands(flat, F_Postfix);
 }
    
 ConditionalExpr::ConditionalExpr(Expr *c, Expr *t, Expr *f)
-  : Expr(Join(c->GetLocation(), f->GetLocation())) {
+  : Expr(Join(c->GetSpan(), f->GetSpan())) {
     Assert(c != NULL && t != NULL && f != NULL);
     (cond=c)->SetParent(this);
     (trueExpr=t)->SetParent(this);
     (falseExpr=f)->SetParent(this);
 }
-void ConditionalExpr::Check() {
-    Type *cond_type = cond->CheckExpr();
-    trueExpr->Check();
-    falseExpr->Check();
+
+ConditionalExpr::~ConditionalExpr() {
+    delete cond;
+    delete trueExpr;
+    delete falseExpr;
+}
+void ConditionalExpr::Check(CompileContext *ctx) {
+    Type *cond_type = cond->CheckExpr(ctx);
+    trueExpr->Check(ctx);
+    falseExpr->Check(ctx);
 
     if (cond_type->IsError())
         return;
 
     if(!cond_type->IsEquivalentTo(Type::boolType)){
-        ReportError::TestNotBoolean(cond);
+        ReportError::TestNotBoolean(ctx, cond);
     }
 }
 
@@ -330,61 +411,81 @@ void ConditionalExpr::PrintChildren(int indentLevel) {
     trueExpr->Print(indentLevel+1, "(true) ");
     falseExpr->Print(indentLevel+1, "(false) ");
 }
-ArrayAccess::ArrayAccess(yyltype loc, Expr *b, Expr *s) : LValue(loc) {
+
+unsigned int ConditionalExpr::Lower(FlatAst *flat) {
+    FlatAst::Index c = cond->Lower(flat), t = trueExpr->Lower(flat), f = falseExpr->Lower(flat);
+    return flat->Add(F_Conditional, span, c, t, f);
+}
+ArrayAccess::ArrayAccess(const SourceSpan &loc, Expr *b, Expr *s) : LValue(loc) {
     (base=b)->SetParent(this); 
     (subscript=s)->SetParent(this);
 }
-Type *ArrayAccess::CheckExpr() {
+
+ArrayAccess::~ArrayAccess() {
+    delete base;
+    delete subscript;
+}
+Type *ArrayAccess::CheckExpr(CompileContext *ctx) {
     VarExpr * b = dynamic_cast<VarExpr*> (base);
     if(!b){
-        ReportError::NotAnArray(b->GetIdentifier());
+        ReportError::NotAnArray(ctx, b->GetIdentifier());
         return Type::errorType;
     }
-    Type * type = base->CheckExpr();
+    Type * type = base->CheckExpr(ctx);
     if(type->IsError()){
         return Type::errorType;
     }
     ArrayType *b_type = dynamic_cast<ArrayType*>(type);
-    //subscript->Check();
+    //subscript->Check(ctx);
 
     if(!b_type){
-        ReportError::NotAnArray(b->GetIdentifier());
+        ReportError::NotAnArray(ctx, b->GetIdentifier());
         return Type::errorType;
     }
     return b_type->GetElemType();
 }
 
-void ArrayAccess::Check(){
-    this->CheckExpr();
+void ArrayAccess::Check(CompileContext *ctx){
+    this->CheckExpr(ctx);
 }
 
 void ArrayAccess::PrintChildren(int indentLevel) {
     base->Print(indentLevel+1);
     subscript->Print(indentLevel+1, "(subscript) ");
 }
+
+unsigned int ArrayAccess::Lower(FlatAst *flat) {
+    FlatAst::Index b = base->Lower(flat), s = subscript->Lower(flat);
+    return flat->Add(F_ArrayAccess, span, b, s);
+}
      
 FieldAccess::FieldAccess(Expr *b, Identifier *f) 
-  : LValue(b? Join(b->GetLocation(), f->GetLocation()) : *f->GetLocation()) {
+  : LValue(b? Join(b->GetSpan(), f->GetSpan()) : f->GetSpan()) {
     Assert(f != NULL); // b can be be NULL (just means no explicit base)
     base = b; 
     if (base) base->SetParent(this); 
     (field=f)->SetParent(this);
 }
-void FieldAccess::Check() {
-    this->CheckExpr();
+
+FieldAccess::~FieldAccess() {
+    delete base;
+    delete field;
+}
+void FieldAccess::Check(CompileContext *ctx) {
+    this->CheckExpr(ctx);
 }
 
-Type *FieldAccess::CheckExpr(){
+Type *FieldAccess::CheckExpr(CompileContext *ctx){
     
-        Type *type = base->CheckExpr();
+        Type *type = base->CheckExpr(ctx);
         if(type->IsError()){
             return Type::errorType;
         }
         if (!type->IsVector()) {
-            ReportError::InaccessibleSwizzle(field, base);
+            ReportError::InaccessibleSwizzle(ctx, field, base);
             return Type::errorType;
         }
-        char *name = field->GetName();
+        const char *name = field->GetName();
         const int len = strlen(name);
         bool has_z = false;
         bool has_w = false;
@@ -392,24 +493,24 @@ Type *FieldAccess::CheckExpr(){
         for(int i=0; i<len; i++){
             char c = name[i];
             if(c!='x'&&c!='y'&&c!='z'&&c!='w'){
-                ReportError::InvalidSwizzle(field, base);
+                ReportError::InvalidSwizzle(ctx, field, base);
                 return Type::errorType;
             }
             if(c!='x' && c!='y' && (type->IsEquivalentTo(Type::vec2Type))) {
-                ReportError::SwizzleOutOfBound(field,base);
+                ReportError::SwizzleOutOfBound(ctx, field,base);
 		return Type::errorType;
 	    }
             if(c!='x' && c!='y' && c!='z' && (type->IsEquivalentTo(Type::vec3Type))) {
-                ReportError::SwizzleOutOfBound(field,base);
+                ReportError::SwizzleOutOfBound(ctx, field,base);
 		return Type::errorType;
 	    }
 	    if(c!='x' && c!='y' && c!='z' && c!='w' && (type->IsEquivalentTo(Type::vec4Type))) {
-		ReportError::SwizzleOutOfBound(field,base);
+		ReportError::SwizzleOutOfBound(ctx, field,base);
 		return Type::errorType;
 	    }
         }
         if(len>4){
-            ReportError::OversizedVector(field, base);
+            ReportError::OversizedVector(ctx, field, base);
             return Type::errorType;
         }
 
@@ -433,51 +534,69 @@ void FieldAccess::PrintChildren(int indentLevel) {
     field->Print(indentLevel+1);
 }
 
-Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) : Expr(loc)  {
+unsigned int FieldAccess::Lower(FlatAst *flat) {
+    FlatAst::Index b = (base ? base->Lower(flat) : FlatAst::None);
+    return flat->Add(F_FieldAccess, span, b, flat->AddIdentifier(field));
+}
+
+Call::Call(const SourceSpan &loc, Expr *b, Identifier *f, List<Expr*> *a) : Expr(loc)  {
     Assert(f != NULL && a != NULL); // b can be be NULL (just means no explicit base)
     base = b;
     if (base) base->SetParent(this);
     (field=f)->SetParent(this);
     (actuals=a)->SetParentAll(this);
+    actuals->Freeze();
 }
-Type* Call::CheckExpr() {
-    Symbol *sym = Node::symtab->find(field->GetName());
+
+Call::~Call() {
+    delete base;
+    delete field;
+    if (actuals) {
+        actuals->DeleteAll();
+        delete actuals;
+    }
+}
+Type* Call::CheckExpr(CompileContext *ctx) {
+    Symbol *sym = ctx->symtab->find(field->GetName());
     if(!sym){
-        ReportError::IdentifierNotDeclared(field, LookingForFunction);
+        ReportError::IdentifierNotDeclared(ctx, field, LookingForFunction);
         return Type::errorType;
     }
 
    
     if(sym->kind != E_FunctionDecl) {
-        ReportError::NotAFunction(field);
+        ReportError::NotAFunction(ctx, field);
         return Type::errorType;
     }
 
     FnDecl* fndecl = dynamic_cast<FnDecl*>(sym->decl);
+    const List<VarDecl*> &formals = *fndecl->GetFormals();
+    int numActuals = actuals->NumElements();
 
 
-    if(fndecl->GetFormals()->NumElements() > actuals->NumElements()) {
-        ReportError::LessFormals(field, fndecl->GetFormals()->NumElements(), actuals->NumElements());
+    if(formals.NumElements() > numActuals) {
+        ReportError::LessFormals(ctx, field, formals.NumElements(), numActuals);
         return Type::errorType;
     }
 
-    else if(fndecl->GetFormals()->NumElements() < actuals->NumElements()) {
-        ReportError::ExtraFormals(field, fndecl->GetFormals()->NumElements(), actuals->NumElements());
+    else if(formals.NumElements() < numActuals) {
+        ReportError::ExtraFormals(ctx, field, formals.NumElements(), numActuals);
         return Type::errorType;
     }
 
     else{
-        for(int i = 0; i < actuals->NumElements(); i++) {
+        // Both lists have numActuals elements, so need no range checks
+        for(int i = 0; i < numActuals; i++) {
 
-            Type *actual = actuals->Nth(i)->CheckExpr();
+            Type *actual = (*actuals)[i]->CheckExpr(ctx);
             if(actual->IsError()){
               return Type::errorType;
             }
 
-            Type *expected = fndecl->GetFormals()->Nth(i)->GetType();
+            Type *expected = formals[i]->GetType();
 
             if(!actual->IsEquivalentTo(expected)) {
-                ReportError::FormalsTypeMismatch(field, i+1, expected, actual);
+                ReportError::FormalsTypeMismatch(ctx, field, i+1, expected, actual);
                 return Type::errorType;
             }
         }
@@ -485,8 +604,8 @@ Type* Call::CheckExpr() {
     return fndecl->GetType();
 }
 
-void Call::Check() {
-    this->CheckExpr();
+void Call::Check(CompileContext *ctx) {
+    this->CheckExpr(ctx);
 }
 
 void Call::PrintChildren(int indentLevel) {
@@ -495,3 +614,8 @@ void Call::PrintChildren(int indentLevel) {
    if (actuals) actuals->PrintAll(indentLevel+1, "(actuals) ");
 }
 
+unsigned int Call::Lower(FlatAst *flat) {
+    FlatAst::Index b = (base ? base->Lower(flat) : FlatAst::None);
+    FlatAst::Index f = flat->AddIdentifier(field), a = flat->AddList(actuals);
+    return flat->Add(F_Call, span, b, f, a);
+}
@@ -18,14 +18,14 @@
 #include "list.h"
 #include "ast_type.h"
 
-void yyerror(const char *msg);
+void yyerror(CompileContext *ctx, const char *msg);
 
 class Expr : public Stmt 
 {
   public:
-    Expr(yyltype loc) : Stmt(loc) {}
+    Expr(const SourceSpan &loc) : Stmt(loc) {}
     Expr() : Stmt() {}
-    virtual Type *CheckExpr() {return NULL;}
+    virtual Type *CheckExpr(CompileContext *ctx) {return NULL;}
 
     
 
@@ -38,7 +38,7 @@ class Expr : public Stmt
 class ExprError : public Expr
 {
   public:
-    ExprError() : Expr() { yyerror(this->GetPrintNameForNode()); }
+    ExprError(CompileContext *ctx) : Expr() { yyerror(ctx, this->GetPrintNameForNode()); }
     const char *GetPrintNameForNode() { return "ExprError"; }
 };
 
@@ -49,6 +49,7 @@ class EmptyExpr : public Expr
 {
   public:
     const char *GetPrintNameForNode() { return "Empty"; }
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class IntConstant : public Expr 
@@ -57,11 +58,12 @@ class IntConstant : public Expr
     int value;
   
   public:
-    IntConstant(yyltype loc, int val);
+    IntConstant(const SourceSpan &loc, int val);
     const char *GetPrintNameForNode() { return "IntConstant"; }
     void PrintChildren(int indentLevel);
 
-    virtual Type *CheckExpr() {return Type::intType;}
+    virtual Type *CheckExpr(CompileContext *ctx) {return Type::intType;}
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class FloatConstant: public Expr 
@@ -70,11 +72,12 @@ class FloatConstant: public Expr
     double value;
     
   public:
-    FloatConstant(yyltype loc, double val);
+    FloatConstant(const SourceSpan &loc, double val);
     const char *GetPrintNameForNode() { return "FloatConstant"; }
     void PrintChildren(int indentLevel);
 
-    virtual Type *CheckExpr() {return Type::floatType;}
+    virtual Type *CheckExpr(CompileContext *ctx) {return Type::floatType;}
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class BoolConstant : public Expr 
@@ -83,11 +86,12 @@ class BoolConstant : public Expr
     bool value;
     
   public:
-    BoolConstant(yyltype loc, bool val);
+    BoolConstant(const SourceSpan &loc, bool val);
     const char *GetPrintNameForNode() { return "BoolConstant"; }
     void PrintChildren(int indentLevel);
 
-    virtual Type *CheckExpr() {return Type::boolType;}
+    virtual Type *CheckExpr(CompileContext *ctx) {return Type::boolType;}
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class VarExpr : public Expr
@@ -96,27 +100,43 @@ class VarExpr : public Expr
     Identifier *id;
 
   public:
-    VarExpr(yyltype loc, Identifier *id);
+    VarExpr(const SourceSpan &loc, Identifier *id);
+    ~VarExpr();
     const char *GetPrintNameForNode() { return "VarExpr"; }
     void PrintChildren(int indentLevel);
     Identifier *GetIdentifier() {return id;}
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
     
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
+// The scanner hands the parser one of these for each operator token
+typedef enum {
+      OpPlus, OpMinus, OpTimes, OpDivide,
+      OpInc, OpDec,
+      OpLess, OpGreater, OpLessEqual, OpGreaterEqual,
+      OpEqual, OpNotEqual,
+      OpAnd, OpOr,
+      OpAssign, OpAddAssign, OpSubAssign, OpMulAssign, OpDivAssign,
+      NumOpcodes
+} opcodeT;
+
 class Operator : public Node 
 {
   protected:
-    char tokenString[4];
+    opcodeT opcode;
     
   public:
-    Operator(yyltype loc, const char *tok);
+    Operator(const SourceSpan &loc, opcodeT op);
     const char *GetPrintNameForNode() { return "Operator"; }
     void PrintChildren(int indentLevel);
-    friend ostream& operator<<(ostream& out, Operator *o) { return out << o->tokenString; }
-    bool IsOp(const char *op) const;
+    friend ostream& operator<<(ostream& out, Operator *o) { return out << o->GetSpelling(); }
+    opcodeT GetOpcode() const { return opcode; }
+    bool IsOp(opcodeT op) const { return opcode == op; }
+    const char *GetSpelling() const;
+    static const char *Spelling(opcodeT op);
  };
  
 class CompoundExpr : public Expr
@@ -129,8 +149,13 @@ class CompoundExpr : public Expr
     CompoundExpr(Expr *lhs, Operator *op, Expr *rhs); // for binary
     CompoundExpr(Operator *op, Expr *rhs);             // for unary
     CompoundExpr(Expr *lhs, Operator *op);             // for unary
+    ~CompoundExpr();
     void PrintChildren(int indentLevel);
 
+  protected:
+    // Lower() for each subclass, as a node of the given flatKindT
+    unsigned int LowerOperands(FlatAst *flat, int kind);
+
 };
 
 class ArithmeticExpr : public CompoundExpr 
@@ -140,9 +165,10 @@ class ArithmeticExpr : public CompoundExpr
     ArithmeticExpr(Operator *op, Expr *rhs) : CompoundExpr(op,rhs) {}
     const char *GetPrintNameForNode() { return "ArithmeticExpr"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
 
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 };
 
@@ -152,9 +178,10 @@ class RelationalExpr : public CompoundExpr
     RelationalExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     const char *GetPrintNameForNode() { return "RelationalExpr"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
 
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class EqualityExpr : public CompoundExpr 
@@ -163,9 +190,10 @@ class EqualityExpr : public CompoundExpr
     EqualityExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     const char *GetPrintNameForNode() { return "EqualityExpr"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
 
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class LogicalExpr : public CompoundExpr 
@@ -175,9 +203,10 @@ class LogicalExpr : public CompoundExpr
     LogicalExpr(Operator *op, Expr *rhs) : CompoundExpr(op,rhs) {}
     const char *GetPrintNameForNode() { return "LogicalExpr"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
 
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class AssignExpr : public CompoundExpr 
@@ -186,9 +215,10 @@ class AssignExpr : public CompoundExpr
     AssignExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     const char *GetPrintNameForNode() { return "AssignExpr"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
 
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class PostfixExpr : public CompoundExpr
@@ -197,9 +227,10 @@ class PostfixExpr : public CompoundExpr
     PostfixExpr(Expr *lhs, Operator *op) : CompoundExpr(lhs,op) {}
     const char *GetPrintNameForNode() { return "PostfixExpr"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
 
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 };
 
@@ -209,16 +240,18 @@ class ConditionalExpr : public Expr
     Expr *cond, *trueExpr, *falseExpr;
   public:
     ConditionalExpr(Expr *c, Expr *t, Expr *f);
+    ~ConditionalExpr();
     void PrintChildren(int indentLevel);
     const char *GetPrintNameForNode() { return "ConditionalExpr"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class LValue : public Expr 
 {
   public:
-    LValue(yyltype loc) : Expr(loc) {}
+    LValue(const SourceSpan &loc) : Expr(loc) {}
 };
 
 class ArrayAccess : public LValue 
@@ -227,13 +260,15 @@ class ArrayAccess : public LValue
     Expr *base, *subscript;
     
   public:
-    ArrayAccess(yyltype loc, Expr *base, Expr *subscript);
+    ArrayAccess(const SourceSpan &loc, Expr *base, Expr *subscript);
+    ~ArrayAccess();
     const char *GetPrintNameForNode() { return "ArrayAccess"; }
     void PrintChildren(int indentLevel);
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
 
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 /* Note that field access is used both for qualified names
@@ -249,12 +284,14 @@ class FieldAccess : public LValue
     
   public:
     FieldAccess(Expr *base, Identifier *field); //ok to pass NULL base
+    ~FieldAccess();
     const char *GetPrintNameForNode() { return "FieldAccess"; }
     void PrintChildren(int indentLevel);
     
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
     
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
     
 };
 
@@ -271,19 +308,21 @@ class Call : public Expr
     
   public:
     Call() : Expr(), base(NULL), field(NULL), actuals(NULL) {}
-    Call(yyltype loc, Expr *base, Identifier *field, List<Expr*> *args);
+    Call(const SourceSpan &loc, Expr *base, Identifier *field, List<Expr*> *args);
+    ~Call();
     const char *GetPrintNameForNode() { return "Call"; }
     void PrintChildren(int indentLevel);
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
     
-    virtual Type *CheckExpr();
+    virtual Type *CheckExpr(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class ActualsError : public Call
 {
   public:
-    ActualsError() : Call() { yyerror(this->GetPrintNameForNode()); }
+    ActualsError(CompileContext *ctx) : Call() { yyerror(ctx, this->GetPrintNameForNode()); }
     const char *GetPrintNameForNode() { return "ActualsError"; }
 };
 
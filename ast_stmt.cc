@@ -8,18 +8,28 @@
 #include "ast_expr.h"
 #include "errors.h"
 #include "symtable.h"
+#include "context.h"
+#include "incremental.h"
+#include "flatast.h"
+#include "utility.h"
 
 Program::Program(List<Decl*> *d) {
     Assert(d != NULL);
     (decls=d)->SetParentAll(this);
+    decls->Freeze();
+}
+
+Program::~Program() {
+    decls->DeleteAll();
+    delete decls;
 }
 
 void Program::PrintChildren(int indentLevel) {
     decls->PrintAll(indentLevel+1);
-    printf("\n");
+    fprintf(DebugFile(), "\n");
 }
 
-void Program::Check() {
+void Program::Check(CompileContext *ctx) {
     /* pp3: here is where the semantic analyzer is kicked off.
      *      The general idea is perform a tree traversal of the
      *      entire program, examining all constructs for compliance
@@ -28,21 +38,33 @@ void Program::Check() {
      *      and polymorphism in the node classes.
      */
 
-    // sample test - not the actual working code
-    // replace it with your own implementation
-    if ( decls->NumElements() > 0 ) {
-      for ( int i = 0; i < decls->NumElements(); ++i ) {
-        Decl *d = decls->Nth(i);
-        d->Check();
-        /* !!! YOUR CODE HERE !!!
-         * Basically you have to make sure that each declaration is 
-         * semantically correct.
-         */
-      }
+    // Let the incremental checker reuse what it can from earlier runs
+    if (ctx->incremental) {
+        ctx->incremental->Check(ctx, decls);
+        return;
     }
+
+    // Or, with -d flatcheck, check the flat form of the tree instead,
+    // with whatever was declared from AST files
+    if (IsDebugOn("flatcheck")) {
+        vector<Decl *> declared;
+        for (const CompileContext::LoadedDecl &d : ctx->loadedDecls)
+            declared.push_back(d.decl);
+        FlatAst flat;
+        flat.Lower(this, &declared);
+        flat.Check(ctx);
+        return;
+    }
+
+    for (Decl *d : *decls)
+        d->Check(ctx);
 }
 
-void Stmt::Check(){
+unsigned int Program::Lower(FlatAst *flat) {
+    return flat->Add(F_Program, span, flat->AddList(decls));
+}
+
+void Stmt::Check(CompileContext *ctx){
 
 }
 
@@ -50,6 +72,15 @@ StmtBlock::StmtBlock(List<VarDecl*> *d, List<Stmt*> *s) {
     Assert(d != NULL && s != NULL);
     (decls=d)->SetParentAll(this);
     (stmts=s)->SetParentAll(this);
+    decls->Freeze();
+    stmts->Freeze();
+}
+
+StmtBlock::~StmtBlock() {
+    decls->DeleteAll();
+    delete decls;
+    stmts->DeleteAll();
+    delete stmts;
 }
 
 void StmtBlock::PrintChildren(int indentLevel) {
@@ -57,45 +88,50 @@ void StmtBlock::PrintChildren(int indentLevel) {
     stmts->PrintAll(indentLevel+1);
 }
 
-void StmtBlock::Check(){
+void StmtBlock::Check(CompileContext *ctx){
   bool isFunction = true;
-  if(!Node::isFnDecl){
-    Node::symtab->push();
-    Node::isFnDecl = false;
+  if(!ctx->isFnDecl){
+    ctx->symtab->push();
+    ctx->isFnDecl = false;
     isFunction = false;
   }
 
-  if ( decls->NumElements() > 0 ) {
-    for ( int i = 0; i < decls->NumElements(); ++i ) {
-      Decl *d = decls->Nth(i);
-      d->Check();
-    }
-  }
+  for (VarDecl *d : *decls)
+    d->Check(ctx);
 
-  if ( stmts->NumElements() > 0 ) {
-    for ( int i = 0; i < stmts->NumElements(); ++i ) {
-      Stmt *st = stmts->Nth(i);
-      st->Check();
-    }
-  }
+  for (Stmt *st : *stmts)
+    st->Check(ctx);
 
   if(!isFunction){
-    Node::symtab->pop();
+    ctx->symtab->pop();
   }
 
 }
 
+unsigned int StmtBlock::Lower(FlatAst *flat) {
+    FlatAst::Index d = flat->AddList(decls), s = flat->AddList(stmts);
+    return flat->Add(F_StmtBlock, span, d, s);
+}
+
 DeclStmt::DeclStmt(Decl *d) {
     Assert(d != NULL);
     (decl=d)->SetParent(this);
 }
 
+DeclStmt::~DeclStmt() {
+    delete decl;
+}
+
 void DeclStmt::PrintChildren(int indentLevel) {
     decl->Print(indentLevel+1);
 }
 
-void DeclStmt::Check(){
-    this->GetDecl()->Check();
+void DeclStmt::Check(CompileContext *ctx){
+    this->GetDecl()->Check(ctx);
+}
+
+unsigned int DeclStmt::Lower(FlatAst *flat) {
+    return flat->Add(F_DeclStmt, span, decl->Lower(flat));
 }
 
 ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b) { 
@@ -104,26 +140,40 @@ ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b) {
     (body=b)->SetParent(this);
 }
 
-void ForStmt::Check() {
-    Node::symtab->push();
-    Node::stack->push(this);
+ConditionalStmt::~ConditionalStmt() {
+    delete test;
+    delete body;
+}
+
+void ForStmt::Check(CompileContext *ctx) {
+    ctx->symtab->push();
+    ctx->stack->push(this);
 
-    //Type *init_type = init->CheckExpr();
-    init->Check();
+    //Type *init_type = init->CheckExpr(ctx);
+    init->Check(ctx);
 
-    Type *test_type = test->CheckExpr();
+    Type *test_type = test->CheckExpr(ctx);
     if(!test_type->IsEquivalentTo(Type::boolType)){
-      ReportError::TestNotBoolean(test);
+      ReportError::TestNotBoolean(ctx, test);
     }
 
    
     if(step != NULL) {
-        step->Check();
+        step->Check(ctx);
     }
 
-    body->Check();
-    Node::stack->pop();
-    Node::symtab->pop();
+    body->Check(ctx);
+    ctx->stack->pop();
+    ctx->symtab->pop();
+}
+
+unsigned int ForStmt::Lower(FlatAst *flat) {
+    vector<FlatAst::Index> parts;
+    parts.push_back(init->Lower(flat));
+    parts.push_back(test->Lower(flat));
+    parts.push_back(step ? step->Lower(flat) : FlatAst::None);
+    parts.push_back(body->Lower(flat));
+    return flat->Add(F_For, span, flat->AddList(parts));
 }
 
 
@@ -136,6 +186,11 @@ ForStmt::ForStmt(Expr *i, Expr *t, Expr *s, Stmt *b): LoopStmt(t, b) {
       (step=s)->SetParent(this);
 }
 
+ForStmt::~ForStmt() {
+    delete init;
+    delete step;
+}
+
 void ForStmt::PrintChildren(int indentLevel) {
     init->Print(indentLevel+1, "(init) ");
     test->Print(indentLevel+1, "(test) ");
@@ -149,18 +204,23 @@ void WhileStmt::PrintChildren(int indentLevel) {
     body->Print(indentLevel+1, "(body) ");
 }
 
-void WhileStmt::Check() {
-    Node::symtab->push();
-    Node::stack->push(this);
+void WhileStmt::Check(CompileContext *ctx) {
+    ctx->symtab->push();
+    ctx->stack->push(this);
     
-    Type *test_type = test->CheckExpr();
+    Type *test_type = test->CheckExpr(ctx);
     if(!test_type->IsEquivalentTo(Type::boolType)){
-      ReportError::TestNotBoolean(test);
+      ReportError::TestNotBoolean(ctx, test);
     }
-    body->Check();
+    body->Check(ctx);
 
-    Node::stack->pop();
-    Node::symtab->pop();
+    ctx->stack->pop();
+    ctx->symtab->pop();
+}
+
+unsigned int WhileStmt::Lower(FlatAst *flat) {
+    FlatAst::Index t = test->Lower(flat), b = body->Lower(flat);
+    return flat->Add(F_While, span, t, b);
 }
 IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb): ConditionalStmt(t, tb) { 
     Assert(t != NULL && tb != NULL); // else can be NULL
@@ -168,64 +228,90 @@ IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb): ConditionalStmt(t, tb) {
     if (elseBody) elseBody->SetParent(this);
 }
 
+IfStmt::~IfStmt() {
+    delete elseBody;
+}
+
 void IfStmt::PrintChildren(int indentLevel) {
     if (test) test->Print(indentLevel+1, "(test) ");
     if (body) body->Print(indentLevel+1, "(then) ");
     if (elseBody) elseBody->Print(indentLevel+1, "(else) ");
 }
 
-void IfStmt::Check() {
-    Node::symtab->push();
+void IfStmt::Check(CompileContext *ctx) {
+    ctx->symtab->push();
     
-    Type *test_type = test->CheckExpr();
+    Type *test_type = test->CheckExpr(ctx);
     if(!test_type->IsEquivalentTo(Type::boolType)){
-      ReportError::TestNotBoolean(test);
+      ReportError::TestNotBoolean(ctx, test);
     }
-    body->Check();
+    body->Check(ctx);
     if(elseBody){
-      elseBody->Check();
+      elseBody->Check(ctx);
     }
 
-    Node::symtab->pop();
+    ctx->symtab->pop();
 }
 
-void BreakStmt::Check(){
-  if(!Node::stack->insideLoop()&&!Node::stack->insideSwitch()){
-    ReportError::BreakOutsideLoop(this);
+unsigned int IfStmt::Lower(FlatAst *flat) {
+    FlatAst::Index t = test->Lower(flat), b = body->Lower(flat);
+    FlatAst::Index e = (elseBody ? elseBody->Lower(flat) : FlatAst::None);
+    return flat->Add(F_If, span, t, b, e);
+}
+
+void BreakStmt::Check(CompileContext *ctx){
+  if(!ctx->stack->insideLoop()&&!ctx->stack->insideSwitch()){
+    ReportError::BreakOutsideLoop(ctx, this);
   }
 }
 
-void ContinueStmt::Check(){
-  if(!Node::stack->insideLoop()){
-    ReportError::ContinueOutsideLoop(this);
+unsigned int BreakStmt::Lower(FlatAst *flat) {
+    return flat->Add(F_Break, span);
+}
+
+void ContinueStmt::Check(CompileContext *ctx){
+  if(!ctx->stack->insideLoop()){
+    ReportError::ContinueOutsideLoop(ctx, this);
   }
 }
 
-ReturnStmt::ReturnStmt(yyltype loc, Expr *e) : Stmt(loc) { 
+unsigned int ContinueStmt::Lower(FlatAst *flat) {
+    return flat->Add(F_Continue, span);
+}
+
+ReturnStmt::ReturnStmt(const SourceSpan &loc, Expr *e) : Stmt(loc) { 
     expr = e;
     if (e != NULL) expr->SetParent(this);
 }
 
+ReturnStmt::~ReturnStmt() {
+    delete expr;
+}
+
 void ReturnStmt::PrintChildren(int indentLevel) {
     if ( expr ) 
       expr->Print(indentLevel+1);
 }
 
-void ReturnStmt::Check() {
-    Type *expected_return = Node::symtab->getType();
+void ReturnStmt::Check(CompileContext *ctx) {
+    Type *expected_return = ctx->symtab->getType();
     Type *actual_return = Type::voidType;
     if(this->expr){
-      actual_return = this->expr->CheckExpr();
+      actual_return = this->expr->CheckExpr(ctx);
     }
     if(actual_return->IsError()){
     }
     else if(!expected_return->IsEquivalentTo(actual_return)){
-        ReportError::ReturnMismatch(this, actual_return, expected_return);
+        ReportError::ReturnMismatch(ctx, this, actual_return, expected_return);
     }
-    Node::symtab->setReturnType(Type::voidType);
+    ctx->symtab->setReturnType(Type::voidType);
 
 }
 
+unsigned int ReturnStmt::Lower(FlatAst *flat) {
+    return flat->Add(F_Return, span, expr ? expr->Lower(flat) : FlatAst::None);
+}
+
 SwitchLabel::SwitchLabel(Expr *l, Stmt *s) {
     Assert(l != NULL && s != NULL);
     (label=l)->SetParent(this);
@@ -238,6 +324,11 @@ SwitchLabel::SwitchLabel(Stmt *s) {
     (stmt=s)->SetParent(this);
 }
 
+SwitchLabel::~SwitchLabel() {
+    delete label;
+    delete stmt;
+}
+
 void SwitchLabel::PrintChildren(int indentLevel) {
     if (label) label->Print(indentLevel+1);
     if (stmt)  stmt->Print(indentLevel+1);
@@ -247,41 +338,66 @@ SwitchStmt::SwitchStmt(Expr *e, List<Stmt *> *c, Default *d) {
     Assert(e != NULL && c != NULL && c->NumElements() != 0 );
     (expr=e)->SetParent(this);
     (cases=c)->SetParentAll(this);
+    cases->Freeze();
     def = d;
     if (def) def->SetParent(this);
 }
 
+SwitchStmt::~SwitchStmt() {
+    delete expr;
+    if (cases) {
+        cases->DeleteAll();
+        delete cases;
+    }
+    delete def;
+}
+
 void SwitchStmt::PrintChildren(int indentLevel) {
     if (expr) expr->Print(indentLevel+1);
     if (cases) cases->PrintAll(indentLevel+1);
     if (def) def->Print(indentLevel+1);
 }
 
-void Case::Check(){
-  this->label->Check();
-  this->stmt->Check();
+void Case::Check(CompileContext *ctx){
+  this->label->Check(ctx);
+  this->stmt->Check(ctx);
 }
 
-void Default::Check(){
-  this->stmt->Check();
+unsigned int Case::Lower(FlatAst *flat) {
+    FlatAst::Index l = label->Lower(flat), s = stmt->Lower(flat);
+    return flat->Add(F_Case, span, l, s);
 }
 
-void SwitchStmt::Check(){
-  Node::symtab->push();
-  Node::stack->push(this);
+void Default::Check(CompileContext *ctx){
+  this->stmt->Check(ctx);
+}
+
+unsigned int Default::Lower(FlatAst *flat) {
+    return flat->Add(F_Default, span, FlatAst::None, stmt->Lower(flat));
+}
 
-  this->expr->Check();
+void SwitchStmt::Check(CompileContext *ctx){
+  ctx->symtab->push();
+  ctx->stack->push(this);
+
+  this->expr->Check(ctx);
   if ( cases->NumElements() > 0 ) {
       for ( int i = 0; i < cases->NumElements(); ++i ) {
         Stmt *st = cases->Nth(i);
-        st->Check();
+        st->Check(ctx);
       }
   }
   if(this->def)
-    this->def->Check();
+    this->def->Check(ctx);
+
 
+  ctx->stack->pop();
+  ctx->symtab->pop();
+}
 
-  Node::stack->pop();
-  Node::symtab->pop();
+unsigned int SwitchStmt::Lower(FlatAst *flat) {
+    FlatAst::Index e = expr->Lower(flat), c = flat->AddList(cases);
+    FlatAst::Index d = (def ? def->Lower(flat) : FlatAst::None);
+    return flat->Add(F_Switch, span, e, c, d);
 }
 
@@ -21,7 +21,7 @@ class VarDecl;
 class Expr;
 class IntConstant;
   
-void yyerror(const char *msg);
+void yyerror(CompileContext *ctx, const char *msg);
 
 class Program : public Node
 {
@@ -30,18 +30,20 @@ class Program : public Node
      
   public:
      Program(List<Decl*> *declList);
+     ~Program();
      const char *GetPrintNameForNode() { return "Program"; }
      void PrintChildren(int indentLevel);
-     virtual void Check();
+     virtual void Check(CompileContext *ctx);
+     virtual unsigned int Lower(FlatAst *flat);
 };
 
 class Stmt : public Node
 {
   public:
      Stmt() : Node() {}
-     Stmt(yyltype loc) : Node(loc) {}
+     Stmt(const SourceSpan &loc) : Node(loc) {}
 
-     virtual void Check();
+     virtual void Check(CompileContext *ctx);
 
      
 };
@@ -54,10 +56,12 @@ class StmtBlock : public Stmt
     
   public:
     StmtBlock(List<VarDecl*> *variableDeclarations, List<Stmt*> *statements);
+    ~StmtBlock();
     const char *GetPrintNameForNode() { return "StmtBlock"; }
     void PrintChildren(int indentLevel);
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class DeclStmt: public Stmt 
@@ -67,11 +71,13 @@ class DeclStmt: public Stmt
     
   public:
     DeclStmt(Decl *d);
+    ~DeclStmt();
     const char *GetPrintNameForNode() { return "DeclStmt"; }
     void PrintChildren(int indentLevel);
 
     Decl* GetDecl(){return decl;}
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 
 };
@@ -85,6 +91,7 @@ class ConditionalStmt : public Stmt
   public:
     ConditionalStmt() : Stmt(), test(NULL), body(NULL) {}
     ConditionalStmt(Expr *testExpr, Stmt *body);
+    ~ConditionalStmt();
 
 };
 
@@ -102,10 +109,12 @@ class ForStmt : public LoopStmt
   
   public:
     ForStmt(Expr *init, Expr *test, Expr *step, Stmt *body);
+    ~ForStmt();
     const char *GetPrintNameForNode() { return "ForStmt"; }
     void PrintChildren(int indentLevel);
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 
 };
@@ -116,7 +125,8 @@ class WhileStmt : public LoopStmt
     WhileStmt(Expr *test, Stmt *body) : LoopStmt(test, body) {}
     const char *GetPrintNameForNode() { return "WhileStmt"; }
     void PrintChildren(int indentLevel);
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 
 };
@@ -129,9 +139,11 @@ class IfStmt : public ConditionalStmt
   public:
     IfStmt() : ConditionalStmt(), elseBody(NULL) {}
     IfStmt(Expr *test, Stmt *thenBody, Stmt *elseBody);
+    ~IfStmt();
     const char *GetPrintNameForNode() { return "IfStmt"; }
     void PrintChildren(int indentLevel);
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 
 };
@@ -139,16 +151,17 @@ class IfStmt : public ConditionalStmt
 class IfStmtExprError : public IfStmt
 {
   public:
-    IfStmtExprError() : IfStmt() { yyerror(this->GetPrintNameForNode()); }
+    IfStmtExprError(CompileContext *ctx) : IfStmt() { yyerror(ctx, this->GetPrintNameForNode()); }
     const char *GetPrintNameForNode() { return "IfStmtExprError"; }
 };
 
 class BreakStmt : public Stmt 
 {
   public:
-    BreakStmt(yyltype loc) : Stmt(loc) {}
+    BreakStmt(const SourceSpan &loc) : Stmt(loc) {}
     const char *GetPrintNameForNode() { return "BreakStmt"; }
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 
 };
@@ -156,9 +169,10 @@ class BreakStmt : public Stmt
 class ContinueStmt : public Stmt 
 {
   public:
-    ContinueStmt(yyltype loc) : Stmt(loc) {}
+    ContinueStmt(const SourceSpan &loc) : Stmt(loc) {}
     const char *GetPrintNameForNode() { return "ContinueStmt"; }
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 
 };
@@ -169,10 +183,12 @@ class ReturnStmt : public Stmt
     Expr *expr;
   
   public:
-    ReturnStmt(yyltype loc, Expr *expr = NULL);
+    ReturnStmt(const SourceSpan &loc, Expr *expr = NULL);
+    ~ReturnStmt();
     const char *GetPrintNameForNode() { return "ReturnStmt"; }
     void PrintChildren(int indentLevel);
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 
 };
@@ -187,6 +203,7 @@ class SwitchLabel : public Stmt
     SwitchLabel() { label = NULL; stmt = NULL; }
     SwitchLabel(Expr *label, Stmt *stmt);
     SwitchLabel(Stmt *stmt);
+    ~SwitchLabel();
     void PrintChildren(int indentLevel);
 
 };
@@ -198,7 +215,8 @@ class Case : public SwitchLabel
     Case(Expr *label, Stmt *stmt) : SwitchLabel(label, stmt) {}
     const char *GetPrintNameForNode() { return "Case"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class Default : public SwitchLabel
@@ -207,7 +225,8 @@ class Default : public SwitchLabel
     Default(Stmt *stmt) : SwitchLabel(stmt) {}
     const char *GetPrintNameForNode() { return "Default"; }
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 class SwitchStmt : public Stmt
@@ -220,17 +239,19 @@ class SwitchStmt : public Stmt
   public:
     SwitchStmt() : expr(NULL), cases(NULL), def(NULL) {}
     SwitchStmt(Expr *expr, List<Stmt*> *cases, Default *def);
+    ~SwitchStmt();
     virtual const char *GetPrintNameForNode() { return "SwitchStmt"; }
     void PrintChildren(int indentLevel);
 
-    virtual void Check();
+    virtual void Check(CompileContext *ctx);
+    virtual unsigned int Lower(FlatAst *flat);
 
 };
 
 class SwitchStmtError : public SwitchStmt
 {
   public:
-    SwitchStmtError(const char * msg) { yyerror(msg); }
+    SwitchStmtError(CompileContext *ctx, const char * msg) { yyerror(ctx, msg); }
     const char *GetPrintNameForNode() { return "SwitchStmtError"; }
 };
 
@@ -6,6 +6,7 @@
 #include <string.h>
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "flatast.h"
  
 /* Class constants
  * ---------------
@@ -45,19 +46,21 @@ TypeQualifier *TypeQualifier::uniformTypeQualifier = new TypeQualifier("uniform"
 Type::Type(const char *n) {
     Assert(n);
     typeName = strdup(n);
+    builtin = true;
 }
 
 void Type::PrintChildren(int indentLevel) {
-    printf("%s", typeName);
+    fprintf(DebugFile(), "%s", typeName);
 }
 
 TypeQualifier::TypeQualifier(const char *n) {
     Assert(n);
     typeQualifierName = strdup(n);
+    builtin = true;
 }
 
 void TypeQualifier::PrintChildren(int indentLevel) {
-    printf("%s", typeQualifierName);
+    fprintf(DebugFile(), "%s", typeQualifierName);
 }
 
 bool Type::IsNumeric() { 
@@ -79,23 +82,37 @@ bool Type::IsMatrix() {
 bool Type::IsError() { 
     return this->IsEquivalentTo(Type::errorType);
 }
+
+unsigned int Type::Lower(FlatAst *flat) {
+    return FlatAst::BuiltinType(this);
+}
 	
-NamedType::NamedType(Identifier *i) : Type(*i->GetLocation()) {
+NamedType::NamedType(Identifier *i) : Type(i->GetSpan()) {
     Assert(i != NULL);
     (id=i)->SetParent(this);
 } 
 
+NamedType::~NamedType() {
+    delete id;
+}
+
 void NamedType::PrintChildren(int indentLevel) {
     id->Print(indentLevel+1);
 }
 
-ArrayType::ArrayType(yyltype loc, Type *et, int ec) : Type(loc) {
+ArrayType::ArrayType(const SourceSpan &loc, Type *et, int ec) : Type(loc) {
     Assert(et != NULL);
     (elemType=et)->SetParent(this);
     elemCount=ec;
 }
+ArrayType::~ArrayType() {
+    if (!elemType->IsBuiltin()) delete elemType;
+}
+
 void ArrayType::PrintChildren(int indentLevel) {
     elemType->Print(indentLevel+1);
 }
 
-
+unsigned int ArrayType::Lower(FlatAst *flat) {
+    return flat->AddArrayType(span, elemType->Lower(flat), elemCount);
+}
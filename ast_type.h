@@ -22,13 +22,19 @@ class TypeQualifier : public Node
 {
   protected:
     char *typeQualifierName;
+    bool builtin;
 
   public :
     static TypeQualifier *inTypeQualifier, *outTypeQualifier, *constTypeQualifier, *uniformTypeQualifier;
 
-    TypeQualifier(yyltype loc) : Node(loc) {}
+    TypeQualifier(const SourceSpan &loc) : Node(loc), typeQualifierName(NULL), builtin(false) {}
     TypeQualifier(const char *str);
 
+    // The built-in qualifiers are shared by every compilation, possibly
+    // on several threads at once, so they are never given a parent.
+    void SetParent(Node *p) { if (!builtin) Node::SetParent(p); }
+    bool IsBuiltin() const { return builtin; }
+
     const char *GetPrintNameForNode() { return "TypeQualifier"; }
     void PrintChildren(int indentLevel);
 };
@@ -37,6 +43,7 @@ class Type : public Node
 {
   protected:
     char *typeName;
+    bool builtin;
 
   public :
     static Type *intType, *uintType,*floatType, *boolType, *voidType,
@@ -47,9 +54,14 @@ class Type : public Node
                 *uvec2Type, *uvec3Type,*uvec4Type, 
                 *errorType;
 
-    Type(yyltype loc) : Node(loc) {}
+    Type(const SourceSpan &loc) : Node(loc), typeName(NULL), builtin(false) {}
     Type(const char *str);
-    
+
+    // Likewise, the built-in types are shared and never take a parent,
+    // and the nodes that refer to them must not delete them.
+    void SetParent(Node *p) { if (!builtin) Node::SetParent(p); }
+    bool IsBuiltin() const { return builtin; }
+
     const char *GetPrintNameForNode() { return "Type"; }
     void PrintChildren(int indentLevel);
 
@@ -61,6 +73,7 @@ class Type : public Node
     bool IsVector();
     bool IsMatrix();
     bool IsError();
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
 
@@ -71,6 +84,7 @@ class NamedType : public Type
     
   public:
     NamedType(Identifier *i);
+    ~NamedType();
     
     const char *GetPrintNameForNode() { return "NamedType"; }
     void PrintChildren(int indentLevel);
@@ -84,12 +98,14 @@ class ArrayType : public Type
     int   elemCount;
 
   public:
-    ArrayType(yyltype loc, Type *elemType, int elemCount);
+    ArrayType(const SourceSpan &loc, Type *elemType, int elemCount);
+    ~ArrayType();
     
     const char *GetPrintNameForNode() { return "ArrayType"; }
     void PrintChildren(int indentLevel);
     void PrintToStream(ostream& out) { out << elemType << "[]"; }
     Type *GetElemType() {return elemType;}
+    virtual unsigned int Lower(FlatAst *flat);
 };
 
  
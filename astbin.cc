@@ -0,0 +1,422 @@
+/* File: astbin.cc
+ * ---------------
+ * Implementation of AST files: writing one from a checked program, and
+ * mapping one back in and using it.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+#include <vector>
+#include "astbin.h"
+#include "context.h"
+#include "symtable.h"
+#include "ast_decl.h"
+#include "ast_stmt.h"
+#include "arena.h"
+#include "utility.h"
+
+static const char AstFileMagic[8] = { 'g', 'l', 'c', '-', 'a', 's', 't', '\n' };
+static const unsigned int AstByteOrder = 0x01020304;
+
+// The size of an element of each section, in the order of astSectionT
+static const unsigned int elemSizes[NumAstSections] = {
+    sizeof(FlatNode), sizeof(SourceSpan), sizeof(FlatAst::Index), sizeof(FlatIdentifier),
+    sizeof(FlatOperator), sizeof(int), sizeof(double), sizeof(FlatArrayType), 1,
+    sizeof(AstFileGlobal), sizeof(unsigned int), 1
+};
+
+static size_t Align(size_t offset)
+{
+    return (offset + 7) & ~(size_t)7;
+}
+
+/* Class: PathTable
+ * ----------------
+ * The paths section as it is written: each path once, NUL-terminated.
+ */
+class PathTable
+{
+  public:
+    string text;
+
+    unsigned int Add(const string &path) {
+        map<string, unsigned int>::iterator it = offsets.find(path);
+        if (it != offsets.end()) return it->second;
+        unsigned int offset = text.size();
+        text.append(path.c_str(), path.size() + 1);
+        offsets[path] = offset;
+        return offset;
+    }
+
+  private:
+    map<string, unsigned int> offsets;
+};
+
+/* Function: WriteAstFile()
+ * ------------------------
+ * Lowers the program, lays out the sections after the header, and
+ * writes them to a temporary file that is then renamed to path, so a
+ * glc that maps path at the same time sees either the old file or the
+ * new one, never part of one.
+ */
+bool WriteAstFile(CompileContext *ctx, const char *path)
+{
+    Assert(ctx->program && ctx->NumErrors() == 0);
+    FlatAst flat;
+    flat.Lower(ctx->program);
+
+    PathTable paths;
+    vector<AstFileGlobal> globals;
+    const FlatNode &program = flat.nodes[flat.root];
+    const FlatAst::Index *decls = flat.ListElements(program.a);
+    for (int i = 0, num = flat.ListLength(program.a); i < num; i++) {
+        AstFileGlobal global;
+        const char *included;
+        global.name = flat.identifiers[flat.nodes[decls[i]].a].name;
+        global.decl = decls[i];
+        global.line = ctx->SourceLine(ctx->LineOf(flat.spans[decls[i]].first), &included);
+        global.path = (included ? paths.Add(included) : FlatAst::None);
+        globals.push_back(global);
+    }
+
+    AstFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AstFileMagic, sizeof(header.magic));
+    header.version = AstFileVersion;
+    header.byteOrder = AstByteOrder;
+    header.root = flat.root;
+    header.sourcePath = (ctx->sourcePath.empty() ? FlatAst::None : paths.Add(ctx->sourcePath));
+
+    const void *data[NumAstSections] = {
+        flat.nodes.elems, flat.spans.elems, flat.lists.elems, flat.identifiers.elems,
+        flat.operators.elems, flat.ints.elems, flat.floats.elems, flat.arrayTypes.elems,
+        flat.names.elems, globals.data(), ctx->lineStarts.data(), paths.text.data()
+    };
+    const size_t counts[NumAstSections] = {
+        flat.nodes.size(), flat.spans.size(), flat.lists.size(), flat.identifiers.size(),
+        flat.operators.size(), flat.ints.size(), flat.floats.size(), flat.arrayTypes.size(),
+        flat.names.size(), globals.size(), ctx->lineStarts.size(), paths.text.size()
+    };
+    size_t offset = Align(sizeof(header));
+    for (int s = 0; s < NumAstSections; s++) {
+        header.sections[s].offset = offset;
+        header.sections[s].count = counts[s];
+        header.sections[s].elemSize = elemSizes[s];
+        offset = Align(offset + counts[s] * elemSizes[s]);
+    }
+
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), ".tmp.%d", (int)getpid());
+    string tmpPath = string(path) + tmp;
+    FILE *f = fopen(tmpPath.c_str(), "w");
+    if (!f) return false;
+    static const char padding[8] = { 0 };
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(padding, 1, Align(sizeof(header)) - sizeof(header), f);
+    for (int s = 0; s < NumAstSections; s++) {
+        size_t len = counts[s] * elemSizes[s];
+        if (len > 0) fwrite(data[s], 1, len, f);
+        fwrite(padding, 1, Align(len) - len, f);
+    }
+    bool failed = ferror(f);
+    if (fclose(f) != 0 || failed || rename(tmpPath.c_str(), path) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+AstFile::AstFile() {
+    mapping = MAP_FAILED;
+    mappedLen = 0;
+    header = NULL;
+    globals = NULL;
+    numGlobals = numLines = 0;
+    lineStarts = NULL;
+    paths = NULL;
+    pathsLen = 0;
+}
+
+AstFile::~AstFile() {
+    if (mapping != MAP_FAILED) munmap(mapping, mappedLen);
+}
+
+AstFile *AstFile::Map(const char *path, string *error) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *error = "cannot open it";
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < sizeof(AstFileHeader)) {
+        close(fd);
+        *error = "it is not an AST file";
+        return NULL;
+    }
+    AstFile *file = new AstFile;
+    file->mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    file->mappedLen = st.st_size;
+    close(fd);
+    if (file->mapping == MAP_FAILED) {
+        *error = "cannot map it";
+    } else if (file->Load(error))
+        return file;
+    delete file;
+    return NULL;
+}
+
+// Points array at section s, which Load() has found to be in the file
+template<class T> static void UseSection(const char *base, const AstFileSection &s,
+                                         FlatArray<T> *array)
+{
+    array->elems = (const T *)(base + s.offset);
+    array->count = s.count;
+}
+
+/* Class: LinkChecker
+ * ------------------
+ * Checks, in one pass over the nodes, that each link of each node is
+ * in range for what its kind says it is (see flatKindT): a node that
+ * comes before it, since Lower() adds children before their parent, a
+ * list whose run and elements are in the lists, or an entry in a side
+ * table. A node link must also be to a node of the kinds the tree puts
+ * there, since Raise() makes it into a node of that class, and may be
+ * None only where the node class's constructor takes NULL. Links that
+ * the kind doesn't use are not looked at.
+ */
+class LinkChecker
+{
+  public:
+    typedef FlatAst::Index Index;
+    typedef FlatAst::TypeId TypeId;
+
+    LinkChecker(const FlatAst &a) : ast(a) {}
+    bool Check();
+
+  private:
+    const FlatAst &ast;
+    Index n;                        // the node being checked
+
+    bool CheckNode(Index n);
+    bool IsNode(Index link, unsigned int kinds, bool optional = false) const;
+    bool IsList(Index list, unsigned int kinds) const;
+    bool IsIdentifier(Index id) const { return id < ast.identifiers.size(); }
+    bool IsOperator(Index op) const   { return op < ast.operators.size(); }
+    bool IsType(TypeId type) const    { return type < NumBuiltinTypes + ast.arrayTypes.size(); }
+};
+
+// The kinds a link may be to, as sets of bits
+static const unsigned int DeclKinds = (1u << F_VarDecl) | (1u << F_FnDecl);
+static const unsigned int VarDeclKinds = 1u << F_VarDecl;
+static const unsigned int ExprKinds = ((1u << NumFlatKinds) - 1) & ~((1u << F_Empty) - 1);
+static const unsigned int StmtKinds = ((1u << NumFlatKinds) - 1) & ~(1u << F_Program) & ~DeclKinds;
+
+// Returns true if link is to a node before n of one of kinds, or is
+// None and may be
+bool LinkChecker::IsNode(Index link, unsigned int kinds, bool optional) const {
+    if (link == FlatAst::None) return optional;
+    return link < n && (kinds & (1u << ast.nodes[link].kind));
+}
+
+// Returns true if list is a run in the lists, and each element is a
+// node before n of one of kinds
+bool LinkChecker::IsList(Index list, unsigned int kinds) const {
+    if (list >= ast.lists.size() || ast.lists[list] > ast.lists.size() - list - 1)
+        return false;
+    const Index *e = ast.ListElements(list);
+    for (int i = 0, num = ast.ListLength(list); i < num; i++)
+        if (!IsNode(e[i], kinds, false)) return false;
+    return true;
+}
+
+bool LinkChecker::CheckNode(Index n) {
+    this->n = n;
+    const FlatNode &node = ast.nodes[n];
+    switch (node.kind) {
+      case F_Program:
+        return IsList(node.a, DeclKinds) && (node.b == FlatAst::None || IsList(node.b, DeclKinds));
+      case F_VarDecl:
+        return (node.tag <= Q_Uniform && IsIdentifier(node.a) &&
+                (node.b == FlatAst::NoType ? node.tag != Q_None : IsType(node.b)) &&
+                IsNode(node.c, ExprKinds, true));
+      case F_FnDecl:
+        return (node.tag < NumBuiltinTypes && IsIdentifier(node.a) &&
+                IsList(node.b, VarDeclKinds) && IsNode(node.c, StmtKinds, true));
+      case F_StmtBlock:
+        return IsList(node.a, VarDeclKinds) && IsList(node.b, StmtKinds);
+      case F_DeclStmt:
+        return IsNode(node.a, DeclKinds);
+      case F_For: {
+        if (node.a >= ast.lists.size() || ast.lists.size() - node.a < 5 ||
+            ast.lists[node.a] != 4)
+            return false;
+        const Index *parts = ast.ListElements(node.a);  // init, test, step, body
+        return (IsNode(parts[0], ExprKinds) && IsNode(parts[1], ExprKinds) &&
+                IsNode(parts[2], ExprKinds, true) && IsNode(parts[3], StmtKinds));
+      }
+      case F_While:
+        return IsNode(node.a, ExprKinds) && IsNode(node.b, StmtKinds);
+      case F_If:
+        return (IsNode(node.a, ExprKinds) && IsNode(node.b, StmtKinds) &&
+                IsNode(node.c, StmtKinds, true));
+      case F_Return:
+        return IsNode(node.a, ExprKinds, true);
+      case F_Switch:
+        return (IsNode(node.a, ExprKinds) && IsList(node.b, StmtKinds) &&
+                ast.ListLength(node.b) > 0 && IsNode(node.c, 1u << F_Default, true));
+      case F_Case:
+        return IsNode(node.a, ExprKinds) && IsNode(node.b, StmtKinds);
+      case F_Default:
+        return IsNode(node.b, StmtKinds);
+      case F_Break: case F_Continue: case F_Empty: case F_BoolConstant:
+        return true;
+      case F_IntConstant:
+        return node.a < ast.ints.size();
+      case F_FloatConstant:
+        return node.a < ast.floats.size();
+      case F_VarExpr:
+        return IsIdentifier(node.a);
+      case F_Arithmetic: case F_Logical:    // a unary one has no left
+        return IsNode(node.a, ExprKinds, true) && IsNode(node.b, ExprKinds) && IsOperator(node.c);
+      case F_Relational: case F_Equality: case F_Assign:
+        return IsNode(node.a, ExprKinds) && IsNode(node.b, ExprKinds) && IsOperator(node.c);
+      case F_Postfix:                       // Raise() reads its b, which is None
+        return IsNode(node.a, ExprKinds) && IsNode(node.b, ExprKinds, true) && IsOperator(node.c);
+      case F_Conditional:
+        return IsNode(node.a, ExprKinds) && IsNode(node.b, ExprKinds) && IsNode(node.c, ExprKinds);
+      case F_ArrayAccess:
+        return IsNode(node.a, ExprKinds) && IsNode(node.b, ExprKinds);
+      case F_FieldAccess:
+        return IsNode(node.a, ExprKinds, true) && IsIdentifier(node.b);
+      case F_Call:
+        return (IsNode(node.a, ExprKinds, true) && IsIdentifier(node.b) &&
+                IsList(node.c, ExprKinds));
+      default:
+        return false;
+    }
+}
+
+bool LinkChecker::Check() {
+    for (int i = 0; i < ast.identifiers.size(); i++)
+        if (ast.identifiers[i].name >= ast.names.size()) return false;
+    for (int i = 0; i < ast.operators.size(); i++)
+        if ((unsigned int)ast.operators[i].opcode >= NumOpcodes) return false;
+    // An array type's element type comes before it, as it was added first
+    for (int i = 0; i < ast.arrayTypes.size(); i++)
+        if (ast.arrayTypes[i].elemType >= NumBuiltinTypes + i) return false;
+    for (Index i = 0; i < ast.nodes.size(); i++)
+        if (!CheckNode(i)) return false;
+    return true;
+}
+
+/* Function: Load()
+ * ----------------
+ * Checks the header of the mapped file, and that each section is where
+ * a section of its kind can be, and points the arrays at them. Then it
+ * checks what is in them, so that nothing read from the file later can
+ * be out of range: the global symbols, the ends of the names and paths,
+ * and every link of every node (see LinkChecker), once, in order.
+ */
+bool AstFile::Load(string *error) {
+    const char *base = (const char *)mapping;
+    header = (const AstFileHeader *)base;
+    if (memcmp(header->magic, AstFileMagic, sizeof(header->magic)) != 0) {
+        *error = "it is not an AST file";
+        return false;
+    }
+    if (header->byteOrder != AstByteOrder || header->version != AstFileVersion) {
+        *error = "it was written by another version of glc";
+        return false;
+    }
+    for (int s = 0; s < NumAstSections; s++) {
+        const AstFileSection &section = header->sections[s];
+        if (section.elemSize != elemSizes[s]) {
+            *error = "it was written by another version of glc";
+            return false;
+        }
+        if (section.offset % 8 != 0 || section.offset > mappedLen ||
+            section.count > (mappedLen - section.offset) / section.elemSize) {
+            *error = "it is damaged";
+            return false;
+        }
+    }
+    const AstFileSection *sections = header->sections;
+    UseSection(base, sections[S_Nodes], &ast.nodes);
+    UseSection(base, sections[S_Spans], &ast.spans);
+    UseSection(base, sections[S_Lists], &ast.lists);
+    UseSection(base, sections[S_Identifiers], &ast.identifiers);
+    UseSection(base, sections[S_Operators], &ast.operators);
+    UseSection(base, sections[S_Ints], &ast.ints);
+    UseSection(base, sections[S_Floats], &ast.floats);
+    UseSection(base, sections[S_ArrayTypes], &ast.arrayTypes);
+    UseSection(base, sections[S_Names], &ast.names);
+    ast.root = header->root;
+    globals = (const AstFileGlobal *)(base + sections[S_Globals].offset);
+    numGlobals = sections[S_Globals].count;
+    lineStarts = (const unsigned int *)(base + sections[S_LineStarts].offset);
+    numLines = sections[S_LineStarts].count;
+    paths = base + sections[S_Paths].offset;
+    pathsLen = sections[S_Paths].count;
+
+    bool ok = (ast.spans.size() == ast.nodes.size() && ast.root < ast.nodes.size() &&
+               ast.nodes[ast.root].kind == F_Program &&
+               (ast.names.size() == 0 || ast.names[ast.names.size() - 1] == '\0') &&
+               (pathsLen == 0 || paths[pathsLen - 1] == '\0') &&
+               (header->sourcePath == FlatAst::None || header->sourcePath < pathsLen));
+    for (int i = 0; ok && i < numGlobals; i++) {
+        const AstFileGlobal &g = globals[i];
+        ok = (g.decl < ast.nodes.size() && g.name < ast.names.size() &&
+              (ast.nodes[g.decl].kind == F_VarDecl || ast.nodes[g.decl].kind == F_FnDecl) &&
+              (g.path == FlatAst::None || g.path < pathsLen));
+    }
+    if (ok) ok = LinkChecker(ast).Check();
+    if (!ok) *error = "it is damaged";
+    return ok;
+}
+
+const char *AstFile::Path(unsigned int offset) const {
+    return (offset == FlatAst::None ? NULL : paths + offset);
+}
+
+const char *AstFile::SourcePath() const {
+    return Path(header->sourcePath);
+}
+
+void AstFile::DeclareGlobals(CompileContext *ctx) const {
+    for (int i = 0; i < numGlobals; i++) {
+        const AstFileGlobal &g = globals[i];
+        Decl *decl = ast.RaiseSignature(g.decl, ctx->atoms);
+        Symbol sym(decl->GetIdentifier()->GetName(), decl,
+                   ast.nodes[g.decl].kind == F_FnDecl ? E_FunctionDecl : E_VarDecl);
+        ctx->symtab->insert(sym);
+        CompileContext::LoadedDecl loaded;
+        loaded.decl = decl;
+        loaded.line = g.line;
+        loaded.path = (g.path != FlatAst::None ? Path(g.path) : SourcePath());
+        ctx->loadedDecls.push_back(loaded);
+    }
+}
+
+/* Function: Print()
+ * -----------------
+ * Raises the whole tree into an arena of its own and prints it, with a
+ * context that has nothing but the unit's lines, which is all that
+ * Node::Print() needs of one.
+ */
+void AstFile::Print() const {
+    CompileContext ctx;
+    ctx.lineStarts.assign(lineStarts, lineStarts + numLines);
+    Arena arena;
+    SetNodeArena(&arena);
+    Node *program = ast.Raise(ast.root, ctx.atoms);
+    SetNodeArena(NULL);
+    SetPrintContext(&ctx);
+    program->Print(0);
+    SetPrintContext(NULL);
+}
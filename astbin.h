@@ -0,0 +1,126 @@
+/* File: astbin.h
+ * --------------
+ * An AST file holds the checked program of a translation unit, as its
+ * FlatAst (see flatast.h), and the signatures of its global symbols, in
+ * a form that is read by mapping the file and using it where it lies.
+ * glc writes one with --emit-ast-bin, for a unit with no errors, and
+ * uses any given with --ast-bin as the global scope of the unit it
+ * checks: their declarations are taken as checked already, just as if
+ * each had come first in the unit (see CompileContext::astFiles). A
+ * shared header that every shader includes can then be parsed and
+ * checked once, rather than in each of them.
+ *
+ * The file is a header and then sections, each an array of one of the
+ * FlatAst's element types (nodes, spans, lists and so on), written as
+ * they are in memory and 8-byte aligned. Nothing in them is a pointer:
+ * links are indices and names are offsets in the names section. So the
+ * file is the same wherever it is mapped, and loading it is checking
+ * the header and pointing the FlatAst's arrays at the sections. The
+ * header records the byte order and each section's element size, and
+ * a file written by a glc that lays them out differently, or of
+ * another version, is refused rather than misread.
+ *
+ * Besides the FlatAst there are the global symbols, one for each
+ * top-level declaration, in order, giving the node of its declaration
+ * (whose type, or return type and formals, is its signature) and the
+ * line it is on; the start of each of the unit's lines, for printing;
+ * and the path of the unit's source and of the files it included.
+ * Only the global symbols and what their signatures refer to are read
+ * to declare them. Loading checks every link of every node against the
+ * sections, in one pass, and refuses a file in which any is out of
+ * range, so a damaged file is an error rather than a crash.
+ *
+ * glc --dump-ast-bin prints the program of an AST file as -d dumpAST
+ * printed it when the file was written, by raising the tree from it
+ * (see FlatAst::Raise()); make test-ast-bin compares the two.
+ */
+
+#ifndef _H_astbin
+#define _H_astbin
+
+#include <stddef.h>
+#include <string>
+#include "flatast.h"
+
+using namespace std;
+
+class CompileContext;
+
+static const int AstFileVersion = 1;
+
+// The sections of the file, in order
+typedef enum {
+      S_Nodes, S_Spans, S_Lists, S_Identifiers, S_Operators, S_Ints, S_Floats,
+      S_ArrayTypes, S_Names, S_Globals, S_LineStarts, S_Paths,
+      NumAstSections
+} astSectionT;
+
+struct AstFileSection
+{
+    unsigned long long offset;      // from the start of the file
+    unsigned int count, elemSize;
+};
+
+struct AstFileHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int byteOrder;         // AstByteOrder, as the writer stored it
+    unsigned int root;
+    unsigned int sourcePath;        // offset in the paths, or None
+    AstFileSection sections[NumAstSections];
+};
+
+struct AstFileGlobal
+{
+    unsigned int name;              // offset in the names
+    unsigned int decl;              // its node
+    int line;                       // as SourceLine() gives it
+    unsigned int path;              // offset in the paths, or None for the source
+};
+
+// Writes the program that ctx checked, which must have had no errors,
+// to the AST file at path, replacing it whole. Returns false if it
+// cannot be written.
+bool WriteAstFile(CompileContext *ctx, const char *path);
+
+class AstFile
+{
+  public:
+    // Maps the AST file at path, or returns NULL and sets error to why
+    // it can't be used
+    static AstFile *Map(const char *path, string *error);
+    ~AstFile();
+
+    const FlatAst &Ast() const      { return ast; }
+    int NumGlobals() const          { return numGlobals; }
+    const AstFileGlobal &Global(int i) const { return globals[i]; }
+    // The path of the unit's source, or NULL if it was read from stdin
+    const char *SourcePath() const;
+
+    // Declares each global symbol in ctx's global scope, with a
+    // declaration raised from its signature, and adds it to loadedDecls.
+    // A symbol already declared keeps its first declaration.
+    void DeclareGlobals(CompileContext *ctx) const;
+
+    // Prints the program as -d dumpAST printed the tree it came from
+    void Print() const;
+
+  private:
+    void *mapping;
+    size_t mappedLen;
+    const AstFileHeader *header;
+    FlatAst ast;                    // its arrays are the mapped sections
+    const AstFileGlobal *globals;
+    int numGlobals;
+    const unsigned int *lineStarts;
+    int numLines;
+    const char *paths;
+    unsigned int pathsLen;
+
+    AstFile();
+    bool Load(string *error);
+    const char *Path(unsigned int offset) const;
+};
+
+#endif
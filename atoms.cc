@@ -0,0 +1,108 @@
+/* File: atoms.cc
+ * --------------
+ * Implementation of the atom table.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "atoms.h"
+
+static const int InitialSlots = 1024;   // must be a power of 2
+
+// FNV-1a
+static unsigned Hash(const char *s, int len)
+{
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+AtomTable::AtomTable()
+{
+    Slot empty = { NULL, 0, 0 };
+    slots.assign(InitialSlots, empty);
+    numUnique = numInterned = 0;
+}
+
+void AtomTable::Clear()
+{
+    Slot empty = { NULL, 0, 0 };
+    slots.assign(slots.size(), empty);
+    spellings.Reset();
+    numUnique = numInterned = 0;
+}
+
+/* Function: Lookup()
+ * ------------------
+ * Returns the slot holding the spelling, or the free slot where it
+ * belongs if it isn't there.
+ */
+const AtomTable::Slot *AtomTable::Lookup(const char *s, int len, unsigned hash) const
+{
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if (!slot.atom ||
+            (slot.hash == hash && slot.len == len && memcmp(slot.atom, s, len) == 0))
+            return &slot;
+    }
+}
+
+const char *AtomTable::Intern(const char *s, int len)
+{
+    numInterned++;
+    unsigned hash = Hash(s, len);
+    Slot *slot = (Slot *)Lookup(s, len, hash);
+    if (slot->atom) return slot->atom;
+
+    const char *atom = slot->atom = Store(s, len);
+    slot->hash = hash;
+    slot->len = len;
+    if (++numUnique * 2 > slots.size()) Grow();
+    return atom;
+}
+
+const char *AtomTable::Find(const char *s) const
+{
+    int len = strlen(s);
+    return Lookup(s, len, Hash(s, len))->atom;
+}
+
+/* Function: Store()
+ * -----------------
+ * Copies the spelling, NUL-terminated, into the arena, whose blocks
+ * never move, so atoms are stable. It is put just after its forwarding
+ * slot, which starts out NULL.
+ */
+const char *AtomTable::Store(const char *s, int len)
+{
+    char *slot = (char *)spellings.Allocate(sizeof(const char *) + len + 1,
+                                            sizeof(const char *));
+    *(const char **)slot = NULL;
+    char *atom = slot + sizeof(const char *);
+    memcpy(atom, s, len);
+    atom[len] = '\0';
+    return atom;
+}
+
+/* Function: Grow()
+ * ----------------
+ * Doubles the number of slots and rehashes every atom into them.
+ */
+void AtomTable::Grow()
+{
+    vector<Slot> old;
+    old.swap(slots);
+    Slot empty = { NULL, 0, 0 };
+    slots.assign(old.size() * 2, empty);
+    size_t mask = slots.size() - 1;
+    for (int i = 0; i < old.size(); i++) {
+        if (!old[i].atom) continue;
+        size_t j = old[i].hash & mask;
+        while (slots[j].atom) j = (j + 1) & mask;
+        slots[j] = old[i];
+    }
+}
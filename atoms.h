@@ -0,0 +1,68 @@
+/* File: atoms.h
+ * -------------
+ * An AtomTable interns identifier spellings. Each distinct spelling is
+ * stored once, and Intern() returns the same pointer, the atom, for
+ * every occurrence of it. The scanner hands atoms to the parser, so an
+ * Identifier needs no copy of its name, and the symbol tables key on
+ * atoms, so comparing two names is comparing two pointers.
+ *
+ * Each CompileContext has its own table, so nothing is shared between
+ * threads; its atoms stay valid until the context is destroyed or reset
+ * (see CompileContext::Reset()), which clears the table. A scan
+ * split over threads (see ChunkedScanTokens()) gives each chunk a table
+ * of its own, and maps the chunk's atoms to the unit's at the join,
+ * through the forwarding slot each atom has for that.
+ */
+
+#ifndef _H_atoms
+#define _H_atoms
+
+#include <stddef.h>
+#include <vector>
+#include "arena.h"
+
+using namespace std;
+
+class AtomTable
+{
+  public:
+    AtomTable();
+
+    // Returns the atom for the len chars at s, adding it if it is new
+    const char *Intern(const char *s, int len);
+
+    // Returns the atom for the NUL-terminated s, or NULL if there is
+    // none (in which case no identifier has that name)
+    const char *Find(const char *s) const;
+
+    // Forgets every atom, keeping the slots and the spellings' blocks
+    // for the atoms of the next unit
+    void Clear();
+
+    int NumUnique() const { return numUnique; }
+    int NumInterned() const { return numInterned; }
+
+    // The atom's forwarding slot: the atom of the same spelling in
+    // another table, NULL until it is set
+    static const char *&Forward(const char *atom) { return ((const char **)atom)[-1]; }
+
+    // Counts n more occurrences of atoms already interned, as another
+    // table interned them
+    void CountInterned(int n) { numInterned += n; }
+
+  private:
+    struct Slot {
+        const char *atom;           // NULL if the slot is free
+        unsigned hash;
+        int len;
+    };
+    vector<Slot> slots;             // open addressing; size a power of 2
+    Arena spellings;                // where the atoms are kept
+    int numUnique, numInterned;
+
+    const Slot *Lookup(const char *s, int len, unsigned hash) const;
+    const char *Store(const char *s, int len);
+    void Grow();
+};
+
+#endif
@@ -0,0 +1,267 @@
+/* File: batch.cc
+ * --------------
+ * Implementation of batch mode. In parallel mode each worker thread
+ * takes the next file from a shared queue, checks it in a fresh
+ * CompileContext whose output is buffered, and marks the result done.
+ * Both streams are buffered: the diagnostics, and what goes to stdout
+ * (the text the scanner echoes and any debug output). The main thread
+ * prints the results strictly in input order as they become available,
+ * so the output is the same as a serial run.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "batch.h"
+#include "context.h"
+#include "cache.h"
+#include "arena.h"
+#include "utility.h"
+
+struct BatchResult {
+    int numErrors;          // -1 if the file could not be opened
+    string output;          // buffered stdout (parallel mode only)
+    string diagnostics;     // buffered error output (parallel mode only)
+    bool done;
+
+    BatchResult() : numErrors(0), done(false) {}
+};
+
+/* The shared work queue: files are handed out in input order by
+ * bumping next, and results are published under the lock.
+ */
+struct BatchQueue {
+    const vector<string> *files;
+    vector<BatchResult> *results;
+    ResultCache *cache;
+    bool streaming;
+    int next;
+    mutex lock;
+    condition_variable resultReady;
+};
+
+static double NowMillis()
+{
+    using namespace std::chrono;
+    return duration<double, milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+/* Class: OutputBuffer
+ * -------------------
+ * Collects what the check of one file writes to stdout, in the order it
+ * is written: the echoed text, which goes to stream (the context's
+ * echoStream), and the debug output of the calling thread (see
+ * SetDebugFile()). Both end up in one memory stream.
+ */
+class OutputBuffer : public streambuf
+{
+  public:
+    ostream stream;
+
+    OutputBuffer() : stream(this) {
+        file = open_memstream(&text, &len);
+        if (!file) Failure("Out of memory buffering output");
+        SetDebugFile(file);
+    }
+
+    // Stops collecting, and returns what was collected
+    string Finish() {
+        SetDebugFile(NULL);
+        fclose(file);
+        string collected(text, len);
+        free(text);
+        return collected;
+    }
+
+  private:
+    FILE *file;
+    char *text;
+    size_t len;
+
+    int overflow(int c)                             { return (c == EOF ? 0 : fputc(c, file)); }
+    streamsize xsputn(const char *s, streamsize n)  { return fwrite(s, 1, n, file); }
+};
+
+/* Function: CheckFile()
+ * ---------------------
+ * Runs the scanner, parser and semantic checker over one file, writing
+ * the echoed text to out and diagnostics to err. Each file gets a fresh
+ * CompileContext (line index, symbol table, loop stack, error count), so
+ * the diagnostics are exactly the ones a fresh glc process would print.
+ * The file is read through a memory mapping where possible, and through
+ * the result cache if there is one. With streaming set, declarations
+ * are checked as they are parsed (see CompileContext::StreamDecl()).
+ * Otherwise the AST is made in nodes, which the caller keeps from one
+ * file to the next. Returns the number of errors reported, or -1 if the
+ * file could not be opened.
+ */
+static int CheckFile(const char *path, ostream &out, ostream &err, ResultCache *cache,
+                     bool streaming, Arena *nodes)
+{
+    int numErrors;
+    if (cache)
+        numErrors = CheckWithCache(cache, path, out, err, streaming);
+    else {
+        CompileContext ctx(err);
+        ctx.echoStream = &out;
+        ctx.streaming = streaming;
+        ctx.arena = nodes;
+        numErrors = ctx.CheckPath(path);
+    }
+    if (numErrors < 0)
+        err << "*** Cannot open file '" << path << "'" << endl;
+    return numErrors;
+}
+
+static void PrintBanner(const string &path)
+{
+    printf("==> %s <==\n", path.c_str());
+    fflush(stdout);
+}
+
+static void BatchWorker(BatchQueue *q)
+{
+    Arena nodes;
+    while (true) {
+        int i;
+        {
+            lock_guard<mutex> guard(q->lock);
+            if (q->next >= q->files->size()) return;
+            i = q->next++;
+        }
+        OutputBuffer out;
+        ostringstream err;
+        int numErrors = CheckFile((*q->files)[i].c_str(), out.stream, err, q->cache,
+                                  q->streaming, &nodes);
+        string output = out.Finish();
+
+        lock_guard<mutex> guard(q->lock);
+        BatchResult &r = (*q->results)[i];
+        r.numErrors = numErrors;
+        r.output.swap(output);
+        r.diagnostics = err.str();
+        r.done = true;
+        q->resultReady.notify_all();
+    }
+}
+
+void AddBatchInput(const char *arg, vector<string> &files)
+{
+    if (arg[0] != '@') {
+        files.push_back(arg);
+        return;
+    }
+    FILE *list = fopen(arg + 1, "r");
+    if (!list) {
+        fprintf(stderr, "*** Cannot open batch list '%s'\n", arg + 1);
+        exit(2);
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), list)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0')
+            files.push_back(line);
+    }
+    fclose(list);
+}
+
+/* Function: TimeSerialRun()
+ * -------------------------
+ * Checks the files again one after another, as -j 1 does, with their
+ * output buffered and then dropped, and returns the wall time taken.
+ * The cache is not used, since the run being compared has just filled
+ * it.
+ */
+static double TimeSerialRun(const vector<string> &files, bool streaming)
+{
+    double start = NowMillis();
+    Arena nodes;
+    for (int i = 0; i < files.size(); i++) {
+        OutputBuffer out;
+        ostringstream err;
+        CheckFile(files[i].c_str(), out.stream, err, NULL, streaming, &nodes);
+        out.Finish();
+    }
+    return NowMillis() - start;
+}
+
+int RunBatch(const vector<string> &files, int numThreads, bool reportTiming,
+             bool measureSpeedup, ResultCache *cache, bool streaming)
+{
+    vector<BatchResult> results(files.size());
+    if (numThreads == 0)
+        numThreads = thread::hardware_concurrency();
+    if (numThreads > (int)files.size())
+        numThreads = files.size();
+    if (numThreads < 1)
+        numThreads = 1;
+
+    double start = NowMillis();
+    if (numThreads == 1) {
+        // Serial: diagnostics go straight to stderr, interleaved with
+        // any debug output exactly as in a standalone run.
+        Arena nodes;
+        for (int i = 0; i < files.size(); i++) {
+            PrintBanner(files[i]);
+            results[i].numErrors = CheckFile(files[i].c_str(), cout, cerr, cache, streaming,
+                                             &nodes);
+            fflush(stdout);
+        }
+    } else {
+        // Parallel: output, including debug output (-d), is buffered per
+        // file and released in order.
+        BatchQueue q;
+        q.files = &files;
+        q.results = &results;
+        q.cache = cache;
+        q.streaming = streaming;
+        q.next = 0;
+        vector<thread> workers;
+        for (int t = 0; t < numThreads; t++)
+            workers.push_back(thread(BatchWorker, &q));
+
+        for (int i = 0; i < files.size(); i++) {
+            string output, diagnostics;
+            {
+                unique_lock<mutex> guard(q.lock);
+                while (!results[i].done)
+                    q.resultReady.wait(guard);
+                output.swap(results[i].output);
+                diagnostics.swap(results[i].diagnostics);
+            }
+            PrintBanner(files[i]);
+            cout << output << flush;
+            cerr << diagnostics << flush;
+        }
+        for (int t = 0; t < numThreads; t++)
+            workers[t].join();
+    }
+    double wallMillis = NowMillis() - start;
+
+    int failed = 0;
+    printf("\n=== batch summary: %d file(s) ===\n", (int)files.size());
+    for (int i = 0; i < files.size(); i++) {
+        int status = (results[i].numErrors == 0 ? 0 : -1);
+        if (status != 0) failed++;
+        if (results[i].numErrors < 0)
+            printf("%s: unreadable, exit %d\n", files[i].c_str(), status);
+        else
+            printf("%s: %d error(s), exit %d\n", files[i].c_str(), results[i].numErrors, status);
+    }
+    printf("=== %d passed, %d failed ===\n", (int)files.size() - failed, failed);
+
+    // The -j 1 time is measured by a second run, unless this one was it
+    if (measureSpeedup) {
+        double serialMillis = (numThreads == 1 ? wallMillis : TimeSerialRun(files, streaming));
+        printf("=== -j %d: %.1f ms wall, -j 1: %.1f ms wall, speedup %.2fx ===\n",
+               numThreads, wallMillis, serialMillis,
+               wallMillis > 0 ? serialMillis / wallMillis : 1.0);
+    } else if (reportTiming)
+        printf("=== -j %d: %.1f ms wall ===\n", numThreads, wallMillis);
+    return (failed == 0 ? 0 : -1);
+}
@@ -0,0 +1,44 @@
+/* File: batch.h
+ * -------------
+ * Batch mode checks many translation units in one glc process, either
+ * one after another or spread over a pool of worker threads. Each file
+ * gets its own CompileContext, so the diagnostics are the same ones a
+ * separate glc run on that file would print, and they are written out
+ * in input order whatever the number of threads.
+ */
+
+#ifndef _H_batch
+#define _H_batch
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class ResultCache;
+
+/* Function: AddBatchInput()
+ * -------------------------
+ * Appends a batch operand to the list of files to check. An operand of
+ * the form @list.txt names a file holding one path per line, which is
+ * expanded in place. Blank lines in a list file are skipped.
+ */
+void AddBatchInput(const char *arg, vector<string> &files);
+
+/* Function: RunBatch()
+ * --------------------
+ * Checks every file and prints a banner and the diagnostics for each,
+ * followed by a per-file exit status summary. With numThreads > 1 the
+ * files are checked by that many worker threads; numThreads == 0 means
+ * one per core. When reportTiming is set a final line gives the wall
+ * time. With measureSpeedup it also gives the speedup over -j 1, which
+ * is measured by checking the files again on one thread (without the
+ * cache, and with the output discarded), so it doubles the work at
+ * least. If cache is not NULL, results are taken from and added to it. With streaming
+ * set, each file is checked in streaming mode (see context.h). Returns
+ * 0 only if every file checked cleanly.
+ */
+int RunBatch(const vector<string> &files, int numThreads, bool reportTiming,
+             bool measureSpeedup, ResultCache *cache, bool streaming);
+
+#endif
@@ -0,0 +1,316 @@
+/* File: cache.cc
+ * --------------
+ * Implementation of the result cache. Keys are 64-bit FNV-1a hashes; an
+ * entry also records the length of its source, which is checked on
+ * lookup as a guard against the (unlikely) hash collision. An entry is
+ * a one-line header giving the version, the source length, the error
+ * count and the lengths of the echoed output and of the diagnostics,
+ * followed by those two texts.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <sstream>
+#include <vector>
+#include "cache.h"
+#include "context.h"
+
+static const char *EntrySuffix = ".glc";
+static const char *TotalFile = "/total";   // the bytes stored since the last trim
+static const int EntryVersion = 2;
+
+static const unsigned long long FnvOffset = 14695981039346656037ULL;
+static const unsigned long long FnvPrime = 1099511628211ULL;
+
+static unsigned long long Hash(const char *data, size_t len, unsigned long long h)
+{
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= FnvPrime;
+    }
+    return h;
+}
+
+/* Function: BuildId()
+ * -------------------
+ * Identifies this build of glc, so that any change to the checker
+ * invalidates the whole cache, from the compile time of this file and
+ * the size, modification time and inode of the running executable,
+ * which any relink changes. Hashing the executable itself would be
+ * surer, but would cost more than a cache hit saves.
+ */
+static unsigned long long BuildId()
+{
+    const char *stamp = __DATE__ " " __TIME__;
+    unsigned long long h = Hash(stamp, strlen(stamp), FnvOffset);
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        unsigned long long fields[] = {
+            (unsigned long long)st.st_size, (unsigned long long)st.st_mtim.tv_sec,
+            (unsigned long long)st.st_mtim.tv_nsec, (unsigned long long)st.st_ino,
+            (unsigned long long)st.st_dev
+        };
+        h = Hash((const char *)fields, sizeof(fields), h);
+    }
+    return h;
+}
+
+ResultCache::ResultCache(const char *d, size_t max)
+{
+    dir = d;
+    maxBytes = max;
+    buildId = BuildId();
+    hits = misses = stores = 0;
+    bytesSaved = bytesStored = 0;
+    mkdir(d, 0777);
+}
+
+string ResultCache::EntryPath(const char *src, size_t len)
+{
+    unsigned long long h = Hash((const char *)&buildId, sizeof(buildId), FnvOffset);
+    h = Hash(src, len, h);
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx", h);
+    return dir + name + EntrySuffix;
+}
+
+/* Reads len bytes of f into text, which is first checked to fit in the
+ * remaining bytes of the file, so a damaged length can't make it huge.
+ */
+static bool ReadText(FILE *f, size_t remaining, unsigned long len, string &text)
+{
+    if (len > remaining) return false;
+    text.resize(len);
+    return len == 0 || fread(&text[0], 1, len, f) == len;
+}
+
+bool ResultCache::Lookup(const char *src, size_t len, string &output, string &diagnostics,
+                         int &numErrors)
+{
+    string path = EntryPath(src, len);
+    FILE *f = fopen(path.c_str(), "r");
+    bool hit = false;
+    if (f) {
+        // The header is read with fgets, since a scanf format would also
+        // eat the blank line that the diagnostics start with
+        char header[128];
+        int version;
+        unsigned long srcLen, outputLen, diagLen;
+        struct stat st;
+        if (fgets(header, sizeof(header), f) && fstat(fileno(f), &st) == 0 &&
+            sscanf(header, "glc-cache %d %lu %d %lu %lu", &version, &srcLen, &numErrors,
+                   &outputLen, &diagLen) == 5 &&
+            version == EntryVersion && srcLen == len) {
+            size_t remaining = st.st_size - strlen(header);
+            hit = (ReadText(f, remaining, outputLen, output) &&
+                   ReadText(f, remaining - outputLen, diagLen, diagnostics));
+        }
+        fclose(f);
+    }
+    if (hit)
+        utime(path.c_str(), NULL); // mark as recently used
+
+    lock_guard<mutex> guard(lock);
+    if (hit) {
+        hits++;
+        bytesSaved += len;
+    } else
+        misses++;
+    return hit;
+}
+
+void ResultCache::Store(const char *src, size_t len, const string &output,
+                        const string &diagnostics, int numErrors)
+{
+    string path = EntryPath(src, len);
+    char tmp[64];
+    static int counter = 0;
+    {
+        lock_guard<mutex> guard(lock);
+        snprintf(tmp, sizeof(tmp), "/.tmp.%d.%d", (int)getpid(), counter++);
+    }
+    string tmpPath = dir + tmp;
+    FILE *f = fopen(tmpPath.c_str(), "w");
+    if (!f) return; // the cache is only an optimization
+    int headerLen = fprintf(f, "glc-cache %d %lu %d %lu %lu\n", EntryVersion,
+                            (unsigned long)len, numErrors, (unsigned long)output.size(),
+                            (unsigned long)diagnostics.size());
+    fwrite(output.data(), 1, output.size(), f);
+    fwrite(diagnostics.data(), 1, diagnostics.size(), f);
+    if (fclose(f) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return;
+    }
+    lock_guard<mutex> guard(lock);
+    stores++;
+    bytesStored += headerLen + output.size() + diagnostics.size();
+}
+
+struct CacheEntry {
+    string path;
+    time_t mtime;
+    size_t size;
+
+    bool operator<(const CacheEntry &other) const { return mtime < other.mtime; }
+};
+
+/* Function: ReadTotal()
+ * ---------------------
+ * Returns the running total of bytes in the directory, or the most a
+ * size_t holds if there is none yet or it can't be read, so that the
+ * entries are listed and it is made afresh.
+ */
+size_t ResultCache::ReadTotal()
+{
+    FILE *f = fopen((dir + TotalFile).c_str(), "r");
+    unsigned long total;
+    bool ok = (f && fscanf(f, "%lu", &total) == 1);
+    if (f) fclose(f);
+    return (ok ? total : (size_t)-1);
+}
+
+// Replaces the running total whole, as Store() does an entry
+void ResultCache::WriteTotal(size_t total)
+{
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "/.tmp.%d.total", (int)getpid());
+    string tmpPath = dir + tmp;
+    FILE *f = fopen(tmpPath.c_str(), "w");
+    if (!f) return;
+    fprintf(f, "%lu\n", (unsigned long)total);
+    if (fclose(f) != 0 || rename(tmpPath.c_str(), (dir + TotalFile).c_str()) != 0)
+        unlink(tmpPath.c_str());
+}
+
+/* Function: Trim()
+ * ----------------
+ * A run that stored nothing can't have taken the directory over its
+ * bound, and one whose stores leave the running total within it just
+ * adds them to the total. Only otherwise are the entries listed, the
+ * least recently used evicted, and the total set to what is left.
+ */
+void ResultCache::Trim()
+{
+    size_t stored;
+    {
+        lock_guard<mutex> guard(lock);
+        stored = bytesStored;
+        bytesStored = 0;
+    }
+    if (stored == 0) return;
+    size_t total = ReadTotal();
+    if (total <= maxBytes && stored <= maxBytes - total) {
+        WriteTotal(total + stored);
+        return;
+    }
+
+    DIR *d = opendir(dir.c_str());
+    if (!d) return;
+    vector<CacheEntry> entries;
+    total = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        size_t n = strlen(de->d_name), m = strlen(EntrySuffix);
+        if (n <= m || strcmp(de->d_name + n - m, EntrySuffix) != 0) continue;
+        CacheEntry e;
+        e.path = dir + "/" + de->d_name;
+        struct stat st;
+        if (stat(e.path.c_str(), &st) != 0) continue; // evicted by someone else
+        e.mtime = st.st_mtime;
+        e.size = st.st_size;
+        total += e.size;
+        entries.push_back(e);
+    }
+    closedir(d);
+
+    sort(entries.begin(), entries.end());
+    for (int i = 0; i < entries.size() && total > maxBytes; i++) {
+        unlink(entries[i].path.c_str());
+        total -= entries[i].size;
+    }
+    WriteTotal(total);
+}
+
+void ResultCache::PrintStats()
+{
+    lock_guard<mutex> guard(lock);
+    printf("=== cache: %d hit(s), %d miss(es), %d stored, %lu source bytes not rechecked ===\n",
+           hits, misses, stores, (unsigned long)bytesSaved);
+}
+
+/* Function: ReadSource()
+ * ----------------------
+ * Reads all of input into source, for stdin, which can't be mapped.
+ */
+static void ReadSource(FILE *input, string &source)
+{
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), input)) > 0)
+        source.append(buf, n);
+}
+
+int CheckWithCache(ResultCache *cache, const char *path, ostream &out, ostream &err,
+                   bool streaming)
+{
+    // The file is mapped once, hashed, and on a miss checked from the
+    // same mapping, so the result stored is that of the bytes hashed
+    // even if the file is replaced in between.
+    string stdinSource;
+    const char *src;
+    size_t len = 0;
+    void *map = MAP_FAILED;
+    if (!path) {
+        ReadSource(stdin, stdinSource);
+        src = stdinSource.data();
+        len = stdinSource.size();
+    } else {
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0) return -1;
+        bool regular = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+        if (regular && st.st_size > 0)
+            map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (!regular || (st.st_size > 0 && map == MAP_FAILED)) {
+            // Can't see the bytes without consuming them, so no caching
+            CompileContext ctx(err);
+            ctx.echoStream = &out;
+            ctx.streaming = streaming;
+            return ctx.CheckPath(path);
+        }
+        len = st.st_size;
+        src = (map != MAP_FAILED ? (const char *)map : "");
+    }
+
+    string output, diagnostics;
+    int numErrors;
+    if (!cache->Lookup(src, len, output, diagnostics, numErrors)) {
+        ostringstream echo, diag;
+        CompileContext ctx(diag);
+        ctx.echoStream = &echo;
+        ctx.streaming = streaming;
+        if (path)
+            ctx.sourcePath = path;  // for its #include names
+        numErrors = ctx.CheckBuffer(src, len);
+        output = echo.str();
+        diagnostics = diag.str();
+        // The result of a unit with #include, even of a file that isn't
+        // there, depends on more than its text
+        if (!ctx.IncludedFiles())
+            cache->Store(src, len, output, diagnostics, numErrors);
+    }
+    if (map != MAP_FAILED)
+        munmap(map, len);
+    out << output << flush;
+    err << diagnostics << flush;
+    return numErrors;
+}
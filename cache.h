@@ -0,0 +1,81 @@
+/* File: cache.h
+ * -------------
+ * An on-disk cache of check results, so that unchanged shaders need not
+ * be scanned, parsed and checked again on the next run. An entry holds
+ * the error count, the diagnostic output and the text echoed to stdout
+ * for one source text. It is keyed by a hash of the source bytes and
+ * the glc build, so a rebuilt glc never sees results from the old one.
+ *
+ * Each entry is one file in the cache directory. Entries are written to
+ * a temporary file and renamed into place, so several glc processes can
+ * share a directory: a reader sees either a whole entry or none. A hit
+ * touches the entry's modification time, and Trim() evicts the least
+ * recently used entries until the directory is within its size bound.
+ * So that Trim() need not look at every entry on every run, the
+ * directory also keeps a running total of the bytes stored in it since
+ * it was last trimmed (approximate, since runs may update it at once);
+ * the entries are only listed once that total passes the bound.
+ */
+
+#ifndef _H_cache
+#define _H_cache
+
+#include <stddef.h>
+#include <iostream>
+#include <string>
+#include <mutex>
+
+using namespace std;
+
+class ResultCache
+{
+  public:
+    ResultCache(const char *dir, size_t maxBytes);
+
+    // Look up the result for the len bytes at src. On a hit, fills in
+    // the echoed output, diagnostic text and error count and returns
+    // true.
+    bool Lookup(const char *src, size_t len, string &output, string &diagnostics,
+                int &numErrors);
+
+    // Record the result for the len bytes at src
+    void Store(const char *src, size_t len, const string &output, const string &diagnostics,
+               int numErrors);
+
+    // Evict least recently used entries until the directory fits, if
+    // what this run stored may have taken it over its bound
+    void Trim();
+
+    void PrintStats();
+
+  private:
+    string dir;
+    size_t maxBytes;
+    unsigned long long buildId;
+
+    mutex lock;                     // guards the counters below
+    int hits, misses, stores;
+    size_t bytesSaved;              // source bytes not checked thanks to hits
+    size_t bytesStored;             // entry bytes written by this run
+
+    string EntryPath(const char *src, size_t len);
+    size_t ReadTotal();
+    void WriteTotal(size_t total);
+};
+
+/* Function: CheckWithCache()
+ * --------------------------
+ * Checks the file at path (or stdin, if path is NULL) as a fresh
+ * CompileContext would, writing the echoed text to out and the
+ * diagnostics to err, but takes the result from cache if it has one for
+ * the same source, and stores it there otherwise. The source is read
+ * once, and what is checked is what was hashed. Returns the number of
+ * errors, or -1 if the file could not be read. Runs with debug flags on
+ * should not use the cache, since the debug output is not part of the
+ * cached result. Streaming mode gives the same diagnostics, so it
+ * shares the cached results.
+ */
+int CheckWithCache(ResultCache *cache, const char *path, ostream &out, ostream &err,
+                   bool streaming);
+
+#endif
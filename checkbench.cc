@@ -0,0 +1,253 @@
+/* File: checkbench.cc
+ * -------------------
+ * A benchmark for the checker on its own: each input is parsed once into
+ * the tree, which is lowered to a FlatAst (see flatast.h), and then the
+ * tree (Program::Check()) and the flat AST (FlatAst::Check()) are each
+ * checked a number of rounds. The median round gives the throughput in
+ * MB of source per second. The memory each takes is given too: for the
+ * tree, the bytes its arena handed out, which is its nodes and lists;
+ * for the flat AST, the bytes its arrays take. The diagnostics of the
+ * two are compared, and any difference is an error.
+ *
+ * The inputs are made up, size megabytes each, one of each kind below,
+ * unless files are named, or kinds with -k:
+ *
+ *    checkbench [-s size] [-r rounds] [-k kind]... [file...]
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "context.h"
+#include "ast_stmt.h"
+#include "symtable.h"
+#include "flatast.h"
+#include "arena.h"
+#include "stats.h"
+#include "parser.h"
+
+using namespace std;
+
+// Each generator appends function number n, which calls function n-1
+typedef void (*Generator)(string &out, int n);
+
+static void Functions(string &out, int n)
+{
+    char buf[2048];
+    snprintf(buf, sizeof(buf),
+             "uniform vec3 light%d;\n"
+             "float f%d(float a, vec3 v, int k) {\n"
+             "    float s = a * 2.0;\n"
+             "    vec3 w = v * s + light%d;\n"
+             "    float weights[4];\n"
+             "    int i;\n"
+             "    for (i = 0; i < k; i++) {\n"
+             "        if (s > 1.0 && w.x < 2.0) {\n"
+             "            s = s + w.y * 0.5;\n"
+             "        } else {\n"
+             "            s = s - weights[2];\n"
+             "        }\n"
+             "        while (s > 100.0) { s = s / 2.0; }\n"
+             "    }\n"
+             "    switch (k) { case 0: s = s + 1.0; break; default: s = s - 1.0; break; }\n"
+             "    w.xy = w.yx;\n", n, n, n);
+    out += buf;
+    if (n > 0) {
+        snprintf(buf, sizeof(buf), "    s = f%d(s, w, k - 1);\n", n - 1);
+        out += buf;
+    }
+    out += "    return s + w.z;\n}\n\n";
+}
+
+static void Expressions(string &out, int n)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "float f%d(float a, float b, float c) {\n    float s = a", n);
+    out += buf;
+    for (int i = 0; i < 200; i++)
+        out += (i % 3 == 0 ? " + (b * c - a)" : i % 3 == 1 ? " * (a - 1.5)" : " - b / (c + 2.0)");
+    out += ";\n    return s;\n}\n\n";
+}
+
+static void Errors(string &out, int n)
+{
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+             "vec2 f%d(vec2 p, int k) {\n"
+             "    vec2 q = p * 2.0;\n"
+             "    int j = 1.5;\n"
+             "    q = q + missing%d;\n"
+             "    if (k) { q.x = q.z; }\n"
+             "    while (k > 0) { k--; }\n"
+             "    break;\n"
+             "    return q;\n"
+             "}\n\n", n, n);
+    out += buf;
+}
+
+struct InputKind {
+    const char *name;
+    Generator generate;
+};
+
+static const InputKind kinds[] = {
+    { "functions", Functions },
+    { "expressions", Expressions },
+    { "errors", Errors },
+};
+static const int NumKinds = sizeof(kinds) / sizeof(kinds[0]);
+
+static const InputKind *FindKind(const string &name)
+{
+    for (int k = 0; k < NumKinds; k++)
+        if (name == kinds[k].name) return &kinds[k];
+    return NULL;
+}
+
+static bool ReadInput(const char *path, string &text)
+{
+    FILE *input = fopen(path, "r");
+    if (!input) return false;
+    char buf[65536];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), input)) > 0)
+        text.append(buf, len);
+    fclose(input);
+    return true;
+}
+
+// Gives ctx a new checker state and error stream, as a new context has
+static void ResetChecker(CompileContext &ctx, ostream &err)
+{
+    ctx.symtab->Clear();
+    ctx.stack->Clear();
+    ctx.isFnDecl = false;
+    ctx.errStream = &err;
+    ctx.numErrors = 0;
+}
+
+static void PrintResult(const char *repr, const string &name, double megabytes, size_t nodes,
+                        size_t bytes, double lowerMillis, vector<double> &millis)
+{
+    sort(millis.begin(), millis.end());
+    double median = millis[millis.size() / 2];
+    printf("%-5s %9.2f %10zu %12zu %10.1f %9.1f %9.1f %9.1f  %s\n", repr, megabytes, nodes,
+           bytes, nodes ? (double)bytes / nodes : 0.0, lowerMillis, median,
+           median > 0 ? megabytes / (median / 1000) : 0.0, name.c_str());
+    fflush(stdout);
+}
+
+/* Function: Bench()
+ * -----------------
+ * Parses text, then checks the tree and its flat form rounds times
+ * each, and prints a line of results for each. Returns false if their
+ * diagnostics differ.
+ */
+static bool Bench(const string &name, const string &text, int rounds)
+{
+    ostringstream parseErr;
+    CompileContext ctx(parseErr);
+    vector<Node *> log;
+    SetNodeLog(&log);
+    ctx.CheckBuffer(text.data(), text.size());
+    SetNodeLog(NULL);
+    if (!ctx.program) {
+        fprintf(stderr, "*** %s: does not parse\n", name.c_str());
+        return false;
+    }
+    double megabytes = text.size() / 1048576.0;
+
+    string treeErrors;
+    vector<double> millis;
+    for (int r = 0; r < rounds; r++) {
+        ostringstream err;
+        ResetChecker(ctx, err);
+        double start = PhaseTimer::Now();
+        ctx.program->Check(&ctx);
+        millis.push_back(PhaseTimer::Now() - start);
+        treeErrors = err.str();
+    }
+    PrintResult("tree", name, megabytes, log.size(), ctx.arena->BytesUsed(), 0, millis);
+
+    FlatAst flat;
+    double start = PhaseTimer::Now();
+    flat.Lower(ctx.program);
+    double lowerMillis = PhaseTimer::Now() - start;
+    string flatErrors;
+    millis.clear();
+    for (int r = 0; r < rounds; r++) {
+        ostringstream err;
+        ResetChecker(ctx, err);
+        start = PhaseTimer::Now();
+        flat.Check(&ctx);
+        millis.push_back(PhaseTimer::Now() - start);
+        flatErrors = err.str();
+    }
+    PrintResult("flat", name, megabytes, flat.NumNodes(), flat.BytesUsed(), lowerMillis, millis);
+
+    if (flatErrors != treeErrors) {
+        fprintf(stderr, "*** %s: the flat AST's diagnostics differ from the tree's\n",
+                name.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    double size = 8;
+    int rounds = 5, mismatches = 0;
+    vector<string> kindNames, files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            size = atof(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            kindNames.push_back(argv[++i]);
+            if (!FindKind(argv[i])) {
+                fprintf(stderr, "*** Unknown input kind '%s'\n", argv[i]);
+                return 2;
+            }
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [-s size] [-r rounds] [-k kind]... [file...]\n", argv[0]);
+            return 2;
+        } else
+            files.push_back(argv[i]);
+    }
+    if (rounds < 1) rounds = 1;
+    if (kindNames.empty() && files.empty())
+        for (int k = 0; k < NumKinds; k++)
+            kindNames.push_back(kinds[k].name);
+
+    InitParser();
+    printf("%-5s %9s %10s %12s %10s %9s %9s %9s  %s\n", "ast", "MB", "nodes", "bytes",
+           "bytes/node", "lower ms", "check ms", "MB/s", "input");
+    for (int i = 0; i < kindNames.size() + files.size(); i++) {
+        string name, text;
+        if (i < kindNames.size()) {
+            name = kindNames[i];
+            const InputKind *kind = FindKind(name);
+            for (int n = 0; text.size() < size * 1048576; n++)
+                kind->generate(text, n);
+        } else {
+            name = files[i - kindNames.size()];
+            if (!ReadInput(name.c_str(), text)) {
+                fprintf(stderr, "*** Cannot open file '%s'\n", name.c_str());
+                return 2;
+            }
+        }
+        if (!Bench(name, text, rounds))
+            mismatches++;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("=== peak RSS %.1f MB ===\n", usage.ru_maxrss / 1024.0);
+    return (mismatches == 0 ? 0 : 1);
+}
@@ -0,0 +1,489 @@
+/* File: context.cc
+ * ----------------
+ * Implementation of the per-compilation context.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "context.h"
+#include "parser.h"
+#include "symtable.h"
+#include "errors.h"
+#include "ast_decl.h"
+#include "utility.h"
+#include "stats.h"
+#include "atoms.h"
+#include "tokens.h"
+#include "fastscan.h"
+#include "preprocess.h"
+#include "ast.h"
+#include "ast_stmt.h"
+#include "arena.h"
+#include "scanner.h"
+#include "astbin.h"
+
+/* Class: DeferredDiagnostics
+ * --------------------------
+ * Holds the diagnostics of declarations checked while streaming. Without
+ * streaming nothing is checked if there is a syntax error anywhere in
+ * the file, so these can't be shown until the parse is over.
+ */
+class DeferredDiagnostics : public DiagnosticSink
+{
+  public:
+    struct Diagnostic {
+        errorKindT kind;
+        bool hasLocation;
+        yyltype loc;
+        string msg;
+    };
+    vector<Diagnostic> list;
+
+    void Report(errorKindT kind, yyltype *loc, const char *msg) {
+        Diagnostic d;
+        d.kind = kind;
+        d.hasLocation = (loc != NULL);
+        if (loc) d.loc = *loc;
+        d.msg = msg;
+        list.push_back(d);
+    }
+};
+
+CompileContext::CompileContext(ostream &err) {
+    scanner = NULL;
+    curLineNum = curColNum = 1;
+    scanAhead = NULL;
+    pretokenize = true;
+    tokens = ownTokens = NULL;
+#ifdef GLC_FAST_SCANNER
+    fastScan = true;
+#else
+    fastScan = false;
+#endif
+    scanThreads = 1;
+    preprocess = true;
+    preprocessed = NULL;
+    preprocessing = false;
+    parseStart = 0;
+    sourceText = NULL;
+    sourceLen = 0;
+    mappedText = NULL;
+    scanBuffer = NULL;
+    mappedLen = 0;
+    atoms = new AtomTable;
+    symtab = new SymbolTable;
+    stack = new MyStack;
+    isFnDecl = false;
+    incremental = NULL;
+    errStream = &err;
+    echoStream = &cout;
+    sink = NULL;
+    recorder = NULL;
+    numErrors = 0;
+    program = NULL;
+    arena = ownArena = NULL;
+    streaming = false;
+    stats = (IsDebugOn("timing") ? new CompileStats : NULL);
+    deferred = NULL;
+}
+
+CompileContext::~CompileContext() {
+    ReleaseUnit();
+    delete ownArena;
+    delete symtab;
+    delete stack;
+    delete ownTokens;
+    delete stats;
+    delete atoms;
+}
+
+void CompileContext::Reset() {
+    ReleaseUnit();
+    curLineNum = curColNum = 1;
+    sourcePath.clear();
+    preprocessing = false;
+    parseStart = 0;
+    sourceText = NULL;
+    sourceLen = 0;
+    lineStarts.clear();
+    ownedSource.clear();
+    atoms->Clear();
+    symtab->Clear();
+    stack->Clear();
+    isFnDecl = false;
+    loadedDecls.clear();
+    declStartLines.clear();
+    numErrors = 0;
+    program = NULL;
+    delete stats;
+    stats = (IsDebugOn("timing") ? new CompileStats : NULL);
+}
+
+/* Function: ReleaseUnit()
+ * -----------------------
+ * Frees what the unit checked holds: its AST, which is released with
+ * the arena's Reset() unless it was streamed, the mapping of its file,
+ * and what the preprocessor made of it.
+ */
+void CompileContext::ReleaseUnit() {
+    if (IsStreaming()) {
+        delete program;             // its nodes are on the heap
+        for (const LoadedDecl &d : loadedDecls)
+            delete d.decl;
+    }
+    else if (arena)
+        arena->Reset();
+    UnmapSource();
+    delete deferred;
+    deferred = NULL;
+    delete preprocessed;
+    preprocessed = NULL;
+}
+
+int CompileContext::CheckFile(FILE *input) {
+    double start = PhaseTimer::Now();
+    char buf[65536];
+    size_t n;
+    ownedSource.clear();
+    while ((n = fread(buf, 1, sizeof(buf), input)) > 0)
+        ownedSource.append(buf, n);
+    IndexLines(ownedSource.data(), ownedSource.size());
+    if (!ScansAhead())
+        InitScannerBuffer(this, ownedSource.data(), ownedSource.size());
+    return Parse(start);
+}
+
+int CompileContext::CheckBuffer(const char *src, int len) {
+    double start = PhaseTimer::Now();
+    IndexLines(src, len);
+    if (!ScansAhead())
+        InitScannerBuffer(this, src, len);
+    return Parse(start);
+}
+
+void CompileContext::ScanBuffer(const char *src, int len) {
+    double start = PhaseTimer::Now();
+    pretokenize = true;
+    IndexLines(src, len);
+    if (!ScansAhead())
+        InitScannerBuffer(this, src, len);
+    BeginParse(start);
+}
+
+int CompileContext::CheckScanned() {
+    return FinishParse();
+}
+
+int CompileContext::CheckPath(const char *path) {
+    double start = PhaseTimer::Now();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    sourcePath = path;
+    if (!MapSource(fd)) {
+        // Not a regular file (a pipe, say), so read it the usual way
+        FILE *input = fdopen(fd, "r");
+        CheckFile(input);
+        fclose(input);
+        return numErrors;
+    }
+    close(fd);
+    IndexLines(mappedText, mappedLen);
+    if (!ScansAhead())
+        InitScannerInPlace(this, scanBuffer, mappedLen + 2);
+    return Parse(start);
+}
+
+int CompileContext::Tokenize(const char *src, size_t len, TokenBuffer *into) {
+    IndexLines(src, len);
+    if (fastScan || scanThreads > 1)
+        FastScanTokens(this, into);
+    else {
+        InitScannerBuffer(this, src, len);
+        ScanTokens(this, into);
+        FreeScanner(this);
+    }
+    return into->NumTokens();
+}
+
+/* Function: ScansAhead()
+ * ----------------------
+ * Decides how the input, indexed by now, is to be made into tokens, and
+ * returns true if it needs no flex scanner: the preprocessor and the
+ * hand-written scanner (chunked or not) only fill a TokenBuffer, so
+ * they are used only if the input is to be scanned ahead.
+ */
+bool CompileContext::ScansAhead() {
+    bool ahead = pretokenize && sourceLen <= UINT_MAX;
+    preprocessing = ahead && preprocess &&
+                    (!defines.empty() || HasDirectives(sourceText, sourceLen));
+    return preprocessing || (ahead && (fastScan || scanThreads > 1));
+}
+
+/* Function: Parse()
+ * -----------------
+ * Runs the parser (and so the scanner and checker) over the input the
+ * scanner was set up on since startMillis.
+ */
+int CompileContext::Parse(double startMillis) {
+    BeginParse(startMillis);
+    return FinishParse();
+}
+
+/* Function: BeginParse()
+ * ----------------------
+ * Starts the timing of the parse, with -d timing, and scans all of the
+ * input first if pretokenize is on, preprocessing it if it has
+ * directives.
+ */
+void CompileContext::BeginParse(double startMillis) {
+    parseStart = PhaseTimer::Now();
+    if (stats) {
+        stats->initMillis = parseStart - startMillis;
+        SetNodeLog(&stats->newNodes);
+    }
+    if (sourceLen > UINT_MAX)
+        pretokenize = false;        // the buffer's offsets are 32 bits
+    if (pretokenize) {
+        PhaseTimer timer(stats ? &stats->scanMillis : NULL);
+        if (!tokens) tokens = ownTokens = new TokenBuffer;
+        if (preprocessing) {
+            PreprocessTokens(this, tokens);
+            IndexLines(preprocessed->text.data(), preprocessed->text.size());
+        } else if (scanner)
+            ScanTokens(this, tokens);
+        else
+            FastScanTokens(this, tokens);
+    }
+}
+
+/* Function: FinishParse()
+ * -----------------------
+ * Runs the parser over what BeginParse() set up, with the AST made in
+ * the arena unless streaming, and prints the phase timings and counters
+ * if they were kept. The declarations of the AST files are made first,
+ * in the same place.
+ */
+int CompileContext::FinishParse() {
+    if (!IsStreaming()) {
+        if (!arena) arena = ownArena = new Arena;
+        SetNodeArena(arena);
+    }
+    for (const AstFile *f : astFiles)
+        f->DeclareGlobals(this);
+    yyparse(scanner, this);
+    SetNodeArena(NULL);
+    if (scanner) FreeScanner(this);
+    if (stats) {
+        SetNodeLog(NULL);
+        if (arena) {
+            stats->arenaBytes = arena->BytesUsed();
+            stats->arenaResets = arena->NumResets();
+        }
+        stats->CountNewNodes();
+        stats->parseMillis = PhaseTimer::Now() - parseStart - stats->scanMillis - stats->checkMillis;
+        stats->Print(NumLines(), atoms->NumInterned(), atoms->NumUnique(),
+                     symtab->numLookups(), numErrors);
+    }
+    if (IsDebugOn("nodesizes")) PrintNodeSizes();
+    return numErrors;
+}
+
+/* Function: MapSource()
+ * ---------------------
+ * Maps the file open on fd twice: read-only for mappedText, and private
+ * and writable, with two trailing NULs, for scanBuffer. flex's
+ * yy_scan_buffer() needs the NULs, and it temporarily overwrites the
+ * character after each token with a NUL as it scans, which is why the
+ * saved lines can't point into scanBuffer. Pages of the private mapping
+ * are only copied when flex writes to them. If the file size isn't a
+ * multiple of the page size, the NULs fit in the zero-filled tail of the
+ * last page; otherwise, we reserve anonymous (zeroed) memory for the
+ * whole buffer and map the file over the front of it. Returns false,
+ * having mapped nothing, if fd is not a regular file or mapping fails.
+ */
+bool CompileContext::MapSource(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return false;
+    size_t len = st.st_size, pageSize = sysconf(_SC_PAGESIZE);
+
+    void *text = MAP_FAILED, *buf = MAP_FAILED;
+    if (len > 0)
+        text = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (len % pageSize != 0 && len % pageSize <= pageSize - 2) {
+        buf = mmap(NULL, len + 2, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    } else {
+        buf = mmap(NULL, len + 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf != MAP_FAILED && len > 0 &&
+            mmap(buf, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(buf, len + 2);
+            buf = MAP_FAILED;
+        }
+    }
+    if ((len > 0 && text == MAP_FAILED) || buf == MAP_FAILED) {
+        if (text != MAP_FAILED) munmap(text, len);
+        if (buf != MAP_FAILED) munmap(buf, len + 2);
+        return false;
+    }
+    // An empty file still needs a non-NULL mappedText to mark the mode
+    mappedText = (len > 0 ? (const char *)text : (const char *)buf);
+    scanBuffer = (char *)buf;
+    mappedLen = len;
+    return true;
+}
+
+void CompileContext::UnmapSource() {
+    if (!scanBuffer) return;
+    if (mappedText != scanBuffer)
+        munmap((void *)mappedText, mappedLen);
+    munmap(scanBuffer, mappedLen + 2);
+    mappedText = scanBuffer = NULL;
+}
+
+/* Function: IndexLines()
+ * ----------------------
+ * Makes the len bytes at text the source text and records where each of
+ * its lines starts, which is all GetLineNumbered() needs; the scanner
+ * never has to copy or rescan a line. Newlines are found sixteen bytes
+ * at a time with SSE2 where the target has it. A newline at the very end
+ * ends the last line rather than starting an empty one, as lines have
+ * always been counted. The offsets are 32 bits, so the lines of a file
+ * beyond 4GB are not indexed and just have no context in errors.
+ */
+void CompileContext::IndexLines(const char *text, size_t len) {
+    sourceText = text;
+    sourceLen = len;
+    lineStarts.clear();
+    if (len > UINT_MAX) len = UINT_MAX;
+    if (len == 0) return;
+    lineStarts.push_back(0);
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        while (mask) {
+            lineStarts.push_back(i + __builtin_ctz(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < len; i++)
+        if (text[i] == '\n') lineStarts.push_back(i + 1);
+    if (lineStarts.back() == len) lineStarts.pop_back();
+}
+
+const char *CompileContext::GetLineNumbered(int num, int *len) const {
+    if (preprocessed) return preprocessed->GetLine(num, len);
+    if (num <= 0 || num > lineStarts.size()) return NULL;
+    size_t start = lineStarts[num-1];
+    size_t end = (num < lineStarts.size() ? lineStarts[num] - 1 : sourceLen);
+    if (num == lineStarts.size() && end > start && sourceText[end-1] == '\n')
+        end--;
+    *len = end - start;
+    return sourceText + start;
+}
+
+int CompileContext::SourceLine(int num, const char **path) const {
+    if (preprocessed) return preprocessed->SourceLine(num, path);
+    *path = NULL;
+    return num;
+}
+
+int CompileContext::LineOf(unsigned int offset) const {
+    return upper_bound(lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin();
+}
+
+int CompileContext::DeclLine(const Decl *decl, const char **path) const {
+    for (const LoadedDecl &d : loadedDecls) {
+        if (d.decl == decl) {
+            *path = d.path;
+            return d.line;
+        }
+    }
+    return SourceLine(LineOf(decl->GetSpan().first), path);
+}
+
+/* Function: ColumnOf()
+ * --------------------
+ * Returns the column of the text at offset, on line line, counting from
+ * the start of the line as the scanner does: one for each character,
+ * and a tab on to the next tab stop. The scanner counts a tab inside a
+ * // comment as one, but no lexeme follows one of those on its line.
+ */
+int CompileContext::ColumnOf(unsigned int offset, int line) const {
+    int column = 1;
+    for (size_t i = (line > 0 ? lineStarts[line-1] : 0); i < offset; i++) {
+        column++;
+        if (sourceText[i] == '\t')
+            column += TAB_SIZE - column % TAB_SIZE + 1;
+    }
+    return column;
+}
+
+yyltype *CompileContext::Locate(const SourceSpan &span, yyltype *loc) const {
+    loc->first_offset = span.first;
+    loc->last_offset = span.last;
+    loc->last_length = span.lastLength;
+    loc->first_line = LineOf(span.first);
+    loc->first_column = ColumnOf(span.first, loc->first_line);
+    loc->last_line = LineOf(span.last);
+    loc->last_column = ColumnOf(span.last, loc->last_line) + span.lastLength - 1;
+    return loc;
+}
+
+bool CompileContext::IncludedFiles() const {
+    return preprocessed && preprocessed->numIncludes > 0;
+}
+
+bool CompileContext::IsStreaming() const {
+    return streaming && !IsDebugOn("dumpAST");
+}
+
+/* Function: StreamDecl()
+ * ----------------------
+ * Checks d, a top-level declaration that has just been parsed, unless
+ * there has already been a syntax error, and then frees its body. What
+ * the global symbol table refers to (names, types, formals) is kept, so
+ * later declarations are checked just as they would be if the whole tree
+ * were built first. The diagnostics are held back for FinishStream().
+ */
+void CompileContext::StreamDecl(Decl *d) {
+    if (!deferred) deferred = new DeferredDiagnostics;
+    if (stats) stats->CountNewNodes();
+    if (numErrors == deferred->list.size()) {
+        PhaseTimer timer(stats ? &stats->checkMillis : NULL);
+        DiagnosticSink *saved = sink;
+        sink = deferred;
+        d->Check(this);
+        sink = saved;
+    }
+    d->DiscardBody();
+}
+
+/* Function: FinishStream()
+ * ------------------------
+ * Reports the held back diagnostics if the whole unit parsed without
+ * errors, and drops them otherwise, as the default mode would never
+ * have checked anything.
+ */
+void CompileContext::FinishStream() {
+    if (!deferred) return;
+    PhaseTimer timer(stats ? &stats->checkMillis : NULL);
+    numErrors -= deferred->list.size();
+    if (numErrors == 0)
+        for (int i = 0; i < deferred->list.size(); i++) {
+            DeferredDiagnostics::Diagnostic &d = deferred->list[i];
+            ReportError::Replay(this, d.kind, d.hasLocation ? &d.loc : NULL, d.msg.c_str());
+        }
+    deferred->list.clear();
+}
@@ -0,0 +1,236 @@
+/* File: context.h
+ * ---------------
+ * A CompileContext holds all of the state that belongs to the compilation
+ * of one translation unit: the reentrant scanner and the source lines it
+ * saves for error context, the identifiers it has interned, the checker's
+ * symbol table and statement stack, and the diagnostics reported so far.
+ *
+ * Nothing in the front end is shared between contexts except the
+ * built-in Type and TypeQualifier instances, which are read-only once
+ * static initialization is done. So separate contexts can be used on
+ * separate threads, and each produces the same output it would produce
+ * if the translation units were compiled one after the other.
+ */
+
+#ifndef _H_context
+#define _H_context
+
+#include <stdio.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class SymbolTable;
+class MyStack;
+class Program;
+class DiagnosticSink;
+class IncrementalChecker;
+class Decl;
+class DeferredDiagnostics;
+class CompileStats;
+class TokenBuffer;
+class AtomTable;
+class PreprocessedUnit;
+class SourceFile;
+class Arena;
+class AstFile;
+struct SourceSpan;
+struct yyltype;
+
+class CompileContext
+{
+  public:
+    // Scanner state, owned by the scanner routines in scanner.l
+    void *scanner;                  // the flex yyscan_t, if there is one
+    int curLineNum, curColNum;
+    TokenBuffer *scanAhead;         // the buffer being filled, if any
+
+    // Unless pretokenize is turned off, the whole input is scanned into
+    // tokens before parsing starts, and the parser takes them from there
+    // (see tokens.h). A caller that checks one unit after another may
+    // supply the buffer, so that its storage is reused; otherwise the
+    // context makes its own.
+    bool pretokenize;
+    TokenBuffer *tokens;
+
+    // If set, the buffer is filled by the hand-written scanner rather
+    // than flex (see fastscan.h), and no flex scanner is made. The
+    // default is set at build time.
+    bool fastScan;
+
+    // If more than 1, a large input is cut into this many chunks at line
+    // breaks, which are scanned at the same time on threads of their own
+    // (see ChunkedScanTokens() in fastscan.h). This implies fastScan.
+    int scanThreads;
+
+    // Unless preprocess is turned off, a unit with directives is run
+    // through the preprocessor (see preprocess.h) as it is scanned ahead.
+    // Its #include names are relative to the directory of sourcePath,
+    // which CheckPath() sets, and then to the current directory. Once
+    // it is preprocessed, preprocessed says where its text came from.
+    bool preprocess;
+    string sourcePath;
+    PreprocessedUnit *preprocessed;
+
+    // Macros to define before the unit's first line, each given as NAME
+    // or NAME=value; with any, the unit is preprocessed even if it has
+    // no directives. A caller that preprocesses the same text several
+    // times (see variants.h) can scan it for the preprocessor once and
+    // set sourceFile (see ScanSourceFile()).
+    vector<string> defines;
+    shared_ptr<const SourceFile> sourceFile;
+
+    // The source text, for error context, and the offset at which each
+    // of its lines starts. The text is the caller's (CheckBuffer()), the
+    // read-only mapping (CheckPath()) or ownedSource (CheckFile()).
+    const char *sourceText;
+    size_t sourceLen;
+    vector<unsigned int> lineStarts;
+    string ownedSource;
+
+    // Set while checking a memory-mapped file (see CheckPath()). The
+    // scanner works in place on scanBuffer, a private writable mapping;
+    // mappedText is a second, read-only mapping of the same file, which
+    // is the source text.
+    const char *mappedText;
+    char *scanBuffer;
+    size_t mappedLen;
+
+    // The identifiers scanned, interned (see atoms.h)
+    AtomTable *atoms;
+
+    // Checker state, threaded through Check()/CheckExpr()
+    SymbolTable *symtab;
+    MyStack *stack;
+    bool isFnDecl;
+
+    // The global declarations of these AST files (see astbin.h) are in
+    // the global scope before the unit's own, as if checked already: the
+    // parse starts by declaring them, from their signatures. Each one
+    // declared is in loadedDecls, with the line and file it came from.
+    struct LoadedDecl {
+        Decl *decl;
+        int line;
+        const char *path;           // NULL if the AST file doesn't say
+    };
+    vector<const AstFile *> astFiles;
+    vector<LoadedDecl> loadedDecls;
+
+    // First line of each top-level declaration, recorded by the parser,
+    // and the incremental checker to use for them, if any
+    vector<int> declStartLines;
+    IncrementalChecker *incremental;
+
+    // Diagnostics are written to errStream, or handed to sink if it is
+    // set, and counted here. The text the scanner echoes, as flex's
+    // ECHO does with what the FIELDS state doesn't match, is written to
+    // echoStream, which is cout unless the caller sets another.
+    ostream *errStream;
+    ostream *echoStream;
+    DiagnosticSink *sink;
+    DiagnosticSink *recorder;       // if set, also sees every diagnostic
+    int numErrors;
+    string message;                 // the one being formatted (errors.cc)
+
+    Program *program;               // set once the parse completes
+
+    // The AST is allocated from arena while it is parsed and checked,
+    // and released in one go, with the arena's Reset(), when the context
+    // is destroyed. As with tokens, a caller that checks one unit after
+    // another may supply the arena, so that its blocks are reused;
+    // otherwise the context makes its own. In streaming mode, which frees
+    // each body as it goes, the nodes come from the heap instead.
+    Arena *arena;
+
+    // In streaming mode each top-level declaration is checked as soon as
+    // it is parsed and its body freed, so only one function body at a time
+    // is held in memory (see StreamDecl()). Off by default; the AST dump
+    // needs the whole tree, so -d dumpAST turns it off too.
+    bool streaming;
+
+    // Timings and counters, if the "timing" debug flag is on (see stats.h)
+    CompileStats *stats;
+
+    CompileContext(ostream &err = cerr);
+    ~CompileContext();
+
+    // Releases what the last unit checked left, and makes the context
+    // ready to check another as if it were new, but keeps its storage:
+    // the atom table, symbol table, line index, token buffer and arena
+    // are cleared, not freed. What the caller set up (the scanner to
+    // use, the streams, sink, incremental checker and so on) is kept.
+    // A caller that checks one unit after another can so reuse one
+    // context, and allocate nothing once it has grown to fit them.
+    void Reset();
+
+    // Scans, parses and checks the translation unit read from input.
+    // Returns the number of errors reported.
+    int CheckFile(FILE *input);
+    // Same, for a translation unit held in memory (len bytes at src).
+    // The source lines are not copied, so GetLineNumbered() can only be
+    // used while src is still around.
+    int CheckBuffer(const char *src, int len);
+    // Same, for the file at path, which is memory-mapped and scanned in
+    // place when possible. Returns -1 if the file cannot be opened.
+    int CheckPath(const char *path);
+    // CheckBuffer() in two steps, for a caller that looks at the tokens
+    // before going on: ScanBuffer() scans (and preprocesses) the whole
+    // input into tokens, whatever pretokenize says, and CheckScanned()
+    // parses and checks them
+    void ScanBuffer(const char *src, int len);
+    int CheckScanned();
+    // Just scans the len bytes at src into the buffer, with the scanner
+    // fastScan picks, and returns the number of tokens (counting the end
+    // of input). Nothing is reported; diagnostics are kept in the buffer.
+    int Tokenize(const char *src, size_t len, TokenBuffer *into);
+
+    int NumErrors() const { return numErrors; }
+    int NumLines() const { return lineStarts.size(); }
+
+    // Called by the parser, in streaming mode, for each top-level
+    // declaration as it is reduced and once the whole unit is parsed
+    bool IsStreaming() const;
+    void StreamDecl(Decl *d);
+    void FinishStream();
+
+    // Returns the text of source line num, or NULL if not available,
+    // and sets len to its length
+    const char *GetLineNumbered(int num, int *len) const;
+    // Returns the line of its own file that source line num is, which
+    // is num itself unless the unit was preprocessed, and sets path to
+    // the file's path if it was an included file, or NULL
+    int SourceLine(int num, const char **path) const;
+    // Fills in loc with the lines and columns of span, as the scanner
+    // counted them, and returns it. Nodes keep just the span (see ast.h).
+    yyltype *Locate(const SourceSpan &span, yyltype *loc) const;
+    // Returns the source line that the text at offset is on
+    int LineOf(unsigned int offset) const;
+    // Returns the line of its own file that decl is on, as SourceLine()
+    // does, including for one declared from an AST file
+    int DeclLine(const Decl *decl, const char **path) const;
+    // Whether the unit's diagnostics depend on files it included, or
+    // tried to: a file that could not be opened may be there next time
+    bool IncludedFiles() const;
+
+  private:
+    DeferredDiagnostics *deferred;
+    TokenBuffer *ownTokens;
+    Arena *ownArena;
+    bool preprocessing;             // preprocess, and it has directives
+    double parseStart;
+
+    void ReleaseUnit();
+    void IndexLines(const char *text, size_t len);
+    int ColumnOf(unsigned int offset, int line) const;
+    bool ScansAhead();
+    int Parse(double startMillis);
+    void BeginParse(double startMillis);
+    int FinishParse();
+    bool MapSource(int fd);
+    void UnmapSource();
+};
+
+#endif
@@ -5,191 +5,253 @@
  */
 
 #include "errors.h"
-#include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 using namespace std;
 
-#include "scanner.h" // for GetLineNumbered
+#include "context.h" // for GetLineNumbered
+#include "scanner.h" // for yyget_lloc
 #include "ast_type.h"
 #include "ast_expr.h"
 #include "ast_stmt.h"
 #include "ast_decl.h"
 
-int ReportError::numErrors = 0;
+/* Class: MessageStream
+ * --------------------
+ * Formats a message in the context's message string, which is emptied
+ * first but keeps its storage, so once the string has grown to fit the
+ * longest message, reporting an error allocates nothing.
+ */
+class MessageStream : public AppendStream
+{
+  public:
+    MessageStream(CompileContext *ctx) : AppendStream(ctx->message), msg(ctx->message) { msg.clear(); }
+    const string &str() const { return msg; }
+
+  private:
+    string &msg;
+};
 
-void ReportError::UnderlineErrorInLine(const char *line, yyltype *pos) {
+void ReportError::UnderlineErrorInLine(ostream &out, const char *line, int len, yyltype *pos) {
     if (!line) return;
-    cerr << line << endl;
+    out.write(line, strnlen(line, len)) << endl;    // up to a NUL, if it has one
     for (int i = 1; i <= pos->last_column; i++)
-        cerr << (i >= pos->first_column ? '^' : ' ');
-    cerr << endl;
+        out << (i >= pos->first_column ? '^' : ' ');
+    out << endl;
 }
 
  
  
-void ReportError::OutputError(yyltype *loc, string msg) {
-    numErrors++;
-    fflush(stdout); // make sure any buffered text has been output
+void ReportError::OutputError(CompileContext *ctx, yyltype *loc, const char *msg, errorKindT kind) {
+    ostream &out = *ctx->errStream;
+    ctx->numErrors++;
+    if (ctx->recorder)
+        ctx->recorder->Report(kind, loc, msg);
+    if (ctx->sink) {
+        ctx->sink->Report(kind, loc, msg);
+        return;
+    }
+    ctx->echoStream->flush(); // make sure any echoed text has been output
     if (loc) {
-        cerr << endl << "*** Error line " << loc->first_line << "." << endl;
-        UnderlineErrorInLine(GetLineNumbered(loc->first_line), loc);
+        const char *path;
+        out << endl << "*** Error line " << ctx->SourceLine(loc->first_line, &path);
+        if (path) out << " of " << path;
+        out << "." << endl;
+        int len;
+        const char *line = ctx->GetLineNumbered(loc->first_line, &len);
+        UnderlineErrorInLine(out, line, len, loc);
     } else
-        cerr << endl << "*** Error." << endl;
-    cerr << "*** " << msg << endl << endl;
+        out << endl << "*** Error." << endl;
+    out << "*** " << msg << endl << endl;
+}
+
+/* The semantic errors are all at a node, whose lines and columns are
+ * only worked out now, from its span.
+ */
+void ReportError::OutputError(CompileContext *ctx, Node *at, const char *msg) {
+    yyltype loc;
+    OutputError(ctx, at->GetLocation(ctx, &loc), msg);
 }
 
 
-void ReportError::Formatted(yyltype *loc, const char *format, ...) {
+void ReportError::Formatted(CompileContext *ctx, yyltype *loc, const char *format, ...) {
     va_list args;
     char errbuf[2048];
     
     va_start(args, format);
     vsprintf(errbuf,format, args);
     va_end(args);
-    OutputError(loc, errbuf);
+    OutputError(ctx, loc, errbuf);
+}
+
+void ReportError::Semantic(CompileContext *ctx, const SourceSpan &at, const string &msg) {
+    yyltype loc;
+    OutputError(ctx, at.first != NoOffset ? ctx->Locate(at, &loc) : NULL, msg.c_str());
+}
+
+void ReportError::Replay(CompileContext *ctx, errorKindT kind, yyltype *loc, const char *msg) {
+    OutputError(ctx, loc, msg, kind);
 }
 
-void ReportError::UntermComment() {
-    OutputError(NULL, "Input ends with unterminated comment");
+void ReportError::UntermComment(CompileContext *ctx) {
+    OutputError(ctx, NULL, "Input ends with unterminated comment", LexicalError);
 }
 
 
-void ReportError::LongIdentifier(yyltype *loc, const char *ident) {
-    ostringstream s;
+void ReportError::LongIdentifier(CompileContext *ctx, yyltype *loc, const char *ident) {
+    MessageStream s(ctx);
     s << "Identifier too long: \"" << ident << "\"";
-    OutputError(loc, s.str());
+    OutputError(ctx, loc, s.str().c_str(), LexicalError);
 }
 
-void ReportError::UntermString(yyltype *loc, const char *str) {
-    ostringstream s;
+void ReportError::UntermString(CompileContext *ctx, yyltype *loc, const char *str) {
+    MessageStream s(ctx);
     s << "Unterminated string constant: " << str;
-    OutputError(loc, s.str());
+    OutputError(ctx, loc, s.str().c_str(), LexicalError);
+}
+
+void ReportError::UnrecogChar(CompileContext *ctx, yyltype *loc, char ch) {
+    MessageStream s(ctx);
+    // A NUL is written as \0, since messages are passed on as C strings
+    s << "Unrecognized char: '";
+    if (ch == '\0')
+        s << "\\0";
+    else
+        s << ch;
+    s << "'";
+    OutputError(ctx, loc, s.str().c_str(), LexicalError);
+}
+
+void ReportError::PreprocessorError(CompileContext *ctx, yyltype *loc, const char *msg) {
+    OutputError(ctx, loc, msg, LexicalError);
 }
 
-void ReportError::UnrecogChar(yyltype *loc, char ch) {
-    ostringstream s;
-    s << "Unrecognized char: '" << ch << "'";
-    OutputError(loc, s.str());
+void ReportError::ParseError(CompileContext *ctx, yyltype *loc, const char *msg) {
+    OutputError(ctx, loc, msg, SyntaxError);
 }
 
-void ReportError::DeclConflict(Decl *decl, Decl *prevDecl) {
-    ostringstream s;
+void ReportError::DeclConflict(CompileContext *ctx, Decl *decl, Decl *prevDecl) {
+    MessageStream s(ctx);
+    const char *path;
     s << "Declaration of '" << decl << "' here conflicts with declaration on line " 
-      << prevDecl->GetLocation()->first_line;
-    OutputError(decl->GetLocation(), s.str());
+      << ctx->DeclLine(prevDecl, &path);
+    if (path) s << " of " << path;
+    OutputError(ctx, decl, s.str().c_str());
 }
 
-void ReportError::InvalidInitialization(Identifier *id, Type *lType, Type *rType) {
-    ostringstream s;
+void ReportError::InvalidInitialization(CompileContext *ctx, Identifier *id, Type *lType, Type *rType) {
+    MessageStream s(ctx);
     s << "Wrong initialization of identifier '" << id << "': idType '" 
       << lType << "' exprType '" << rType << "'" ;
-    OutputError(id->GetLocation(), s.str());
+    OutputError(ctx, id, s.str().c_str());
 }
 
-void ReportError::IdentifierNotDeclared(Identifier *ident, reasonT whyNeeded) {
-    ostringstream s;
+void ReportError::IdentifierNotDeclared(CompileContext *ctx, Identifier *ident, reasonT whyNeeded) {
+    MessageStream s(ctx);
     static const char *names[] =  {"type", "variable", "function"};
     Assert(whyNeeded >= 0 && whyNeeded <= sizeof(names)/sizeof(names[0]));
     s << "No declaration found for "<< names[whyNeeded] << " '" << ident << "'";
-    OutputError(ident->GetLocation(), s.str());
+    OutputError(ctx, ident, s.str().c_str());
 }
 
-void ReportError::ExtraFormals(Identifier *id, int expCount, int actualCount) {
-    ostringstream s;
+void ReportError::ExtraFormals(CompileContext *ctx, Identifier *id, int expCount, int actualCount) {
+    MessageStream s(ctx);
     s << "Extra arguments given to function '" << id << "': expected " 
       << expCount << ", given " << actualCount ;
-    OutputError(id->GetLocation(), s.str());
+    OutputError(ctx, id, s.str().c_str());
 }
 
-void ReportError::LessFormals(Identifier *id, int expCount, int actualCount) {
-    ostringstream s;
+void ReportError::LessFormals(CompileContext *ctx, Identifier *id, int expCount, int actualCount) {
+    MessageStream s(ctx);
     s << "Less arguments given to function '" << id << "': expected " 
       << expCount << ", given " << actualCount ;
-    OutputError(id->GetLocation(), s.str());
+    OutputError(ctx, id, s.str().c_str());
 }
 
-void ReportError::FormalsTypeMismatch(Identifier *id, int pos, Type *expType, Type *actualType)
+void ReportError::FormalsTypeMismatch(CompileContext *ctx, Identifier *id, int pos, Type *expType, Type *actualType)
 { 
-    ostringstream s;
+    MessageStream s(ctx);
     s << "Formal type mismatch in function '" << id << "' at pos " << pos 
       << ": expected '" << expType << "', given '" << actualType <<"'";
-    OutputError(id->GetLocation(), s.str());
+    OutputError(ctx, id, s.str().c_str());
 }
 
-void ReportError::NotAFunction(Identifier *id) {
-    ostringstream s;
+void ReportError::NotAFunction(CompileContext *ctx, Identifier *id) {
+    MessageStream s(ctx);
     s << "'" << id << "' is not a function.";
-    OutputError(id->GetLocation(), s.str());
+    OutputError(ctx, id, s.str().c_str());
 }
 
-void ReportError::NotAnArray(Identifier *id) {
-    ostringstream s;
+void ReportError::NotAnArray(CompileContext *ctx, Identifier *id) {
+    MessageStream s(ctx);
     s << "'" << id << "' is not an array.";
-    OutputError(id->GetLocation(), s.str());
+    OutputError(ctx, id, s.str().c_str());
 }
 
-void ReportError::IncompatibleOperands(Operator *op, Type *lhs, Type *rhs) {
-    ostringstream s;
+void ReportError::IncompatibleOperands(CompileContext *ctx, Operator *op, Type *lhs, Type *rhs) {
+    MessageStream s(ctx);
     s << "Incompatible operands: " << lhs << " " << op << " " << rhs;
-    OutputError(op->GetLocation(), s.str());
+    OutputError(ctx, op, s.str().c_str());
 }
      
-void ReportError::IncompatibleOperand(Operator *op, Type *rhs) {
-    ostringstream s;
+void ReportError::IncompatibleOperand(CompileContext *ctx, Operator *op, Type *rhs) {
+    MessageStream s(ctx);
     s << "Incompatible operand: " << op << " " << rhs;
-    OutputError(op->GetLocation(), s.str());
+    OutputError(ctx, op, s.str().c_str());
 }
 
-void ReportError::ReturnMismatch(ReturnStmt *rStmt, Type *given, Type *expected) {
-    ostringstream s;
+void ReportError::ReturnMismatch(CompileContext *ctx, ReturnStmt *rStmt, Type *given, Type *expected) {
+    MessageStream s(ctx);
     s << "Incompatible return: " << given << " given, " << expected << " expected";
-    OutputError(rStmt->GetLocation(), s.str());
+    OutputError(ctx, rStmt, s.str().c_str());
 }
 
-void ReportError::ReturnMissing(FnDecl *fnDecl) {
-    ostringstream s;
+void ReportError::ReturnMissing(CompileContext *ctx, FnDecl *fnDecl) {
+    MessageStream s(ctx);
+    const char *path;
     s << "Declaration of '" << fnDecl << "' on line " 
-      << fnDecl->GetLocation()->first_line
-      << " doesn't have a return";
-    OutputError(fnDecl->GetLocation(), s.str());
+      << ctx->SourceLine(ctx->LineOf(fnDecl->GetSpan().first), &path);
+    if (path) s << " of " << path;
+    s << " doesn't have a return";
+    OutputError(ctx, fnDecl, s.str().c_str());
 }
 
-void ReportError::InaccessibleSwizzle(Identifier *field, Expr *base) {
-    ostringstream s;
+void ReportError::InaccessibleSwizzle(CompileContext *ctx, Identifier *field, Expr *base) {
+    MessageStream s(ctx);
     s << base << " non-vector type can't have swizzle '" << field <<"'";
-    OutputError(field->GetLocation(), s.str());
+    OutputError(ctx, field, s.str().c_str());
 }
      
-void ReportError::InvalidSwizzle(Identifier *field, Expr *base) {
-    ostringstream s;
+void ReportError::InvalidSwizzle(CompileContext *ctx, Identifier *field, Expr *base) {
+    MessageStream s(ctx);
     s << base << " swizzle '" << field <<"' is not proper subset of [xyzw]";
-    OutputError(field->GetLocation(), s.str());
+    OutputError(ctx, field, s.str().c_str());
 }
      
-void ReportError::SwizzleOutOfBound(Identifier *field, Expr *base) {
-    ostringstream s;
+void ReportError::SwizzleOutOfBound(CompileContext *ctx, Identifier *field, Expr *base) {
+    MessageStream s(ctx);
     s << base << " swizzle '" << field <<"' exceeds its vector component";
-    OutputError(field->GetLocation(), s.str());
+    OutputError(ctx, field, s.str().c_str());
 }
 
-void ReportError::OversizedVector(Identifier *field, Expr *base) {
-    ostringstream s;
+void ReportError::OversizedVector(CompileContext *ctx, Identifier *field, Expr *base) {
+    MessageStream s(ctx);
     s << base << " swizzle '" << field <<"' generates a vector longer than vec4";
-    OutputError(field->GetLocation(), s.str());
+    OutputError(ctx, field, s.str().c_str());
 }
 
-void ReportError::TestNotBoolean(Expr *expr) {
-    OutputError(expr->GetLocation(), "Test expression must have boolean type");
+void ReportError::TestNotBoolean(CompileContext *ctx, Expr *expr) {
+    OutputError(ctx, expr, "Test expression must have boolean type");
 }
 
-void ReportError::BreakOutsideLoop(BreakStmt *bStmt) {
-    OutputError(bStmt->GetLocation(), "break is only allowed inside a loop");
+void ReportError::BreakOutsideLoop(CompileContext *ctx, BreakStmt *bStmt) {
+    OutputError(ctx, bStmt, "break is only allowed inside a loop");
 }
   
-void ReportError::ContinueOutsideLoop(ContinueStmt *cStmt) {
-    OutputError(cStmt->GetLocation(), "continue is only allowed inside a loop");
+void ReportError::ContinueOutsideLoop(CompileContext *ctx, ContinueStmt *cStmt) {
+    OutputError(ctx, cStmt, "continue is only allowed inside a loop");
 }
 
 /**
@@ -200,9 +262,18 @@ void ReportError::ContinueOutsideLoop(ContinueStmt *cStmt) {
  * the last token read. If you want to suppress the ordinary "parse error"
  * message from yacc, you can implement yyerror to do nothing and
  * then call ReportError::Formatted yourself with a more descriptive 
- * message.
+ * message. The parser is pure, so bison passes the lookahead location,
+ * the scanner and the context explicitly.
  */
 
-void yyerror(const char *msg) {
-    ReportError::Formatted(&yylloc, "%s", msg);
+void yyerror(yyltype *loc, void *scanner, CompileContext *ctx, const char *msg) {
+    ReportError::ParseError(ctx, loc, msg);
+}
+
+/* The error nodes in the AST report through this variant, which finds
+ * the location of the last token read through the context's scanner.
+ */
+void yyerror(CompileContext *ctx, const char *msg) {
+    yyltype *loc = (ctx->scanner ? yyget_lloc(ctx->scanner) : NULL);
+    ReportError::ParseError(ctx, loc, msg);
 }
@@ -13,6 +13,7 @@
 #ifndef _errors_h_
 #define _errors_h_
 
+#include <ostream>
 #include <string>
 #include "location.h"
 #include "ast_decl.h"
@@ -30,10 +31,16 @@ using namespace std;
  * the class name, e.g.
  *
  *    if (missingEnd) { 
- *       ReportError::UntermString(&yylloc, str);
+ *       ReportError::UntermString(ctx, yylloc, str);
  *    }
  *
- * For some methods, the first argument is the pointer to the location
+ * The first argument is always the CompileContext of the translation
+ * unit being compiled. The message goes to that context's error stream
+ * (or its DiagnosticSink, if it has one), bumps its error count, and the
+ * offending source line is taken from the lines that context's scanner
+ * saved.
+ *
+ * For some methods, the next argument is the pointer to the location
  * structure that identifies where the problem is (usually this is the
  * location of the offending token). You can pass NULL for the argument
  * if there is no appropriate position to point out. For other methods,
@@ -41,6 +48,7 @@ using namespace std;
  * as an argument. You cannot pass NULL for these arguments.
  */
 
+class CompileContext;
 class Type;
 class Identifier;
 class Expr;
@@ -49,6 +57,7 @@ class ContinueStmt;
 class ReturnStmt;
 class Decl;
 class Operator;
+class Node;
 
 typedef enum {
       LookingForType,
@@ -56,59 +65,118 @@ typedef enum {
       LookingForFunction
 } reasonT;
 
+typedef enum {
+      LexicalError,
+      SyntaxError,
+      SemanticError
+} errorKindT;
+
+/**
+ * Class: DiagnosticSink
+ * ---------------------
+ * If a CompileContext has a sink, each error is handed to it as a
+ * structured record (kind, location and message) instead of being
+ * formatted onto the context's error stream. The location is NULL for
+ * errors that have no position, and the message is only valid for the
+ * duration of the call.
+ */
+class DiagnosticSink {
+ public:
+  virtual ~DiagnosticSink() {}
+  virtual void Report(errorKindT kind, yyltype *loc, const char *msg) = 0;
+};
+
+/**
+ * Class: AppendStream
+ * -------------------
+ * An ostream that appends what is written to it to a string the caller
+ * owns. Unlike an ostringstream, which hands its text out only as a new
+ * string, it lets the caller clear the string and write to it again
+ * without giving up its storage.
+ */
+class AppendStream : public ostream {
+ public:
+  AppendStream(string &text) : ostream(&buf), buf(text) {}
+
+ private:
+  struct Buf : public streambuf {
+    string &text;
+    Buf(string &t) : text(t) {}
+    int overflow(int c) {
+      if (c != traits_type::eof()) text.push_back(c);
+      return c;
+    }
+    streamsize xsputn(const char *s, streamsize n) {
+      text.append(s, n);
+      return n;
+    }
+  } buf;
+};
+
 class ReportError {
  public:
 
   // Errors used by scanner
-  static void UntermComment(); 
-  static void LongIdentifier(yyltype *loc, const char *ident);
-  static void UntermString(yyltype *loc, const char *str);
-  static void UnrecogChar(yyltype *loc, char ch);
+  static void UntermComment(CompileContext *ctx); 
+  static void LongIdentifier(CompileContext *ctx, yyltype *loc, const char *ident);
+  static void UntermString(CompileContext *ctx, yyltype *loc, const char *str);
+  static void UnrecogChar(CompileContext *ctx, yyltype *loc, char ch);
+
+  // Errors used by preprocessor
+  static void PreprocessorError(CompileContext *ctx, yyltype *loc, const char *msg);
+
+  // Errors used by parser (via yyerror)
+  static void ParseError(CompileContext *ctx, yyltype *loc, const char *msg);
 
   // Errors used by semantic analyzer for declarations
-  static void DeclConflict(Decl *newDecl, Decl *prevDecl);
-  static void InvalidInitialization(Identifier *id, Type *lType, Type *rType);
+  static void DeclConflict(CompileContext *ctx, Decl *newDecl, Decl *prevDecl);
+  static void InvalidInitialization(CompileContext *ctx, Identifier *id, Type *lType, Type *rType);
   
   
   // Errors used by semantic analyzer for identifiers
-  static void IdentifierNotDeclared(Identifier *ident, reasonT whyNeeded);
+  static void IdentifierNotDeclared(CompileContext *ctx, Identifier *ident, reasonT whyNeeded);
 
   // Errors used by semantic analyzer for arrays
-  static void NotAnArray(Identifier *id);
+  static void NotAnArray(CompileContext *ctx, Identifier *id);
               
   // Errors used by semantic analyzer for expressions
-  static void IncompatibleOperand(Operator *op, Type *rhs); // unary
-  static void IncompatibleOperands(Operator *op, Type *lhs, Type *rhs); // binary
+  static void IncompatibleOperand(CompileContext *ctx, Operator *op, Type *rhs); // unary
+  static void IncompatibleOperands(CompileContext *ctx, Operator *op, Type *lhs, Type *rhs); // binary
 
   // Errors used by semantic analyzer for function calls
-  static void ExtraFormals(Identifier *id, int expCount, int actualCount); 
-  static void LessFormals(Identifier *id, int expCount, int actualCount); 
-  static void FormalsTypeMismatch(Identifier *id, int pos, Type *expType, Type *actualType); 
-  static void NotAFunction(Identifier *id); 
+  static void ExtraFormals(CompileContext *ctx, Identifier *id, int expCount, int actualCount); 
+  static void LessFormals(CompileContext *ctx, Identifier *id, int expCount, int actualCount); 
+  static void FormalsTypeMismatch(CompileContext *ctx, Identifier *id, int pos, Type *expType, Type *actualType); 
+  static void NotAFunction(CompileContext *ctx, Identifier *id); 
   
   // Errors used by semantic analyzer for vector access
-  static void InaccessibleSwizzle(Identifier *swizzle, Expr *base);
-  static void InvalidSwizzle(Identifier *swizzle, Expr *base);
-  static void SwizzleOutOfBound(Identifier *swizzle, Expr *base);
-  static void OversizedVector(Identifier *swizzle, Expr *base);
+  static void InaccessibleSwizzle(CompileContext *ctx, Identifier *swizzle, Expr *base);
+  static void InvalidSwizzle(CompileContext *ctx, Identifier *swizzle, Expr *base);
+  static void SwizzleOutOfBound(CompileContext *ctx, Identifier *swizzle, Expr *base);
+  static void OversizedVector(CompileContext *ctx, Identifier *swizzle, Expr *base);
   
   // Errors used by semantic analyzer for control structures
-  static void TestNotBoolean(Expr *testExpr);
-  static void ReturnMismatch(ReturnStmt *rStmt, Type *given, Type *expected);
-  static void ReturnMissing(FnDecl *fnDecl);
-  static void BreakOutsideLoop(BreakStmt *bStmt); 
-  static void ContinueOutsideLoop(ContinueStmt *cStmt); 
+  static void TestNotBoolean(CompileContext *ctx, Expr *testExpr);
+  static void ReturnMismatch(CompileContext *ctx, ReturnStmt *rStmt, Type *given, Type *expected);
+  static void ReturnMissing(CompileContext *ctx, FnDecl *fnDecl);
+  static void BreakOutsideLoop(CompileContext *ctx, BreakStmt *bStmt); 
+  static void ContinueOutsideLoop(CompileContext *ctx, ContinueStmt *cStmt); 
 
   // Generic method to report a printf-style error message
-  static void Formatted(yyltype *loc, const char *format, ...);
+  static void Formatted(CompileContext *ctx, yyltype *loc, const char *format, ...);
 
+  // Reports a semantic error at a span, for the flat checker (see
+  // flatast.h), which has no nodes to pass to the methods above
+  static void Semantic(CompileContext *ctx, const SourceSpan &at, const string &msg);
+
+  // Reports again an error recorded by a DiagnosticSink on an earlier
+  // compilation (used by the incremental checker)
+  static void Replay(CompileContext *ctx, errorKindT kind, yyltype *loc, const char *msg);
 
-  // Returns number of error messages printed
-  static int NumErrors() { return numErrors; }
-  
  private:
-  static void UnderlineErrorInLine(const char *line, yyltype *pos);
-  static void OutputError(yyltype *loc, string msg);
-  static int numErrors;
+  static void UnderlineErrorInLine(ostream &out, const char *line, int len, yyltype *pos);
+  static void OutputError(CompileContext *ctx, yyltype *loc, const char *msg,
+                          errorKindT kind = SemanticError);
+  static void OutputError(CompileContext *ctx, Node *at, const char *msg);
 };
 #endif
@@ -0,0 +1,625 @@
+/* File: fastscan.cc
+ * -----------------
+ * Implementation of the hand-written scanner. It follows the rules in
+ * scanner.l, and where more than one could match, it takes the one flex
+ * would: the longest match, or of those, the rule listed first.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sstream>
+#include <thread>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "fastscan.h"
+#include "context.h"
+#include "scanner.h"
+#include "errors.h"
+#include "atoms.h"
+#include "keywords.h"
+#include "parser.h" // for token codes, YYSTYPE
+#include "tokens.h"
+
+// The character classes the rules are made of
+enum {
+    IdentStart = 1,                 // [a-zA-Z]
+    IdentChar = 2,                  // [a-zA-Z_0-9]
+    Digit = 4,                      // [0-9]
+    HexDigit = 8,                   // [0-9a-fA-F]
+    Blank = 16                      // [ \t\n], which never make a token
+};
+
+/* Class: ScanTables
+ * -----------------
+ * The class of each character. Built once, during static
+ * initialization, and only read after that.
+ */
+static struct ScanTables {
+    unsigned char classOf[256];
+
+    ScanTables() {
+        memset(classOf, 0, sizeof(classOf));
+        for (int c = 'a'; c <= 'z'; c++)
+            classOf[c] = classOf[c - 'a' + 'A'] = IdentStart | IdentChar;
+        for (int c = 'a'; c <= 'f'; c++)
+            classOf[c] |= HexDigit, classOf[c - 'a' + 'A'] |= HexDigit;
+        for (int c = '0'; c <= '9'; c++)
+            classOf[c] = IdentChar | Digit | HexDigit;
+        classOf['_'] = IdentChar;
+        classOf[' '] = classOf['\t'] = classOf['\n'] = Blank;
+    }
+} tables;
+
+static inline bool IsClass(char c, int cls)
+{
+    return tables.classOf[(unsigned char)c] & cls;
+}
+
+static inline const char *SkipClass(const char *p, const char *end, int cls)
+{
+    while (p < end && IsClass(*p, cls)) p++;
+    return p;
+}
+
+/* Vectors
+ * -------
+ * Blanks and comment bodies are skipped a vector at a time: 32 bytes
+ * with AVX2, or 16 with SSE2. Equal() gives a mask with bit i set if
+ * byte i of the two vectors is the same.
+ */
+#if defined(__AVX2__)
+#define HAVE_VECTORS
+typedef __m256i Vector;
+static const int VectorSize = 32;
+static const unsigned AllLanes = 0xffffffffu;
+static inline Vector Load(const char *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline Vector Splat(char c) { return _mm256_set1_epi8(c); }
+static inline unsigned Equal(Vector a, Vector b) { return _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)); }
+#elif defined(__SSE2__)
+#define HAVE_VECTORS
+typedef __m128i Vector;
+static const int VectorSize = 16;
+static const unsigned AllLanes = 0xffffu;
+static inline Vector Load(const char *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline Vector Splat(char c) { return _mm_set1_epi8(c); }
+static inline unsigned Equal(Vector a, Vector b) { return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)); }
+#endif
+
+/* Function: SkipBlanks()
+ * ----------------------
+ * Returns the first character from p on that isn't a space, tab or
+ * newline, or end if there is none. Most runs of blanks are a single
+ * space, so the first character is tried on its own.
+ */
+static const char *SkipBlanks(const char *p, const char *end)
+{
+    if (p == end || !IsClass(*p, Blank)) return p;
+    p++;
+#ifdef HAVE_VECTORS
+    const Vector space = Splat(' '), tab = Splat('\t'), newline = Splat('\n');
+    for (; p + VectorSize <= end; p += VectorSize) {
+        Vector chunk = Load(p);
+        unsigned mask = ~(Equal(chunk, space) | Equal(chunk, tab) | Equal(chunk, newline)) & AllLanes;
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+    return SkipClass(p, end, Blank);
+}
+
+/* Function: FindNewline()
+ * -----------------------
+ * Returns the first newline from p on, or end if there is none: the end
+ * of a // comment.
+ */
+static const char *FindNewline(const char *p, const char *end)
+{
+#ifdef HAVE_VECTORS
+    const Vector newline = Splat('\n');
+    for (; p + VectorSize <= end; p += VectorSize) {
+        unsigned mask = Equal(Load(p), newline);
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+    while (p < end && *p != '\n') p++;
+    return p;
+}
+
+/* Function: FindCommentEnd()
+ * --------------------------
+ * Returns the first "*" + "/" from p on, or end if there is none. A
+ * vector of the text is compared with '*' and the same vector one byte
+ * on with '/', so both halves are found in one pass.
+ */
+static const char *FindCommentEnd(const char *p, const char *end)
+{
+#ifdef HAVE_VECTORS
+    const Vector star = Splat('*'), slash = Splat('/');
+    for (; p + VectorSize + 1 <= end; p += VectorSize) {
+        unsigned mask = Equal(Load(p), star) & Equal(Load(p + 1), slash);
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p + 1 < end; p++)
+        if (p[0] == '*' && p[1] == '/') return p;
+    return end;
+}
+
+/* Function: Terminated()
+ * ----------------------
+ * Returns the text from start to end as a C string, for the library
+ * routines that convert constants: copied into buf if it fits, or into
+ * big if not.
+ */
+static const char *Terminated(const char *start, const char *end, char *buf, size_t size, string &big)
+{
+    size_t len = end - start;
+    if (len >= size) {
+        big.assign(start, len);
+        return big.c_str();
+    }
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    return buf;
+}
+
+/* Function: ScanNumber()
+ * ----------------------
+ * Scans the constant starting with the digit at start into value, and
+ * returns its token code, with next set to the character after it. Of
+ * {INTEGER}, {HEX_INTEGER} and {FLOAT}, flex takes the longest, and
+ * {HEX_INTEGER} and {FLOAT} can't both match, so whichever of those does
+ * wins. The value is converted as scanner.l does it, except that a short
+ * decimal integer is simply added up.
+ */
+static int ScanNumber(const char *start, const char *end, const char **next, YYSTYPE *value)
+{
+    char buf[64];
+    string big;
+    const char *p = SkipClass(start, end, Digit);
+    if (p == start + 1 && *start == '0' && p + 1 < end && (*p == 'x' || *p == 'X') &&
+        IsClass(p[1], HexDigit)) {
+        *next = SkipClass(p + 1, end, HexDigit);
+        value->integerConstant = strtol(Terminated(start, *next, buf, sizeof(buf), big), NULL, 16);
+        return T_IntConstant;
+    }
+    if (p < end && *p == '.') {
+        p = SkipClass(p + 1, end, Digit);
+        if (p < end && (*p == 'f' || *p == 'F')) p++;
+        *next = p;
+        value->floatConstant = atof(Terminated(start, p, buf, sizeof(buf), big));
+        return T_FloatConstant;
+    }
+    *next = p;
+    if (p - start <= 9) {
+        int n = 0;
+        for (const char *d = start; d < p; d++)
+            n = n * 10 + (*d - '0');
+        value->integerConstant = n;
+    } else
+        value->integerConstant = strtol(Terminated(start, p, buf, sizeof(buf), big), NULL, 10);
+    return T_IntConstant;
+}
+
+/* Function: InternIdentifier()
+ * ----------------------------
+ * As in scanner.l: complains if the identifier from start to end is too
+ * long, and returns the atom for its first MaxIdentLen chars.
+ */
+static const char *InternIdentifier(CompileContext *ctx, TokenBuffer *tokens, const char *text,
+                                    const char *start, const char *end)
+{
+    int len = end - start;
+    if (len > 1023) {
+        yyltype loc = yyltype();    // only tested for NULL while scanning ahead
+        tokens->At(start - text, len);
+        ReportError::LongIdentifier(ctx, &loc, string(start, len).c_str());
+    }
+    return ctx->atoms->Intern(start, len < MaxIdentLen ? len : MaxIdentLen);
+}
+
+// Where the scan of a part of the text is, at its start or end
+typedef enum {
+    Outside,                        // of a comment, and not after a '.'
+    InFields,                       // FIELDS, after a '.'
+    InComment                       // a block comment
+} scanStateT;
+
+// Inputs smaller than this are never split into chunks
+static const size_t MinChunkedScan = 1 << 20;
+
+// If the character at p is c, moves past it and returns true
+static inline bool Follows(const char *&p, const char *end, char c)
+{
+    if (p == end || *p != c) return false;
+    p++;
+    return true;
+}
+
+static inline int Op(YYSTYPE *value, opcodeT opcode, int kind)
+{
+    value->opcode = opcode;
+    return kind;
+}
+
+/* Function: ScanRange()
+ * ----------------------
+ * Scans the text from p up to end, in the given state, into tokens, at
+ * their offsets from text. The INITIAL and N states of scanner.l have
+ * the same rules, so there are only two states to keep track of here:
+ * FIELDS, just after a '.', and the rest. A block comment is skipped
+ * whole rather than entering COMM, unless it doesn't end before end.
+ * Returns the state at end. Identifiers are interned in ctx's atoms.
+ */
+static scanStateT ScanRange(CompileContext *ctx, TokenBuffer *tokens, const char *text,
+                            const char *p, const char *end, scanStateT state)
+{
+    bool fields = (state == InFields);
+    YYSTYPE value;
+    memset(&value, 0, sizeof(value));
+    if (state == InComment) {
+        if ((p = FindCommentEnd(p, end)) == end) return InComment;
+        p += 2;
+    }
+    while ((p = SkipBlanks(p, end)) < end) {
+        const char *start = p;
+        int kind = 0;
+        if (fields) {
+            if (IsClass(*p, IdentStart)) {
+                p = SkipClass(p + 1, end, IdentChar);
+                value.atom = InternIdentifier(ctx, tokens, text, start, p);
+                tokens->Add(T_FieldSelection, start - text, p - start, value);
+                fields = false;
+            } else if (*p++ != '\r') {
+                // flex's default rule copies anything else to the output
+                tokens->At(start - text, 1);
+                tokens->Echo(start, 1);
+            }
+            continue;
+        }
+
+        if (IsClass(*p, IdentStart)) {
+            p = SkipClass(p + 1, end, IdentChar);
+            kind = LookupKeyword(start, p - start);
+            if (kind == T_BoolConstant)
+                value.boolConstant = (*start == 't');
+            else if (kind == 0) {
+                value.atom = InternIdentifier(ctx, tokens, text, start, p);
+                kind = T_Identifier;
+            }
+            tokens->Add(kind, start - text, p - start, value);
+            continue;
+        }
+        if (IsClass(*p, Digit)) {
+            kind = ScanNumber(start, end, &p, &value);
+            tokens->Add(kind, start - text, p - start, value);
+            continue;
+        }
+        if (*p == '/' && p + 1 < end && (p[1] == '/' || p[1] == '*')) {
+            if (p[1] == '/')
+                p = FindNewline(p + 2, end);
+            else if ((p = FindCommentEnd(p + 2, end)) < end)
+                p += 2;
+            else
+                return InComment;
+            continue;
+        }
+
+        switch (*p++) {
+          case '(': kind = T_LeftParen; break;
+          case ')': kind = T_RightParen; break;
+          case ':': kind = T_Colon; break;
+          case ';': kind = T_Semicolon; break;
+          case '{': kind = T_LeftBrace; break;
+          case '}': kind = T_RightBrace; break;
+          case '[': kind = T_LeftBracket; break;
+          case ']': kind = T_RightBracket; break;
+          case ',': kind = T_Comma; break;
+          case '?': kind = T_Question; break;
+          case '.': kind = T_Dot; fields = true; break;
+          case '<':
+            kind = (Follows(p, end, '=') ? Op(&value, OpLessEqual, T_LessEqual) : Op(&value, OpLess, T_LeftAngle));
+            break;
+          case '>':
+            kind = (Follows(p, end, '=') ? Op(&value, OpGreaterEqual, T_GreaterEqual) : Op(&value, OpGreater, T_RightAngle));
+            break;
+          case '=':
+            kind = (Follows(p, end, '=') ? Op(&value, OpEqual, T_EQ) : Op(&value, OpAssign, T_Equal));
+            break;
+          case '!':
+            if (Follows(p, end, '=')) kind = Op(&value, OpNotEqual, T_NE);
+            break;
+          case '&':
+            if (Follows(p, end, '&')) kind = Op(&value, OpAnd, T_And);
+            break;
+          case '|':
+            if (Follows(p, end, '|')) kind = Op(&value, OpOr, T_Or);
+            break;
+          case '+':
+            if (Follows(p, end, '+')) kind = Op(&value, OpInc, T_Inc);
+            else if (Follows(p, end, '=')) kind = Op(&value, OpAddAssign, T_AddAssign);
+            else kind = Op(&value, OpPlus, T_Plus);
+            break;
+          case '-':
+            if (Follows(p, end, '-')) kind = Op(&value, OpDec, T_Dec);
+            else if (Follows(p, end, '=')) kind = Op(&value, OpSubAssign, T_SubAssign);
+            else kind = Op(&value, OpMinus, T_Dash);
+            break;
+          case '*':
+            kind = (Follows(p, end, '=') ? Op(&value, OpMulAssign, T_MulAssign) : Op(&value, OpTimes, T_Star));
+            break;
+          case '/':
+            kind = (Follows(p, end, '=') ? Op(&value, OpDivAssign, T_DivAssign) : Op(&value, OpDivide, T_Slash));
+            break;
+        }
+        if (kind == 0) {
+            yyltype loc = yyltype();
+            p = start + 1;
+            tokens->At(start - text, 1);
+            ReportError::UnrecogChar(ctx, &loc, *start);
+            continue;
+        }
+        tokens->Add(kind, start - text, p - start, value);
+    }
+    return (fields ? InFields : Outside);
+}
+
+/* Function: EndScan()
+ * -------------------
+ * Finishes a scan of the whole text that ended in state: reports a
+ * comment that was never closed, and adds the end of input.
+ */
+static void EndScan(CompileContext *ctx, TokenBuffer *tokens, scanStateT state)
+{
+    if (state == InComment) {
+        tokens->At(ctx->sourceLen, 0);
+        ReportError::UntermComment(ctx);
+    }
+    YYSTYPE value;
+    memset(&value, 0, sizeof(value));
+    tokens->Add(0, ctx->sourceLen, 0, value);
+    tokens->EndScan(ctx);
+}
+
+void FastScanTokens(CompileContext *ctx, TokenBuffer *tokens)
+{
+    if (ctx->scanThreads > 1 && ctx->sourceLen >= MinChunkedScan) {
+        ChunkedScanTokens(ctx, tokens, ctx->scanThreads);
+        return;
+    }
+    const char *text = ctx->sourceText;
+    tokens->BeginScan(ctx);
+    EndScan(ctx, tokens, ScanRange(ctx, tokens, text, text, text + ctx->sourceLen, Outside));
+}
+
+/* Struct: Chunk
+ * -------------
+ * A part of the text, from the start of a line, scanned on a thread of
+ * its own by ChunkedScanTokens(), as if it began outside any comment.
+ * Its identifiers are interned in a table of its own.
+ */
+struct Chunk {
+    size_t begin, end;
+    TokenBuffer tokens;
+    AtomTable atoms;
+    scanStateT endState;
+};
+
+static void ScanChunk(const char *text, Chunk *c, scanStateT state)
+{
+    // The diagnostics go to the chunk's buffer, through a context of its
+    // own, which is lent the chunk's atom table
+    ostringstream ignored;
+    CompileContext scratch(ignored);
+    AtomTable *own = scratch.atoms;
+    scratch.atoms = &c->atoms;
+    scratch.sourceText = text + c->begin;
+    scratch.sourceLen = c->end - c->begin;
+    c->tokens.BeginScan(&scratch);
+    c->endState = ScanRange(&scratch, &c->tokens, text, text + c->begin, text + c->end, state);
+    c->tokens.EndScan(&scratch);
+    scratch.atoms = own;
+}
+
+/* Function: JoinChunk()
+ * ---------------------
+ * Appends the chunk's tokens and events to tokens, which has room for
+ * them, with each of its atoms replaced by the context's atom of the
+ * same spelling. That is interned the first time the chunk's atom is
+ * met, in the order the serial scan would have met it, and kept in the
+ * chunk's atom's forwarding slot, so the other occurrences cost a load.
+ */
+static void JoinChunk(CompileContext *ctx, TokenBuffer *tokens, Chunk &c)
+{
+    for (int e = 0; e < c.tokens.NumEvents(); e++)
+        tokens->CopyEvent(c.tokens, e, c.tokens.EventOffset(e));
+    size_t first = tokens->NumTokens();
+    tokens->kinds.insert(tokens->kinds.end(), c.tokens.kinds.begin(), c.tokens.kinds.end());
+    tokens->offsets.insert(tokens->offsets.end(), c.tokens.offsets.begin(), c.tokens.offsets.end());
+    tokens->lengths.insert(tokens->lengths.end(), c.tokens.lengths.begin(), c.tokens.lengths.end());
+    tokens->values.insert(tokens->values.end(), c.tokens.values.begin(), c.tokens.values.end());
+    int numIdentifiers = 0;
+    for (size_t t = first; t < tokens->NumTokens(); t++)
+        if (tokens->kinds[t] == T_Identifier || tokens->kinds[t] == T_FieldSelection) {
+            const char *&atom = AtomTable::Forward(tokens->values[t].atom);
+            if (!atom) {
+                unsigned int n = tokens->lengths[t];
+                atom = ctx->atoms->Intern(tokens->values[t].atom, n < MaxIdentLen ? n : MaxIdentLen);
+            } else
+                numIdentifiers++;
+            tokens->values[t].atom = atom;
+        }
+    ctx->atoms->CountInterned(numIdentifiers);
+}
+
+/* Function: ChunkedScanTokens()
+ * -----------------------------
+ * The first chunk is scanned on the calling thread, straight into the
+ * buffer, and the others at the same time on threads of their own. A
+ * chunk can only be scanned wrong at the start, if it begins inside a
+ * block comment, or just after a '.'. Once every thread is done, the
+ * state each chunk ends in is known in turn, and a chunk that was
+ * assumed to begin in another state is scanned again from the right
+ * one. Then the buffer is grown once to fit them all, and the chunks
+ * are joined on (see JoinChunk()).
+ */
+void ChunkedScanTokens(CompileContext *ctx, TokenBuffer *tokens, int numChunks)
+{
+    const char *text = ctx->sourceText;
+    size_t len = ctx->sourceLen;
+    vector<size_t> starts(1, 0);
+    for (int i = 1; i < numChunks; i++) {
+        size_t at = len / numChunks * i;
+        if (at < starts.back()) at = starts.back();
+        const char *newline = (const char *)memchr(text + at, '\n', len - at);
+        if (newline && newline + 1 < text + len)
+            starts.push_back(newline + 1 - text);
+    }
+    starts.push_back(len);
+
+    vector<Chunk> chunks(starts.size() - 2);
+    vector<thread> workers;
+    for (int i = 0; i < chunks.size(); i++) {
+        chunks[i].begin = starts[i+1];
+        chunks[i].end = starts[i+2];
+        workers.push_back(thread(ScanChunk, text, &chunks[i], Outside));
+    }
+    tokens->BeginScan(ctx);
+    scanStateT state = ScanRange(ctx, tokens, text, text, text + starts[1], Outside);
+    size_t numTokens = tokens->NumTokens() + 1;     // and the end of input
+    for (int i = 0; i < chunks.size(); i++) {
+        Chunk &c = chunks[i];
+        workers[i].join();
+        if (state != Outside)
+            ScanChunk(text, &c, state);
+        numTokens += c.tokens.NumTokens();
+        state = c.endState;
+    }
+    tokens->kinds.reserve(numTokens);
+    tokens->offsets.reserve(numTokens);
+    tokens->lengths.reserve(numTokens);
+    tokens->values.reserve(numTokens);
+    for (int i = 0; i < chunks.size(); i++)
+        JoinChunk(ctx, tokens, chunks[i]);
+    EndScan(ctx, tokens, state);
+}
+
+
+// Text inserted by Mutate(): where the rules of the scanner meet
+static const char *fragments[] = {
+    "/*", "*/", "//", "\n", "\t", " ", "\r", ".", "..", "0x", "0X1f", "07",
+    "1.", "2.5f", "1e5", "_", "!", "&", "|", "=", "+", "-", "*", "/", "<",
+    ">", "?", "\xff", "int", "vec3", "true", "falsey", "x1", "a.b", "9999999999"
+};
+static const int NumFragments = sizeof(fragments) / sizeof(fragments[0]);
+
+static unsigned Random(unsigned long long &seed)
+{
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return seed >> 33;
+}
+
+/* Function: Mutate()
+ * ------------------
+ * Makes one random change to text: inserts a fragment, a NUL or an
+ * overlong identifier, deletes a few bytes, or repeats a stretch. The
+ * same seed always gives the same changes.
+ */
+static void Mutate(string &text, unsigned long long &seed)
+{
+    size_t at = (text.empty() ? 0 : Random(seed) % (text.size() + 1));
+    size_t len = 1 + Random(seed) % 8;
+    switch (Random(seed) % 5) {
+      case 0: case 1: {
+        int which = Random(seed) % (NumFragments + 2);
+        if (which < NumFragments)
+            text.insert(at, fragments[which]);
+        else if (which == NumFragments)
+            text.insert(at, 1, '\0');
+        else
+            text.insert(at, 1100, 'q');
+        break;
+      }
+      case 2: case 3:
+        text.erase(at, len);
+        break;
+      default:
+        if (at < text.size())
+            text.insert(at, text.substr(at, len * 4));
+    }
+}
+
+static void PrintDifference(const char *name, int variant, const TokenBuffer &flex,
+                            const TokenBuffer &fast, const char *scanner)
+{
+    int i = 0;
+    while (i < flex.NumTokens() && i < fast.NumTokens() && flex.kinds[i] == fast.kinds[i] &&
+           flex.offsets[i] == fast.offsets[i] && flex.lengths[i] == fast.lengths[i])
+        i++;
+    fprintf(stderr, "*** %s, variant %d: ", name, variant);
+    if (i == flex.NumTokens() && i == fast.NumTokens()) {
+        fprintf(stderr, "same tokens, but a value or diagnostic differs\n");
+        return;
+    }
+    fprintf(stderr, "token %d is", i);
+    if (i < flex.NumTokens())
+        fprintf(stderr, " %d at %u+%u", flex.kinds[i], flex.offsets[i], flex.lengths[i]);
+    fprintf(stderr, " with flex, but");
+    if (i < fast.NumTokens())
+        fprintf(stderr, " %d at %u+%u", fast.kinds[i], fast.offsets[i], fast.lengths[i]);
+    fprintf(stderr, " with the %s\n", scanner);
+}
+
+// However small the input, the test scans it in this many chunks too
+static const int TestChunks = 4;
+
+int RunScannerTest(const vector<string> &files, int rounds)
+{
+    ostringstream ignored;
+    CompileContext ctx(ignored);
+    TokenBuffer flex, fast, chunked;
+    unsigned long long seed = 1;
+    int numInputs = 0, mismatches = 0;
+    long numTokens = 0;
+    for (int f = 0; f < files.size(); f++) {
+        FILE *input = fopen(files[f].c_str(), "r");
+        if (!input) {
+            fprintf(stderr, "*** Cannot open file '%s'\n", files[f].c_str());
+            return 2;
+        }
+        string source;
+        char buf[65536];
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), input)) > 0)
+            source.append(buf, len);
+        fclose(input);
+
+        for (int r = 0; r <= rounds; r++) {
+            string variant = source;
+            for (int edits = (r == 0 ? 0 : 1 + Random(seed) % 4); edits > 0; edits--)
+                Mutate(variant, seed);
+            // Both scans use the one context, so the atoms are comparable
+            ctx.fastScan = false;
+            ctx.Tokenize(variant.data(), variant.size(), &flex);
+            ctx.fastScan = true;
+            ctx.Tokenize(variant.data(), variant.size(), &fast);
+            numInputs++;
+            numTokens += flex.NumTokens();
+            if (!fast.SameAs(flex)) {
+                mismatches++;
+                PrintDifference(files[f].c_str(), r, flex, fast, "hand-written scanner");
+            }
+            ChunkedScanTokens(&ctx, &chunked, TestChunks);
+            if (!chunked.SameAs(flex)) {
+                mismatches++;
+                PrintDifference(files[f].c_str(), r, flex, chunked, "chunked scan");
+            }
+        }
+    }
+    printf("=== %d input(s), %ld token(s) compared, %d mismatch(es) ===\n",
+           numInputs, numTokens, mismatches);
+    return (mismatches == 0 ? 0 : -1);
+}
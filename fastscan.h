@@ -0,0 +1,64 @@
+/* File: fastscan.h
+ * ----------------
+ * A hand-written scanner that can stand in for the flex scanner when the
+ * input is scanned ahead into a TokenBuffer (see tokens.h). It gives the
+ * same tokens, at the same offsets and with the same values, and reports
+ * the same lexical errors at the same places, so the parser and the
+ * locations it is given can't tell the two apart.
+ *
+ * Most of the bytes of a typical shader are blanks and comments, which
+ * flex takes one match (and, in a block comment, one character) at a
+ * time. This scanner skips them a vector at a time (SSE2, or AVX2 where
+ * the target has it), and steps through identifiers and numbers with a
+ * character class table.
+ *
+ * A CompileContext uses it if its fastScan flag is set (see context.h).
+ * It is off by default unless glc is built with make SCANNER=fast.
+ *
+ * A large input can also be scanned on several threads at once, in
+ * chunks that start at line breaks (see ChunkedScanTokens()). No token
+ * spans a line break, so the only state a chunk can begin in, other
+ * than the usual one, is inside a block comment or just after a '.';
+ * a chunk that guessed wrong is scanned again once the one before it
+ * is done. The tokens, diagnostics and atoms are the same as from one
+ * scan of the whole input.
+ */
+
+#ifndef _H_fastscan
+#define _H_fastscan
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class CompileContext;
+class TokenBuffer;
+
+/* Function: FastScanTokens()
+ * --------------------------
+ * Does what ScanTokens() does with the flex scanner: scans the context's
+ * whole source text into tokens, ending with the end of input (token 0).
+ */
+void FastScanTokens(CompileContext *ctx, TokenBuffer *tokens);
+
+/* Function: ChunkedScanTokens()
+ * -----------------------------
+ * Does what FastScanTokens() does, with the source text cut into about
+ * numChunks chunks at line breaks, each scanned on a thread of its own.
+ * FastScanTokens() calls this when the context's scanThreads is over 1
+ * and the input is large enough for the threads to pay for themselves.
+ */
+void ChunkedScanTokens(CompileContext *ctx, TokenBuffer *tokens, int numChunks);
+
+/* Function: RunScannerTest()
+ * --------------------------
+ * Scans each file with both scanners, and in chunks with the hand-written
+ * one, and compares the results token for token, then does the same for
+ * rounds variants of each file with bytes inserted, deleted and repeated
+ * at random. Prints any differences and a summary; returns 0 if there
+ * were none.
+ */
+int RunScannerTest(const vector<string> &files, int rounds);
+
+#endif
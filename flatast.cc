@@ -0,0 +1,967 @@
+/* File: flatast.cc
+ * ----------------
+ * Implementation of the flat AST, and of its checker, which follows the
+ * Check() and CheckExpr() methods of the node classes rule for rule,
+ * and of Raise(), which goes back the other way.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <map>
+#include <sstream>
+#include "flatast.h"
+#include "ast_type.h"
+#include "ast_decl.h"
+#include "ast_stmt.h"
+#include "errors.h"
+#include "symtable.h" // for EntryKind
+#include "context.h"
+#include "atoms.h"
+
+// The built-in types, in the order of builtinTypeT. These are the
+// addresses of the statics, which may not be set yet when this is.
+static Type **const builtinTypes[NumBuiltinTypes] = {
+    &Type::intType, &Type::uintType, &Type::floatType, &Type::boolType, &Type::voidType,
+    &Type::vec2Type, &Type::vec3Type, &Type::vec4Type,
+    &Type::mat2Type, &Type::mat3Type, &Type::mat4Type,
+    &Type::ivec2Type, &Type::ivec3Type, &Type::ivec4Type,
+    &Type::bvec2Type, &Type::bvec3Type, &Type::bvec4Type,
+    &Type::uvec2Type, &Type::uvec3Type, &Type::uvec4Type,
+    &Type::errorType
+};
+
+static const char *const kindNames[NumFlatKinds] = {
+    "Program", "VarDecl", "FnDecl", "StmtBlock", "DeclStmt",
+    "ForStmt", "WhileStmt", "IfStmt", "BreakStmt", "ContinueStmt",
+    "ReturnStmt", "SwitchStmt", "Case", "Default", "Empty",
+    "IntConstant", "FloatConstant", "BoolConstant", "VarExpr",
+    "ArithmeticExpr", "RelationalExpr", "EqualityExpr", "LogicalExpr",
+    "AssignExpr", "PostfixExpr", "ConditionalExpr",
+    "ArrayAccess", "FieldAccess", "Call"
+};
+
+FlatAst::FlatAst() {
+    root = None;
+}
+
+void FlatAst::Lower(Node *program, const vector<Decl *> *declared) {
+    ownNodes.clear();
+    ownSpans.clear();
+    ownLists.clear();
+    ownIdentifiers.clear();
+    ownOperators.clear();
+    ownInts.clear();
+    ownFloats.clear();
+    ownArrayTypes.clear();
+    ownNames.clear();
+    nameOffsets.clear();
+    root = program->Lower(this);
+    if (declared && !declared->empty()) {
+        vector<Index> decls;
+        for (Decl *d : *declared)
+            decls.push_back(d->Lower(this));
+        ownNodes[root].b = AddList(decls);
+    }
+    nameOffsets.clear();
+    ownNodes.shrink_to_fit();
+    ownSpans.shrink_to_fit();
+    ownLists.shrink_to_fit();
+    ownIdentifiers.shrink_to_fit();
+    ownOperators.shrink_to_fit();
+    ownInts.shrink_to_fit();
+    ownFloats.shrink_to_fit();
+    ownArrayTypes.shrink_to_fit();
+    ownNames.shrink_to_fit();
+    nodes.Use(ownNodes);
+    spans.Use(ownSpans);
+    lists.Use(ownLists);
+    identifiers.Use(ownIdentifiers);
+    operators.Use(ownOperators);
+    ints.Use(ownInts);
+    floats.Use(ownFloats);
+    arrayTypes.Use(ownArrayTypes);
+    names.Use(ownNames);
+}
+
+FlatAst::Index FlatAst::Add(flatKindT kind, const SourceSpan &span, Index a, Index b,
+                            Index c, unsigned char tag) {
+    FlatNode node;
+    memset(&node, 0, sizeof(node));     // so the padding is written out as zeros
+    node.kind = kind;
+    node.tag = tag;
+    node.a = a;
+    node.b = b;
+    node.c = c;
+    ownNodes.push_back(node);
+    ownSpans.push_back(span);
+    return ownNodes.size() - 1;
+}
+
+// Each name is added to names the first time an identifier has it
+FlatAst::Index FlatAst::AddIdentifier(Identifier *id) {
+    const char *name = id->GetName();
+    map<const char *, unsigned int>::iterator it = nameOffsets.find(name);
+    if (it == nameOffsets.end()) {
+        it = nameOffsets.insert(make_pair(name, (unsigned int)ownNames.size())).first;
+        ownNames.insert(ownNames.end(), name, name + strlen(name) + 1);
+    }
+    FlatIdentifier ident;
+    ident.name = it->second;
+    ident.span = id->GetSpan();
+    ownIdentifiers.push_back(ident);
+    return ownIdentifiers.size() - 1;
+}
+
+FlatAst::Index FlatAst::AddOperator(Operator *op) {
+    FlatOperator o;
+    o.opcode = op->GetOpcode();
+    o.span = op->GetSpan();
+    ownOperators.push_back(o);
+    return ownOperators.size() - 1;
+}
+
+FlatAst::TypeId FlatAst::AddArrayType(const SourceSpan &span, TypeId elemType, int elemCount) {
+    FlatArrayType array;
+    array.elemType = elemType;
+    array.elemCount = elemCount;
+    array.span = span;
+    ownArrayTypes.push_back(array);
+    return NumBuiltinTypes + ownArrayTypes.size() - 1;
+}
+
+FlatAst::Index FlatAst::AddList(const vector<Index> &elems) {
+    Index list = ownLists.size();
+    ownLists.push_back(elems.size());
+    ownLists.insert(ownLists.end(), elems.begin(), elems.end());
+    return list;
+}
+
+FlatAst::TypeId FlatAst::BuiltinType(Type *type) {
+    for (int i = 0; i < NumBuiltinTypes; i++)
+        if (*builtinTypes[i] == type) return i;
+    return NoType;
+}
+
+unsigned char FlatAst::Qualifier(TypeQualifier *typeq) {
+    if (typeq == TypeQualifier::inTypeQualifier) return Q_In;
+    if (typeq == TypeQualifier::outTypeQualifier) return Q_Out;
+    if (typeq == TypeQualifier::constTypeQualifier) return Q_Const;
+    if (typeq == TypeQualifier::uniformTypeQualifier) return Q_Uniform;
+    return Q_None;
+}
+
+const char *FlatAst::KindName(flatKindT kind) {
+    Assert(kind >= 0 && kind < NumFlatKinds);
+    return kindNames[kind];
+}
+
+Type *FlatAst::Builtin(TypeId type) {
+    Assert(type < NumBuiltinTypes);
+    return *builtinTypes[type];
+}
+
+size_t FlatAst::BytesUsed() const {
+    return nodes.size() * sizeof(FlatNode) + spans.size() * sizeof(SourceSpan) +
+           lists.size() * sizeof(Index) + identifiers.size() * sizeof(FlatIdentifier) +
+           operators.size() * sizeof(FlatOperator) + ints.size() * sizeof(int) +
+           floats.size() * sizeof(double) + arrayTypes.size() * sizeof(FlatArrayType) +
+           names.size();
+}
+
+
+/* Class: FlatChecker
+ * ------------------
+ * The state of one check of a FlatAst: the scopes, the return type the
+ * function being checked still expects, and how many loops and switches
+ * the statement being checked is in, which is all that the tree's
+ * checker keeps in its SymbolTable and MyStack. A lookup looks in the
+ * innermost scope, and then in the others from the global scope in, as
+ * SymbolTable::find() does. The declarations checked already (the
+ * Program's b) are put in the global scope before the program's own.
+ */
+struct FlatSymbol {
+    FlatAst::Index decl;
+    EntryKind kind;
+};
+
+class FlatChecker
+{
+  public:
+    typedef FlatAst::Index Index;
+    typedef FlatAst::TypeId TypeId;
+
+    FlatChecker(const FlatAst &a, CompileContext *c);
+    void Check(Index n);
+
+  private:
+    const FlatAst &ast;
+    CompileContext *ctx;
+    vector<map<const char *, FlatSymbol> > scopes;
+    TypeId returnType;
+    bool inFunction;                // CompileContext::isFnDecl
+    int numLoops, numSwitches;
+    map<Index, int> declared;       // each of those, and its place in the list
+
+    FlatSymbol *Find(const char *name, bool *inCurrentScope);
+    void Insert(const char *name, Index decl, EntryKind kind);
+    void Push() { scopes.push_back(map<const char *, FlatSymbol>()); }
+    void Pop()  { scopes.pop_back(); }
+
+    void CheckVarDecl(Index n);
+    void CheckFnDecl(Index n);
+    void CheckTest(Index test);
+    TypeId CheckExpr(Index n);
+    TypeId CheckArithmetic(const FlatNode &n);
+    TypeId CheckLogical(const FlatNode &n);
+    TypeId CheckArrayAccess(const FlatNode &n);
+    TypeId CheckFieldAccess(const FlatNode &n);
+    TypeId CheckCall(const FlatNode &n);
+    void CheckConditional(const FlatNode &n);
+
+    static bool IsNumeric(TypeId t) { return t == BT_Int || t == BT_Float; }
+    static bool IsVector(TypeId t)  { return t == BT_Vec2 || t == BT_Vec3 || t == BT_Vec4; }
+    static bool IsMatrix(TypeId t)  { return t == BT_Mat2 || t == BT_Mat3 || t == BT_Mat4; }
+
+    // The errors of errors.h, worded the same
+    void PrintType(ostream &out, TypeId t);
+    void DeclConflict(Index decl, Index prevDecl);
+    void InvalidInitialization(const FlatIdentifier &id, TypeId lType, TypeId rType);
+    void IdentifierNotDeclared(const FlatIdentifier &id, reasonT whyNeeded);
+    void NotAnArray(const FlatIdentifier &id);
+    void IncompatibleOperand(Index op, TypeId rhs);
+    void IncompatibleOperands(Index op, TypeId lhs, TypeId rhs);
+    void ArgumentCount(const FlatIdentifier &id, const char *which, int expCount, int actualCount);
+    void FormalsTypeMismatch(const FlatIdentifier &id, int pos, TypeId expType, TypeId actualType);
+    void NotAFunction(const FlatIdentifier &id);
+    void Swizzle(const FlatIdentifier &field, Index base, const char *what);
+    void ReturnMismatch(Index ret, TypeId given, TypeId expected);
+    void ReturnMissing(Index fn);
+};
+
+FlatChecker::FlatChecker(const FlatAst &a, CompileContext *c) : ast(a), ctx(c) {
+    Push();
+    returnType = FlatAst::NoType;
+    inFunction = false;
+    numLoops = numSwitches = 0;
+}
+
+FlatSymbol *FlatChecker::Find(const char *name, bool *inCurrentScope) {
+    map<const char *, FlatSymbol>::iterator it = scopes.back().find(name);
+    *inCurrentScope = true;
+    if (it != scopes.back().end()) return &it->second;
+    *inCurrentScope = false;
+    for (int i = 0; i < scopes.size(); i++) {
+        it = scopes[i].find(name);
+        if (it != scopes[i].end()) return &it->second;
+    }
+    return NULL;
+}
+
+void FlatChecker::Insert(const char *name, Index decl, EntryKind kind) {
+    FlatSymbol sym;
+    sym.decl = decl;
+    sym.kind = kind;
+    scopes.back().insert(make_pair(name, sym));
+}
+
+/* Function: Check()
+ * -----------------
+ * Checks node n as its node class's Check() would: the declarations and
+ * statements, and the expressions that check themselves when they are
+ * statements. Constants and Empty don't.
+ */
+void FlatChecker::Check(Index n) {
+    const FlatNode &node = ast.nodes[n];
+    switch (node.kind) {
+      case F_Program: {
+        if (node.b != FlatAst::None) {
+            const Index *checked = ast.ListElements(node.b);
+            for (int i = 0, num = ast.ListLength(node.b); i < num; i++) {
+                const FlatNode &d = ast.nodes[checked[i]];
+                Insert(ast.Name(ast.identifiers[d.a]), checked[i],
+                       d.kind == F_FnDecl ? E_FunctionDecl : E_VarDecl);
+                declared[checked[i]] = i;
+            }
+        }
+        const Index *decls = ast.ListElements(node.a);
+        for (int i = 0, num = ast.ListLength(node.a); i < num; i++)
+            Check(decls[i]);
+        break;
+      }
+      case F_VarDecl:
+        CheckVarDecl(n);
+        break;
+      case F_FnDecl:
+        CheckFnDecl(n);
+        break;
+      case F_StmtBlock: {
+        bool isFunction = inFunction;
+        if (!isFunction) Push();
+        const Index *decls = ast.ListElements(node.a), *stmts = ast.ListElements(node.b);
+        for (int i = 0, num = ast.ListLength(node.a); i < num; i++)
+            Check(decls[i]);
+        for (int i = 0, num = ast.ListLength(node.b); i < num; i++)
+            Check(stmts[i]);
+        if (!isFunction) Pop();
+        break;
+      }
+      case F_DeclStmt:
+        Check(node.a);
+        break;
+      case F_For: {
+        const Index *parts = ast.ListElements(node.a);  // init, test, step, body
+        Push();
+        numLoops++;
+        Check(parts[0]);
+        CheckTest(parts[1]);
+        if (parts[2] != FlatAst::None) Check(parts[2]);
+        Check(parts[3]);
+        numLoops--;
+        Pop();
+        break;
+      }
+      case F_While:
+        Push();
+        numLoops++;
+        CheckTest(node.a);
+        Check(node.b);
+        numLoops--;
+        Pop();
+        break;
+      case F_If:
+        Push();
+        CheckTest(node.a);
+        Check(node.b);
+        if (node.c != FlatAst::None) Check(node.c);
+        Pop();
+        break;
+      case F_Break:
+        if (numLoops == 0 && numSwitches == 0)
+            ReportError::Semantic(ctx, ast.spans[n], "break is only allowed inside a loop");
+        break;
+      case F_Continue:
+        if (numLoops == 0)
+            ReportError::Semantic(ctx, ast.spans[n], "continue is only allowed inside a loop");
+        break;
+      case F_Return: {
+        TypeId expected = returnType, actual = BT_Void;
+        if (node.a != FlatAst::None)
+            actual = CheckExpr(node.a);
+        if (actual != BT_Error && expected != actual)
+            ReturnMismatch(n, actual, expected);
+        returnType = BT_Void;
+        break;
+      }
+      case F_Switch: {
+        Push();
+        numSwitches++;
+        Check(node.a);
+        const Index *cases = ast.ListElements(node.b);
+        for (int i = 0, num = ast.ListLength(node.b); i < num; i++)
+            Check(cases[i]);
+        if (node.c != FlatAst::None) Check(node.c);
+        numSwitches--;
+        Pop();
+        break;
+      }
+      case F_Case:
+        Check(node.a);
+        Check(node.b);
+        break;
+      case F_Default:
+        Check(node.b);
+        break;
+      case F_Conditional:
+        CheckConditional(node);
+        break;
+      case F_VarExpr: case F_Arithmetic: case F_Relational: case F_Equality:
+      case F_Logical: case F_Assign: case F_Postfix:
+      case F_ArrayAccess: case F_FieldAccess: case F_Call:
+        CheckExpr(n);
+        break;
+      default:
+        break;
+    }
+}
+
+void FlatChecker::CheckVarDecl(Index n) {
+    const FlatNode &node = ast.nodes[n];
+    const FlatIdentifier &id = ast.identifiers[node.a];
+    bool inCurrentScope;
+    FlatSymbol *sym = Find(ast.Name(id), &inCurrentScope);
+    if (sym && inCurrentScope) {
+        DeclConflict(n, sym->decl);
+        scopes.back().erase(ast.Name(id));
+    }
+    if (node.c != FlatAst::None) {
+        TypeId actual = CheckExpr(node.c);
+        if (actual == BT_Error)
+            return;
+        if (actual != node.b)
+            InvalidInitialization(id, node.b, actual);
+    }
+    Insert(ast.Name(id), n, E_VarDecl);
+}
+
+void FlatChecker::CheckFnDecl(Index n) {
+    const FlatNode &node = ast.nodes[n];
+    const FlatIdentifier &id = ast.identifiers[node.a];
+    bool inCurrentScope;
+    FlatSymbol *sym = Find(ast.Name(id), &inCurrentScope);
+    if (sym && inCurrentScope) {
+        DeclConflict(n, sym->decl);
+        scopes.back().erase(ast.Name(id));
+    }
+    Insert(ast.Name(id), n, E_FunctionDecl);
+    Push();
+    returnType = node.tag;
+    inFunction = true;
+    const Index *formals = ast.ListElements(node.b);
+    for (int i = 0, num = ast.ListLength(node.b); i < num; i++)
+        CheckVarDecl(formals[i]);
+    if (node.c != FlatAst::None)
+        Check(node.c);
+    if (returnType != BT_Void)
+        ReturnMissing(n);
+    Pop();
+}
+
+// The test of a for, while or if, which must be a bool, even if it is
+// in error already
+void FlatChecker::CheckTest(Index test) {
+    if (CheckExpr(test) != BT_Bool)
+        ReportError::Semantic(ctx, ast.spans[test], "Test expression must have boolean type");
+}
+
+void FlatChecker::CheckConditional(const FlatNode &n) {
+    TypeId cond = CheckExpr(n.a);
+    Check(n.b);
+    Check(n.c);
+    if (cond == BT_Error)
+        return;
+    if (cond != BT_Bool)
+        ReportError::Semantic(ctx, ast.spans[n.a], "Test expression must have boolean type");
+}
+
+/* Function: CheckExpr()
+ * ---------------------
+ * Returns the type of expression n, having checked it as its node
+ * class's CheckExpr() would. A ConditionalExpr, like Empty, has none: it
+ * is only checked as a statement.
+ */
+FlatAst::TypeId FlatChecker::CheckExpr(Index n) {
+    const FlatNode &node = ast.nodes[n];
+    switch (node.kind) {
+      case F_IntConstant:   return BT_Int;
+      case F_FloatConstant: return BT_Float;
+      case F_BoolConstant:  return BT_Bool;
+      case F_VarExpr: {
+        const FlatIdentifier &id = ast.identifiers[node.a];
+        bool inCurrentScope;
+        FlatSymbol *sym = Find(ast.Name(id), &inCurrentScope);
+        if (!sym) {
+            IdentifierNotDeclared(id, LookingForVariable);
+            return BT_Error;
+        }
+        if (sym->kind != E_VarDecl) return FlatAst::NoType;
+        return ast.nodes[sym->decl].b;
+      }
+      case F_Arithmetic:
+        return CheckArithmetic(node);
+      case F_Relational: {
+        TypeId l = CheckExpr(node.a), r = CheckExpr(node.b);
+        if (l == BT_Error || r == BT_Error)
+            return BT_Error;
+        if (l != r || !IsNumeric(r)) {
+            IncompatibleOperands(node.c, l, r);
+            return BT_Error;
+        }
+        return BT_Bool;
+      }
+      case F_Equality: {
+        TypeId l = CheckExpr(node.a), r = CheckExpr(node.b);
+        if (l == BT_Error || r == BT_Error)
+            return BT_Error;
+        if (l != r) {
+            IncompatibleOperands(node.c, l, r);
+            return BT_Error;
+        }
+        return BT_Bool;
+      }
+      case F_Logical:
+        return CheckLogical(node);
+      case F_Assign: {
+        TypeId l = CheckExpr(node.a), r = CheckExpr(node.b);
+        if (l == BT_Error || r == BT_Error)
+            return BT_Error;
+        if (l != r) {
+            IncompatibleOperands(node.c, l, r);
+            return BT_Error;
+        }
+        return r;
+      }
+      case F_Postfix: {
+        TypeId r = CheckExpr(node.a);
+        if (r == BT_Error)
+            return BT_Error;
+        if (IsNumeric(r) || IsMatrix(r) || IsVector(r))
+            return r;
+        IncompatibleOperand(node.c, r);
+        return BT_Error;
+      }
+      case F_ArrayAccess:
+        return CheckArrayAccess(node);
+      case F_FieldAccess:
+        return CheckFieldAccess(node);
+      case F_Call:
+        return CheckCall(node);
+      default:
+        return FlatAst::NoType;
+    }
+}
+
+FlatAst::TypeId FlatChecker::CheckArithmetic(const FlatNode &n) {
+    // A scalar with a vector or matrix, or a matrix with a vector of its
+    // size, is the vector or matrix
+    static const TypeId scaled[] = { BT_Vec2, BT_Vec3, BT_Vec4, BT_Mat2, BT_Mat3, BT_Mat4 };
+    static const TypeId squared[][2] = { { BT_Mat2, BT_Vec2 }, { BT_Mat3, BT_Vec3 }, { BT_Mat4, BT_Vec4 } };
+    TypeId l = FlatAst::NoType, r;
+    if (n.a != FlatAst::None) {
+        l = CheckExpr(n.a);
+        r = CheckExpr(n.b);
+        if (l == BT_Error || r == BT_Error)
+            return BT_Error;
+        for (int i = 0; i < sizeof(scaled) / sizeof(scaled[0]); i++)
+            if ((l == BT_Float && r == scaled[i]) || (r == BT_Float && l == scaled[i]))
+                return scaled[i];
+        for (int i = 0; i < sizeof(squared) / sizeof(squared[0]); i++)
+            if ((l == squared[i][0] && r == squared[i][1]) || (r == squared[i][0] && l == squared[i][1]))
+                return squared[i][0];
+        if (l != r) {
+            IncompatibleOperands(n.c, l, r);
+            return BT_Error;
+        }
+    } else {
+        r = CheckExpr(n.b);
+        if (r == BT_Error)
+            return BT_Error;
+    }
+    if (IsNumeric(r) || IsMatrix(r) || IsVector(r))
+        return r;
+    if (n.a == FlatAst::None)
+        IncompatibleOperand(n.c, r);
+    else
+        IncompatibleOperands(n.c, l, r);
+    return BT_Error;
+}
+
+FlatAst::TypeId FlatChecker::CheckLogical(const FlatNode &n) {
+    TypeId l = FlatAst::NoType, r;
+    if (n.a != FlatAst::None) {
+        l = CheckExpr(n.a);
+        r = CheckExpr(n.b);
+        if (l == BT_Error || r == BT_Error)
+            return BT_Error;
+        if (l != r) {
+            IncompatibleOperands(n.c, l, r);
+            return BT_Error;
+        }
+    } else {
+        r = CheckExpr(n.b);
+        if (r == BT_Error)
+            return BT_Error;
+    }
+    if (r == BT_Bool)
+        return BT_Bool;
+    if (n.a == FlatAst::None)
+        IncompatibleOperand(n.c, r);
+    else
+        IncompatibleOperands(n.c, l, r);
+    return BT_Error;
+}
+
+// Only a variable can be indexed; the subscript is not checked. The
+// tree's checker crashes on any other base, and this one lets it be.
+FlatAst::TypeId FlatChecker::CheckArrayAccess(const FlatNode &n) {
+    const FlatNode &base = ast.nodes[n.a];
+    if (base.kind != F_VarExpr)
+        return BT_Error;
+    TypeId type = CheckExpr(n.a);
+    if (type == BT_Error)
+        return BT_Error;
+    if (type < NumBuiltinTypes || type == FlatAst::NoType) {
+        NotAnArray(ast.identifiers[base.a]);
+        return BT_Error;
+    }
+    return ast.arrayTypes[type - NumBuiltinTypes].elemType;
+}
+
+FlatAst::TypeId FlatChecker::CheckFieldAccess(const FlatNode &n) {
+    const FlatIdentifier &field = ast.identifiers[n.b];
+    TypeId type = CheckExpr(n.a);
+    if (type == BT_Error)
+        return BT_Error;
+    if (!IsVector(type)) {
+        Swizzle(field, n.a, " non-vector type can't have swizzle '%s'");
+        return BT_Error;
+    }
+    const char *name = ast.Name(field);
+    int len = strlen(name);
+    for (int i = 0; i < len; i++) {
+        char c = name[i];
+        if (c != 'x' && c != 'y' && c != 'z' && c != 'w') {
+            Swizzle(field, n.a, " swizzle '%s' is not proper subset of [xyzw]");
+            return BT_Error;
+        }
+        if ((c != 'x' && c != 'y' && type == BT_Vec2) ||
+            (c != 'x' && c != 'y' && c != 'z' && type == BT_Vec3)) {
+            Swizzle(field, n.a, " swizzle '%s' exceeds its vector component");
+            return BT_Error;
+        }
+    }
+    if (len > 4) {
+        Swizzle(field, n.a, " swizzle '%s' generates a vector longer than vec4");
+        return BT_Error;
+    }
+    static const TypeId swizzled[] = { BT_Float, BT_Vec2, BT_Vec3 };
+    return (len <= 3 ? swizzled[len - 1] : BT_Vec4);
+}
+
+FlatAst::TypeId FlatChecker::CheckCall(const FlatNode &n) {
+    const FlatIdentifier &field = ast.identifiers[n.b];
+    bool inCurrentScope;
+    FlatSymbol *sym = Find(ast.Name(field), &inCurrentScope);
+    if (!sym) {
+        IdentifierNotDeclared(field, LookingForFunction);
+        return BT_Error;
+    }
+    if (sym->kind != E_FunctionDecl) {
+        NotAFunction(field);
+        return BT_Error;
+    }
+    const FlatNode &fn = ast.nodes[sym->decl];
+    int numFormals = ast.ListLength(fn.b), numActuals = ast.ListLength(n.c);
+    if (numFormals > numActuals) {
+        ArgumentCount(field, "Less", numFormals, numActuals);
+        return BT_Error;
+    } else if (numFormals < numActuals) {
+        ArgumentCount(field, "Extra", numFormals, numActuals);
+        return BT_Error;
+    }
+    const Index *formals = ast.ListElements(fn.b), *actuals = ast.ListElements(n.c);
+    for (int i = 0; i < numActuals; i++) {
+        TypeId actual = CheckExpr(actuals[i]);
+        if (actual == BT_Error)
+            return BT_Error;
+        TypeId expected = ast.nodes[formals[i]].b;
+        if (actual != expected) {
+            FormalsTypeMismatch(field, i + 1, expected, actual);
+            return BT_Error;
+        }
+    }
+    return fn.tag;
+}
+
+void FlatChecker::PrintType(ostream &out, TypeId t) {
+    if (t < NumBuiltinTypes)
+        out << FlatAst::Builtin(t);
+    else if (t != FlatAst::NoType) {
+        PrintType(out, ast.arrayTypes[t - NumBuiltinTypes].elemType);
+        out << "[]";
+    }
+}
+
+// A declaration checked already may be from another file, whose line the
+// context keeps (see CompileContext::DeclLine())
+void FlatChecker::DeclConflict(Index decl, Index prevDecl) {
+    ostringstream s;
+    const char *path;
+    map<Index, int>::iterator it = declared.find(prevDecl);
+    int line;
+    if (it != declared.end()) {
+        line = ctx->loadedDecls[it->second].line;
+        path = ctx->loadedDecls[it->second].path;
+    } else
+        line = ctx->SourceLine(ctx->LineOf(ast.spans[prevDecl].first), &path);
+    s << "Declaration of '" << ast.Name(ast.identifiers[ast.nodes[decl].a])
+      << "' here conflicts with declaration on line " << line;
+    if (path) s << " of " << path;
+    ReportError::Semantic(ctx, ast.spans[decl], s.str());
+}
+
+void FlatChecker::InvalidInitialization(const FlatIdentifier &id, TypeId lType, TypeId rType) {
+    ostringstream s;
+    s << "Wrong initialization of identifier '" << ast.Name(id) << "': idType '";
+    PrintType(s, lType);
+    s << "' exprType '";
+    PrintType(s, rType);
+    s << "'";
+    ReportError::Semantic(ctx, id.span, s.str());
+}
+
+void FlatChecker::IdentifierNotDeclared(const FlatIdentifier &id, reasonT whyNeeded) {
+    static const char *names[] = {"type", "variable", "function"};
+    ostringstream s;
+    s << "No declaration found for " << names[whyNeeded] << " '" << ast.Name(id) << "'";
+    ReportError::Semantic(ctx, id.span, s.str());
+}
+
+void FlatChecker::NotAnArray(const FlatIdentifier &id) {
+    ostringstream s;
+    s << "'" << ast.Name(id) << "' is not an array.";
+    ReportError::Semantic(ctx, id.span, s.str());
+}
+
+void FlatChecker::IncompatibleOperand(Index op, TypeId rhs) {
+    const FlatOperator &o = ast.operators[op];
+    ostringstream s;
+    s << "Incompatible operand: " << Operator::Spelling(o.opcode) << " ";
+    PrintType(s, rhs);
+    ReportError::Semantic(ctx, o.span, s.str());
+}
+
+void FlatChecker::IncompatibleOperands(Index op, TypeId lhs, TypeId rhs) {
+    const FlatOperator &o = ast.operators[op];
+    ostringstream s;
+    s << "Incompatible operands: ";
+    PrintType(s, lhs);
+    s << " " << Operator::Spelling(o.opcode) << " ";
+    PrintType(s, rhs);
+    ReportError::Semantic(ctx, o.span, s.str());
+}
+
+// which is "Less" or "Extra"
+void FlatChecker::ArgumentCount(const FlatIdentifier &id, const char *which, int expCount,
+                                int actualCount) {
+    ostringstream s;
+    s << which << " arguments given to function '" << ast.Name(id) << "': expected "
+      << expCount << ", given " << actualCount;
+    ReportError::Semantic(ctx, id.span, s.str());
+}
+
+void FlatChecker::FormalsTypeMismatch(const FlatIdentifier &id, int pos, TypeId expType,
+                                      TypeId actualType) {
+    ostringstream s;
+    s << "Formal type mismatch in function '" << ast.Name(id) << "' at pos " << pos
+      << ": expected '";
+    PrintType(s, expType);
+    s << "', given '";
+    PrintType(s, actualType);
+    s << "'";
+    ReportError::Semantic(ctx, id.span, s.str());
+}
+
+void FlatChecker::NotAFunction(const FlatIdentifier &id) {
+    ostringstream s;
+    s << "'" << ast.Name(id) << "' is not a function.";
+    ReportError::Semantic(ctx, id.span, s.str());
+}
+
+// what is the rest of the message after the base, with %s for the field
+void FlatChecker::Swizzle(const FlatIdentifier &field, Index base, const char *what) {
+    char rest[2048];
+    snprintf(rest, sizeof(rest), what, ast.Name(field));
+    ReportError::Semantic(ctx, field.span,
+                          string(FlatAst::KindName((flatKindT)ast.nodes[base].kind)) + rest);
+}
+
+void FlatChecker::ReturnMismatch(Index ret, TypeId given, TypeId expected) {
+    ostringstream s;
+    s << "Incompatible return: ";
+    PrintType(s, given);
+    s << " given, ";
+    PrintType(s, expected);
+    s << " expected";
+    ReportError::Semantic(ctx, ast.spans[ret], s.str());
+}
+
+void FlatChecker::ReturnMissing(Index fn) {
+    ostringstream s;
+    const char *path;
+    s << "Declaration of '" << ast.Name(ast.identifiers[ast.nodes[fn].a]) << "' on line "
+      << ctx->SourceLine(ctx->LineOf(ast.spans[fn].first), &path);
+    if (path) s << " of " << path;
+    s << " doesn't have a return";
+    ReportError::Semantic(ctx, ast.spans[fn], s.str());
+}
+
+void FlatAst::Check(CompileContext *ctx) const {
+    FlatChecker checker(*this, ctx);
+    checker.Check(root);
+}
+
+
+/* Class: Raiser
+ * -------------
+ * Makes the tree again from a FlatAst, node by node, with the
+ * constructors the parser uses, so each node works out the same span
+ * from its children as it did then. The operator and identifier nodes
+ * and the array types come back from the side tables.
+ */
+class Raiser
+{
+  public:
+    typedef FlatAst::Index Index;
+    typedef FlatAst::TypeId TypeId;
+
+    Raiser(const FlatAst &a, AtomTable *t) : ast(a), atoms(t) {}
+    Node *Raise(Index n, bool withBody = true);
+
+  private:
+    const FlatAst &ast;
+    AtomTable *atoms;
+
+    Identifier *RaiseIdentifier(Index id);
+    Operator *RaiseOperator(Index op);
+    Type *RaiseType(TypeId type);
+    Expr *RaiseExpr(Index n) { return (n == FlatAst::None ? NULL : (Expr *)Raise(n)); }
+    Stmt *RaiseStmt(Index n) { return (n == FlatAst::None ? NULL : (Stmt *)Raise(n)); }
+    template<class Element> List<Element> *RaiseList(Index list);
+};
+
+Identifier *Raiser::RaiseIdentifier(Index id) {
+    const FlatIdentifier &ident = ast.identifiers[id];
+    const char *name = ast.Name(ident);
+    return new Identifier(ident.span, atoms->Intern(name, strlen(name)));
+}
+
+Operator *Raiser::RaiseOperator(Index op) {
+    return new Operator(ast.operators[op].span, ast.operators[op].opcode);
+}
+
+Type *Raiser::RaiseType(TypeId type) {
+    if (type < NumBuiltinTypes)
+        return FlatAst::Builtin(type);
+    const FlatArrayType &array = ast.arrayTypes[type - NumBuiltinTypes];
+    return new ArrayType(array.span, RaiseType(array.elemType), array.elemCount);
+}
+
+template<class Element> List<Element> *Raiser::RaiseList(Index list) {
+    List<Element> *elems = new List<Element>;
+    const Index *e = ast.ListElements(list);
+    for (int i = 0, num = ast.ListLength(list); i < num; i++)
+        elems->Append((Element)Raise(e[i]));
+    return elems;
+}
+
+// withBody is false for a declaration's signature alone
+Node *Raiser::Raise(Index n, bool withBody) {
+    static TypeQualifier **const qualifiers[] = {
+        NULL, &TypeQualifier::inTypeQualifier, &TypeQualifier::outTypeQualifier,
+        &TypeQualifier::constTypeQualifier, &TypeQualifier::uniformTypeQualifier
+    };
+    const FlatNode &node = ast.nodes[n];
+    const SourceSpan &span = ast.spans[n];
+    switch (node.kind) {
+      case F_Program:
+        return new Program(RaiseList<Decl *>(node.a));
+      case F_VarDecl: {
+        Identifier *id = RaiseIdentifier(node.a);
+        TypeQualifier *typeq = (node.tag != Q_None ? *qualifiers[node.tag] : NULL);
+        Expr *init = (withBody ? RaiseExpr(node.c) : NULL);
+        if (node.b == FlatAst::NoType)
+            return new VarDecl(id, typeq, init);
+        if (typeq)
+            return new VarDecl(id, RaiseType(node.b), typeq, init);
+        return new VarDecl(id, RaiseType(node.b), init);
+      }
+      case F_FnDecl: {
+        Identifier *id = RaiseIdentifier(node.a);
+        FnDecl *fn = new FnDecl(id, FlatAst::Builtin(node.tag), RaiseList<VarDecl *>(node.b));
+        if (withBody && node.c != FlatAst::None)
+            fn->SetFunctionBody(RaiseStmt(node.c));
+        return fn;
+      }
+      case F_StmtBlock: {
+        List<VarDecl *> *decls = RaiseList<VarDecl *>(node.a);
+        return new StmtBlock(decls, RaiseList<Stmt *>(node.b));
+      }
+      case F_DeclStmt:
+        return new DeclStmt((Decl *)Raise(node.a));
+      case F_For: {
+        const Index *parts = ast.ListElements(node.a);  // init, test, step, body
+        Expr *init = RaiseExpr(parts[0]), *test = RaiseExpr(parts[1]);
+        Expr *step = RaiseExpr(parts[2]);
+        return new ForStmt(init, test, step, RaiseStmt(parts[3]));
+      }
+      case F_While: {
+        Expr *test = RaiseExpr(node.a);
+        return new WhileStmt(test, RaiseStmt(node.b));
+      }
+      case F_If: {
+        Expr *test = RaiseExpr(node.a);
+        Stmt *thenBody = RaiseStmt(node.b);
+        return new IfStmt(test, thenBody, RaiseStmt(node.c));
+      }
+      case F_Break:
+        return new BreakStmt(span);
+      case F_Continue:
+        return new ContinueStmt(span);
+      case F_Return:
+        return new ReturnStmt(span, RaiseExpr(node.a));
+      case F_Switch: {
+        Expr *expr = RaiseExpr(node.a);
+        List<Stmt *> *cases = RaiseList<Stmt *>(node.b);
+        return new SwitchStmt(expr, cases, (Default *)RaiseStmt(node.c));
+      }
+      case F_Case: {
+        Expr *label = RaiseExpr(node.a);
+        return new Case(label, RaiseStmt(node.b));
+      }
+      case F_Default:
+        return new Default(RaiseStmt(node.b));
+      case F_Empty:
+        return new EmptyExpr();
+      case F_IntConstant:
+        return new IntConstant(span, ast.ints[node.a]);
+      case F_FloatConstant:
+        return new FloatConstant(span, ast.floats[node.a]);
+      case F_BoolConstant:
+        return new BoolConstant(span, node.tag);
+      case F_VarExpr:
+        return new VarExpr(span, RaiseIdentifier(node.a));
+      case F_Arithmetic: case F_Relational: case F_Equality:
+      case F_Logical: case F_Assign: case F_Postfix: {
+        Expr *left = RaiseExpr(node.a), *right = RaiseExpr(node.b);
+        Operator *op = RaiseOperator(node.c);
+        switch (node.kind) {
+          case F_Arithmetic:
+            return (left ? new ArithmeticExpr(left, op, right) : new ArithmeticExpr(op, right));
+          case F_Relational: return new RelationalExpr(left, op, right);
+          case F_Equality:   return new EqualityExpr(left, op, right);
+          case F_Logical:
+            return (left ? new LogicalExpr(left, op, right) : new LogicalExpr(op, right));
+          case F_Assign:     return new AssignExpr(left, op, right);
+          default:           return new PostfixExpr(left, op);
+        }
+      }
+      case F_Conditional: {
+        Expr *cond = RaiseExpr(node.a), *trueExpr = RaiseExpr(node.b);
+        return new ConditionalExpr(cond, trueExpr, RaiseExpr(node.c));
+      }
+      case F_ArrayAccess: {
+        Expr *base = RaiseExpr(node.a);
+        return new ArrayAccess(span, base, RaiseExpr(node.b));
+      }
+      case F_FieldAccess: {
+        Expr *base = RaiseExpr(node.a);
+        return new FieldAccess(base, RaiseIdentifier(node.b));
+      }
+      case F_Call: {
+        Expr *base = RaiseExpr(node.a);
+        Identifier *field = RaiseIdentifier(node.b);
+        return new Call(span, base, field, RaiseList<Expr *>(node.c));
+      }
+      default:
+        Failure("Can't raise a node of kind %d", node.kind);
+        return NULL;
+    }
+}
+
+Node *FlatAst::Raise(Index n, AtomTable *atoms) const {
+    return Raiser(*this, atoms).Raise(n);
+}
+
+Decl *FlatAst::RaiseSignature(Index decl, AtomTable *atoms) const {
+    return (Decl *)Raiser(*this, atoms).Raise(decl, false);
+}
@@ -0,0 +1,225 @@
+/* File: flatast.h
+ * ---------------
+ * A FlatAst is a second, compact representation of a parsed program,
+ * lowered from the tree of nodes (see Node::Lower()), and a checker
+ * that walks it in place of the tree's Check() methods, with the same
+ * rules and the same diagnostics, in the same order.
+ *
+ * Its nodes are kept in one array, and refer to their children by their
+ * 32-bit index in it, not by pointer. Each node is 16 bytes: its kind,
+ * a one-byte tag and three links. What a link means depends on the
+ * kind (see flatKindT below): a child node, a list of them, or an entry
+ * in one of the side tables, which hold what the tree keeps in nodes of
+ * its own or in fields: identifiers, operators, int and float constants
+ * and array types. A list is a run in the lists table, its length first
+ * and then its elements. Absent children are None. The spans, which are
+ * only read to report an error, are kept apart from the nodes, in an
+ * array of their own with the same indices.
+ *
+ * Types are TypeIds. The built-in types are the first NumBuiltinTypes of
+ * them, in the order of builtinTypeT; the rest are the array types, one
+ * for each declaration of an array, as the tree makes an ArrayType node
+ * for each. So two types are the same type exactly when their TypeIds
+ * are equal, as two Types are when they are the same node.
+ *
+ * The checker keeps its own symbol table and loop and switch counts, and
+ * uses the context only to report errors. Wherever the tree's checker
+ * would call a method through a NULL Type (a ConditionalExpr used as an
+ * operand, say), which crashes, the flat one takes the type to be NoType,
+ * which is not the same as any other, and goes on.
+ *
+ * With -d flatcheck, glc checks the flat form of each program instead of
+ * the tree (see Program::Check()); checkbench.cc times the two.
+ *
+ * Nothing in it is a pointer: identifiers keep the offset of their name
+ * in the names array, which holds each name once. So the arrays can be
+ * written out as they are and mapped back in, and a FlatAst can use the
+ * arrays of a mapped AST file where they lie (see astbin.h), as well as
+ * vectors of its own. Raise() makes the tree again from either.
+ */
+
+#ifndef _H_flatast
+#define _H_flatast
+
+#include <map>
+#include <vector>
+#include "location.h"
+#include "ast_expr.h" // for opcodeT
+#include "list.h"
+
+using namespace std;
+
+class CompileContext;
+class Type;
+class TypeQualifier;
+class Identifier;
+class Operator;
+class Decl;
+class AtomTable;
+
+typedef enum {
+      F_Program,        // a: decls, b: decls checked already (see Lower())
+      F_VarDecl,        // tag: qualifier, a: identifier, b: TypeId, c: initializer
+      F_FnDecl,         // tag: return TypeId, a: identifier, b: formals, c: body
+      F_StmtBlock,      // a: decls, b: stmts
+      F_DeclStmt,       // a: decl
+      F_For,            // a: a list of init, test, step and body
+      F_While,          // a: test, b: body
+      F_If,             // a: test, b: then, c: else
+      F_Break, F_Continue,
+      F_Return,         // a: expr
+      F_Switch,         // a: expr, b: cases, c: default
+      F_Case,           // a: label, b: stmt
+      F_Default,        // b: stmt
+      F_Empty,
+      F_IntConstant,    // a: index in ints
+      F_FloatConstant,  // a: index in floats
+      F_BoolConstant,   // tag: value
+      F_VarExpr,        // a: identifier
+      F_Arithmetic, F_Relational, F_Equality, F_Logical, F_Assign, F_Postfix,
+                        // a: left, b: right, c: operator
+      F_Conditional,    // a: cond, b: true, c: false
+      F_ArrayAccess,    // a: base, b: subscript
+      F_FieldAccess,    // a: base, b: field identifier
+      F_Call,           // a: base, b: function identifier, c: actuals
+      NumFlatKinds
+} flatKindT;
+
+typedef enum {
+      BT_Int, BT_Uint, BT_Float, BT_Bool, BT_Void,
+      BT_Vec2, BT_Vec3, BT_Vec4, BT_Mat2, BT_Mat3, BT_Mat4,
+      BT_Ivec2, BT_Ivec3, BT_Ivec4, BT_Bvec2, BT_Bvec3, BT_Bvec4,
+      BT_Uvec2, BT_Uvec3, BT_Uvec4, BT_Error,
+      NumBuiltinTypes
+} builtinTypeT;
+
+// The tag of a VarDecl: its qualifier, if any
+typedef enum {
+      Q_None, Q_In, Q_Out, Q_Const, Q_Uniform
+} qualifierT;
+
+struct FlatNode
+{
+    unsigned char kind;             // flatKindT
+    unsigned char tag;
+    unsigned int a, b, c;
+};
+
+struct FlatIdentifier
+{
+    unsigned int name;              // its offset in names
+    SourceSpan span;
+};
+
+struct FlatOperator
+{
+    opcodeT opcode;
+    SourceSpan span;
+};
+
+struct FlatArrayType
+{
+    unsigned int elemType;          // a TypeId
+    int elemCount;
+    SourceSpan span;
+};
+
+// One of the arrays of a FlatAst: count elements at elems
+template<class T> struct FlatArray
+{
+    const T *elems;
+    unsigned int count;
+
+    FlatArray() : elems(NULL), count(0) {}
+    void Use(const vector<T> &v)    { elems = v.data(); count = v.size(); }
+    const T &operator[](unsigned int i) const { return elems[i]; }
+    unsigned int size() const       { return count; }
+};
+
+class FlatAst
+{
+  public:
+    typedef unsigned int Index;
+    typedef unsigned int TypeId;
+    static const Index None = ~0u;
+    static const TypeId NoType = ~0u;
+
+    FlatArray<FlatNode> nodes;
+    FlatArray<SourceSpan> spans;
+    Index root;                     // the Program
+
+    FlatArray<Index> lists;
+    FlatArray<FlatIdentifier> identifiers;
+    FlatArray<FlatOperator> operators;
+    FlatArray<int> ints;
+    FlatArray<double> floats;
+    FlatArray<FlatArrayType> arrayTypes;
+    FlatArray<char> names;          // NUL-terminated, one after another
+
+    FlatAst();
+
+    // Lowers the tree under program, replacing what was here before. The
+    // declared ones, if any, are lowered too, as the Program's b: the
+    // checker takes them to be in the global scope already (see
+    // CompileContext::loadedDecls). Each node class adds itself with
+    // Lower(), which calls these.
+    void Lower(Node *program, const vector<Decl *> *declared = NULL);
+    Index Add(flatKindT kind, const SourceSpan &span, Index a = None, Index b = None,
+              Index c = None, unsigned char tag = 0);
+    Index AddIdentifier(Identifier *id);
+    Index AddOperator(Operator *op);
+    Index AddInt(int value)         { ownInts.push_back(value); return ownInts.size() - 1; }
+    Index AddFloat(double value)    { ownFloats.push_back(value); return ownFloats.size() - 1; }
+    TypeId AddArrayType(const SourceSpan &span, TypeId elemType, int elemCount);
+    template<class Element> Index AddList(const List<Element> *list) {
+        vector<Index> elems;
+        for (Element e : *list) elems.push_back(e->Lower(this));
+        return AddList(elems);
+    }
+    Index AddList(const vector<Index> &elems);
+    static TypeId BuiltinType(Type *type);
+    static unsigned char Qualifier(TypeQualifier *typeq);
+
+    // The print name of the node class that a kind stands for
+    static const char *KindName(flatKindT kind);
+    // The Type for a built-in TypeId
+    static Type *Builtin(TypeId type);
+
+    int NumNodes() const { return nodes.size(); }
+    // The length of the list at list, and its elements
+    int ListLength(Index list) const { return lists[list]; }
+    const Index *ListElements(Index list) const { return &lists[list + 1]; }
+    const char *Name(const FlatIdentifier &id) const { return &names[id.name]; }
+    // The bytes all of it takes
+    size_t BytesUsed() const;
+
+    // Checks the program, as Program::Check() would check the tree it
+    // was lowered from, reporting the same errors through ctx
+    void Check(CompileContext *ctx) const;
+
+    // Makes the tree that node n was lowered from again, in the node
+    // arena if one is set, with the names interned in atoms. Printed,
+    // it is the same as the tree it was lowered from.
+    Node *Raise(Index n, AtomTable *atoms) const;
+    // Same, for a declaration, leaving out a function's body and a
+    // variable's initializer: just what its symbol refers to
+    Decl *RaiseSignature(Index decl, AtomTable *atoms) const;
+
+  private:
+    // The arrays, while they are this FlatAst's own
+    vector<FlatNode> ownNodes;
+    vector<SourceSpan> ownSpans;
+    vector<Index> ownLists;
+    vector<FlatIdentifier> ownIdentifiers;
+    vector<FlatOperator> ownOperators;
+    vector<int> ownInts;
+    vector<double> ownFloats;
+    vector<FlatArrayType> ownArrayTypes;
+    vector<char> ownNames;
+    map<const char *, unsigned int> nameOffsets;  // of each atom, while lowering
+
+    FlatAst(const FlatAst &);       // not copied, as the arrays may be its own
+    FlatAst &operator=(const FlatAst &);
+};
+
+#endif
@@ -0,0 +1,113 @@
+/* File: glc.cc
+ * ------------
+ * Implementation of the libglc interface. A result's arena is a
+ * DiagnosticSink that collects the errors of one check; its vectors and
+ * message buffer are cleared, not freed, between calls, so once they
+ * have grown to fit the largest error list seen they are simply reused.
+ * So is the CompileContext it keeps, which is reset after each check
+ * (see CompileContext::Reset()), and with it the atom and symbol tables,
+ * the line index, the token buffer and the arena the AST is made in, so
+ * checking again source that was checked before allocates nothing.
+ * The context scans with the hand-written scanner (see fastscan.h),
+ * which needs no state of its own, where flex would make a scanner and
+ * a copy of the source on every call.
+ *
+ * The arena also keeps an IncrementalChecker, so top-level declarations
+ * that are unchanged since an earlier call are not checked again. What
+ * the scanner echoes is appended to the arena's output rather than
+ * written to cout.
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "glc.h"
+#include "context.h"
+#include "errors.h"
+#include "incremental.h"
+#include "utility.h"
+
+using namespace std;
+
+class GlcArena : public DiagnosticSink
+{
+  public:
+    vector<glc_diagnostic> diagnostics;
+    vector<size_t> offsets;         // of each message in text
+    string text;                    // the messages, NUL-terminated
+    ostringstream unused;           // the context's error stream, never written
+    string output;                  // what the scanner echoed
+    AppendStream echo;              // the context's echo stream, onto output
+    IncrementalChecker checker;     // remembers declarations across calls
+    CompileContext ctx;             // reset after each check
+
+    GlcArena() : echo(output), ctx(unused) {
+        ctx.echoStream = &echo;
+        ctx.sink = this;
+        ctx.incremental = &checker;
+        ctx.fastScan = true;
+    }
+
+    void Reset() {
+        diagnostics.clear();
+        offsets.clear();
+        text.clear();
+        output.clear();
+    }
+
+    void Report(errorKindT kind, yyltype *loc, const char *msg) {
+        static const glc_kind kinds[] = { GLC_LEXICAL, GLC_SYNTAX, GLC_SEMANTIC };
+        glc_diagnostic d;
+        d.kind = kinds[kind];
+        d.line = (loc ? loc->first_line : 0);
+        d.first_column = (loc ? loc->first_column : 0);
+        d.last_column = (loc ? loc->last_column : 0);
+        d.message = NULL;           // filled in once text stops growing
+        diagnostics.push_back(d);
+        offsets.push_back(text.size());
+        text.append(msg, strlen(msg) + 1);
+    }
+};
+
+int glc_check(const char *src, size_t len, glc_result *out)
+{
+    if (!out || (!src && len > 0) || len > INT_MAX) return -1;
+    bool debugWasOn = SetDebugOutput(false);
+    GlcArena *arena = (GlcArena *)out->arena;
+    if (!arena)
+        out->arena = arena = new GlcArena;
+    arena->Reset();
+
+    CompileContext &ctx = arena->ctx;
+    ctx.CheckBuffer(src ? src : "", len);
+
+    // Lines of a preprocessed unit are given in the files they came from
+    for (int i = 0; i < arena->diagnostics.size(); i++) {
+        glc_diagnostic &d = arena->diagnostics[i];
+        const char *path;
+        d.message = arena->text.data() + arena->offsets[i];
+        if (d.line > 0) d.line = ctx.SourceLine(d.line, &path);
+    }
+    out->num_errors = ctx.NumErrors();
+    out->num_diagnostics = arena->diagnostics.size();
+    out->diagnostics = (arena->diagnostics.empty() ? NULL : &arena->diagnostics[0]);
+    out->output = arena->output.c_str();
+    out->output_len = arena->output.size();
+    ctx.Reset();
+    SetDebugOutput(debugWasOn);
+    return out->num_errors;
+}
+
+void glc_result_free(glc_result *result)
+{
+    if (!result) return;
+    delete (GlcArena *)result->arena;
+    result->num_errors = 0;
+    result->num_diagnostics = 0;
+    result->diagnostics = NULL;
+    result->output = NULL;
+    result->output_len = 0;
+    result->arena = NULL;
+}
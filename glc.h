@@ -0,0 +1,85 @@
+/* File: glc.h
+ * -----------
+ * The public interface of libglc, which lets a program check GLSL source
+ * held in memory without running glc as a separate process. The library
+ * never writes to stdout or stderr; errors come back as structured
+ * diagnostics with the same wording glc prints, and the text glc would
+ * echo to stdout (what the scanner passes over after a '.' it can't
+ * read as a field) comes back as the result's output.
+ *
+ * Typical use:
+ *
+ *    glc_result result = GLC_RESULT_INIT;
+ *    for (each shader) {
+ *        if (glc_check(src, len, &result) != 0)
+ *            for (int i = 0; i < result.num_diagnostics; i++) ...
+ *    }
+ *    glc_result_free(&result);
+ *
+ * The result owns the storage for its diagnostics. Passing the same
+ * result to the next call reuses that storage, which invalidates the
+ * diagnostics from the previous call. It also lets the next call skip
+ * checking top-level declarations that have not changed (see
+ * incremental.h). Separate results may be used on separate threads at
+ * the same time.
+ */
+
+#ifndef _H_glc
+#define _H_glc
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    GLC_LEXICAL,            /* from the scanner */
+    GLC_SYNTAX,             /* from the parser */
+    GLC_SEMANTIC            /* from the semantic checker */
+} glc_kind;
+
+typedef struct {
+    glc_kind kind;
+    int line;               /* 0 if the error has no position */
+    int first_column;       /* columns are 1-based and inclusive */
+    int last_column;
+    const char *message;    /* e.g. "No declaration found for variable 'x'" */
+} glc_diagnostic;
+
+typedef struct {
+    int num_errors;
+    int num_diagnostics;
+    const glc_diagnostic *diagnostics;
+    const char *output;     /* what glc would write to stdout, NUL-terminated */
+    size_t output_len;      /* not counting the NUL */
+    void *arena;            /* private storage, reused from call to call */
+} glc_result;
+
+#define GLC_RESULT_INIT { 0, 0, NULL, NULL, 0, NULL }
+
+/* Function: glc_check()
+ * ---------------------
+ * Scans, parses and checks the len bytes of source at src, filling in
+ * out with the diagnostics in the order glc would report them, and the
+ * text glc would echo. Debugging output that glc's -d keys turn on is
+ * not printed while it checks. Returns
+ * the number of errors (0 if the source is valid), or -1 if out is NULL,
+ * src is NULL with len > 0, or len is more than INT_MAX. Since the
+ * storage out keeps is reused, checking source that out has checked
+ * before allocates no memory, unless it has preprocessor directives.
+ */
+int glc_check(const char *src, size_t len, glc_result *out);
+
+/* Function: glc_result_free()
+ * ---------------------------
+ * Releases the storage held by a result and resets it to
+ * GLC_RESULT_INIT.
+ */
+void glc_result_free(glc_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
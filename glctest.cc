@@ -0,0 +1,135 @@
+/* File: glctest.cc
+ * ----------------
+ * A test of libglc through its interface (glc.h). Each case below is
+ * checked with one result, reused from case to case as a program using
+ * the library would, and what comes back (the error count, the first
+ * diagnostic and the echoed output) is compared with what is expected.
+ * All of it runs with every -d key glc has turned on, and with stdout
+ * sent to a file that must still be empty at the end, since the
+ * library must not print. Then each case is checked again, and, with
+ * the storage the result kept, must make no allocation at all (every
+ * operator new is counted). make test-lib builds and runs it:
+ *
+ *    glctest
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <new>
+#include "glc.h"
+#include "utility.h"
+
+static long numAllocations = 0;
+
+void *operator new(size_t size)
+{
+    numAllocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t size) noexcept { free(p); }
+
+struct TestCase
+{
+    const char *name;
+    const char *source;
+    int numErrors;
+    int line;                   // of the first diagnostic, if any
+    const char *message;        // of the first diagnostic, or NULL for none
+    const char *output;         // the echoed text
+};
+
+static const TestCase cases[] = {
+    { "valid", "void main() { float x = 1.0; }\n", 0, 0, NULL, "" },
+    { "undeclared", "void main() {\n  x = 1;\n}\n", 1, 2,
+      "No declaration found for variable 'x'", "" },
+    { "field echo", "void main(){ vec3 v; float x = v. 5; }\n", 1, 1,
+      "syntax error", "5;}" },
+    { "valid again", "void main() { float x = 1.0; }\n", 0, 0, NULL, "" },
+    { "unrecognized char", "void main() { int y = 2 @ 3; }\n", 2, 1,
+      "Unrecognized char: '@'", "" },
+    { "wrong argument", "float f(float a) { return a; }\nvoid main() { bool b = f(1); }\n",
+      1, 2, "Formal type mismatch in function 'f' at pos 1: expected 'float', given 'int'", "" },
+};
+
+static const char *debugKeys[] = {
+    "lex", "parser", "dumpAST", "flatcheck", "timing", "nodesizes"
+};
+
+static bool RunCase(const TestCase &t, glc_result *result)
+{
+    int errors = glc_check(t.source, strlen(t.source), result);
+    bool ok = (errors == t.numErrors && result->num_errors == t.numErrors &&
+               result->output_len == strlen(t.output) &&
+               memcmp(result->output, t.output, result->output_len) == 0 &&
+               result->output[result->output_len] == '\0');
+    if (t.message)
+        ok = ok && (result->num_diagnostics > 0 && result->diagnostics[0].line == t.line &&
+                    strcmp(result->diagnostics[0].message, t.message) == 0);
+    else
+        ok = ok && result->num_diagnostics == 0;
+    if (!ok) {
+        fprintf(stderr, "*** %s: %d error(s), output \"%.*s\"", t.name, errors,
+                (int)result->output_len, result->output);
+        if (result->num_diagnostics > 0)
+            fprintf(stderr, ", first line %d: %s", result->diagnostics[0].line,
+                    result->diagnostics[0].message);
+        fprintf(stderr, "\n");
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 0; i < sizeof(debugKeys) / sizeof(debugKeys[0]); i++)
+        SetDebugForKey(debugKeys[i], true);
+
+    // Send stdout to a file, unlinked at once, and keep the real one
+    char path[] = "/tmp/glctest.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("glctest");
+        return 1;
+    }
+    unlink(path);
+    fflush(stdout);
+    int realStdout = dup(1);
+    dup2(fd, 1);
+
+    int failed = 0;
+    glc_result result = GLC_RESULT_INIT;
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        if (!RunCase(cases[i], &result)) failed++;
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        long before = numAllocations;
+        if (!RunCase(cases[i], &result)) failed++;
+        if (numAllocations != before) {
+            fprintf(stderr, "*** %s: %ld allocation(s) when checked again\n", cases[i].name,
+                    numAllocations - before);
+            failed++;
+        }
+    }
+    glc_result_free(&result);
+    if (glc_check("", 0, NULL) != -1 || glc_check(NULL, 1, &result) != -1 ||
+        glc_check("", (size_t)INT_MAX + 1, &result) != -1) {
+        fprintf(stderr, "*** bad arguments were not refused\n");
+        failed++;
+    }
+    glc_result_free(&result);
+
+    fflush(stdout);
+    off_t printed = lseek(fd, 0, SEEK_END);
+    dup2(realStdout, 1);
+    if (printed != 0) {
+        fprintf(stderr, "*** %ld byte(s) were written to stdout\n", (long)printed);
+        failed++;
+    }
+    printf("=== %d case(s), %d failed ===\n", (int)(sizeof(cases) / sizeof(cases[0])), failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/* File: incremental.cc
+ * --------------------
+ * Implementation of the incremental checker.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include "incremental.h"
+#include "context.h"
+#include "ast_decl.h"
+#include "ast_type.h"
+#include "atoms.h"
+#include "tokens.h"
+
+// Entries are dropped wholesale when there get to be more than this
+static const int MaxEntries = 1 << 16;
+
+static const unsigned long long FnvOffset = 14695981039346656037ULL;
+static const unsigned long long FnvPrime = 1099511628211ULL;
+
+struct Dependency {
+    string name;
+    string signature;               // empty if the name was not bound
+    bool withLine;
+};
+
+struct RecordedError {
+    errorKindT kind;
+    bool hasLocation;
+    int line;                       // relative to the first line of the decl
+    int firstColumn, lastColumn;
+    string msg;
+};
+
+typedef enum {
+    Unchanged,                      // the name keeps its earlier binding
+    Bound,                          // the name is bound to the decl
+    Unbound                         // the name is left with no binding
+} effectT;
+
+struct IncrementalChecker::Entry {
+    vector<Dependency> deps;
+    vector<RecordedError> errors;
+    effectT effect;
+    bool lineSensitive;             // a message quotes one of its lines
+    int firstLine;
+    string firstSource;             // where firstLine came from
+};
+
+/* Function: Fingerprint()
+ * -----------------------
+ * Hashes (FNV-1a) the text of source lines first through last, and, if
+ * the unit was preprocessed, their tokens and the files they are from.
+ */
+static unsigned long long Fingerprint(CompileContext *ctx, int first, int last)
+{
+    unsigned long long h = FnvOffset;
+    for (int num = first; num <= last; num++) {
+        int len = 0;
+        const char *text = ctx->GetLineNumbered(num, &len);
+        for (int i = 0; text && i < len; i++) {
+            h ^= (unsigned char)text[i];
+            h *= FnvPrime;
+        }
+        const char *path = NULL;
+        if (ctx->preprocessed) ctx->SourceLine(num, &path);
+        for (const char *p = path; p && *p; p++) {
+            h ^= (unsigned char)*p;
+            h *= FnvPrime;
+        }
+        h ^= '\n';
+        h *= FnvPrime;
+    }
+    if (ctx->preprocessed && ctx->tokens && first >= 1 && first <= ctx->NumLines()) {
+        unsigned int end = (last < ctx->NumLines() ? ctx->lineStarts[last] : UINT_MAX);
+        h = ctx->tokens->Hash(h, ctx->lineStarts[first-1], end);
+    }
+    return h;
+}
+
+/* Function: PrintSource()
+ * -----------------------
+ * Describes where line num came from, as a message quoting it would.
+ * Without the preprocessor, that is just num.
+ */
+static void PrintSource(ostream &out, CompileContext *ctx, int num)
+{
+    const char *path;
+    out << ctx->SourceLine(num, &path);
+    if (path) out << " of " << path;
+}
+
+static void PrintType(ostream &out, Type *t)
+{
+    if (t) out << t;
+    else out << "?";
+}
+
+/* Function: PrintSignature()
+ * --------------------------
+ * Describes what a check can learn about a global symbol: its kind and
+ * types, and, if withLine is set, the line it was declared on (which a
+ * declaration conflict error quotes). Nothing is printed for no symbol.
+ */
+static void PrintSignature(ostream &s, CompileContext *ctx, Symbol *sym, bool withLine)
+{
+    if (!sym) return;
+    s << (sym->kind == E_FunctionDecl ? "fn " : "var ");
+    FnDecl *fn = dynamic_cast<FnDecl*>(sym->decl);
+    VarDecl *var = dynamic_cast<VarDecl*>(sym->decl);
+    if (fn) {
+        PrintType(s, fn->GetType());
+        s << " (";
+        for (int i = 0; i < fn->GetFormals()->NumElements(); i++) {
+            PrintType(s, fn->GetFormals()->Nth(i)->GetType());
+            s << ",";
+        }
+        s << ")";
+    } else if (var)
+        PrintType(s, var->GetType());
+    if (withLine && sym->decl->HasLocation()) {
+        s << " @";
+        PrintSource(s, ctx, ctx->LineOf(sym->decl->GetSpan().first));
+    }
+}
+
+/* Function: QuotesLine()
+ * ----------------------
+ * Returns true if msg mentions "line N" for some N from first to last.
+ * Diagnostics like that can't simply be moved to another line.
+ */
+static bool QuotesLine(const char *msg, int first, int last)
+{
+    for (const char *p = strstr(msg, "line "); p; p = strstr(p + 1, "line ")) {
+        int n = atoi(p + 5);
+        if (n >= first && n <= last) return true;
+    }
+    return false;
+}
+
+IncrementalChecker::IncrementalChecker()
+{
+    numChecked = numReused = 0;
+    context = NULL;
+    recording = NULL;
+    recordingName = NULL;
+    firstLine = lastLine = 0;
+    nextRecorder = NULL;
+}
+
+IncrementalChecker::~IncrementalChecker()
+{
+    for (multimap<unsigned long long, Entry *>::iterator it = entries.begin(); it != entries.end(); ++it)
+        delete it->second;
+}
+
+void IncrementalChecker::Check(CompileContext *ctx, List<Decl*> *decls)
+{
+    if (entries.size() > MaxEntries) {
+        for (multimap<unsigned long long, Entry *>::iterator it = entries.begin(); it != entries.end(); ++it)
+            delete it->second;
+        entries.clear();
+    }
+
+    int n = decls->NumElements();
+    for (int i = 0; i < n; i++) {
+        Decl *d = decls->Nth(i);
+        if (ctx->declStartLines.size() != n) { // no line information
+            d->Check(ctx);
+            numChecked++;
+            continue;
+        }
+        int first = ctx->declStartLines[i];
+        int last = (i + 1 < n ? ctx->declStartLines[i+1] : ctx->NumLines());
+        unsigned long long key = Fingerprint(ctx, first, last);
+
+        Entry *found = NULL;
+        pair<multimap<unsigned long long, Entry *>::iterator,
+             multimap<unsigned long long, Entry *>::iterator> range = entries.equal_range(key);
+        for (multimap<unsigned long long, Entry *>::iterator it = range.first; it != range.second; ++it)
+            if (Matches(ctx, it->second, first)) {
+                found = it->second;
+                break;
+            }
+        if (found) {
+            Replay(ctx, found, d, first);
+            numReused++;
+        } else {
+            entries.insert(make_pair(key, Record(ctx, d, first, last)));
+            numChecked++;
+        }
+    }
+}
+
+/* Function: Matches()
+ * --------------------
+ * Returns true if e holds for the declaration at line now. What it is
+ * compared with is printed in scratch, which keeps its storage from one
+ * comparison to the next, and was made room in for everything recorded.
+ */
+bool IncrementalChecker::Matches(CompileContext *ctx, Entry *e, int line)
+{
+    AppendStream s(scratch);
+    if (e->lineSensitive) {
+        scratch.clear();
+        PrintSource(s, ctx, line);
+        if (e->firstLine != line || e->firstSource != scratch)
+            return false;
+    }
+    for (int i = 0; i < e->deps.size(); i++) {
+        Dependency &dep = e->deps[i];
+        // A name that was never scanned has no atom, and so no symbol
+        const char *atom = ctx->atoms->Find(dep.name.c_str());
+        Symbol *sym = (atom ? ctx->symtab->findGlobal(atom) : NULL);
+        scratch.clear();
+        PrintSignature(s, ctx, sym, dep.withLine);
+        if (scratch != dep.signature)
+            return false;
+    }
+    return true;
+}
+
+void IncrementalChecker::Replay(CompileContext *ctx, Entry *e, Decl *d, int line)
+{
+    for (int i = 0; i < e->errors.size(); i++) {
+        RecordedError &r = e->errors[i];
+        yyltype loc;
+        memset(&loc, 0, sizeof(loc));
+        loc.first_line = loc.last_line = line + r.line;
+        loc.first_column = r.firstColumn;
+        loc.last_column = r.lastColumn;
+        ReportError::Replay(ctx, r.kind, r.hasLocation ? &loc : NULL, r.msg.c_str());
+    }
+
+    // Leave the global scope as checking d would have
+    const char *name = d->GetIdentifier()->GetName();
+    bool isFn = (dynamic_cast<FnDecl*>(d) != NULL);
+    Symbol *old = ctx->symtab->findGlobal(name);
+    if (old && e->effect != Unchanged)
+        ctx->symtab->remove(*old);
+    if (e->effect == Bound) {
+        Symbol sym(name, d, isFn ? E_FunctionDecl : E_VarDecl);
+        ctx->symtab->insert(sym);
+    }
+    if (isFn) ctx->isFnDecl = true;
+}
+
+IncrementalChecker::Entry *IncrementalChecker::Record(CompileContext *ctx, Decl *d, int first, int last)
+{
+    Entry *e = new Entry;
+    e->firstLine = first;
+    AppendStream source(e->firstSource);
+    PrintSource(source, ctx, first);
+    if (scratch.capacity() < e->firstSource.size())
+        scratch.reserve(e->firstSource.size());
+    e->lineSensitive = false;
+    context = ctx;
+    recording = e;
+    recordingName = d->GetIdentifier()->GetName();
+    recordedNames.clear();
+    firstLine = first;
+    lastLine = last;
+
+    Symbol *before = ctx->symtab->findGlobal(recordingName);
+    Decl *prev = (before ? before->decl : NULL);
+    nextRecorder = ctx->recorder;
+    ctx->recorder = this;
+    ctx->symtab->setObserver(this);
+    d->Check(ctx);
+    ctx->symtab->setObserver(NULL);
+    ctx->recorder = nextRecorder;
+
+    Symbol *after = ctx->symtab->findGlobal(recordingName);
+    if (!after)
+        e->effect = Unbound;
+    else
+        e->effect = (after->decl == prev ? Unchanged : Bound);
+    recording = NULL;
+    return e;
+}
+
+void IncrementalChecker::GlobalLookup(const char *name, Symbol *sym)
+{
+    if (!recording || !recordedNames.insert(name).second) return;
+    // Only the first lookup of a name counts: the only global binding a
+    // check changes is its own, and later lookups of that find the decl
+    // itself, which the fingerprint covers.
+    Dependency dep;
+    dep.name = name;
+    dep.withLine = (strcmp(name, recordingName) == 0);
+    AppendStream signature(dep.signature);
+    PrintSignature(signature, context, sym, dep.withLine);
+    if (scratch.capacity() < dep.signature.size())
+        scratch.reserve(dep.signature.size());
+    recording->deps.push_back(dep);
+}
+
+void IncrementalChecker::Report(errorKindT kind, yyltype *loc, const char *msg)
+{
+    if (nextRecorder) nextRecorder->Report(kind, loc, msg);
+    if (!recording) return;
+    RecordedError r;
+    r.kind = kind;
+    r.hasLocation = (loc != NULL);
+    r.line = (loc ? loc->first_line - firstLine : 0);
+    r.firstColumn = (loc ? loc->first_column : 0);
+    r.lastColumn = (loc ? loc->last_column : 0);
+    r.msg = msg;
+    recording->errors.push_back(r);
+    // In a preprocessed unit, the lines quoted are the ones they came
+    // from, so any quote might be of one of its lines
+    if (QuotesLine(msg, firstLine, lastLine) ||
+        (context->preprocessed && QuotesLine(msg, 1, INT_MAX)))
+        recording->lineSensitive = true;
+}
+
+static double Median(vector<double> &v)
+{
+    sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+int RunIncrementalBenchmark(const char *path, int rounds)
+{
+    FILE *input = fopen(path, "r");
+    if (!input) {
+        fprintf(stderr, "*** Cannot open file '%s'\n", path);
+        return 2;
+    }
+    string source;
+    char buf[65536];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), input)) > 0)
+        source.append(buf, len);
+    fclose(input);
+
+    // Find the middle declaration and the end of its first line
+    ostringstream ignored;
+    CompileContext probe(ignored);
+    probe.CheckBuffer(source.data(), source.size());
+    int numDecls = probe.declStartLines.size();
+    if (numDecls == 0 || rounds < 1) {
+        fprintf(stderr, "*** Nothing to edit in '%s'\n", path);
+        return 2;
+    }
+    int editLine = probe.declStartLines[numDecls / 2];
+    size_t editAt = 0;
+    for (int line = 1; line <= editLine && editAt != string::npos; line++)
+        editAt = source.find('\n', line == 1 ? 0 : editAt + 1);
+    if (editAt == string::npos) editAt = source.size();
+
+    IncrementalChecker checker;
+    {
+        CompileContext warm(ignored);
+        warm.incremental = &checker;
+        warm.CheckBuffer(source.data(), source.size());
+    }
+    int checkedBefore = checker.NumChecked(), reusedBefore = checker.NumReused();
+
+    // Each edit adds another trailing blank to the line, so every edit
+    // gives the declaration a fingerprint the checker hasn't seen
+    vector<double> fullMillis, incrementalMillis;
+    int mismatches = 0;
+    string edited = source;
+    for (int r = 0; r < rounds; r++) {
+        edited.insert(editAt, " ");
+        ostringstream full, incremental;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        {
+            CompileContext ctx(full);
+            ctx.CheckBuffer(edited.data(), edited.size());
+        }
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        {
+            CompileContext ctx(incremental);
+            ctx.incremental = &checker;
+            ctx.CheckBuffer(edited.data(), edited.size());
+        }
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+        fullMillis.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+        incrementalMillis.push_back(std::chrono::duration<double, std::milli>(t2 - t1).count());
+        if (full.str() != incremental.str()) mismatches++;
+    }
+
+    double fullMedian = Median(fullMillis), incrementalMedian = Median(incrementalMillis);
+    printf("=== %d edit(s) to line %d, %d top-level decl(s) ===\n", rounds, editLine, numDecls);
+    printf("=== full check p50 %.3f ms, incremental p50 %.3f ms, speedup %.2fx ===\n",
+           fullMedian, incrementalMedian,
+           incrementalMedian > 0 ? fullMedian / incrementalMedian : 1.0);
+    printf("=== %d decl(s) rechecked, %d reused, %d output mismatch(es) ===\n",
+           checker.NumChecked() - checkedBefore, checker.NumReused() - reusedBefore, mismatches);
+    return (mismatches == 0 ? 0 : -1);
+}
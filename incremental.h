@@ -0,0 +1,87 @@
+/* File: incremental.h
+ * -------------------
+ * The incremental checker lets a long-lived process (the compile server,
+ * or a libglc result reused from call to call) skip checking top-level
+ * declarations that have not changed since it last checked them, and
+ * replay the diagnostics they gave instead.
+ *
+ * A top-level declaration is identified by a fingerprint of the source
+ * lines it spans (from its first line up to the first line of the next
+ * declaration, or the end of the file). Checking it can only be affected
+ * by what it finds in the global scope, so while it is checked we record
+ * each global name it looks up along with a signature of the symbol
+ * found (kind and types), and what the check leaves bound to its own
+ * name in the global scope. A later declaration with the same
+ * fingerprint whose global names have the same signatures gets the same
+ * diagnostics, shifted to its line, and the same effect on the global
+ * scope, so that is replayed rather than checked. The output is the same
+ * as a full check, in the same order.
+ *
+ * In a preprocessed unit the same lines can mean something else, if
+ * the macros they use are defined differently, so there the fingerprint
+ * also covers the tokens of those lines, and the files they came from.
+ */
+
+#ifndef _H_incremental
+#define _H_incremental
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "errors.h"
+#include "symtable.h"
+#include "list.h"
+
+using namespace std;
+
+class CompileContext;
+class Decl;
+
+class IncrementalChecker : public LookupObserver, public DiagnosticSink
+{
+  public:
+    IncrementalChecker();
+    ~IncrementalChecker();
+
+    // Checks the top-level declarations of the program parsed in ctx,
+    // reusing earlier results where possible
+    void Check(CompileContext *ctx, List<Decl*> *decls);
+
+    int NumChecked() const { return numChecked; }
+    int NumReused() const { return numReused; }
+
+  private:
+    struct Entry;
+    multimap<unsigned long long, Entry *> entries;
+    int numChecked, numReused;
+
+    // While checking a declaration, its entry is being recorded here
+    CompileContext *context;
+    Entry *recording;
+    const char *recordingName;
+    set<string> recordedNames;
+    int firstLine, lastLine;
+    DiagnosticSink *nextRecorder;
+    string scratch;                 // see Matches()
+
+    void GlobalLookup(const char *name, Symbol *sym);
+    void Report(errorKindT kind, yyltype *loc, const char *msg);
+
+    bool Matches(CompileContext *ctx, Entry *e, int line);
+    void Replay(CompileContext *ctx, Entry *e, Decl *d, int line);
+    Entry *Record(CompileContext *ctx, Decl *d, int first, int last);
+};
+
+/* Function: RunIncrementalBenchmark()
+ * -----------------------------------
+ * Simulates editing one function at a time in the file at path: for
+ * each of rounds edits to the middle declaration, the edited source is
+ * checked both from scratch and with a warm IncrementalChecker. Prints
+ * the median time of each and how many declarations were rechecked.
+ * Returns 0 only if the two checks gave identical diagnostics for every
+ * edit.
+ */
+int RunIncrementalBenchmark(const char *path, int rounds);
+
+#endif
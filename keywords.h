@@ -0,0 +1,17 @@
+/* File: keywords.h
+ * ----------------
+ * Recognizes the reserved words. Rather than having a rule for each, the
+ * scanners match any identifier and then ask LookupKeyword() whether it
+ * is a keyword. The table behind it is a perfect hash, which mkkeywords
+ * generates from the list in keywords.def when glc is built, so a lookup
+ * is one hash and at most one string compare.
+ */
+
+#ifndef _H_keywords
+#define _H_keywords
+
+// Returns the token code of the keyword that is the len chars at text,
+// or 0 if they aren't one
+int LookupKeyword(const char *text, int len);
+
+#endif
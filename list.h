@@ -3,15 +3,24 @@
  * ------------
  * Simple list class for storing a linear collection of elements. It
  * supports operations similar in name to the CS107 CVector -- nth, insert,
- * append, remove, etc.  This class is nothing more than a very thin
- * cover of a STL deque, with some added range-checking. Given not everyone
- * is familiar with the C++ templates, this class provides a more familiar
- * interface.
+ * append, remove, etc.  The elements are kept contiguous, in one array:
+ * the first few in the List itself, and when there are more, in an array
+ * that doubles as it fills. Like the nodes it holds, a List and its array
+ * come from the node arena if one is set (see arena.h), and from the heap
+ * if not. Given not everyone is familiar with the C++ templates, this
+ * class provides a more familiar interface.
  *
- * It can handle elements of any type, the typename for a List includes the
- * element type in angle brackets, e.g.  to store elements of type double,
- * you would use the type name List<double>, to store elements of type
- * Decl *, it woud be List<Decl*> and so on.
+ * A List is built up while its production is parsed, and the node that
+ * takes it then calls Freeze(): from then on its elements stay where they
+ * are, so the loops over it that the checker runs can use the unchecked
+ * operator[] or a range-for, which walk the array directly. Nth() still
+ * checks its index, as before.
+ *
+ * It can handle elements of any type that copies by assignment, such as
+ * pointers and numbers; the typename for a List includes the element
+ * type in angle brackets, e.g. to store elements of type double, you
+ * would use the type name List<double>, to store elements of type Decl *,
+ * it woud be List<Decl*> and so on.
  *
  * Here is some sample code illustrating the usage of a List of integers
  *
@@ -23,13 +32,15 @@
  *       }
  *       return sum;
  *    }
+ *
+ * or, once the list is frozen, for (int val : *list) sum += val;
  */
 
 #ifndef _H_list
 #define _H_list
 
-#include <deque>
 #include "utility.h"  // for Assert()
+#include "arena.h"
 using namespace std;
 
 class Node;
@@ -37,15 +48,45 @@ class Node;
 template<class Element> class List {
 
  private:
-    deque<Element> elems;
+    static const int InlineElements = 4;
+
+    Element *elems;                 // inlineElems, or an array from arena
+    Arena *arena;                   // or NULL for the heap
+    int numElems, capacity;
+    bool frozen;
+    Element inlineElems[InlineElements];
+
+    // Makes room for one more element, moving them all to an array twice
+    // the size. The old array is the arena's, or freed if on the heap.
+    void Grow()
+	{ int newCapacity = capacity * 2;
+	  size_t size = newCapacity * sizeof(Element);
+	  Element *grown = (Element *)(arena ? arena->Allocate(size, alignof(Element))
+	                                     : ::operator new(size));
+	  for (int i = 0; i < numElems; i++)
+	      grown[i] = elems[i];
+	  Release();
+	  elems = grown;
+	  capacity = newCapacity; }
+
+    void Release()
+	{ if (!arena && elems != inlineElems) ::operator delete(elems); }
+
+    List(const List &);             // not copied
+    List &operator=(const List &);
 
  public:
            // Create a new empty list
-    List() {}
+    List() : elems(inlineElems), arena(GetNodeArena()), numElems(0),
+             capacity(InlineElements), frozen(false) {}
+    ~List() { Release(); }
+
+    static void *operator new(size_t size) { return AllocateNodeMemory(size); }
+    static void operator delete(void *p)   { FreeNodeMemory(p); }
 
            // Returns count of elements currently in list
     int NumElements() const
-	{ return elems.size(); }
+	{ return numElems; }
 
           // Returns element at index in list. Indexing is 0-based.
           // Raises an assert if index is out of range.
@@ -53,36 +94,62 @@ template<class Element> class List {
 	{ Assert(index >= 0 && index < NumElements());
 	  return elems[index]; }
 
+          // Same, without the range check, for loops that keep their
+          // index in range themselves
+    Element operator[](int index) const
+	{ return elems[index]; }
+
+          // The elements in order, for range-for
+    const Element *begin() const { return elems; }
+    const Element *end() const   { return elems + numElems; }
+
+          // Ends the building of the list: the elements can no longer be
+          // added to, inserted or removed, so they stay where they are
+    void Freeze()
+	{ frozen = true; }
+    bool IsFrozen() const { return frozen; }
+
           // Inserts element at index, shuffling over others
           // Raises assert if index out of range
     void InsertAt(const Element &elem, int index)
-	{ Assert(index >= 0 && index <= NumElements());
-	  elems.insert(elems.begin() + index, elem); }
+	{ Assert(!frozen && index >= 0 && index <= NumElements());
+	  if (numElems == capacity) Grow();
+	  for (int i = numElems; i > index; i--)
+	      elems[i] = elems[i-1];
+	  elems[index] = elem;
+	  numElems++; }
 
           // Adds element to list end
     void Append(const Element &elem)
-	{ elems.push_back(elem); }
+	{ Assert(!frozen);
+	  if (numElems == capacity) Grow();
+	  elems[numElems++] = elem; }
 
          // Removes element at index, shuffling down others
          // Raises assert if index out of range
     void RemoveAt(int index)
-	{ Assert(index >= 0 && index < NumElements());
-	  elems.erase(elems.begin() + index); }
-          
+	{ Assert(!frozen && index >= 0 && index < NumElements());
+	  for (int i = index; i + 1 < numElems; i++)
+	      elems[i] = elems[i+1];
+	  numElems--; }
+
        // These are some specific methods useful for lists of ast nodes
        // They will only work on lists of elements that respond to the
        // messages, but since C++ only instantiates the template if you use
-       // you can still have Lists of ints, chars*, as long as you 
+       // you can still have Lists of ints, chars*, as long as you
        // don't try to SetParentAll on that list.
     void SetParentAll(Node *p)
         { for (int i = 0; i < NumElements(); i++)
-             Nth(i)->SetParent(p); }
+             elems[i]->SetParent(p); }
     void PrintAll(int indentLevel, const char *label = NULL)
         { for (int i = 0; i < NumElements(); i++)
-             Nth(i)->Print(indentLevel, label); }
-             
+             elems[i]->Print(indentLevel, label); }
+    void DeleteAll()
+        { for (int i = 0; i < NumElements(); i++)
+             delete elems[i];
+          numElems = 0; }
+
 
 };
 
 #endif
-
@@ -2,9 +2,15 @@
  * ----------------
  * This file just contains features relative to the location structure
  * used to record the lexical position of a token or symbol.  This file
- * establishes the cmoon definition for the yyltype structure, the global
- * variable yylloc, and a utility function to join locations you might
- * find handy at times.
+ * establishes the cmoon definition for the yyltype structure and a
+ * utility function to join locations you might find handy at times.
+ * There is no global yylloc: the parser is pure, and it hands the
+ * scanner a pointer to the lookahead location on each call to yylex().
+ *
+ * A node keeps its location as a SourceSpan, which is just byte offsets
+ * into the source text; the lines and columns of a yyltype are worked
+ * out from it again only when a diagnostic or the AST dump needs them
+ * (see CompileContext::Locate()).
  */
 
 #ifndef YYLTYPE
@@ -16,21 +22,36 @@
  */
 typedef struct yyltype
 {
-    int timestamp;                 // you can ignore this field
     int first_line, first_column;
     int last_line, last_column;      
-    char *text;                    // you can also ignore this field
+    // Where the first lexeme starts in the source text, and where the
+    // last starts and how long it is (see SourceSpan)
+    unsigned int first_offset, last_offset, last_length;
 } yyltype;
 
 #define YYLTYPE yyltype
 
 
-/* Global variable: yylloc
- * ------------------------
- * The global variable holding the position information about the
- * lexeme just scanned.
+/* Struct: SourceSpan
+ * ------------------
+ * The part of a yyltype that a node keeps: the offset of its first
+ * lexeme, and the offset and length of its last. That is all it takes to
+ * work out the lines and columns again, since a column is the scanner's
+ * column at the start of a lexeme, and the last column is that of the
+ * start of the last lexeme plus its length (which, for a token expanded
+ * from a macro, isn't the length of the text at its offset). A span
+ * with a first offset of NoOffset is no location at all.
  */
-extern struct yyltype yylloc;
+static const unsigned int NoOffset = ~0u;
+
+struct SourceSpan
+{
+    unsigned int first, last, lastLength;
+
+    SourceSpan() : first(NoOffset), last(NoOffset), lastLength(0) {}
+    SourceSpan(const yyltype &loc)
+      : first(loc.first_offset), last(loc.last_offset), lastLength(loc.last_length) {}
+};
 
 
 /* Function: Join
@@ -38,22 +59,15 @@ extern struct yyltype yylloc;
  * Takes two locations and returns a new location which represents
  * the span from first to last, inclusive.
  */
-inline yyltype Join(yyltype first, yyltype last)
+inline SourceSpan Join(const SourceSpan &first, const SourceSpan &last)
 {
-  yyltype combined;
-  combined.first_column = first.first_column;
-  combined.first_line = first.first_line;
-  combined.last_column = last.last_column;
-  combined.last_line = last.last_line;
+  SourceSpan combined;
+  combined.first = first.first;
+  combined.last = last.last;
+  combined.lastLength = last.lastLength;
   return combined;
 }
 
-/* Same as above, except operates on pointers as a convenience  */
-inline yyltype Join(yyltype *firstPtr, yyltype *lastPtr)
-{
-  return Join(*firstPtr, *lastPtr);
-}
-
 
 #endif
 
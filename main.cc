@@ -1,30 +1,315 @@
 /* File: main.cc
  * -------------
  * This file defines the main() routine for the program and not much else.
- * You should not need to modify this file.
+ * Besides checking a single translation unit read from stdin, it offers
+ * a batch mode that checks many files in one process (see batch.h) and
+ * a persistent compile server with a matching client (see server.h).
  */
  
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <vector>
 #include "utility.h"
 #include "errors.h"
 #include "parser.h"
+#include "context.h"
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+#include "incremental.h"
+#include "fastscan.h"
+#include "variants.h"
+#include "astbin.h"
+
+using namespace std;
+
+static const size_t DefaultCacheMegabytes = 256;
+
+
+/* Struct: Option
+ * --------------
+ * An option that may be given anywhere before the -d flags, in any mode
+ * that uses it, and the words that follow it each time it is.
+ */
+struct Option
+{
+    const char *name;
+    int arity;                      // the words it takes
+    int count;                      // the times it was given
+    vector<const char *> values;    // the words of each time, in order
+};
+
+// The options main() takes out of the command line, in the order of
+// optionT, and what they do:
+//
+//    --cache-dir dir      use (and create if need be) the result cache in
+//                         dir (see cache.h)
+//    --cache-size mb      evict entries beyond mb megabytes (default 256)
+//    --cache-stats        print hit/miss counts when done
+//    --stream             check each top-level declaration as soon as it
+//                         is parsed and then free its body, which bounds
+//                         memory use by the largest function rather than
+//                         the whole file (see context.h)
+//    --scan-threads N     scan a large input in N chunks at once (see
+//                         fastscan.h)
+//    --emit-ast-bin out   write the unit, if it checks cleanly, to the
+//                         AST file out (see astbin.h)
+//    --ast-bin file       declare the globals of the AST file before the
+//                         unit's own; may be given more than once
+typedef enum {
+      O_CacheDir, O_CacheSize, O_CacheStats, O_Stream, O_ScanThreads,
+      O_EmitAstBin, O_AstBin, NumOptions
+} optionT;
+
+static Option commandOptions[NumOptions] = {
+    { "--cache-dir", 1 }, { "--cache-size", 1 }, { "--cache-stats", 0 }, { "--stream", 0 },
+    { "--scan-threads", 1 }, { "--emit-ast-bin", 1 }, { "--ast-bin", 1 }
+};
+
+/* Function: RemoveOptions()
+ * -------------------------
+ * Removes each of the options from the command line, with the words it
+ * takes, wherever it appears before the -d flags, and records them in
+ * the option. One without all its words after it is left where it is.
+ */
+static void RemoveOptions(int &argc, char *argv[], Option *options, int numOptions)
+{
+    int kept = 1, i;
+    for (i = 1; i < argc && strcmp(argv[i], "-d") != 0; i++) {
+        Option *o = NULL;
+        for (int k = 0; k < numOptions && !o; k++)
+            if (strcmp(argv[i], options[k].name) == 0 && i + options[k].arity < argc)
+                o = &options[k];
+        if (!o) {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        o->count++;
+        for (int w = 0; w < o->arity; w++)
+            o->values.push_back(argv[++i]);
+    }
+    while (i < argc)
+        argv[kept++] = argv[i++];
+    argc = kept;
+}
+
+// The word given with option o the last time it was given, or NULL
+static const char *LastValue(const Option &o)
+{
+    return (o.values.empty() ? NULL : o.values.back());
+}
+
+/* Function: ParseDebugFlags()
+ * ---------------------------
+ * Hands the -d flags, which start at argv[first], on to
+ * ParseCommandLine(), in place of the operands before them.
+ */
+static void ParseDebugFlags(int argc, char *argv[], int first)
+{
+    argv[first - 1] = argv[0]; // so the -d flags follow a program name
+    ParseCommandLine(argc - (first - 1), argv + (first - 1));
+}
+
+// The result cache the options ask for, or NULL for none
+static ResultCache *MakeCache()
+{
+    const char *dir = LastValue(commandOptions[O_CacheDir]);
+    const char *size = LastValue(commandOptions[O_CacheSize]);
+    size_t megabytes = (size ? atol(size) : DefaultCacheMegabytes);
+    return (dir ? new ResultCache(dir, megabytes << 20) : NULL);
+}
+
+/* Function: UseCache()
+ * --------------------
+ * Debug output goes straight to stdout and is not part of a cached
+ * result, so the cache is skipped when any debug flag is on.
+ */
+static ResultCache *UseCache(ResultCache *cache)
+{
+    return (IsAnyDebugOn() ? NULL : cache);
+}
+
+static int FinishCache(ResultCache *cache, bool printStats, int status)
+{
+    if (cache) {
+        cache->Trim();
+        if (printStats) cache->PrintStats();
+    }
+    return status;
+}
+
+// Prints the program of the AST file at path, for --dump-ast-bin
+static int DumpAstFile(const char *path)
+{
+    string error;
+    AstFile *file = AstFile::Map(path, &error);
+    if (!file) {
+        fprintf(stderr, "*** Cannot use AST file '%s': %s\n", path, error.c_str());
+        return 2;
+    }
+    file->Print();
+    delete file;
+    return 0;
+}
 
 
 /* Function: main()
  * ----------------
  * Entry point to the entire program.  We parse the command line and turn
  * on any debugging flags requested by the user when invoking the program.
- * InitScanner() is used to set up the scanner.
- * InitParser() is used to set up the parser. The call to yyparse() will
- * attempt to parse a complete program from the input. 
+ * InitParser() is used to set up the parser. A CompileContext then
+ * scans, parses and checks a complete program from the input, which is
+ * stdin, or the file named by a path given before any -d flags. A file
+ * named this way is memory-mapped and scanned in place.
+ *
+ * With --batch, the operands up to the first -d are files (or @lists of
+ * files) to check, optionally with -j N to use N worker threads (0 means
+ * one per core), and --speedup to time a -j 1 run of the same files as
+ * well (see RunBatch()); any -d flags that follow are handed on to
+ * ParseCommandLine() as usual.
+ *
+ * With --serve sock, requests are taken from the Unix socket sock (any
+ * -d flags follow the socket path). With --client sock, the given files
+ * (or stdin) are checked by the server at sock; --bench N sends each
+ * file N times and reports request latency instead of diagnostics.
+ * --bench-incremental file [N] times N single-function edits to file,
+ * checked from scratch and incrementally (see incremental.h).
+ * --test-scanners files compares the flex scanner with the hand-written
+ * one on each file and, with --fuzz N, on N random variants of each
+ * (see fastscan.h). --dump-ast-bin file prints the AST in an AST file as
+ * -d dumpAST prints it (see astbin.h).
+ *
+ * With --variants defines.txt file, the file is checked once for each
+ * set of predefined macros listed in defines.txt, with the work the
+ * variants share done once (see variants.h); any -d flags follow. With
+ * --variants defines.txt --bench file, each variant is then checked
+ * again on its own, to compare the time and the output.
+ *
+ * In the single file and batch modes, --cache-dir dir reuses the results
+ * of earlier runs on the same source, and --stream checks each
+ * declaration as it is parsed. Without a cache, --scan-threads N scans a
+ * single large file on N threads. In the single file mode,
+ * --emit-ast-bin and --ast-bin write and use AST files; the cache is not
+ * used with either. See commandOptions above for all of these.
  */
 int main(int argc, char *argv[])
 {
-    ParseCommandLine(argc, argv);
-    InitScanner();
+    RemoveOptions(argc, argv, commandOptions, NumOptions);
+    ResultCache *cache = MakeCache();
+    bool printStats = commandOptions[O_CacheStats].count > 0;
+    bool streaming = commandOptions[O_Stream].count > 0;
+    const char *threads = LastValue(commandOptions[O_ScanThreads]);
+    int scanThreads = (threads ? atoi(threads) : 1);
+    const vector<const char *> &astPaths = commandOptions[O_AstBin].values;
+    const char *emitPath = LastValue(commandOptions[O_EmitAstBin]);
+
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        vector<string> files;
+        int numThreads = 1;
+        bool reportTiming = false, measureSpeedup = false;
+        int i;
+        for (i = 2; i < argc && strcmp(argv[i], "-d") != 0; i++) {
+            if (strncmp(argv[i], "-j", 2) == 0) {
+                const char *n = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+                numThreads = atoi(n);
+                reportTiming = true;
+            } else if (strcmp(argv[i], "--speedup") == 0)
+                measureSpeedup = true;
+            else
+                AddBatchInput(argv[i], files);
+        }
+        ParseDebugFlags(argc, argv, i);
+        InitParser();
+        int status = RunBatch(files, numThreads, reportTiming, measureSpeedup, UseCache(cache),
+                              streaming);
+        return FinishCache(cache, printStats, status);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--serve") == 0) {
+        const char *path = argv[2];
+        ParseDebugFlags(argc, argv, 3);
+        InitParser();
+        return RunServer(path);
+    }
+    if (argc > 2 && strcmp(argv[1], "--bench-incremental") == 0)
+        return RunIncrementalBenchmark(argv[2], argc > 3 ? atoi(argv[3]) : 100);
+    if (argc > 1 && strcmp(argv[1], "--test-scanners") == 0) {
+        vector<string> files;
+        int rounds = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc)
+                rounds = atoi(argv[++i]);
+            else
+                files.push_back(argv[i]);
+        }
+        return RunScannerTest(files, rounds);
+    }
+    if (argc > 2 && strcmp(argv[1], "--dump-ast-bin") == 0)
+        return DumpAstFile(argv[2]);
+    if (argc > 3 && strcmp(argv[1], "--variants") == 0) {
+        vector<vector<string> > variants;
+        if (!ReadVariants(argv[2], variants)) {
+            fprintf(stderr, "*** Cannot open variants file '%s'\n", argv[2]);
+            return 2;
+        }
+        int next = 3;
+        bool compare = (strcmp(argv[next], "--bench") == 0);
+        if (compare && ++next == argc) {
+            fprintf(stderr, "*** --variants needs a file to check\n");
+            return 2;
+        }
+        const char *path = argv[next];
+        ParseDebugFlags(argc, argv, next + 1);
+        InitParser();
+        return RunVariants(path, variants, compare);
+    }
+    if (argc > 2 && strcmp(argv[1], "--client") == 0) {
+        vector<string> files;
+        int benchRounds = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+                benchRounds = atoi(argv[++i]);
+            else
+                files.push_back(argv[i]);
+        }
+        return RunClient(argv[2], files, benchRounds);
+    }
+
+    const char *path = (argc > 1 && argv[1][0] != '-' ? argv[1] : NULL);
+    ParseDebugFlags(argc, argv, path ? 2 : 1);
     InitParser();
-    yyparse();
-    return (ReportError::NumErrors() == 0? 0 : -1);
+    vector<AstFile *> astFiles;
+    for (const char *astPath : astPaths) {
+        string error;
+        AstFile *file = AstFile::Map(astPath, &error);
+        if (!file) {
+            fprintf(stderr, "*** Cannot use AST file '%s': %s\n", astPath, error.c_str());
+            return 2;
+        }
+        astFiles.push_back(file);
+    }
+    int numErrors;
+    bool emitFailed = false;
+    if (UseCache(cache) && !emitPath && astFiles.empty())
+        numErrors = CheckWithCache(cache, path, cout, cerr, streaming);
+    else {
+        CompileContext ctx;
+        ctx.streaming = streaming && !emitPath; // the AST file needs the whole tree
+        ctx.scanThreads = scanThreads;
+        ctx.astFiles.assign(astFiles.begin(), astFiles.end());
+        numErrors = (path ? ctx.CheckPath(path) : ctx.CheckFile(stdin));
+        if (emitPath && numErrors == 0 && ctx.program && !WriteAstFile(&ctx, emitPath)) {
+            fprintf(stderr, "*** Cannot write AST file '%s'\n", emitPath);
+            emitFailed = true;
+        }
+    }
+    for (AstFile *file : astFiles)
+        delete file;
+    if (numErrors < 0) {
+        fprintf(stderr, "*** Cannot open file '%s'\n", path);
+        return 2;
+    }
+    if (emitFailed) return 2;
+    return FinishCache(cache, printStats, numErrors == 0? 0 : -1);
 }
-
@@ -0,0 +1,133 @@
+/* File: mkkeywords.cc
+ * -------------------
+ * Generates the scanner's keyword table (see keywords.h). It is built
+ * and run on the build machine, and writes keyword_table.cc to stdout.
+ *
+ * The keywords, from keywords.def, are hashed into a table with
+ *
+ *    (len + a*s[0] + b*s[len/2] + c*s[len-1]) mod size
+ *
+ * where size is the smallest power of two, and a, b and c the first
+ * multipliers tried, for which no two keywords share a slot. Any other
+ * identifier lands on some slot too, so a lookup compares the text with
+ * the one keyword there.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+struct Keyword {
+    const char *text;
+    const char *token;
+};
+
+static const Keyword keywords[] = {
+#define KEYWORD(text, token) { text, #token },
+#include "keywords.def"
+#undef KEYWORD
+};
+static const int NumKeywords = sizeof(keywords) / sizeof(keywords[0]);
+
+static const unsigned MaxMultiplier = 64;
+static const unsigned MaxTableSize = 4096;
+
+static unsigned Hash(const char *s, unsigned a, unsigned b, unsigned c, unsigned size)
+{
+    unsigned len = strlen(s);
+    return (len + a * (unsigned char)s[0] + b * (unsigned char)s[len/2] +
+            c * (unsigned char)s[len-1]) & (size - 1);
+}
+
+/* Function: Fits()
+ * ----------------
+ * Fills in slots (of size entries) with the index of the keyword in each
+ * one, or -1, and returns true if no two keywords collide.
+ */
+static bool Fits(unsigned a, unsigned b, unsigned c, unsigned size, vector<int> &slots)
+{
+    slots.assign(size, -1);
+    for (int k = 0; k < NumKeywords; k++) {
+        int &slot = slots[Hash(keywords[k].text, a, b, c, size)];
+        if (slot >= 0) return false;
+        slot = k;
+    }
+    return true;
+}
+
+/* Function: Search()
+ * -------------------
+ * Tries the multipliers in turn, and returns true, with a, b and c set,
+ * if some of them give a table of size slots with no collisions.
+ */
+static bool Search(unsigned size, unsigned *a, unsigned *b, unsigned *c, vector<int> &slots)
+{
+    for (*a = 1; *a < MaxMultiplier; (*a)++)
+        for (*b = 0; *b < MaxMultiplier; (*b)++)
+            for (*c = 0; *c < MaxMultiplier; (*c)++)
+                if (Fits(*a, *b, *c, size, slots)) return true;
+    return false;
+}
+
+int main()
+{
+    int minLength = 0, maxLength = 0;
+    for (int k = 0; k < NumKeywords; k++) {
+        int len = strlen(keywords[k].text);
+        if (len == 0) {
+            fprintf(stderr, "mkkeywords: empty keyword in keywords.def\n");
+            return 1;
+        }
+        for (int j = 0; j < k; j++)
+            if (strcmp(keywords[j].text, keywords[k].text) == 0) {
+                fprintf(stderr, "mkkeywords: \"%s\" is listed twice\n", keywords[k].text);
+                return 1;
+            }
+        if (k == 0 || len < minLength) minLength = len;
+        if (len > maxLength) maxLength = len;
+    }
+
+    vector<int> slots;
+    unsigned size = 1, a, b, c;
+    while (size < NumKeywords) size *= 2;
+    while (!Search(size, &a, &b, &c, slots)) {
+        size *= 2;
+        if (size > MaxTableSize) {
+            fprintf(stderr, "mkkeywords: no perfect hash for keywords.def\n");
+            return 1;
+        }
+    }
+
+    printf("/* File: keyword_table.cc\n"
+           " * ----------------------\n"
+           " * Generated by mkkeywords from keywords.def. Do not edit.\n"
+           " */\n\n"
+           "#include <string.h>\n"
+           "#include \"keywords.h\"\n"
+           "#include \"parser.h\" // for token codes\n\n");
+    printf("static const struct {\n"
+           "    const char *text;\n"
+           "    int length;\n"
+           "    int kind;\n"
+           "} slots[%u] = {\n", size);
+    for (unsigned i = 0; i < size; i++) {
+        if (slots[i] < 0)
+            printf("    { \"\", 0, 0 },\n");
+        else
+            printf("    { \"%s\", %d, %s },\n", keywords[slots[i]].text,
+                   (int)strlen(keywords[slots[i]].text), keywords[slots[i]].token);
+    }
+    printf("};\n\n");
+    printf("int LookupKeyword(const char *text, int len)\n"
+           "{\n"
+           "    if (len < %d || len > %d) return 0;\n"
+           "    const unsigned char *s = (const unsigned char *)text;\n"
+           "    unsigned h = (len + %uu * s[0] + %uu * s[len/2] + %uu * s[len-1]) & %uu;\n"
+           "    if (slots[h].length != len || memcmp(slots[h].text, text, len) != 0)\n"
+           "        return 0;\n"
+           "    return slots[h].kind;\n"
+           "}\n", minLength, maxLength, a, b, c, size - 1);
+    return 0;
+}
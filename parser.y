@@ -19,11 +19,45 @@
 #include "scanner.h" // for yylex
 #include "parser.h"
 #include "errors.h"
-
-void yyerror(const char *msg); // standard error-handling routine
+#include "context.h"
+
+// standard error-handling routine, with the pure parser's extra arguments
+void yyerror(yyltype *loc, void *scanner, CompileContext *ctx, const char *msg);
+
+// The location of a rule runs from its first symbol to its last, as
+// bison's default has it, offsets and all (see location.h)
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                 \
+    do {                                                                \
+        if (N) {                                                        \
+            (Current).first_line = YYRHSLOC(Rhs, 1).first_line;         \
+            (Current).first_column = YYRHSLOC(Rhs, 1).first_column;     \
+            (Current).first_offset = YYRHSLOC(Rhs, 1).first_offset;     \
+            (Current).last_line = YYRHSLOC(Rhs, N).last_line;           \
+            (Current).last_column = YYRHSLOC(Rhs, N).last_column;       \
+            (Current).last_offset = YYRHSLOC(Rhs, N).last_offset;       \
+            (Current).last_length = YYRHSLOC(Rhs, N).last_length;       \
+        } else {                                                        \
+            (Current).first_line = (Current).last_line =                \
+                YYRHSLOC(Rhs, 0).last_line;                             \
+            (Current).first_column = (Current).last_column =            \
+                YYRHSLOC(Rhs, 0).last_column;                           \
+            (Current).first_offset = (Current).last_offset =            \
+                YYRHSLOC(Rhs, 0).last_offset;                           \
+            (Current).last_length = YYRHSLOC(Rhs, 0).last_length;       \
+        }                                                               \
+    } while (0)
 
 %}
 
+/* The parser is pure (reentrant): there are no global yylval or yylloc,
+ * and everything belonging to one translation unit is reached through
+ * the scanner handle and the CompileContext passed to yyparse().
+ */
+%define api.pure full
+%locations
+%lex-param   {void *scanner}
+%parse-param {void *scanner} {CompileContext *ctx}
+
 /* The section before the first %% is the Definitions section of the yacc
  * input file. Here is where you declare tokens and types, add precedence
  * and associativity options, and so on.
@@ -42,7 +76,8 @@ void yyerror(const char *msg); // standard error-handling routine
     int integerConstant;
     bool boolConstant;
     double floatConstant;
-    char identifier[MaxIdentLen+1]; // +1 for terminating null
+    const char *atom;               // an identifier, interned (see atoms.h)
+    opcodeT opcode;
     Decl *decl;
     FnDecl *funcDecl;
     List<Decl*> *declList;
@@ -58,6 +93,32 @@ void yyerror(const char *msg); // standard error-handling routine
     List<Expr*> *argList;
 }
 
+%{
+/* Tokens come from the TokenBuffer if the input was scanned ahead, and
+ * straight from the scanner if not. With -d timing, the time spent
+ * getting them is kept apart from the rest of the parse, so each token
+ * is fetched through TimedLex(). This block follows the %union since it
+ * needs YYSTYPE.
+ */
+#include "stats.h"
+#include "tokens.h"
+
+static int NextToken(YYSTYPE *yylval, yyltype *yylloc, void *scanner, CompileContext *ctx)
+{
+    if (ctx->pretokenize) return ctx->tokens->Next(ctx, yylval, yylloc);
+    return yylex(yylval, yylloc, scanner);
+}
+
+static int TimedLex(YYSTYPE *yylval, yyltype *yylloc, void *scanner, CompileContext *ctx)
+{
+    if (!ctx->stats) return NextToken(yylval, yylloc, scanner, ctx);
+    PhaseTimer timer(&ctx->stats->scanMillis);
+    ctx->stats->tokens++;
+    return NextToken(yylval, yylloc, scanner, ctx);
+}
+#define yylex(lval, lloc, scanner) TimedLex(lval, lloc, scanner, ctx)
+%}
+
 
 /* Tokens
  * ------
@@ -75,17 +136,17 @@ void yyerror(const char *msg); // standard error-handling routine
 %token   T_LeftParen T_RightParen T_LeftBracket T_RightBracket T_LeftBrace T_RightBrace
 %token   T_Dot T_Comma T_Colon T_Semicolon T_Question
 
-%token   <identifier> T_LessEqual T_GreaterEqual T_EQ T_NE
-%token   <identifier> T_And T_Or 
-%token   <identifier> T_Plus T_Star
-%token   <identifier> T_MulAssign T_DivAssign T_AddAssign T_SubAssign T_Equal
-%token   <identifier> T_LeftAngle T_RightAngle T_Dash T_Slash
-%token   <identifier> T_Inc T_Dec 
-%token   <identifier> T_Identifier
+%token   <opcode>     T_LessEqual T_GreaterEqual T_EQ T_NE
+%token   <opcode>     T_And T_Or 
+%token   <opcode>     T_Plus T_Star
+%token   <opcode>     T_MulAssign T_DivAssign T_AddAssign T_SubAssign T_Equal
+%token   <opcode>     T_LeftAngle T_RightAngle T_Dash T_Slash
+%token   <opcode>     T_Inc T_Dec 
+%token   <atom>       T_Identifier
 %token   <integerConstant> T_IntConstant
 %token   <floatConstant> T_FloatConstant
 %token   <boolConstant> T_BoolConstant
-%token   <identifier> T_FieldSelection
+%token   <atom>       T_FieldSelection
 
 %nonassoc LOWEST
 %nonassoc LOWER_THAN_ELSE
@@ -138,18 +199,29 @@ Program   :    DeclList            {
                                        * yacc to set up yylloc. You can remove 
                                        * it once you have other uses of @n*/
                                       Program *program = new Program($1);
+                                      ctx->program = program;
+                                      // the decls were checked as they were parsed
+                                      if (ctx->IsStreaming())
+                                          ctx->FinishStream();
                                       // if no errors, advance to next phase
-                                      if (ReportError::NumErrors() == 0) {
+                                      else if (ctx->NumErrors() == 0) {
                                           if ( IsDebugOn("dumpAST") ) {
+                                            SetPrintContext(ctx);
                                             program->Print(0);
+                                            SetPrintContext(NULL);
                                           }
-                                          program->Check();
+                                          PhaseTimer timer(ctx->stats ? &ctx->stats->checkMillis : NULL);
+                                          program->Check(ctx);
                                       }
                                     }
           ;
 
-DeclList  :    DeclList Decl        { ($$=$1)->Append($2); }
-          |    Decl                 { ($$ = new List<Decl*>)->Append($1); }
+DeclList  :    DeclList Decl        { ($$=$1)->Append($2);
+                                      ctx->declStartLines.push_back(@2.first_line);
+                                      if (ctx->IsStreaming()) ctx->StreamDecl($2); }
+          |    Decl                 { ($$ = new List<Decl*>)->Append($1);
+                                      ctx->declStartLines.push_back(@1.first_line);
+                                      if (ctx->IsStreaming()) ctx->StreamDecl($1); }
           ;
 
 /* combine external_declaration and function_definition into a single rule
@@ -178,13 +250,13 @@ Declaration : FuncDecl T_Semicolon   { $$ = $1; }
 
 FuncDecl  : TypeDecl T_Identifier T_LeftParen T_RightParen 
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(yylloc, $2); 
                             List<VarDecl *> *formals = new List<VarDecl *>;
                             $$ = new FnDecl(id, $1, formals);
                          }
           | TypeDecl T_Identifier T_LeftParen ParameterList T_RightParen 
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(yylloc, $2); 
                             $$ = new FnDecl(id, $1, $4);
                          }
           ;
@@ -195,28 +267,28 @@ ParameterList : SingleDecl { ($$ = new List<VarDecl *>)->Append($1);  }
 
 SingleDecl    : TypeDecl T_Identifier
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(yylloc, $2); 
                             $$ = new VarDecl(id, $1);
                          }
               | TypeQualify TypeDecl T_Identifier
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$3); 
+                            Identifier *id = new Identifier(yylloc, $3); 
                             $$ = new VarDecl(id, $2, $1);
                          }
               | TypeDecl T_Identifier T_Equal Initializer
                          {
                             // incomplete: drop the initializer here
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(yylloc, $2); 
                             $$ = new VarDecl(id, $1, $4);
                          }
               | TypeQualify TypeDecl T_Identifier T_Equal Initializer
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$3); 
+                            Identifier *id = new Identifier(yylloc, $3); 
                             $$ = new VarDecl(id, $2, $1, $5);
                          }
               | TypeDecl T_Identifier T_LeftBracket T_IntConstant T_RightBracket 
                          { 
-                            Identifier *id = new Identifier(@2, (const char *)$2);
+                            Identifier *id = new Identifier(@2, $2);
                             $$ = new VarDecl(id, new ArrayType(@1, $1, $4));
                          }
               | TypeQualify TypeDecl T_Identifier T_LeftBracket T_IntConstant T_RightBracket 
@@ -308,7 +380,7 @@ ForStmt            : T_For T_LeftParen Expression T_Semicolon Expression T_Semic
                                  }
                    ;
 
-PrimaryExpr        : T_Identifier    { Identifier *id = new Identifier(yylloc, (const char*)$1);
+PrimaryExpr        : T_Identifier    { Identifier *id = new Identifier(yylloc, $1);
                                        $$ = new VarExpr(yyloc, id);
                                      }
                    | T_IntConstant   { $$ = new IntConstant(yylloc, $1); }
@@ -342,17 +414,17 @@ PostfixExpr        : PrimaryExpr     { $$ = $1; }
                                        }
                    | PostfixExpr T_Inc 
                                        {
-                                          Operator *op = new Operator(yylloc, (const char *)$2);
+                                          Operator *op = new Operator(yylloc, $2);
                                           $$ = new PostfixExpr($1, op);
                                        }
                    | PostfixExpr T_Dec 
                                        {
-                                          Operator *op = new Operator(yylloc, (const char *)$2);
+                                          Operator *op = new Operator(yylloc, $2);
                                           $$ = new PostfixExpr($1, op);
                                        }
                    | PostfixExpr T_Dot T_FieldSelection
                                        {
-                                          Identifier *id = new Identifier(yylloc, (const char *)$3);
+                                          Identifier *id = new Identifier(yylloc, $3);
                                           $$ = new FieldAccess($1, id);
                                        }
                    ;
@@ -470,10 +542,10 @@ Expression         : LogicOrExpr       { $$ = $1; }
                    ;
 
 AssignOp           : T_Equal         { $$ = new Operator(yylloc, $1);   }
-                   | T_AddAssign     { $$ = new Operator(yylloc, "+=");  }
-                   | T_SubAssign     { $$ = new Operator(yylloc, "-=");  }
-                   | T_MulAssign     { $$ = new Operator(yylloc, "*=");  }
-                   | T_DivAssign     { $$ = new Operator(yylloc, "/=");  }
+                   | T_AddAssign     { $$ = new Operator(yylloc, $1);   }
+                   | T_SubAssign     { $$ = new Operator(yylloc, $1);   }
+                   | T_MulAssign     { $$ = new Operator(yylloc, $1);   }
+                   | T_DivAssign     { $$ = new Operator(yylloc, $1);   }
                    ;
 
 %%
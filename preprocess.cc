@@ -0,0 +1,1353 @@
+/* File: preprocess.cc
+ * -------------------
+ * Implementation of the preprocessor.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include "preprocess.h"
+#include "context.h"
+#include "tokens.h"
+#include "atoms.h"
+#include "errors.h"
+#include "parser.h"
+
+static const int MaxIncludeDepth = 64;
+static const int MaxConditionDepth = 256; // of macros within macros in #if
+
+/* Struct: Directive
+ * -----------------
+ * A directive, as found by FindDirectives(). It takes up whole lines,
+ * from start up to end, which is just past the last one's newline.
+ */
+struct Directive {
+    unsigned int start, end;
+    unsigned int hash, hashLineEnd; // the '#', and the end of its line
+    int line;                       // the line the '#' is on
+    string name;                    // "define", "if"..., or "" for a lone '#'
+    string rest;                    // the text after the name, with
+                                    // comments and continuations removed
+    string error;                   // what is wrong with it, if anything
+
+    // For #define: the macro, its parameters if it takes arguments, and
+    // its replacement list, which starts at body in the file
+    string macro;
+    bool function;
+    vector<string> params;
+    string replacement;
+    unsigned int body;
+};
+
+/* Class: SourceFile
+ * -----------------
+ * A file, with its directives found and the rest of it scanned. Once
+ * made it isn't changed, so units on different threads can share it.
+ */
+class SourceFile
+{
+  public:
+    string path, dir;               // dir ends in '/', or is empty
+    string key;                     // the real path, if it has a path
+    time_t mtime;
+    off_t size;
+    string text;
+    vector<unsigned int> lineStarts;
+    string scanned;                 // the text, with the directives blanked
+    TokenBuffer tokens;             // of scanned
+    vector<Directive> directives;
+    string guard;                   // the macro of its include guard, if any
+
+    SourceFile(const string &path, const char *src, size_t len, bool fastScan);
+    int NumLines() const { return lineStarts.size(); }
+    unsigned int LineEnd(int num) const {
+        return (num < lineStarts.size() ? lineStarts[num] : text.size());
+    }
+    const char *GetLine(int num, int *len) const;
+};
+
+static bool IsBlank(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\f' || ch == '\v';
+}
+
+static bool IsNameChar(char ch)
+{
+    return isalnum((unsigned char)ch) || ch == '_';
+}
+
+static size_t SkipBlanks(const string &s, size_t i)
+{
+    while (i < s.size() && IsBlank(s[i])) i++;
+    return i;
+}
+
+static string Trim(const string &s)
+{
+    size_t start = SkipBlanks(s, 0), end = s.size();
+    while (end > start && IsBlank(s[end-1])) end--;
+    return s.substr(start, end - start);
+}
+
+/* Function: FirstName()
+ * ---------------------
+ * Returns the name at the start of s, or "" if it doesn't start with
+ * one.
+ */
+static string FirstName(const string &s)
+{
+    size_t i = SkipBlanks(s, 0), j = i;
+    if (j < s.size() && isdigit((unsigned char)s[j])) return "";
+    while (j < s.size() && IsNameChar(s[j])) j++;
+    return s.substr(i, j - i);
+}
+
+static bool IsConditional(const string &name)
+{
+    return name == "if" || name == "ifdef" || name == "ifndef";
+}
+
+/* Function: Blank()
+ * -----------------
+ * Turns the text from start up to end into blanks, but keeps newlines
+ * and tabs, so lines and columns stay where they were.
+ */
+static void Blank(string &text, size_t start, size_t end)
+{
+    for (size_t i = start; i < end; i++)
+        if (text[i] != '\n' && text[i] != '\t') text[i] = ' ';
+}
+
+/* Function: EndsInComment()
+ * -------------------------
+ * Returns whether a block comment is open at end, after the text from i
+ * on, given whether one was open at i.
+ */
+static bool EndsInComment(const char *s, size_t i, size_t end, bool inComment)
+{
+    for (; i + 1 < end; i++) {
+        if (inComment) {
+            if (s[i] == '*' && s[i+1] == '/') {
+                inComment = false;
+                i++;
+            }
+        } else if (s[i] == '/' && s[i+1] == '/')
+            return false;
+        else if (s[i] == '/' && s[i+1] == '*') {
+            inComment = true;
+            i++;
+        }
+    }
+    return inComment;
+}
+
+/* Function: JoinLines()
+ * ---------------------
+ * Returns the text of a directive from i on, with its lines joined and
+ * each comment replaced by a blank. Sets where to the offset of each
+ * character of it, and one more for its end, and end to just past the
+ * newline of its last line.
+ */
+static string JoinLines(const char *s, size_t i, size_t n, unsigned int *end,
+                        vector<unsigned int> &where)
+{
+    string line;
+    while (i < n && s[i] != '\n') {
+        if (s[i] == '\\' && i + 1 < n && s[i+1] == '\n')
+            i += 2;
+        else if (s[i] == '\\' && i + 2 < n && s[i+1] == '\r' && s[i+2] == '\n')
+            i += 3;
+        else if (s[i] == '/' && i + 1 < n && s[i+1] == '/') {
+            while (i < n && s[i] != '\n') i++;
+        } else if (s[i] == '/' && i + 1 < n && s[i+1] == '*') {
+            where.push_back(i);
+            line += ' ';
+            for (i += 2; i < n && !(s[i] == '*' && i + 1 < n && s[i+1] == '/'); i++)
+                ;
+            i = (i < n ? i + 2 : n);
+        } else {
+            where.push_back(i);
+            line += s[i++];
+        }
+    }
+    where.push_back(i);
+    *end = (i < n ? i + 1 : n);
+    return line;
+}
+
+/* Function: ParseDefine()
+ * -----------------------
+ * Fills in the macro of #define d from the text after its name, from
+ * i on in line.
+ */
+static void ParseDefine(const string &line, size_t i, const vector<unsigned int> &where,
+                        Directive &d)
+{
+    i = SkipBlanks(line, i);
+    d.macro = FirstName(line.substr(i));
+    if (d.macro.empty()) {
+        d.error = "#define needs a macro name";
+        return;
+    }
+    size_t j = i + d.macro.size();
+    if (j < line.size() && line[j] == '(') {
+        // No blank before the '(', so it takes arguments
+        d.function = true;
+        j = SkipBlanks(line, j + 1);
+        if (j < line.size() && line[j] == ')')
+            j++;
+        else
+            for (;;) {
+                string param = FirstName(line.substr(j));
+                j = SkipBlanks(line, j + param.size());
+                if (param.empty() || j >= line.size() || (line[j] != ',' && line[j] != ')')) {
+                    d.error = "Invalid parameter list for macro '" + d.macro + "'";
+                    return;
+                }
+                d.params.push_back(param);
+                if (line[j++] == ')') break;
+                j = SkipBlanks(line, j);
+            }
+    }
+    j = SkipBlanks(line, j);
+    d.replacement = Trim(line.substr(j));
+    d.body = where[j];
+}
+
+/* Function: FindDirectives()
+ * --------------------------
+ * Finds the file's directives, and sets scanned to its text with them
+ * blanked out, except for the replacement list of each #define. A
+ * backslash at the end of a line carries a directive on to the next,
+ * as does a block comment, to the line it ends on. A '#' in a comment
+ * doesn't start a directive, so the comments in between are followed.
+ */
+static void FindDirectives(SourceFile *f)
+{
+    const char *s = f->text.data();
+    size_t n = f->text.size();
+    f->scanned = f->text;
+    bool inComment = false;
+    for (int num = 1; num <= f->NumLines(); ) {
+        unsigned int i = f->lineStarts[num-1], end = f->LineEnd(num);
+        while (i < end && IsBlank(s[i])) i++;
+        if (inComment || i == end || s[i] != '#') {
+            inComment = EndsInComment(s, i, end, inComment);
+            num++;
+            continue;
+        }
+
+        Directive d;
+        d.start = f->lineStarts[num-1];
+        d.hash = i;
+        for (d.hashLineEnd = end; d.hashLineEnd > i && isspace((unsigned char)s[d.hashLineEnd-1]); )
+            d.hashLineEnd--;
+        d.line = num;
+        vector<unsigned int> where;
+        string line = JoinLines(s, i + 1, n, &d.end, where);
+        size_t j = SkipBlanks(line, 0), k = j;
+        while (k < line.size() && IsNameChar(line[k])) k++;
+        d.name = line.substr(j, k - j);
+        d.rest = Trim(line.substr(k));
+        d.function = false;
+        d.body = d.end;
+        if (d.name == "define")
+            ParseDefine(line, k, where, d);
+
+        // The replacement list is scanned where it is, less continuations
+        Blank(f->scanned, d.hash, d.body);
+        for (unsigned int b = d.body; b + 1 < d.end; b++)
+            if (s[b] == '\\' && (s[b+1] == '\n' || (s[b+1] == '\r' && b + 2 < n && s[b+2] == '\n')))
+                f->scanned[b] = ' ';
+        f->directives.push_back(d);
+        while (num <= f->NumLines() && f->lineStarts[num-1] < d.end) num++;
+    }
+}
+
+/* Function: FindGuard()
+ * ---------------------
+ * Returns the macro of the file's include guard, if it has one: its
+ * first directive is #ifndef X and its second #define X, its last one
+ * is the #endif of the first, and it has no tokens outside them.
+ */
+static string FindGuard(const SourceFile *f)
+{
+    const vector<Directive> &ds = f->directives;
+    if (ds.size() < 3 || ds[0].name != "ifndef" || ds[1].name != "define" ||
+        ds.back().name != "endif")
+        return "";
+    string guard = FirstName(ds[0].rest);
+    if (guard.empty() || ds[1].macro != guard) return "";
+    int depth = 0;
+    for (int i = 0; i + 1 < ds.size(); i++) {
+        if (IsConditional(ds[i].name))
+            depth++;
+        else if (ds[i].name == "endif" && --depth == 0)
+            return "";
+    }
+    const TokenBuffer &t = f->tokens;
+    int last = t.NumTokens() - 2;   // the one before the end of input
+    if (last >= 0 && (t.offsets[0] < ds[0].end || t.offsets[last] >= ds.back().start))
+        return "";
+    return guard;
+}
+
+SourceFile::SourceFile(const string &path, const char *src, size_t len, bool fastScan)
+    : path(path), text(src, len)
+{
+    size_t slash = path.rfind('/');
+    dir = (slash == string::npos ? "" : path.substr(0, slash + 1));
+    mtime = 0;
+    size = len;
+    const char *p = text.data(), *end = p + len;
+    if (len > 0) lineStarts.push_back(0);
+    while ((p = (const char *)memchr(p, '\n', end - p)) != NULL && ++p < end)
+        lineStarts.push_back(p - text.data());
+    FindDirectives(this);
+
+    // The tokens don't depend on the context that scans them, except for
+    // identifiers' atoms, which the preprocessor gets from the text
+    ostringstream ignored;
+    CompileContext scratch(ignored);
+    scratch.fastScan = fastScan;
+    scratch.Tokenize(scanned.data(), scanned.size(), &tokens);
+    guard = FindGuard(this);
+}
+
+const char *SourceFile::GetLine(int num, int *len) const
+{
+    if (num <= 0 || num > lineStarts.size()) return NULL;
+    size_t start = lineStarts[num-1], end = LineEnd(num);
+    if (end > start && text[end-1] == '\n') end--;
+    *len = end - start;
+    return text.data() + start;
+}
+
+bool HasDirectives(const char *text, size_t len)
+{
+    const char *end = text + len;
+    for (const char *p = text; (p = (const char *)memchr(p, '#', end - p)) != NULL; p++) {
+        const char *q = p;
+        while (q > text && IsBlank(q[-1])) q--;
+        if (q == text || q[-1] == '\n') return true;
+    }
+    return false;
+}
+
+const char *PreprocessedUnit::GetLine(int num, int *len) const
+{
+    if (num <= 0 || num > lines.size()) return NULL;
+    return lines[num-1].file->GetLine(lines[num-1].line, len);
+}
+
+int PreprocessedUnit::SourceLine(int num, const char **path) const
+{
+    *path = NULL;
+    if (num <= 0 || num > lines.size()) return num;
+    const Origin &o = lines[num-1];
+    if (o.file != files[0].get()) *path = o.file->path.c_str();
+    return o.line;
+}
+
+
+/* Class: IncludeCache
+ * -------------------
+ * The files included by every unit compiled in the process (glc --batch
+ * and the server compile many, on several threads), scanned, by their
+ * real path. An entry is used again while the file's modification time
+ * and size are the same; otherwise the file is read again, and the new
+ * entry replaces the old one.
+ */
+class IncludeCache
+{
+  public:
+    shared_ptr<const SourceFile> Lookup(const string &path, const string &key,
+                                        const struct stat &st, bool fastScan);
+  private:
+    mutex lock;
+    map<string, shared_ptr<const SourceFile> > files;
+};
+
+static IncludeCache includeCache;
+
+static bool ReadFile(const string &path, string &text)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+shared_ptr<const SourceFile> IncludeCache::Lookup(const string &path, const string &key,
+                                                  const struct stat &st, bool fastScan)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        map<string, shared_ptr<const SourceFile> >::iterator it = files.find(key);
+        if (it != files.end() && it->second->mtime == st.st_mtime &&
+            it->second->size == st.st_size)
+            return it->second;
+    }
+    // Read and scanned without the lock held. If two units miss at once,
+    // both do that, and the second one's entry is kept.
+    string text;
+    if (!ReadFile(path, text) || text.size() > UINT_MAX)
+        return shared_ptr<const SourceFile>();
+    SourceFile *file = new SourceFile(path, text.data(), text.size(), fastScan);
+    file->key = key;
+    file->mtime = st.st_mtime;
+    shared_ptr<const SourceFile> entry(file);
+    lock_guard<mutex> guard(lock);
+    files[key] = entry;
+    return entry;
+}
+
+/* Function: Resolve()
+ * -------------------
+ * Finds the file included as name from a file in dir: relative to dir,
+ * or failing that to the current directory. Sets path to it, key to its
+ * real path and st to its status, and returns false if there is none.
+ */
+static bool Resolve(const string &dir, const string &name, string &path, string &key,
+                    struct stat &st)
+{
+    string tries[2] = { (name[0] == '/' ? name : dir + name), name };
+    for (int i = 0; i < 2; i++) {
+        if (stat(tries[i].c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        path = tries[i];
+        char *real = realpath(path.c_str(), NULL);
+        key = (real ? real : path);
+        free(real);
+        return true;
+    }
+    return false;
+}
+
+
+/* Struct: Word
+ * ------------
+ * A token of the text of a directive: a name ('a'), a number ('0'), a
+ * string ('"') or punctuation ('p').
+ */
+struct Word {
+    char kind;
+    string text;
+
+    Word(char kind, const string &text) : kind(kind), text(text) {}
+};
+
+static void SplitWords(const string &s, vector<Word> &words)
+{
+    static const char *const pairs[] = { "||", "&&", "==", "!=", "<=", ">=", "<<", ">>" };
+    for (size_t i = SkipBlanks(s, 0); i < s.size(); i = SkipBlanks(s, i)) {
+        size_t j = i + 1;
+        char kind = 'p';
+        if (isdigit((unsigned char)s[i])) {
+            while (j < s.size() && (IsNameChar(s[j]) || s[j] == '.')) j++;
+            kind = '0';
+        } else if (IsNameChar(s[i])) {
+            while (j < s.size() && IsNameChar(s[j])) j++;
+            kind = 'a';
+        } else if (s[i] == '"') {
+            while (j < s.size() && s[j] != '"') j++;
+            j = (j < s.size() ? j + 1 : j);
+            kind = '"';
+        } else {
+            for (int k = 0; k < sizeof(pairs) / sizeof(pairs[0]); k++)
+                if (s.compare(i, 2, pairs[k]) == 0) j = i + 2;
+        }
+        words.push_back(Word(kind, s.substr(i, j - i)));
+        i = j;
+    }
+}
+
+/* Class: ConditionParser
+ * ----------------------
+ * Evaluates the expression of an #if or #elif, once its macros are
+ * expanded, in long long arithmetic, as C does in intmax_t.
+ */
+class ConditionParser
+{
+  public:
+    ConditionParser(const vector<Word> &words) : words(words), pos(0) {}
+    bool Evaluate(long long *value, string &message);
+
+  private:
+    const vector<Word> &words;
+    int pos;
+    string error;
+
+    bool Take(const char *text);
+    long long Conditional();
+    long long Binary(int level);
+    long long Unary();
+    long long Primary();
+};
+
+// The binary operators, from the loosest binding to the tightest
+static const char *const binaryOps[][4] = {
+    { "||" }, { "&&" }, { "|" }, { "^" }, { "&" }, { "==", "!=" },
+    { "<", ">", "<=", ">=" }, { "<<", ">>" }, { "+", "-" }, { "*", "/", "%" },
+};
+static const int NumLevels = sizeof(binaryOps) / sizeof(binaryOps[0]);
+
+bool ConditionParser::Evaluate(long long *value, string &message)
+{
+    if (words.empty())
+        error = "#if with no expression";
+    else {
+        *value = Conditional();
+        if (error.empty() && pos < words.size())
+            error = "Invalid #if expression at '" + words[pos].text + "'";
+    }
+    message = error;
+    return error.empty();
+}
+
+bool ConditionParser::Take(const char *text)
+{
+    if (pos < words.size() && words[pos].kind == 'p' && words[pos].text == text) {
+        pos++;
+        return true;
+    }
+    return false;
+}
+
+long long ConditionParser::Conditional()
+{
+    long long test = Binary(0);
+    if (!Take("?")) return test;
+    long long ifTrue = Conditional();
+    if (!Take(":")) {
+        if (error.empty()) error = "Missing ':' in #if expression";
+        return 0;
+    }
+    long long ifFalse = Conditional();
+    return test ? ifTrue : ifFalse;
+}
+
+/* Function: Binary()
+ * ------------------
+ * Evaluates operands joined by the operators of level or tighter ones.
+ * The arithmetic is done unsigned, where C's would overflow.
+ */
+long long ConditionParser::Binary(int level)
+{
+    if (level == NumLevels) return Unary();
+    long long lhs = Binary(level + 1);
+    for (;;) {
+        const char *op = NULL;
+        for (int i = 0; i < 4 && binaryOps[level][i] && !op; i++)
+            if (Take(binaryOps[level][i])) op = binaryOps[level][i];
+        if (!op) return lhs;
+        long long rhs = Binary(level + 1);
+        unsigned long long a = lhs, b = rhs;
+        string o = op;
+        if ((o == "/" || o == "%") && rhs == 0) {
+            if (error.empty()) error = "Division by zero in #if";
+            return 0;
+        }
+        if (o == "||") lhs = (lhs || rhs);
+        else if (o == "&&") lhs = (lhs && rhs);
+        else if (o == "|") lhs = lhs | rhs;
+        else if (o == "^") lhs = lhs ^ rhs;
+        else if (o == "&") lhs = lhs & rhs;
+        else if (o == "==") lhs = (lhs == rhs);
+        else if (o == "!=") lhs = (lhs != rhs);
+        else if (o == "<") lhs = (lhs < rhs);
+        else if (o == ">") lhs = (lhs > rhs);
+        else if (o == "<=") lhs = (lhs <= rhs);
+        else if (o == ">=") lhs = (lhs >= rhs);
+        else if (o == "<<") lhs = (long long)(a << (b & 63));
+        else if (o == ">>") lhs = lhs >> (b & 63);
+        else if (o == "+") lhs = (long long)(a + b);
+        else if (o == "-") lhs = (long long)(a - b);
+        else if (o == "*") lhs = (long long)(a * b);
+        else if (o == "/") lhs = (rhs == -1 ? (long long)(0 - a) : lhs / rhs);
+        else lhs = (rhs == -1 ? 0 : lhs % rhs);
+    }
+}
+
+long long ConditionParser::Unary()
+{
+    if (Take("!")) return !Unary();
+    if (Take("~")) return ~Unary();
+    if (Take("-")) return (long long)(0 - (unsigned long long)Unary());
+    if (Take("+")) return Unary();
+    return Primary();
+}
+
+long long ConditionParser::Primary()
+{
+    if (Take("(")) {
+        long long value = Conditional();
+        if (!Take(")") && error.empty()) error = "Missing ')' in #if expression";
+        return value;
+    }
+    if (pos < words.size() && words[pos].kind == '0') {
+        const string &text = words[pos++].text;
+        char *end;
+        long long value = (long long)strtoull(text.c_str(), &end, 0);
+        if (*end == 'u' || *end == 'U') end++;
+        if (*end != '\0' && error.empty()) error = "Invalid number in #if: " + text;
+        return value;
+    }
+    if (error.empty())
+        error = (pos < words.size() ? "Invalid #if expression at '" + words[pos].text + "'"
+                                    : "#if expression ends too soon");
+    return 0;
+}
+
+
+/* Struct: Token
+ * -------------
+ * A token on its way to the unit's buffer: what the parser will see,
+ * and where it is to be put.
+ */
+struct Macro;
+struct Token {
+    int kind;
+    YYSTYPE value;
+    unsigned int offset, length;
+    bool expanded;                  // from a macro, so put at its name
+    bool painted;                   // a macro's name not to be expanded
+    int param;                      // in a replacement list, the parameter
+                                    // it stands for, or -1
+    Macro *ends;                    // if set, not a token but the end of
+                                    // this macro's expansion
+};
+
+struct Macro {
+    bool function;
+    vector<const char *> params;
+    vector<Token> body;
+    string text;                    // the replacement list, for #if
+    bool busy;                      // being expanded
+};
+
+/* Struct: OpenConditional
+ * -----------------------
+ * An #if, #ifdef or #ifndef whose #endif hasn't been reached yet.
+ */
+struct OpenConditional {
+    const Directive *opened;
+    bool enclosing;                 // whether the lines around it are kept
+    bool taken;                     // whether one of its groups was kept
+    bool sawElse;
+};
+
+/* Class: Preprocessor
+ * -------------------
+ * Preprocesses one unit into its TokenBuffer, while the buffer records
+ * diagnostics (see TokenBuffer::BeginScan()).
+ */
+class Preprocessor
+{
+  public:
+    Preprocessor(CompileContext *ctx, TokenBuffer *out, PreprocessedUnit *unit);
+    void Include(const SourceFile *f, int depth);
+    void Predefine(const string &definition);
+
+  private:
+    CompileContext *ctx;
+    TokenBuffer *out;
+    PreprocessedUnit *unit;
+    map<const char *, Macro> macros;
+    map<string, const SourceFile *> included; // by directory and name
+    set<string> onceOnly;           // keys of files with #pragma once
+
+    // The file being worked through: how much of it has been copied
+    // into the unit's text, which is where its offsets are moved to, and
+    // how far its tokens, diagnostics and lines have been taken
+    const SourceFile *file;
+    unsigned int copied;
+    long delta;
+    int nextToken, nextEvent, nextLine;
+    unsigned int limit;             // where reading from it stops
+    unsigned int lastEvent;         // the offset of the last diagnostic
+
+    // Tokens that macros expanded to, which are read before the file's,
+    // and, while arguments are expanded, where tokens go instead of the
+    // buffer
+    deque<Token> pending;
+    bool fromFile;
+    vector<Token> *collected;
+    unsigned int lastOffset, lastLength; // of the last token read
+
+    const char *Atom(const char *name, size_t len);
+    const char *Atom(const string &name) { return Atom(name.data(), name.size()); }
+    void Error(unsigned int offset, unsigned int length, const string &msg);
+    void Error(const Directive &d, const string &msg);
+    void EndLine();
+    void Copy(unsigned int end, bool keep);
+    void TakeEvents(unsigned int end, bool keep);
+    Token ScannedToken(const TokenBuffer &tokens, int i, const char *text, long delta);
+    Token FileToken(int i);
+    bool Read(Token *t);
+    bool NextIsLeftParen();
+    bool Expand(Token &name);
+    bool ReadArguments(const Token &name, const Macro &m, vector<vector<Token> > &args);
+    void ExpandList(const vector<Token> &in, vector<Token> &result);
+    void Emit(const Token &t);
+    bool Conditional(const Directive &d, vector<OpenConditional> &open, bool active);
+    bool Test(const Directive &d);
+    bool ExpandCondition(const vector<Word> &in, vector<Word> &result, int depth, string &error);
+    void Define(const Directive &d, const vector<Token> &body);
+    void IncludeFile(const Directive &d, int depth);
+    bool Skippable(const SourceFile *f);
+};
+
+Preprocessor::Preprocessor(CompileContext *ctx, TokenBuffer *out, PreprocessedUnit *unit)
+{
+    this->ctx = ctx;
+    this->out = out;
+    this->unit = unit;
+    file = NULL;
+    copied = 0;
+    delta = 0;
+    nextToken = nextEvent = 0;
+    nextLine = 1;
+    limit = 0;
+    lastEvent = 0;
+    fromFile = false;
+    collected = NULL;
+    lastOffset = lastLength = 0;
+}
+
+/* Function: Atom()
+ * ----------------
+ * Returns the context's atom for a name, which, as for an identifier,
+ * is its first MaxIdentLen characters.
+ */
+const char *Preprocessor::Atom(const char *name, size_t len)
+{
+    return ctx->atoms->Intern(name, len < MaxIdentLen ? len : MaxIdentLen);
+}
+
+/* Function: Error()
+ * -----------------
+ * Reports msg at offset in the unit's text, or, with no length, without
+ * a location. Like the scanner's, it is reported when the parser gets
+ * there.
+ */
+void Preprocessor::Error(unsigned int offset, unsigned int length, const string &msg)
+{
+    if (offset < lastEvent) offset = lastEvent;
+    lastEvent = offset;
+    out->At(offset, length);
+    yyltype loc = yyltype();
+    ReportError::PreprocessorError(ctx, length > 0 ? &loc : NULL, msg.c_str());
+}
+
+void Preprocessor::Error(const Directive &d, const string &msg)
+{
+    Error(d.hash + delta, d.hashLineEnd - d.hash, msg);
+}
+
+/* Function: EndLine()
+ * -------------------
+ * Ends the last line of the unit's text, if it isn't ended, so that
+ * another file's lines can follow.
+ */
+void Preprocessor::EndLine()
+{
+    if (!unit->text.empty() && unit->text[unit->text.size()-1] != '\n')
+        unit->text += '\n';
+}
+
+/* Function: Include()
+ * -------------------
+ * Adds the lines of f to the unit, and the tokens of those that are
+ * kept, doing its directives as it gets to them. depth is how many
+ * files include it.
+ */
+void Preprocessor::Include(const SourceFile *f, int depth)
+{
+    const SourceFile *includer = file;
+    unsigned int savedCopied = copied;
+    int savedToken = nextToken, savedEvent = nextEvent, savedLine = nextLine;
+    EndLine();
+    file = f;
+    copied = 0;
+    delta = unit->text.size();
+    nextToken = nextEvent = 0;
+    nextLine = 1;
+
+    vector<OpenConditional> open;
+    bool active = true;
+    for (int i = 0; i < f->directives.size(); i++) {
+        const Directive &d = f->directives[i];
+        Copy(d.start, active);
+        bool keep = active;
+        if (IsConditional(d.name) || d.name == "elif" || d.name == "else" || d.name == "endif")
+            active = Conditional(d, open, active);
+        else if (keep && !d.error.empty())
+            Error(d, d.error);
+        else if (keep && d.name == "undef")
+            macros.erase(Atom(FirstName(d.rest)));
+        else if (keep && d.name == "error")
+            Error(d, "#error " + d.rest);
+        else if (keep && d.name == "pragma" && d.rest == "once")
+            onceOnly.insert(f->key);
+        else if (keep && d.name != "define" && d.name != "include" && d.name != "pragma" &&
+                 d.name != "version" && d.name != "extension" && d.name != "line" && d.name != "")
+            Error(d, "Invalid preprocessor directive: #" + d.name);
+
+        // The tokens in a directive's lines are a #define's replacement list
+        vector<Token> body;
+        for (; nextToken < f->tokens.NumTokens() - 1 && f->tokens.offsets[nextToken] < d.end; nextToken++)
+            body.push_back(FileToken(nextToken));
+        if (keep && d.name == "define" && d.error.empty())
+            Define(d, body);
+        TakeEvents(d.end, keep);
+        Copy(d.end, keep && d.name == "define");
+        if (keep && d.name == "include")
+            IncludeFile(d, depth);
+    }
+    Copy(f->text.size(), active);
+    TakeEvents(UINT_MAX, active);
+    for (int i = 0; i < open.size(); i++) {
+        ostringstream s;
+        s << "#" << open[i].opened->name << " on line " << open[i].opened->line;
+        if (f != unit->files[0].get()) s << " of " << f->path;
+        s << " has no #endif";
+        Error(f->text.size() + delta, 0, s.str());
+    }
+
+    if (!includer) return;
+    EndLine();
+    file = includer;
+    copied = savedCopied;
+    delta = (long)unit->text.size() - copied;
+    nextToken = savedToken;
+    nextEvent = savedEvent;
+    nextLine = savedLine;
+}
+
+/* Function: Copy()
+ * ----------------
+ * Copies the file's text up to end into the unit's text, blanked unless
+ * keep is set, with the lines it came from. If the lines are kept, so
+ * are their tokens, with macros expanded, and their diagnostics.
+ */
+void Preprocessor::Copy(unsigned int end, bool keep)
+{
+    if (end <= copied) return;
+    size_t start = unit->text.size();
+    unit->text.append(file->scanned, copied, end - copied);
+    if (!keep) Blank(unit->text, start, unit->text.size());
+    for (; nextLine <= file->NumLines() && file->lineStarts[nextLine-1] < end; nextLine++) {
+        PreprocessedUnit::Origin o = { file, nextLine };
+        unit->lines.push_back(o);
+    }
+    copied = end;
+
+    limit = end;
+    if (keep) {
+        fromFile = true;
+        Token t;
+        while (Read(&t))
+            if (!Expand(t)) Emit(t);
+        fromFile = false;
+    } else {
+        while (nextToken < file->tokens.NumTokens() - 1 && file->tokens.offsets[nextToken] < end)
+            nextToken++;
+    }
+    TakeEvents(end, keep);
+}
+
+/* Function: TakeEvents()
+ * ----------------------
+ * Moves on past the file's diagnostics before end, copying them into
+ * the unit's buffer if keep is set.
+ */
+void Preprocessor::TakeEvents(unsigned int end, bool keep)
+{
+    const TokenBuffer &tokens = file->tokens;
+    for (; nextEvent < tokens.NumEvents() && tokens.EventOffset(nextEvent) < end; nextEvent++) {
+        if (!keep) continue;
+        unsigned int offset = tokens.EventOffset(nextEvent) + delta;
+        if (offset < lastEvent) offset = lastEvent;
+        lastEvent = offset;
+        out->CopyEvent(tokens, nextEvent, offset);
+    }
+}
+
+/* Function: ScannedToken()
+ * -------------------------
+ * Returns token i of tokens, a scan of text, moved on by delta.
+ */
+Token Preprocessor::ScannedToken(const TokenBuffer &tokens, int i, const char *text, long delta)
+{
+    Token t;
+    t.kind = tokens.kinds[i];
+    t.value = tokens.values[i];
+    t.offset = tokens.offsets[i] + delta;
+    t.length = tokens.lengths[i];
+    if (t.kind == T_Identifier || t.kind == T_FieldSelection)
+        t.value.atom = Atom(text + tokens.offsets[i], tokens.lengths[i]);
+    t.expanded = t.painted = false;
+    t.param = -1;
+    t.ends = NULL;
+    return t;
+}
+
+Token Preprocessor::FileToken(int i)
+{
+    return ScannedToken(file->tokens, i, file->text.data(), delta);
+}
+
+/* Function: Read()
+ * ----------------
+ * Sets t to the next token to be expanded, if there is one: the next
+ * that a macro expanded to, or else, if reading from the file, its next
+ * one before the limit. Once past the end of a macro's expansion, the
+ * macro can be expanded again.
+ */
+bool Preprocessor::Read(Token *t)
+{
+    while (!pending.empty()) {
+        *t = pending.front();
+        pending.pop_front();
+        if (!t->ends) {
+            lastOffset = t->offset;
+            lastLength = t->length;
+            return true;
+        }
+        t->ends->busy = false;
+    }
+    const TokenBuffer &tokens = file->tokens;
+    if (!fromFile || nextToken >= tokens.NumTokens() - 1 || tokens.offsets[nextToken] >= limit)
+        return false;
+    TakeEvents(tokens.offsets[nextToken] + 1, true);
+    *t = FileToken(nextToken++);
+    lastOffset = t->offset;
+    lastLength = t->length;
+    return true;
+}
+
+bool Preprocessor::NextIsLeftParen()
+{
+    for (deque<Token>::iterator it = pending.begin(); it != pending.end(); ++it)
+        if (!it->ends) return it->kind == T_LeftParen;
+    const TokenBuffer &tokens = file->tokens;
+    return fromFile && nextToken < tokens.NumTokens() - 1 &&
+           tokens.offsets[nextToken] < limit && tokens.kinds[nextToken] == T_LeftParen;
+}
+
+/* Function: Expand()
+ * ------------------
+ * If name is a macro to be expanded, reads its arguments, if it takes
+ * any, and puts what it expands to back to be read next. Returns false
+ * if name is to be kept as it is.
+ */
+bool Preprocessor::Expand(Token &name)
+{
+    if (name.kind != T_Identifier || name.painted) return false;
+    map<const char *, Macro>::iterator it = macros.find(name.value.atom);
+    if (it == macros.end()) return false;
+    Macro &m = it->second;
+    if (m.busy) {
+        name.painted = true;        // for good, as in C
+        return false;
+    }
+    vector<vector<Token> > args;
+    if (m.function) {
+        if (!NextIsLeftParen()) return false;
+        if (!ReadArguments(name, m, args)) return true;
+    }
+
+    Token end = Token();
+    end.ends = &m;
+    pending.push_front(end);
+    for (int i = m.body.size() - 1; i >= 0; i--) {
+        const vector<Token> *tokens = NULL;
+        if (m.body[i].param >= 0) tokens = &args[m.body[i].param];
+        for (int j = (tokens ? tokens->size() : 1) - 1; j >= 0; j--) {
+            Token t = (tokens ? (*tokens)[j] : m.body[i]);
+            t.offset = name.offset;
+            t.length = name.length;
+            t.expanded = true;
+            t.param = -1;
+            pending.push_front(t);
+        }
+    }
+    m.busy = true;
+    return true;
+}
+
+/* Function: ReadArguments()
+ * -------------------------
+ * Reads the arguments in parentheses after a call of m, and expands
+ * each of them. Returns false, having reported it, if there are more or
+ * fewer than m has parameters.
+ */
+bool Preprocessor::ReadArguments(const Token &name, const Macro &m, vector<vector<Token> > &args)
+{
+    Token t;
+    Read(&t);                       // the '('
+    vector<vector<Token> > given(1);
+    for (int depth = 0; ; ) {
+        if (!Read(&t)) {
+            Error(lastOffset, lastLength, string("Unterminated call of macro '") + name.value.atom + "'");
+            return false;
+        }
+        if (t.kind == T_RightParen && depth == 0) break;
+        if (t.kind == T_Comma && depth == 0) {
+            given.push_back(vector<Token>());
+            continue;
+        }
+        if (t.kind == T_LeftParen) depth++;
+        if (t.kind == T_RightParen) depth--;
+        given.back().push_back(t);
+    }
+    if (given.size() == 1 && given[0].empty() && m.params.empty())
+        given.clear();
+    if (given.size() != m.params.size()) {
+        ostringstream s;
+        s << "Wrong number of arguments given to macro '" << name.value.atom << "': expected "
+          << m.params.size() << ", given " << given.size();
+        Error(lastOffset, lastLength, s.str());
+        return false;
+    }
+    args.resize(given.size());
+    for (int i = 0; i < given.size(); i++)
+        ExpandList(given[i], args[i]);
+    return true;
+}
+
+/* Function: ExpandList()
+ * ----------------------
+ * Expands the tokens of an argument on their own, into result.
+ */
+void Preprocessor::ExpandList(const vector<Token> &in, vector<Token> &result)
+{
+    deque<Token> savedPending;
+    savedPending.swap(pending);
+    bool savedFromFile = fromFile;
+    vector<Token> *savedCollected = collected;
+    pending.assign(in.begin(), in.end());
+    fromFile = false;
+    collected = &result;
+    Token t;
+    while (Read(&t))
+        if (!Expand(t)) Emit(t);
+    pending.swap(savedPending);
+    fromFile = savedFromFile;
+    collected = savedCollected;
+}
+
+void Preprocessor::Emit(const Token &t)
+{
+    if (collected)
+        collected->push_back(t);
+    else if (t.expanded)
+        out->AddExpanded(t.kind, t.offset, t.length, t.value);
+    else
+        out->Add(t.kind, t.offset, t.length, t.value);
+}
+
+/* Function: Conditional()
+ * -----------------------
+ * Does #if, #ifdef, #ifndef, #elif, #else or #endif d, given the
+ * file's open conditionals and whether the lines before it are kept.
+ * Returns whether the lines after it are kept.
+ */
+bool Preprocessor::Conditional(const Directive &d, vector<OpenConditional> &open, bool active)
+{
+    if (IsConditional(d.name)) {
+        OpenConditional c;
+        c.opened = &d;
+        c.enclosing = active;
+        c.taken = (active && Test(d));
+        c.sawElse = false;
+        open.push_back(c);
+        return c.taken;
+    }
+    if (open.empty()) {
+        Error(d, "#" + d.name + " without #if");
+        return active;
+    }
+    OpenConditional &c = open.back();
+    if (d.name == "endif") {
+        bool enclosing = c.enclosing;
+        open.pop_back();
+        return enclosing;
+    }
+    if (c.sawElse) {
+        if (c.enclosing) Error(d, "#" + d.name + " after #else");
+        return false;
+    }
+    if (d.name == "else") {
+        c.sawElse = true;
+        bool keep = (c.enclosing && !c.taken);
+        c.taken = true;
+        return keep;
+    }
+    if (!c.enclosing || c.taken) return false;
+    c.taken = Test(d);
+    return c.taken;
+}
+
+/* Function: Test()
+ * ----------------
+ * Returns whether the group after #if, #ifdef, #ifndef or #elif d is
+ * kept. An expression that can't be evaluated is reported, and false.
+ */
+bool Preprocessor::Test(const Directive &d)
+{
+    if (d.name == "ifdef" || d.name == "ifndef") {
+        string macro = FirstName(d.rest);
+        if (macro.empty()) {
+            Error(d, "#" + d.name + " needs a macro name");
+            return false;
+        }
+        return (macros.count(Atom(macro)) > 0) == (d.name == "ifdef");
+    }
+    vector<Word> words, expanded;
+    SplitWords(d.rest, words);
+    long long value = 0;
+    string error;
+    if (!ExpandCondition(words, expanded, 0, error) ||
+        !ConditionParser(expanded).Evaluate(&value, error)) {
+        Error(d, error);
+        return false;
+    }
+    return value != 0;
+}
+
+/* Function: ExpandCondition()
+ * ---------------------------
+ * Copies the words of an #if expression to result with each "defined X"
+ * or "defined(X)" replaced by 1 or 0, macros expanded, and then any
+ * name left replaced by 0. Returns false, with error set, on failure.
+ */
+bool Preprocessor::ExpandCondition(const vector<Word> &in, vector<Word> &result, int depth,
+                                   string &error)
+{
+    if (depth > MaxConditionDepth) {
+        error = "Macros in #if nested too deeply";
+        return false;
+    }
+    for (int i = 0; i < in.size(); i++) {
+        const Word &w = in[i];
+        if (w.kind != 'a') {
+            result.push_back(w);
+            continue;
+        }
+        if (w.text == "defined") {
+            bool paren = (i + 1 < in.size() && in[i+1].text == "(");
+            int j = i + (paren ? 2 : 1);
+            if (j >= in.size() || in[j].kind != 'a' ||
+                (paren && (j + 1 >= in.size() || in[j+1].text != ")"))) {
+                error = "'defined' needs a macro name";
+                return false;
+            }
+            result.push_back(Word('0', macros.count(Atom(in[j].text)) ? "1" : "0"));
+            i = j + (paren ? 1 : 0);
+            continue;
+        }
+        map<const char *, Macro>::iterator it = macros.find(Atom(w.text));
+        if (it == macros.end() || it->second.busy ||
+            (it->second.function && (i + 1 >= in.size() || in[i+1].text != "("))) {
+            result.push_back(Word('0', "0"));
+            continue;
+        }
+        Macro &m = it->second;
+        vector<Word> body;
+        SplitWords(m.text, body);
+        if (m.function) {
+            vector<vector<Word> > args(1);
+            int j, nesting = 0;
+            for (j = i + 2; j < in.size(); j++) {
+                if (in[j].text == ")" && nesting == 0) break;
+                if (in[j].text == "," && nesting == 0) {
+                    args.push_back(vector<Word>());
+                    continue;
+                }
+                if (in[j].text == "(") nesting++;
+                if (in[j].text == ")") nesting--;
+                args.back().push_back(in[j]);
+            }
+            if (j >= in.size()) {
+                error = "Unterminated call of macro '" + w.text + "'";
+                return false;
+            }
+            if (args.size() == 1 && args[0].empty() && m.params.empty())
+                args.clear();
+            if (args.size() != m.params.size()) {
+                ostringstream s;
+                s << "Wrong number of arguments given to macro '" << w.text << "': expected "
+                  << m.params.size() << ", given " << args.size();
+                error = s.str();
+                return false;
+            }
+            vector<Word> substituted;
+            for (int k = 0; k < body.size(); k++) {
+                int p = m.params.size() - 1;
+                while (p >= 0 && (body[k].kind != 'a' || Atom(body[k].text) != m.params[p])) p--;
+                if (p < 0)
+                    substituted.push_back(body[k]);
+                else
+                    substituted.insert(substituted.end(), args[p].begin(), args[p].end());
+            }
+            body.swap(substituted);
+            i = j;
+        }
+        m.busy = true;
+        bool ok = ExpandCondition(body, result, depth + 1, error);
+        m.busy = false;
+        if (!ok) return false;
+    }
+    return true;
+}
+
+/* Function: Define()
+ * ------------------
+ * Does #define d, whose replacement list scanned as body. A macro that
+ * is defined again just takes the new definition.
+ */
+void Preprocessor::Define(const Directive &d, const vector<Token> &body)
+{
+    Macro m;
+    m.function = d.function;
+    for (int i = 0; i < d.params.size(); i++)
+        m.params.push_back(Atom(d.params[i]));
+    m.body = body;
+    for (int i = 0; i < m.body.size(); i++)
+        for (int p = 0; p < m.params.size(); p++)
+            if (m.body[i].kind == T_Identifier && m.body[i].value.atom == m.params[p])
+                m.body[i].param = p;
+    m.text = d.replacement;
+    m.busy = false;
+    macros[Atom(d.macro)] = m;
+}
+
+/* Function: Predefine()
+ * -----------------------
+ * Defines a macro before the unit's first line, given as NAME, which is
+ * then defined as 1, or as NAME=value, where NAME may have a parameter
+ * list. One that can't be defined is reported, with no location.
+ */
+void Preprocessor::Predefine(const string &definition)
+{
+    size_t equals = definition.find('=');
+    string name = definition.substr(0, equals);
+    string line = name + " " + (equals == string::npos ? "1" : definition.substr(equals + 1));
+    vector<unsigned int> where;
+    for (unsigned int i = 0; i <= line.size(); i++)
+        where.push_back(i);
+    Directive d;
+    d.function = false;
+    ParseDefine(line, 0, where, d);
+    if (d.error.empty() && d.macro.size() < name.size() && name[d.macro.size()] != '(')
+        d.error = "Invalid macro name '" + name + "'";
+    if (!d.error.empty()) {
+        Error(0, 0, d.error + " (predefined as '" + definition + "')");
+        return;
+    }
+
+    ostringstream ignored;
+    CompileContext scratch(ignored);
+    scratch.fastScan = ctx->fastScan;
+    TokenBuffer scanned;
+    scratch.Tokenize(d.replacement.data(), d.replacement.size(), &scanned);
+    vector<Token> body;
+    for (int i = 0; i < scanned.NumTokens() - 1; i++)
+        body.push_back(ScannedToken(scanned, i, d.replacement.data(), 0));
+    Define(d, body);
+}
+
+/* Function: Skippable()
+ * ---------------------
+ * Returns true if including f again would add nothing: it has #pragma
+ * once, or its include guard is defined.
+ */
+bool Preprocessor::Skippable(const SourceFile *f)
+{
+    return onceOnly.count(f->key) > 0 || (!f->guard.empty() && macros.count(Atom(f->guard)) > 0);
+}
+
+/* Function: IncludeFile()
+ * -----------------------
+ * Does #include d, whose lines are in the unit's text already. A file
+ * included again in the same way is skipped, if it can be, without
+ * looking at it; otherwise it comes from the include cache.
+ */
+void Preprocessor::IncludeFile(const Directive &d, int depth)
+{
+    string name;
+    if (d.rest.size() >= 2 && ((d.rest[0] == '"' && d.rest[d.rest.size()-1] == '"') ||
+                               (d.rest[0] == '<' && d.rest[d.rest.size()-1] == '>')))
+        name = d.rest.substr(1, d.rest.size() - 2);
+    if (name.empty()) {
+        Error(d, "#include expects \"file\" or <file>");
+        return;
+    }
+    unit->numIncludes++;
+    string seenAs = file->dir + '\n' + name;
+    map<string, const SourceFile *>::iterator seen = included.find(seenAs);
+    if (seen != included.end() && Skippable(seen->second)) return;
+    if (depth >= MaxIncludeDepth) {
+        Error(d, "#include nested too deeply");
+        return;
+    }
+
+    string path, key;
+    struct stat st;
+    shared_ptr<const SourceFile> f;
+    if (Resolve(file->dir, name, path, key, st))
+        f = includeCache.Lookup(path, key, st, ctx->fastScan);
+    if (!f) {
+        Error(d, "Cannot open include file \"" + name + "\"");
+        return;
+    }
+    included[seenAs] = f.get();
+    if (Skippable(f.get())) return;
+    unit->files.push_back(f);
+    Include(f.get(), depth + 1);
+}
+
+shared_ptr<const SourceFile> ScanSourceFile(const string &path, const char *src, size_t len,
+                                            bool fastScan)
+{
+    SourceFile *f = new SourceFile(path, src, len, fastScan);
+    if (!path.empty()) {
+        char *real = realpath(path.c_str(), NULL);
+        f->key = (real ? real : path);
+        free(real);
+    }
+    return shared_ptr<const SourceFile>(f);
+}
+
+void PreprocessTokens(CompileContext *ctx, TokenBuffer *tokens)
+{
+    delete ctx->preprocessed;
+    PreprocessedUnit *unit = ctx->preprocessed = new PreprocessedUnit;
+    shared_ptr<const SourceFile> main = ctx->sourceFile;
+    if (!main)
+        main = ScanSourceFile(ctx->sourcePath, ctx->sourceText, ctx->sourceLen, ctx->fastScan);
+    unit->files.push_back(main);
+
+    tokens->BeginScan(ctx);
+    Preprocessor pp(ctx, tokens, unit);
+    for (int i = 0; i < ctx->defines.size(); i++)
+        pp.Predefine(ctx->defines[i]);
+    pp.Include(main.get(), 0);
+    YYSTYPE value;
+    memset(&value, 0, sizeof(value));
+    tokens->Add(0, unit->text.size(), 0, value);
+    tokens->EndScan(ctx);
+}
@@ -0,0 +1,105 @@
+/* File: preprocess.h
+ * ------------------
+ * The preprocessor, which runs in front of the scanner when a unit has
+ * directives: lines whose first non-blank character is a '#'. It does
+ * #define and #undef (object-like and function-like macros), #if,
+ * #ifdef, #ifndef, #elif, #else and #endif, #include, #error and
+ * #pragma once. #version, #extension, #line and other pragmas are
+ * accepted and ignored. A unit without directives is scanned as before.
+ *
+ * It works on tokens, not text. Each file is scanned once, with its
+ * directive lines blanked out, except for the replacement list of a
+ * #define, which is scanned in place. The unit's TokenBuffer is made
+ * from the tokens of the lines that are kept, with macros expanded, and
+ * the unit's text is the files' text pieced together the same way, with
+ * the lines left out blanked. The tokens' offsets are into that text,
+ * so TokenBuffer::Next() works out their lines and columns as usual.
+ * Each line of the unit's text remembers the file and line it came
+ * from, so errors give that line and underline the original text (see
+ * CompileContext::SourceLine()).
+ *
+ * Everything a macro expands to, arguments included, is placed at the
+ * macro's name. Macros can also be defined before the first line, as
+ * by the -D option of a C compiler (see CompileContext::defines).
+ *
+ * Included files are kept in an in-process cache, already scanned, and
+ * keyed by path. An entry is used again while the file's modification
+ * time and size are unchanged, so a header that many units include is
+ * read and scanned once. Within a unit, a file with #pragma once, or
+ * with an include guard (an #ifndef around the whole file) whose macro
+ * is defined, is skipped when it is included again, without even
+ * looking it up.
+ */
+
+#ifndef _H_preprocess
+#define _H_preprocess
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class CompileContext;
+class TokenBuffer;
+class SourceFile;
+
+/* Function: HasDirectives()
+ * -------------------------
+ * Returns true if any of the len bytes at text start a line with a '#',
+ * after blanks. Comments aren't looked at, so it can say yes to a unit
+ * with nothing for the preprocessor to do, which is harmless.
+ */
+bool HasDirectives(const char *text, size_t len);
+
+/* Function: PreprocessTokens()
+ * ----------------------------
+ * Does what ScanTokens() does, for a unit with directives: preprocesses
+ * the context's source text into tokens, ending with the end of input.
+ * The context's source text is then the unit's text, described by
+ * ctx->preprocessed.
+ */
+void PreprocessTokens(CompileContext *ctx, TokenBuffer *tokens);
+
+/* Function: ScanSourceFile()
+ * --------------------------
+ * Finds the directives of the len bytes at src, the text of the file at
+ * path, and scans the rest, as PreprocessTokens() does first with a
+ * unit's own file. The result can be set as the sourceFile of any
+ * context that is to check the same text, which then skips that step.
+ */
+shared_ptr<const SourceFile> ScanSourceFile(const string &path, const char *src, size_t len,
+                                            bool fastScan);
+
+/* Class: PreprocessedUnit
+ * -----------------------
+ * The text that a preprocessed unit's tokens are in, and where each of
+ * its lines came from.
+ */
+class PreprocessedUnit
+{
+  public:
+    struct Origin {
+        const SourceFile *file;
+        int line;
+    };
+    string text;
+    vector<Origin> lines;
+    // The unit's own file first, then the files it included. Holding on
+    // to them keeps them alive even if the cache replaces them.
+    vector<shared_ptr<const SourceFile> > files;
+    // The #includes of a file that it tried to include, whether or not
+    // it was found or added anything
+    int numIncludes;
+
+    PreprocessedUnit() : numIncludes(0) {}
+
+    // Returns the original text of line num of text, or NULL
+    const char *GetLine(int num, int *len) const;
+    // Returns the line of its file that line num came from, and sets
+    // path to that file's path, or to NULL if it is the unit's own file
+    int SourceLine(int num, const char **path) const;
+};
+
+#endif
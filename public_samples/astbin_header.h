@@ -0,0 +1,12 @@
+uniform vec3 lightDir;
+const float scale = 2.0;
+int count;
+
+float brightness(vec3 normal) {
+    float d = 0.5;
+    return d * scale;
+}
+
+vec3 tint(vec3 c, float amount) {
+    return c;
+}
@@ -0,0 +1,17 @@
+void main() {
+    vec3 n;
+    float b = brightness(n);
+    vec3 c = tint(n, b);
+    int i = count + 1;
+    float f = brightness(i);
+    c = tint(n);
+    lightDir();
+    bool flag = scale;
+    undeclared = 3;
+}
+
+int count;
+
+float brightness(vec3 normal) {
+    return 1.0;
+}
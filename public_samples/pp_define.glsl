@@ -0,0 +1,13 @@
+#define N 4
+#define SCALE 2.0
+#define SQUARE(x) ((x) * (x))
+#define ADD(a, b) ((a) + (b))
+#define NEGATE(v) -v
+
+void main() {
+    int i = SQUARE(N);
+    float f = ADD(SCALE, 1.0);
+    int j = ADD(i, SQUARE(N + 1));
+    float g = NEGATE(f);
+    bool b = SQUARE(true);
+}
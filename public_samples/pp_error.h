@@ -0,0 +1,4 @@
+// a header with a mistake in it
+vec3 tint(vec3 c) {
+    return c * undefinedScale;
+}
@@ -0,0 +1,6 @@
+#ifndef PP_GUARD_H
+#define PP_GUARD_H
+float guarded(float x) {
+    return x * 2.0;
+}
+#endif
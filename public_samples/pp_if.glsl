@@ -0,0 +1,32 @@
+#define LEVEL 2
+#define ENABLED
+
+#if LEVEL == 1
+int one;
+#elif LEVEL == 2 && defined(ENABLED)
+int two;
+#else
+int other;
+#endif
+
+#if defined MISSING || !defined(LEVEL)
+int never;
+#elif LEVEL > 1
+int many;
+#endif
+
+#ifdef ENABLED
+int enabled;
+#endif
+#ifndef ENABLED
+int disabled;
+#endif
+
+void main() {
+    two = 1;
+    many = 2;
+    enabled = 3;
+    one = 4;
+    other = 5;
+    disabled = 6;
+}
@@ -0,0 +1,10 @@
+#include "public_samples/pp_guard.h"
+#include "public_samples/pp_once.h"
+#include "public_samples/pp_guard.h"
+#include "public_samples/pp_once.h"
+
+void main() {
+    counter = 1;
+    float y = guarded(1.0);
+    float z = guarded(counter);
+}
@@ -0,0 +1,7 @@
+#include "public_samples/pp_error.h"
+
+void main() {
+    vec3 v;
+    vec3 c = tint(v);
+    int unused = missing;
+}
@@ -0,0 +1,4 @@
+#include "public_samples/pp_no_such_file.h"
+
+void main() {
+}
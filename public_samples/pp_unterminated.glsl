@@ -0,0 +1,7 @@
+#define DEBUG 1
+#if DEBUG
+int debugCount;
+
+void main() {
+    debugCount = 1;
+}
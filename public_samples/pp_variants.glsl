@@ -0,0 +1,23 @@
+#include "public_samples/pp_guard.h"
+
+#ifdef USE_FOG
+uniform float fogDensity;
+#endif
+
+#if QUALITY >= 2
+float sharpen(float x) {
+    return guarded(x);
+}
+#endif
+
+void main() {
+    float color = 1.0;
+#ifdef USE_FOG
+    color = color * fogDensity;
+#endif
+#if QUALITY >= 2
+    color = sharpen(color);
+#elif defined(USE_TONEMAP)
+    color = tonemap(color);
+#endif
+}
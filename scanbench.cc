@@ -0,0 +1,274 @@
+/* File: scanbench.cc
+ * ------------------
+ * A benchmark for the scanners on their own, with no parser: each
+ * input is scanned into a TokenBuffer (see CompileContext::Tokenize())
+ * by the flex scanner and by the hand-written one (see fastscan.h), a
+ * number of rounds each, and the median round gives the throughput in
+ * MB/s and tokens/s. Allocations (calls to operator new) are counted
+ * while scanning, and given per token; the peak RSS of the whole run,
+ * which includes the inputs, is printed at the end.
+ *
+ * The inputs are made up, size megabytes each, one of each kind below,
+ * unless files are named, or kinds with -k:
+ *
+ *    scanbench [-s size] [-r rounds] [-k kind]... [-x flex|fast] [-t max]
+ *              [file...]
+ *
+ * -t also scans each input in chunks with the hand-written scanner (see
+ * ChunkedScanTokens() in fastscan.h), on 2, 4, 8 and so on up to max
+ * threads, to show how it scales; the tokens are checked against those
+ * of the scan on one thread, and any difference is an error.
+ *
+ * -x limits the run to one scanner, so that perf record or perf stat on
+ * a run with one input and one scanner profiles just that. This is a
+ * program of its own rather than a glc mode so that it can replace
+ * operator new to count allocations without slowing glc down.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "context.h"
+#include "tokens.h"
+#include "fastscan.h"
+#include "stats.h"
+
+using namespace std;
+
+static unsigned long long numAllocations;
+
+void *operator new(size_t size)
+{
+    numAllocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static unsigned int Random(unsigned int &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+// Each generator appends a few lines of one kind of input
+typedef void (*Generator)(string &out, unsigned int &seed);
+
+static void Comments(string &out, unsigned int &seed)
+{
+    char buf[512];
+    int n = Random(seed);
+    snprintf(buf, sizeof(buf),
+             "/* Block comment %d, which goes on for a while, with a * and\n"
+             " * a / or two in it, as the comments in a real shader do.\n"
+             " */\n"
+             "// A line comment about v%d, and what it is for\n"
+             "float v%d = 1.0; // and a trailing one\n\n", n, n, n);
+    out += buf;
+}
+
+static void Identifiers(string &out, unsigned int &seed)
+{
+    char buf[512];
+    int a = Random(seed), b = Random(seed), c = Random(seed);
+    snprintf(buf, sizeof(buf),
+             "vec3 position_%d = normalize(lightDirection_%d * surfaceNormal + viewVector_%d);\n"
+             "shadowFactor_%d = ambientOcclusion_%d * shadowFactor_%d + specularPower;\n",
+             a, b, c, b, c, a);
+    out += buf;
+}
+
+static void Numbers(string &out, unsigned int &seed)
+{
+    char buf[512];
+    int a = Random(seed), b = Random(seed);
+    snprintf(buf, sizeof(buf),
+             "float c%d = 1.5e3 * 0.25 + %d - 3.14159 / 2.0e-2 + %d * 0.001 + 7.0;\n"
+             "int k%d = %d + 65536 * 3 - 0 + 42 * %d;\n", a, b, a, b, a, b);
+    out += buf;
+}
+
+static void LongLines(string &out, unsigned int &seed)
+{
+    char buf[64];
+    out += "float sum = 0.0";
+    for (int i = 0; i < 4000; i++) {
+        snprintf(buf, sizeof(buf), " + weight%d * sample%d", Random(seed) % 100, i);
+        out += buf;
+    }
+    out += ";\n";
+}
+
+static void ShortLines(string &out, unsigned int &seed)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "x\n=\ny%d\n+\n1\n;\n\n", Random(seed) % 100);
+    out += buf;
+}
+
+struct InputKind {
+    const char *name;
+    Generator generate;
+};
+
+static const InputKind kinds[] = {
+    { "comments", Comments },
+    { "identifiers", Identifiers },
+    { "numbers", Numbers },
+    { "long-lines", LongLines },
+    { "short-lines", ShortLines },
+};
+static const int NumKinds = sizeof(kinds) / sizeof(kinds[0]);
+
+static const InputKind *FindKind(const string &name)
+{
+    for (int k = 0; k < NumKinds; k++)
+        if (name == kinds[k].name) return &kinds[k];
+    return NULL;
+}
+
+static bool ReadInput(const char *path, string &text)
+{
+    FILE *input = fopen(path, "r");
+    if (!input) return false;
+    char buf[65536];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), input)) > 0)
+        text.append(buf, len);
+    fclose(input);
+    return true;
+}
+
+/* Function: Bench()
+ * -----------------
+ * Scans text rounds times with the given scanner, on the given number
+ * of threads, each time in a new context and buffer as a compilation
+ * would, and prints a line of results.
+ */
+static void Bench(const string &name, const string &text, bool fastScan, int threads, int rounds)
+{
+    vector<double> millis;
+    unsigned long long allocations = 0, tokens = 0;
+    for (int r = 0; r < rounds; r++) {
+        ostringstream ignored;
+        CompileContext ctx(ignored);
+        ctx.fastScan = fastScan;
+        ctx.scanThreads = threads;
+        TokenBuffer buffer;
+        unsigned long long before = numAllocations;
+        double start = PhaseTimer::Now();
+        tokens += ctx.Tokenize(text.data(), text.size(), &buffer);
+        millis.push_back(PhaseTimer::Now() - start);
+        allocations += numAllocations - before;
+    }
+    sort(millis.begin(), millis.end());
+    double median = millis[millis.size() / 2] / 1000;  // in seconds
+    double megabytes = text.size() / 1048576.0, perRound = (double)tokens / rounds;
+    printf("%-5s %7d %9.2f %12.0f %10.1f %10.2f %12.5f  %s\n", fastScan ? "fast" : "flex",
+           threads, megabytes, perRound, median > 0 ? megabytes / median : 0.0,
+           median > 0 ? perRound / median / 1e6 : 0.0,
+           tokens ? (double)allocations / tokens : 0.0, name.c_str());
+    fflush(stdout);
+}
+
+/* Function: SameChunked()
+ * -----------------------
+ * Returns true if text scanned in chunks on threads threads comes out
+ * the same as scanned whole. Both scans use the one context, so that
+ * their atoms can be compared.
+ */
+static bool SameChunked(const string &text, int threads)
+{
+    ostringstream ignored;
+    CompileContext ctx(ignored);
+    TokenBuffer whole, chunked;
+    ctx.Tokenize(text.data(), text.size(), &whole);
+    ChunkedScanTokens(&ctx, &chunked, threads);
+    return chunked.SameAs(whole);
+}
+
+int main(int argc, char *argv[])
+{
+    double size = 16;
+    int rounds = 5, maxThreads = 1, mismatches = 0;
+    vector<string> kindNames, files;
+    string scanner;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            size = atof(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            kindNames.push_back(argv[++i]);
+            if (!FindKind(argv[i])) {
+                fprintf(stderr, "*** Unknown input kind '%s'\n", argv[i]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i+1], "flex") == 0 || strcmp(argv[i+1], "fast") == 0))
+            scanner = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            maxThreads = atoi(argv[++i]);
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [-s size] [-r rounds] [-k kind]... [-x flex|fast] [-t max] "
+                    "[file...]\n", argv[0]);
+            return 2;
+        } else
+            files.push_back(argv[i]);
+    }
+    if (rounds < 1) rounds = 1;
+    if (kindNames.empty() && files.empty())
+        for (int k = 0; k < NumKinds; k++)
+            kindNames.push_back(kinds[k].name);
+
+    printf("%-5s %7s %9s %12s %10s %10s %12s  %s\n", "scan", "threads", "MB", "tokens", "MB/s",
+           "Mtokens/s", "allocs/token", "input");
+    for (int i = 0; i < kindNames.size() + files.size(); i++) {
+        string name, text;
+        if (i < kindNames.size()) {
+            name = kindNames[i];
+            const InputKind *kind = FindKind(name);
+            unsigned int seed = 1;
+            while (text.size() < size * 1048576)
+                kind->generate(text, seed);
+        } else {
+            name = files[i - kindNames.size()];
+            if (!ReadInput(name.c_str(), text)) {
+                fprintf(stderr, "*** Cannot open file '%s'\n", name.c_str());
+                return 2;
+            }
+        }
+        if (scanner != "fast") Bench(name, text, false, 1, rounds);
+        if (scanner == "flex") continue;
+        Bench(name, text, true, 1, rounds);
+        for (int threads = 2; threads <= maxThreads; threads *= 2) {
+            Bench(name, text, true, threads, rounds);
+            if (!SameChunked(text, threads)) {
+                fprintf(stderr, "*** %s: the tokens differ when scanned on %d threads\n",
+                        name.c_str(), threads);
+                mismatches++;
+            }
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("=== peak RSS %.1f MB ===\n", usage.ru_maxrss / 1024.0);
+    return (mismatches == 0 ? 0 : 1);
+}
@@ -9,15 +9,24 @@
 #define _H_scanner
 
 #include <stdio.h>
+#include "location.h"
 
 #define MaxIdentLen 31    // Maximum length for identifiers
+#define TAB_SIZE 8        // A tab moves on to the next multiple of this
 
-extern char *yytext;      // Text of lexeme just scanned
+class CompileContext;
+class TokenBuffer;
+union YYSTYPE;
 
+// Defined in the generated lex.yy.c file. The scanner is reentrant: all
+// of its state hangs off the yyscan_t handle, passed here as void *.
+int yylex(union YYSTYPE *yylval, yyltype *yylloc, void *scanner);
+yyltype *yyget_lloc(void *scanner);
 
-int yylex();              // Defined in the generated lex.yy.c file
-
-void InitScanner();                 // Defined in scanner.l user subroutines
-const char *GetLineNumbered(int n); // ditto
+void InitScannerBuffer(CompileContext *ctx, const char *src, int len); // Defined in scanner.l user subroutines
+void InitScannerInPlace(CompileContext *ctx, char *base, size_t size); // ditto
+void FreeScanner(CompileContext *ctx);              // ditto
+void ScanTokens(CompileContext *ctx, TokenBuffer *tokens); // ditto
+void CurrentMatch(CompileContext *ctx, unsigned int *offset, unsigned int *length); // ditto
  
 #endif
@@ -0,0 +1,253 @@
+/* File: server.cc
+ * ---------------
+ * Implementation of the compile server and its client. See server.h for
+ * the wire format.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "server.h"
+#include "context.h"
+#include "incremental.h"
+#include "tokens.h"
+#include "arena.h"
+
+static const uint32_t MaxFrameLen = 64 * 1024 * 1024;
+
+/* Function: ReadFully(), WriteFully()
+ * -----------------------------------
+ * Transfer exactly len bytes, retrying short reads/writes. Return false
+ * on error or if the peer closed the connection first.
+ */
+static bool ReadFully(int fd, char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool WriteFully(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool ReadFrame(int fd, string &frame)
+{
+    uint32_t len;
+    if (!ReadFully(fd, (char *)&len, sizeof(len))) return false;
+    len = ntohl(len);
+    if (len > MaxFrameLen) return false;
+    frame.resize(len);
+    return len == 0 || ReadFully(fd, &frame[0], len);
+}
+
+static bool WriteFrame(int fd, const string &frame)
+{
+    uint32_t len = htonl(frame.size());
+    return WriteFully(fd, (const char *)&len, sizeof(len)) &&
+           WriteFully(fd, frame.data(), frame.size());
+}
+
+static void FillAddress(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+}
+
+/* Function: ServeConnection()
+ * ---------------------------
+ * Answers requests on one connection until the client hangs up. Each
+ * request is checked in a fresh CompileContext, so the diagnostics are
+ * the same as for a separate glc run; the diagnostic, response and
+ * token buffers, and the arena the AST is made in, are reused from one
+ * request to the next. What the scanner echoes is collected per request
+ * and sent back, never written to the server's own stdout. Top-level
+ * declarations unchanged since an earlier request (on any connection)
+ * are not checked again, thanks to the server's IncrementalChecker.
+ * Each connection is served on a thread of its own, and the checker is
+ * only used by one at a time: a request that finds it in use is checked
+ * without it, which gives the same response.
+ */
+static void ServeConnection(int fd, IncrementalChecker *checker, mutex *checkerLock)
+{
+    string source, response;
+    ostringstream err, echo;
+    TokenBuffer tokens;
+    Arena nodes;
+    while (ReadFrame(fd, source)) {
+        err.str("");
+        echo.str("");
+        unique_lock<mutex> usingChecker(*checkerLock, try_to_lock);
+        CompileContext ctx(err);
+        ctx.echoStream = &echo;
+        ctx.incremental = (usingChecker.owns_lock() ? checker : NULL);
+        ctx.tokens = &tokens;
+        ctx.arena = &nodes;
+        uint32_t numErrors = htonl(ctx.CheckBuffer(source.data(), source.size()));
+        if (usingChecker.owns_lock()) usingChecker.unlock();
+        string echoed = echo.str();
+        uint32_t echoLen = htonl(echoed.size());
+        response.assign((const char *)&numErrors, sizeof(numErrors));
+        response.append((const char *)&echoLen, sizeof(echoLen));
+        response += echoed;
+        response += err.str();
+        if (!WriteFrame(fd, response)) break;
+    }
+    close(fd);
+}
+
+int RunServer(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "*** Socket path too long '%s'\n", path);
+        return 2;
+    }
+    FillAddress(&addr, path);
+    signal(SIGPIPE, SIG_IGN); // a client that goes away is not fatal
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, 16) < 0) {
+        fprintf(stderr, "*** Cannot listen on '%s': %s\n", path, strerror(errno));
+        return 2;
+    }
+    IncrementalChecker checker;
+    mutex checkerLock;
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "*** accept failed: %s\n", strerror(errno));
+            return 2;
+        }
+        thread(ServeConnection, fd, &checker, &checkerLock).detach();
+    }
+}
+
+static bool ReadSource(FILE *input, string &source)
+{
+    char buf[65536];
+    size_t n;
+    source.clear();
+    while ((n = fread(buf, 1, sizeof(buf), input)) > 0)
+        source.append(buf, n);
+    return !ferror(input);
+}
+
+/* Function: Request()
+ * -------------------
+ * One round trip: sends source and unpacks the response into numErrors,
+ * output (the echoed text) and diagnostics. Returns false if the
+ * connection failed or the response is malformed.
+ */
+static bool Request(int fd, const string &source, int &numErrors, string &output,
+                    string &diagnostics)
+{
+    string response;
+    if (!WriteFrame(fd, source) || !ReadFrame(fd, response) || response.size() < 8)
+        return false;
+    uint32_t n, outputLen;
+    memcpy(&n, response.data(), sizeof(n));
+    memcpy(&outputLen, response.data() + 4, sizeof(outputLen));
+    numErrors = ntohl(n);
+    outputLen = ntohl(outputLen);
+    if (outputLen > response.size() - 8) return false;
+    output.assign(response, 8, outputLen);
+    diagnostics.assign(response, 8 + outputLen, string::npos);
+    return true;
+}
+
+static double Percentile(const vector<double> &sorted, int pct)
+{
+    int i = (sorted.size() * pct + 99) / 100 - 1;
+    return sorted[max(i, 0)];
+}
+
+int RunClient(const char *path, const vector<string> &files, int benchRounds)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "*** Socket path too long '%s'\n", path);
+        return 2;
+    }
+    FillAddress(&addr, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "*** Cannot connect to '%s': %s\n", path, strerror(errno));
+        return 2;
+    }
+
+    // Read everything up front so the benchmark times only the requests
+    vector<string> sources(max((int)files.size(), 1));
+    if (files.empty())
+        ReadSource(stdin, sources[0]);
+    for (int i = 0; i < files.size(); i++) {
+        FILE *input = fopen(files[i].c_str(), "r");
+        if (!input) {
+            fprintf(stderr, "*** Cannot open file '%s'\n", files[i].c_str());
+            return 2;
+        }
+        ReadSource(input, sources[i]);
+        fclose(input);
+    }
+
+    int failed = 0, numErrors;
+    string output, diagnostics;
+    vector<double> millis;
+    for (int round = 0; round < max(benchRounds, 1); round++) {
+        for (int i = 0; i < sources.size(); i++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (!Request(fd, sources[i], numErrors, output, diagnostics)) {
+                fprintf(stderr, "*** Lost connection to '%s'\n", path);
+                return 2;
+            }
+            millis.push_back(std::chrono::duration<double, std::milli>(
+                                 std::chrono::steady_clock::now() - start).count());
+            if (benchRounds > 0) continue;
+            if (files.size() > 1) {
+                printf("==> %s <==\n", files[i].c_str());
+            }
+            fwrite(output.data(), 1, output.size(), stdout);
+            fflush(stdout);
+            fputs(diagnostics.c_str(), stderr);
+            if (numErrors != 0) failed++;
+        }
+    }
+    close(fd);
+
+    if (benchRounds > 0) {
+        sort(millis.begin(), millis.end());
+        printf("=== %d request(s): p50 %.3f ms, p99 %.3f ms, max %.3f ms ===\n",
+               (int)millis.size(), Percentile(millis, 50), Percentile(millis, 99),
+               millis.back());
+    }
+    return (failed == 0 ? 0 : -1);
+}
@@ -0,0 +1,50 @@
+/* File: server.h
+ * --------------
+ * Server mode keeps one glc process running behind a Unix domain socket,
+ * so that tools which check one shader at a time (editors, hot reload)
+ * don't pay for process start-up and front end initialization on every
+ * request. The built-in types and the heap stay warm across requests.
+ *
+ * The protocol is a sequence of frames over a stream socket. A frame is
+ * a 4-byte length in network byte order followed by that many bytes.
+ * The client sends one frame holding the shader source; the server
+ * answers with one frame whose first 4 bytes are the error count (again
+ * in network byte order), the next 4 the length of the text the scanner
+ * echoed, as glc would have written it to stdout, then that text, and
+ * whose remainder is the diagnostic text, as glc would have written it
+ * to stderr. A connection may carry any
+ * number of requests, one after another.
+ */
+
+#ifndef _H_server
+#define _H_server
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Function: RunServer()
+ * ---------------------
+ * Listens on the Unix socket at path, replacing any stale socket file,
+ * and serves requests until killed. Each connection is served on a
+ * thread of its own, so a client that keeps its connection open, as an
+ * editor does, doesn't hold up the others. Returns nonzero only if the
+ * socket could not be set up.
+ */
+int RunServer(const char *path);
+
+/* Function: RunClient()
+ * ---------------------
+ * Sends each file to the server at path and prints its echoed text to
+ * stdout and its diagnostics to stderr; with no files, the source is read from stdin instead, so
+ * "glc --client sock < f.glsl" behaves like "glc < f.glsl". Returns 0
+ * only if every file checked cleanly.
+ *
+ * With benchRounds > 0 the output is discarded; every file is
+ * sent benchRounds times over one connection, and the p50/p99 request
+ * latency is printed instead.
+ */
+int RunClient(const char *path, const vector<string> &files, int benchRounds);
+
+#endif
@@ -0,0 +1,59 @@
+/* File: stats.cc
+ * --------------
+ * Implementation of the -d timing counters.
+ */
+
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include "stats.h"
+#include "ast.h"
+#include "utility.h"
+
+double PhaseTimer::Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+CompileStats::CompileStats()
+{
+    initMillis = scanMillis = parseMillis = checkMillis = 0;
+    tokens = 0;
+    nodeBytes = 0;
+    arenaBytes = 0;
+    arenaResets = 0;
+}
+
+void CompileStats::CountNewNodes()
+{
+    for (int i = 0; i < newNodes.size(); i++) {
+        const char *name = newNodes[i]->GetPrintNameForNode();
+        nodes[name]++;
+        nodeBytes += NodeClassSize(name);
+    }
+    newNodes.clear();
+}
+
+void CompileStats::Print(int lines, int identifiers, int uniqueIdentifiers,
+                         int lookups, int diagnostics)
+{
+    char line[2048];
+    int total = 0, len;
+    for (map<string, int>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+        total += it->second;
+    len = snprintf(line, sizeof(line),
+                   "init_ms=%.3f scan_ms=%.3f parse_ms=%.3f check_ms=%.3f total_ms=%.3f "
+                   "lines=%d tokens=%d identifiers=%d unique_identifiers=%d lookups=%d "
+                   "diagnostics=%d nodes=%d node_bytes=%zu arena_bytes=%zu arena_resets=%d",
+                   initMillis, scanMillis, parseMillis, checkMillis,
+                   initMillis + scanMillis + parseMillis + checkMillis,
+                   lines, tokens, identifiers, uniqueIdentifiers, lookups, diagnostics, total,
+                   nodeBytes, arenaBytes, arenaResets);
+    for (map<string, int>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+        if (len < sizeof(line))
+            len += snprintf(line + len, sizeof(line) - len, " nodes.%s=%d",
+                            it->first.c_str(), it->second);
+    PrintDebug("timing", "%s", line);
+}
@@ -0,0 +1,76 @@
+/* File: stats.h
+ * -------------
+ * Per-compilation timings and counters. They are only collected when
+ * the "timing" debug flag is on (glc -d timing), and are then printed
+ * as one line of key=value pairs at the end of each compilation, e.g.
+ *
+ *   +++ (timing): init_ms=0.021 scan_ms=0.094 parse_ms=0.151 check_ms=0.043
+ *                 total_ms=0.309 lines=30 tokens=212 identifiers=52
+ *                 unique_identifiers=17 lookups=41 diagnostics=1 nodes=160
+ *                 node_bytes=7456 arena_bytes=11904 arena_resets=0
+ *                 nodes.Identifier=38 ...
+ *
+ * (all on one line). init_ms covers setting up the scanner on the input,
+ * scan_ms the calls into the scanner, check_ms the semantic checker, and
+ * parse_ms the rest of yyparse: the parser's shifts and reductions,
+ * whose actions are what build the AST. nodes counts the AST nodes
+ * allocated, in total and by class, node_bytes the size of them all
+ * (-d nodesizes gives the size of each class), and arena_bytes the
+ * memory taken from the node arena (see arena.h) for them and their
+ * lists; arena_resets is how many trees the arena held before this one,
+ * which is more than 0 only if it is reused. Of the identifiers scanned,
+ * identifiers counts them all and unique_identifiers the distinct
+ * spellings among them.
+ */
+
+#ifndef _H_stats
+#define _H_stats
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Node;
+
+class CompileStats
+{
+  public:
+    double initMillis, scanMillis, parseMillis, checkMillis;
+    int tokens;
+    size_t nodeBytes;               // of the nodes counted in nodes
+    size_t arenaBytes;
+    int arenaResets;
+    map<string, int> nodes;         // by GetPrintNameForNode()
+    vector<Node *> newNodes;        // not yet counted in nodes
+
+    CompileStats();
+
+    // Counts the nodes in newNodes by class. Must be done before any of
+    // them are freed, and once they are fully constructed.
+    void CountNewNodes();
+
+    void Print(int lines, int identifiers, int uniqueIdentifiers,
+               int lookups, int diagnostics);
+};
+
+/* Class: PhaseTimer
+ * -----------------
+ * Adds the time from its construction to its destruction to *total, or
+ * does nothing if total is NULL.
+ */
+class PhaseTimer
+{
+  public:
+    PhaseTimer(double *t) : total(t), start(t ? Now() : 0) {}
+    ~PhaseTimer() { if (total) *total += Now() - start; }
+
+    static double Now();            // in milliseconds
+
+  private:
+    double *total;
+    double start;
+};
+
+#endif
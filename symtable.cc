@@ -6,7 +6,8 @@
 
 using namespace std;
 
-ScopedTable::ScopedTable(){
+ScopedTable::ScopedTable(Arena *arena) :
+	symbols(less<const char *>(), SymbolMap::allocator_type(arena)){
 }
 
 ScopedTable::~ScopedTable(){
@@ -17,7 +18,7 @@ ScopedTable::~ScopedTable(){
 
 void ScopedTable::insert(Symbol &sym){
 
-	this->symbols.insert(pair<char*, Symbol>(sym.name, sym));
+	this->symbols.insert(pair<const char*, Symbol>(sym.name, sym));
 
 }
 
@@ -38,15 +39,27 @@ Symbol *ScopedTable::find(const char *name){
 SymbolTable::SymbolTable(){
 	this->push();
 	this->return_type = NULL;
+	this->observer = NULL;
+	this->lookups = 0;
 
 }
 
 SymbolTable::~SymbolTable(){
 	for(vector<ScopedTable*>::iterator it = this->tables.begin(); it != this->tables.end(); ++it){
-		delete *it;
+		(*it)->~ScopedTable();
 	}
 }
 
+void SymbolTable::Clear(){
+	while(!this->tables.empty())
+		this->pop();
+	this->scopes.Reset();
+	this->push();
+	this->return_type = NULL;
+	this->observer = NULL;
+	this->lookups = 0;
+}
+
 void SymbolTable::setReturnType(Type *t){
 	this->return_type = t;
 }
@@ -60,12 +73,16 @@ Type *SymbolTable::getType(){
 
 
 
+// The scoped tables are made in the arena, and only their destructors
+// are run when they are popped; the memory is taken back by Clear()
 void SymbolTable::push(){
-	this->tables.push_back(new ScopedTable());
+	void *p = this->scopes.Allocate(sizeof(ScopedTable), alignof(ScopedTable));
+	this->tables.push_back(new (p) ScopedTable(&this->scopes));
 }
 
 void SymbolTable::pop(){
 
+	this->tables.back()->~ScopedTable();
 	this->tables.pop_back();
 }
 
@@ -79,27 +96,41 @@ void SymbolTable::remove(Symbol &sym){
 }
 
 Symbol *SymbolTable::find(const char *name){
+	this->lookups++;
 	if(this->tables.empty())
 		return NULL;
 	Symbol *sym = this->tables.back()->find(name);
 	if(sym){
 		sym->someInfo=0;
+		if(this->observer && this->tables.size() == 1)
+			this->observer->GlobalLookup(name, sym);
 	    return sym;
 	}
 	for(vector<ScopedTable*>::iterator it = this->tables.begin(); it != this->tables.end(); ++it){
 	    sym = (*it)->find(name);
 	    if(sym){
 			sym->someInfo=1;
+			// found in an enclosing scope, which (since the global
+			// scope is searched first) depends on the global scope
+			if(this->observer)
+				this->observer->GlobalLookup(name, it == this->tables.begin() ? sym : NULL);
 			return sym;
 	    }
 		
 	}
 
-
+	if(this->observer)
+		this->observer->GlobalLookup(name, NULL);
 	return NULL;
 
 }
 
+Symbol *SymbolTable::findGlobal(const char *name){
+	if(this->tables.empty())
+		return NULL;
+	return this->tables.front()->find(name);
+}
+
 bool MyStack::insideLoop(){
 
 	for(vector<Stmt*>::iterator it = this->stmtStack.begin(); it != this->stmtStack.end(); ++it){
@@ -7,7 +7,10 @@
  *  uses the standard C++ map.
  *
  *  Symbol table is implemented as a vector, where each vector entry holds
- *  a pointer to the scoped table.
+ *  a pointer to the scoped table. The scoped tables and the nodes of
+ *  their maps come from the symbol table's arena (see arena.h), so once
+ *  it has its blocks a table that is cleared and used again allocates
+ *  nothing.
  */
 
 #ifndef _H_symtable
@@ -18,6 +21,7 @@
 #include <iostream>
 #include <string.h>
 #include "errors.h"
+#include "arena.h"
 
 using namespace std;
 
@@ -31,33 +35,43 @@ enum EntryKind {
 };
 
 struct Symbol {
-  char *name;
+  const char *name;
   Decl *decl;
   EntryKind kind;
   int someInfo;
 
   Symbol() : name(NULL), decl(NULL), kind(E_VarDecl), someInfo(0) {}
-  Symbol(char *n, Decl *d, EntryKind k, int info = 0) :
+  Symbol(const char *n, Decl *d, EntryKind k, int info = 0) :
         name(n),
         decl(d),
         kind(k),
         someInfo(info) {}
 };
 
-struct lessStr {
-  bool operator()(const char* s1, const char* s2) const
-  { return strcmp(s1, s2) < 0; }
+// Names are atoms (see atoms.h), so the tables compare them as pointers
+typedef map<const char *, Symbol, less<const char *>,
+            ArenaAllocator<pair<const char * const, Symbol> > > SymbolMap;
+typedef SymbolMap::iterator SymbolIterator;
+
+/* If a SymbolTable has a LookupObserver, it is told about every lookup
+ * whose result depends on the global scope: sym is the global symbol
+ * found, or NULL if the global scope has no symbol of that name. Used
+ * by the incremental checker (see incremental.h) to learn what each
+ * top-level declaration depends on.
+ */
+class LookupObserver {
+  public:
+    virtual ~LookupObserver() {}
+    virtual void GlobalLookup(const char *name, Symbol *sym) = 0;
 };
- 
-typedef map<const char *, Symbol, lessStr>::iterator SymbolIterator;
 
 class ScopedTable {
-  map<const char *, Symbol, lessStr> symbols;
+  SymbolMap symbols;
   
   
 
   public:
-    ScopedTable();
+    ScopedTable(Arena *arena);
     ~ScopedTable();
 
     void insert(Symbol &sym); 
@@ -71,8 +85,11 @@ class ScopedTable {
 };
    
 class SymbolTable {
+  Arena scopes;                     // the tables and their entries
   std::vector<ScopedTable *> tables;
   Type *return_type;
+  LookupObserver *observer;
+  int lookups;
  
   public:
     SymbolTable();
@@ -81,6 +98,10 @@ class SymbolTable {
     void push();
     void pop();
 
+    // Empties the table, leaving just a global scope with nothing in it,
+    // as a new table has
+    void Clear();
+
     void insert(Symbol &sym);
     void remove(Symbol &sym);
     void setReturnType(Type* type);
@@ -89,6 +110,11 @@ class SymbolTable {
     
     Symbol *find(const char *name);
 
+    // Looks in the global scope only, and is not reported to the observer
+    Symbol *findGlobal(const char *name);
+    void setObserver(LookupObserver *o) { observer = o; }
+    int numLookups() const { return lookups; }
+
 };    
 
 class MyStack {
@@ -99,6 +125,7 @@ class MyStack {
     ~MyStack(){}
     void push(Stmt *s) { stmtStack.push_back(s); }
     void pop()         { if (stmtStack.size() > 0 ) stmtStack.pop_back(); }
+    void Clear()       { stmtStack.clear(); }
     bool insideLoop();
     bool insideSwitch();
 };
@@ -0,0 +1,357 @@
+/* File: tokens.cc
+ * ---------------
+ * Implementation of the token buffer.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "tokens.h"
+#include "context.h"
+#include "scanner.h"
+
+static const unsigned long long FnvOffset = 14695981039346656037ULL;
+static const unsigned long long FnvPrime = 1099511628211ULL;
+
+// Which of the scanner's states the text between two tokens is in
+typedef enum {
+    Between,                        // INITIAL or N
+    InComment,                      // COMM
+    InFields                        // FIELDS, after a '.'
+} gapStateT;
+
+TokenBuffer::TokenBuffer()
+{
+    scanning = NULL;
+    scanOffset = scanLength = 0;
+    savedSink = savedRecorder = NULL;
+    savedNumErrors = 0;
+    Rewind();
+}
+
+void TokenBuffer::Clear()
+{
+    kinds.clear();
+    offsets.clear();
+    lengths.clear();
+    values.clear();
+    events.clear();
+    eventText.clear();
+    Rewind();
+}
+
+void TokenBuffer::BeginScan(CompileContext *ctx)
+{
+    Clear();
+    // Real code has a token every few characters. Room for more than
+    // that costs only address space, since untouched pages stay unmapped.
+    size_t expected = ctx->sourceLen / 2 + 1;
+    if (kinds.capacity() < expected) {
+        kinds.reserve(expected);
+        offsets.reserve(expected);
+        lengths.reserve(expected);
+        values.reserve(expected);
+    }
+    scanning = ctx;
+    savedSink = ctx->sink;
+    savedRecorder = ctx->recorder;
+    savedNumErrors = ctx->numErrors;
+    ctx->sink = this;
+    ctx->recorder = NULL;
+    ctx->scanAhead = this;
+}
+
+void TokenBuffer::EndScan(CompileContext *ctx)
+{
+    ctx->sink = savedSink;
+    ctx->recorder = savedRecorder;
+    ctx->numErrors = savedNumErrors;
+    ctx->scanAhead = NULL;
+    scanning = NULL;
+}
+
+void TokenBuffer::Report(errorKindT kind, yyltype *loc, const char *msg)
+{
+    Event e;
+    Where(&e.offset, &e.length);
+    e.echo = false;
+    e.kind = kind;
+    e.hasLocation = (loc != NULL);
+    AddText(&e, msg, strlen(msg));
+    events.push_back(e);
+}
+
+void TokenBuffer::Echo(const char *text, int len)
+{
+    Event e;
+    Where(&e.offset, &e.length);
+    e.echo = true;
+    e.kind = LexicalError;
+    e.hasLocation = false;
+    AddText(&e, text, len);
+    events.push_back(e);
+}
+
+void TokenBuffer::CopyEvent(const TokenBuffer &from, int i, unsigned int offset)
+{
+    Event e = from.events[i];
+    e.offset = offset;
+    AddText(&e, from.Text(e), e.textLen);
+    events.push_back(e);
+}
+
+// The texts of all the events are kept in one string, which, like the
+// vectors, keeps its storage when the buffer is cleared
+void TokenBuffer::AddText(Event *e, const char *text, size_t len)
+{
+    e->textStart = eventText.size();
+    e->textLen = len;
+    eventText.append(text, len);
+    eventText.push_back('\0');
+}
+
+void TokenBuffer::Where(unsigned int *offset, unsigned int *length) const
+{
+    if (scanning->scanner)
+        CurrentMatch(scanning, offset, length);
+    else {
+        *offset = scanOffset;
+        *length = scanLength;
+    }
+}
+
+/* Function: SameAs()
+ * ------------------
+ * Compares everything the parser would see. Only the part of a value
+ * that its kind of token sets is compared. The length of a diagnostic
+ * without a location is ignored, since it is never used (and flex
+ * leaves it stale at the end of input).
+ */
+bool TokenBuffer::SameAs(const TokenBuffer &other) const
+{
+    if (kinds != other.kinds || offsets != other.offsets || lengths != other.lengths)
+        return false;
+    for (int i = 0; i < kinds.size(); i++)
+        if (!SameValue(kinds[i], values[i], other.values[i])) return false;
+    if (events.size() != other.events.size()) return false;
+    for (int i = 0; i < events.size(); i++) {
+        const Event &a = events[i], &b = other.events[i];
+        if (a.offset != b.offset || a.echo != b.echo || a.kind != b.kind ||
+            a.hasLocation != b.hasLocation || a.textLen != b.textLen ||
+            memcmp(Text(a), other.Text(b), a.textLen) != 0 ||
+            (a.hasLocation && a.length != b.length))
+            return false;
+    }
+    return true;
+}
+
+bool TokenBuffer::SameValue(int kind, const YYSTYPE &a, const YYSTYPE &b)
+{
+    switch (kind) {
+      case T_Identifier: case T_FieldSelection:
+        return a.atom == b.atom;
+      case T_IntConstant:
+        return a.integerConstant == b.integerConstant;
+      case T_FloatConstant:
+        return memcmp(&a.floatConstant, &b.floatConstant, sizeof(double)) == 0;
+      case T_BoolConstant:
+        return a.boolConstant == b.boolConstant;
+      case T_LessEqual: case T_GreaterEqual: case T_EQ: case T_NE:
+      case T_And: case T_Or: case T_Inc: case T_Dec:
+      case T_Plus: case T_Dash: case T_Star: case T_Slash:
+      case T_AddAssign: case T_SubAssign: case T_MulAssign: case T_DivAssign:
+      case T_Equal: case T_RightAngle: case T_LeftAngle:
+        return a.opcode == b.opcode;
+      default:
+        return true;
+    }
+}
+
+static unsigned long long Mix(unsigned long long h, const void *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        h ^= ((const unsigned char *)data)[i];
+        h *= FnvPrime;
+    }
+    return h;
+}
+
+unsigned long long TokenBuffer::Hash(unsigned long long h, unsigned int from,
+                                     unsigned int to) const
+{
+    int i = lower_bound(offsets.begin(), offsets.end(), from) - offsets.begin();
+    for (; i < kinds.size() && offsets[i] < to; i++) {
+        unsigned int where[2] = { offsets[i] - from, lengths[i] };
+        h = Mix(h, &kinds[i], sizeof(kinds[i]));
+        h = Mix(h, where, sizeof(where));
+        h = HashValue(h, kinds[i] & ~Expanded, values[i]);
+    }
+    for (i = 0; i < events.size(); i++) {
+        const Event &e = events[i];
+        if (e.offset < from || e.offset >= to) continue;
+        unsigned int where[2] = { e.offset - from, e.hasLocation ? e.length : 0 };
+        int flags[3] = { e.echo, e.kind, e.hasLocation };
+        h = Mix(h, where, sizeof(where));
+        h = Mix(h, flags, sizeof(flags));
+        h = Mix(h, Text(e), e.textLen + 1);
+    }
+    return h;
+}
+
+unsigned long long TokenBuffer::HashValue(unsigned long long h, int kind, const YYSTYPE &v)
+{
+    switch (kind) {
+      case T_Identifier: case T_FieldSelection:
+        return Mix(h, v.atom, strlen(v.atom) + 1);
+      case T_IntConstant:
+        return Mix(h, &v.integerConstant, sizeof(v.integerConstant));
+      case T_FloatConstant:
+        return Mix(h, &v.floatConstant, sizeof(v.floatConstant));
+      case T_BoolConstant:
+        return Mix(h, &v.boolConstant, sizeof(v.boolConstant));
+      case T_LessEqual: case T_GreaterEqual: case T_EQ: case T_NE:
+      case T_And: case T_Or: case T_Inc: case T_Dec:
+      case T_Plus: case T_Dash: case T_Star: case T_Slash:
+      case T_AddAssign: case T_SubAssign: case T_MulAssign: case T_DivAssign:
+      case T_Equal: case T_RightAngle: case T_LeftAngle:
+        return Mix(h, &v.opcode, sizeof(v.opcode));
+      default:
+        return h;
+    }
+}
+
+void TokenBuffer::Rewind()
+{
+    next = 0;
+    pos = 0;
+    line = column = 1;
+    state = Between;
+    matchLine = matchColumn = matchLength = 0;
+    matchOffset = 0;
+    nextEvent = 0;
+}
+
+/* Function: Next()
+ * ----------------
+ * Moves up to the next token, reporting anything recorded on the way,
+ * and fills in its value and location. After the last token, keeps
+ * returning 0 for the end of input.
+ */
+int TokenBuffer::Next(CompileContext *ctx, YYSTYPE *lval, yyltype *loc)
+{
+    int i = next;
+    if (i + 1 < kinds.size()) next++;
+    if (pos < offsets[i]) Advance(ctx, offsets[i]);
+    if (nextEvent < events.size()) ReplayEvents(ctx, offsets[i]);
+    int kind = kinds[i];
+    if (kind & Expanded) {
+        // At the macro's name, which the next token walks over
+        loc->first_line = line;
+        loc->first_column = column;
+        loc->last_column = column + lengths[i] - 1;
+        loc->first_offset = loc->last_offset = offsets[i];
+        loc->last_length = lengths[i];
+        *lval = values[i];
+        return kind & ~Expanded;
+    }
+    if (kind == 0) {
+        // The scanner leaves the location of whatever it matched last
+        if (matchLength > 0) {
+            loc->first_line = matchLine;
+            loc->first_column = matchColumn;
+            loc->last_column = matchColumn + matchLength - 1;
+            loc->first_offset = loc->last_offset = matchOffset;
+            loc->last_length = matchLength;
+        }
+        return 0;
+    }
+
+    Matched(lengths[i]);
+    loc->first_line = line;
+    loc->first_column = column;
+    loc->last_column = column + lengths[i] - 1;
+    loc->first_offset = loc->last_offset = offsets[i];
+    loc->last_length = lengths[i];
+    column += lengths[i];
+    pos += lengths[i];
+    *lval = values[i];
+    if (kind == T_Dot)
+        state = InFields;
+    else if (kind == T_FieldSelection)
+        state = Between;
+    return kind;
+}
+
+void TokenBuffer::Matched(unsigned int length)
+{
+    matchLine = line;
+    matchColumn = column;
+    matchOffset = pos;
+    matchLength = length;
+}
+
+/* Function: Advance()
+ * -------------------
+ * Walks the text from pos up to offset to, none of which is part of a
+ * token, one scanner match at a time, keeping line and column as the
+ * scanner does (see the rules in scanner.l): each match moves the
+ * column on by its length, then a newline starts a new line and a tab
+ * also moves on to the next tab stop. A tab inside a // comment is part
+ * of the comment's match, so it counts just one.
+ */
+void TokenBuffer::Advance(CompileContext *ctx, unsigned int to)
+{
+    const char *text = ctx->sourceText;
+    bool events = (nextEvent < this->events.size());
+    while (pos < to) {
+        if (events) ReplayEvents(ctx, pos);
+        char ch = text[pos];
+        char next = (pos + 1 < to ? text[pos+1] : '\0');
+        unsigned int length = 1;
+        if (state == Between && ch == ' ') {
+            while (pos + length < to && text[pos+length] == ' ') length++;
+        } else if (state == Between && ch == '/' && next == '/') {
+            while (pos + length < to && text[pos+length] != '\n') length++;
+        } else if (state == Between && ch == '/' && next == '*') {
+            state = InComment;
+            length = 2;
+        } else if (state == InComment && ch == '*' && next == '/') {
+            state = Between;
+            length = 2;
+        }
+        matchColumn = column;
+        matchLine = line;
+        matchOffset = pos;
+        column += length;
+        pos += length;
+        if (ch == '\n') {
+            line++;
+            column = 1;
+        } else if (ch == '\t')
+            column += TAB_SIZE - column % TAB_SIZE + 1;
+        matchLength = length;
+    }
+}
+
+/* Function: ReplayEvents()
+ * ------------------------
+ * Reports or echoes everything recorded at or before offset that hasn't
+ * been yet. Anything with a location is at the current line and column.
+ */
+void TokenBuffer::ReplayEvents(CompileContext *ctx, unsigned int offset)
+{
+    while (nextEvent < events.size() && events[nextEvent].offset <= offset) {
+        Event &e = events[nextEvent++];
+        if (e.echo) {
+            ctx->echoStream->write(Text(e), e.textLen);
+            continue;
+        }
+        yyltype loc = yyltype();
+        loc.first_line = line;
+        loc.first_column = column;
+        loc.last_column = column + e.length - 1;
+        loc.first_offset = loc.last_offset = e.offset;
+        loc.last_length = e.length;
+        ReportError::Replay(ctx, e.kind, e.hasLocation ? &loc : NULL, Text(e));
+    }
+}
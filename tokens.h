@@ -0,0 +1,134 @@
+/* File: tokens.h
+ * --------------
+ * A TokenBuffer holds every token of a translation unit, scanned in one
+ * pass before parsing starts (see ScanTokens() in scanner.l). The parser
+ * then takes its tokens from the buffer with Next() instead of calling
+ * yylex() for each one.
+ *
+ * The buffer is a struct of arrays: for token i, kinds[i] is its token
+ * code, offsets[i] and lengths[i] say where it is in the source text,
+ * and values[i] is its semantic value (atom, constant or opcode). No
+ * line or column is stored. Next() works them out as the parser asks
+ * for each token, by walking the text between the previous token and
+ * this one with the same rules the scanner uses to count columns, so
+ * they come out exactly as the scanner would have set them.
+ *
+ * The scanner's diagnostics, and any text it echoes, are not reported
+ * during the scan but recorded at their offsets. Next() reports them
+ * when it gets to them, so they come out in the same order, and with
+ * the same locations, as when scanning and parsing are interleaved. If
+ * the parse stops early, the ones it never reached are never reported,
+ * as before.
+ *
+ * Clearing a buffer keeps its storage, so a buffer that is reused from
+ * one compilation to the next soon stops allocating.
+ */
+
+#ifndef _H_tokens
+#define _H_tokens
+
+#include <string>
+#include <vector>
+#include "errors.h"
+#include "parser.h" // for YYSTYPE
+
+using namespace std;
+
+class CompileContext;
+
+class TokenBuffer : public DiagnosticSink
+{
+  public:
+    vector<unsigned short> kinds;
+    vector<unsigned int> offsets;
+    vector<unsigned int> lengths;
+    vector<YYSTYPE> values;
+
+    TokenBuffer();
+
+    void Clear();
+    int NumTokens() const { return kinds.size(); }
+    void Add(int kind, unsigned int offset, unsigned int length, const YYSTYPE &value) {
+        kinds.push_back(kind);
+        offsets.push_back(offset);
+        lengths.push_back(length);
+        values.push_back(value);
+    }
+
+    // Called by ScanTokens() around the scan. In between, the buffer is
+    // the context's diagnostic sink, and it records what the scanner
+    // reports or echoes at the text being matched. That is flex's
+    // current match, or, with no flex scanner (see fastscan.h), the text
+    // last given to At().
+    void BeginScan(CompileContext *ctx);
+    void EndScan(CompileContext *ctx);
+    void At(unsigned int offset, unsigned int length) { scanOffset = offset; scanLength = length; }
+    void Report(errorKindT kind, yyltype *loc, const char *msg);
+    void Echo(const char *text, int len);
+
+    // Used by the preprocessor (see preprocess.h), which makes a unit's
+    // buffer out of the tokens and diagnostics of its files' buffers. A
+    // token that a macro expanded to is given the location of the
+    // macro's name, offset and length here, and the text of the macro's
+    // call is then walked over as if it were blank.
+    void AddExpanded(int kind, unsigned int offset, unsigned int length, const YYSTYPE &value) {
+        Add(kind | Expanded, offset, length, value);
+    }
+    int NumEvents() const { return events.size(); }
+    unsigned int EventOffset(int i) const { return events[i].offset; }
+    void CopyEvent(const TokenBuffer &from, int i, unsigned int offset);
+
+    // Returns true if other holds the same tokens and recorded the same
+    // diagnostics and echoed text at the same places
+    bool SameAs(const TokenBuffer &other) const;
+    // Returns h with the tokens from offset from up to to, and the
+    // diagnostics and echoed text there, hashed in (FNV-1a), their
+    // offsets taken from from. It covers what SameAs() compares, but
+    // an identifier is hashed by its spelling, so that the buffers of
+    // different contexts can be compared.
+    unsigned long long Hash(unsigned long long h, unsigned int from, unsigned int to) const;
+
+    // Starts handing out tokens from the first one
+    void Rewind();
+    // Returns the next token, as yylex() would
+    int Next(CompileContext *ctx, YYSTYPE *lval, yyltype *loc);
+
+  private:
+    static const unsigned short Expanded = 0x8000; // or'd into the kind
+
+    struct Event {
+        unsigned int offset, length;
+        bool echo;                  // if not, a diagnostic
+        errorKindT kind;
+        bool hasLocation;
+        size_t textStart, textLen;  // the message, or the text echoed
+    };
+    vector<Event> events;
+    string eventText;               // each event's, NUL-terminated
+
+    // The context's own sink and counts, put back by EndScan()
+    CompileContext *scanning;
+    unsigned int scanOffset, scanLength;
+    DiagnosticSink *savedSink, *savedRecorder;
+    int savedNumErrors;
+
+    // Where Next() has got to
+    int next;
+    unsigned int pos;
+    int line, column;
+    int state;
+    int nextEvent;
+    int matchLine, matchColumn, matchLength; // of the last thing scanned
+    unsigned int matchOffset;
+
+    const char *Text(const Event &e) const { return eventText.data() + e.textStart; }
+    void AddText(Event *e, const char *text, size_t len);
+    void Where(unsigned int *offset, unsigned int *length) const;
+    static bool SameValue(int kind, const YYSTYPE &a, const YYSTYPE &b);
+    static unsigned long long HashValue(unsigned long long h, int kind, const YYSTYPE &v);
+    void Matched(unsigned int length);
+    void Advance(CompileContext *ctx, unsigned int to);
+    void ReplayEvents(CompileContext *ctx, unsigned int offset);
+};
+
+#endif
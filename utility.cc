@@ -11,6 +11,8 @@
 using std::vector;
 
 static vector<const char*> debugKeys;
+static thread_local bool debugOutput = true;
+static thread_local FILE *debugFile = NULL;   // NULL for stdout
 static const int BufferSize = 2048;
 
 void Failure(const char *format, ...) {
@@ -34,7 +36,17 @@ int IndexOf(const char *key) {
 }
 
 bool IsDebugOn(const char *key) {
-  return (IndexOf(key) != -1);
+  return debugOutput && (IndexOf(key) != -1);
+}
+
+bool IsAnyDebugOn() {
+  return debugOutput && !debugKeys.empty();
+}
+
+bool SetDebugOutput(bool on) {
+  bool wasOn = debugOutput;
+  debugOutput = on;
+  return wasOn;
 }
 
 void SetDebugForKey(const char *key, bool value) {
@@ -45,6 +57,14 @@ void SetDebugForKey(const char *key, bool value) {
     debugKeys.push_back(key);
 }
 
+void SetDebugFile(FILE *file) {
+  debugFile = file;
+}
+
+FILE *DebugFile() {
+  return (debugFile ? debugFile : stdout);
+}
+
 void PrintDebug(const char *key, const char *format, ...) {
   va_list args;
   char buf[BufferSize];
@@ -55,7 +75,7 @@ void PrintDebug(const char *key, const char *format, ...) {
   va_start(args, format);
   vsprintf(buf, format, args);
   va_end(args);
-  printf("+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
+  fprintf(DebugFile(), "+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
 }
 
 void ParseCommandLine(int argc, char *argv[]) {
@@ -73,6 +73,40 @@ void SetDebugForKey(const char *key, bool val);
 
 bool IsDebugOn(const char *key);
 
+/**
+ * Function: IsAnyDebugOn()
+ * Usage: if (IsAnyDebugOn()) ...
+ * ------------------------------
+ * Return true if debug printing is on for at least one key.
+ */
+
+bool IsAnyDebugOn();
+
+/**
+ * Function: SetDebugOutput()
+ * Usage: bool wasOn = SetDebugOutput(false);
+ * ------------------------------------------
+ * Turn all debugging output off (or back on) for the calling thread,
+ * whichever keys are on, and return whether it was on. While it is off,
+ * IsDebugOn() and IsAnyDebugOn() return false. libglc turns it off
+ * while it checks, since the library must not print.
+ */
+
+bool SetDebugOutput(bool on);
+
+/**
+ * Function: SetDebugFile()
+ * Usage: SetDebugFile(buffer);
+ * ----------------------------
+ * Send the calling thread's debugging output, from PrintDebug() and the
+ * AST printing of -d dumpAST, to file rather than stdout (or back to
+ * stdout, if file is NULL). Batch mode uses it to keep each file's
+ * output together. DebugFile() returns where the output goes.
+ */
+
+void SetDebugFile(FILE *file);
+FILE *DebugFile();
+
 /**
  * Function: ParseCommandLine
  * --------------------------
@@ -0,0 +1,197 @@
+/* File: variants.cc
+ * -----------------
+ * Implementation of variants mode.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <sstream>
+#include <map>
+#include <chrono>
+#include "variants.h"
+#include "context.h"
+#include "incremental.h"
+#include "preprocess.h"
+#include "tokens.h"
+
+static const unsigned long long FnvOffset = 14695981039346656037ULL;
+static const unsigned long long FnvPrime = 1099511628211ULL;
+
+struct VariantResult {
+    int numErrors;
+    string output;          // the echoed text
+    string diagnostics;
+    int sameAs;             // the variant whose output this repeats, or -1
+
+    VariantResult() : numErrors(0), sameAs(-1) {}
+};
+
+static double NowMillis()
+{
+    using namespace std::chrono;
+    return duration<double, milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned long long Mix(unsigned long long h, const void *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        h ^= ((const unsigned char *)data)[i];
+        h *= FnvPrime;
+    }
+    return h;
+}
+
+static string Describe(const vector<string> &defines)
+{
+    if (defines.empty()) return "-";
+    string s = defines[0];
+    for (int i = 1; i < defines.size(); i++)
+        s += " " + defines[i];
+    return s;
+}
+
+static bool ReadSource(const char *path, string &source)
+{
+    FILE *input = fopen(path, "r");
+    if (!input) return false;
+    char buf[65536];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), input)) > 0)
+        source.append(buf, len);
+    fclose(input);
+    return true;
+}
+
+bool ReadVariants(const char *path, vector<vector<string> > &variants)
+{
+    FILE *list = fopen(path, "r");
+    if (!list) return false;
+    char line[4096];
+    while (fgets(line, sizeof(line), list)) {
+        vector<string> defines;
+        for (char *word = strtok(line, " \t\r\n"); word; word = strtok(NULL, " \t\r\n"))
+            defines.push_back(word);
+        if (defines.empty() || defines[0][0] == '#') continue;
+        if (defines.size() == 1 && defines[0] == "-") defines.clear();
+        variants.push_back(defines);
+    }
+    fclose(list);
+    return true;
+}
+
+/* Function: UnitHash()
+ * --------------------
+ * Hashes (FNV-1a) all that the parser, and the error messages, will see
+ * of the unit scanned in ctx: its tokens and their diagnostics, its
+ * text, from which their lines and columns are worked out, and where
+ * each of its lines came from.
+ */
+static unsigned long long UnitHash(CompileContext &ctx)
+{
+    unsigned long long h = ctx.tokens->Hash(FnvOffset, 0, UINT_MAX);
+    h = Mix(h, ctx.sourceText, ctx.sourceLen);
+    for (int num = 1; num <= ctx.NumLines(); num++) {
+        const char *path;
+        int line = ctx.SourceLine(num, &path);
+        h = Mix(h, &line, sizeof(line));
+        if (path) h = Mix(h, path, strlen(path) + 1);
+    }
+    return h;
+}
+
+int RunVariants(const char *path, const vector<vector<string> > &variants, bool compare)
+{
+    string source;
+    if (!ReadSource(path, source)) {
+        fprintf(stderr, "*** Cannot open file '%s'\n", path);
+        return 2;
+    }
+
+    vector<VariantResult> results(variants.size());
+    map<unsigned long long, int> seen;  // the first variant with each hash
+    IncrementalChecker checker;
+    shared_ptr<const SourceFile> file;
+    double sharedMillis = 0;
+    for (int i = 0; i < variants.size(); i++) {
+        VariantResult &r = results[i];
+        double start = NowMillis();
+        {
+            ostringstream out, err;
+            CompileContext ctx(err);
+            ctx.echoStream = &out;
+            ctx.sourcePath = path;
+            ctx.defines = variants[i];
+            if (!file)
+                file = ScanSourceFile(path, source.data(), source.size(), ctx.fastScan);
+            ctx.sourceFile = file;
+            ctx.ScanBuffer(source.data(), source.size());
+            unsigned long long key = UnitHash(ctx);
+            map<unsigned long long, int>::iterator it = seen.find(key);
+            if (it != seen.end()) {
+                r = results[it->second];
+                r.sameAs = it->second;
+            } else {
+                seen[key] = i;
+                ctx.incremental = &checker;
+                r.numErrors = ctx.CheckScanned();
+                r.output = out.str();
+                r.diagnostics = err.str();
+            }
+        }
+        sharedMillis += NowMillis() - start;
+        printf("==> variant %d: %s <==\n", i + 1, Describe(variants[i]).c_str());
+        fflush(stdout);
+        cout << r.output << flush;
+        cerr << r.diagnostics << flush;
+    }
+
+    // Each variant again, as a glc run of its own would check it, though
+    // the files it includes are still in the include cache
+    double independentMillis = 0;
+    int mismatches = 0;
+    for (int i = 0; compare && i < variants.size(); i++) {
+        ostringstream out, err;
+        int numErrors;
+        double start = NowMillis();
+        {
+            CompileContext ctx(err);
+            ctx.echoStream = &out;
+            ctx.sourcePath = path;
+            ctx.defines = variants[i];
+            numErrors = ctx.CheckBuffer(source.data(), source.size());
+        }
+        independentMillis += NowMillis() - start;
+        if (numErrors != results[i].numErrors || out.str() != results[i].output ||
+            err.str() != results[i].diagnostics)
+            mismatches++;
+    }
+
+    int failed = 0;
+    printf("\n=== variants summary: %d variant(s) of %s ===\n", (int)variants.size(), path);
+    for (int i = 0; i < variants.size(); i++) {
+        if (results[i].numErrors != 0) failed++;
+        printf("variant %d (%s): %d error(s)", i + 1, Describe(variants[i]).c_str(),
+               results[i].numErrors);
+        if (results[i].sameAs >= 0)
+            printf(", same tokens as variant %d", results[i].sameAs + 1);
+        printf("\n");
+    }
+    printf("=== %d unique of %d variant(s), %d failed; %d decl(s) checked, %d reused ===\n",
+           (int)seen.size(), (int)variants.size(), failed, checker.NumChecked(),
+           checker.NumReused());
+    if (!compare) {
+        printf("=== shared %.1f ms ===\n", sharedMillis);
+        return (failed == 0 ? 0 : -1);
+    }
+    // On a small input the sharing can cost more than it saves
+    if (independentMillis > sharedMillis)
+        printf("=== shared %.1f ms, independent %.1f ms, saved %.1f ms (%.0f%%) ===\n",
+               sharedMillis, independentMillis, independentMillis - sharedMillis,
+               100 * (independentMillis - sharedMillis) / independentMillis);
+    else
+        printf("=== shared %.1f ms, independent %.1f ms, nothing saved ===\n",
+               sharedMillis, independentMillis);
+    printf("=== %d output mismatch(es) ===\n", mismatches);
+    return (failed == 0 && mismatches == 0 ? 0 : -1);
+}
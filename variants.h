@@ -0,0 +1,50 @@
+/* File: variants.h
+ * ----------------
+ * Variants mode checks one shader under many sets of predefined macros
+ * (feature flags, say), sharing the work the variants have in common.
+ *
+ * The shader is read and scanned for the preprocessor once, and its
+ * included files come from the include cache (see preprocess.h), so
+ * for each variant only its conditionals and macros are worked out
+ * again. Two variants that come out as the same tokens, in the same
+ * places, give the same diagnostics, so the tokens are hashed and only
+ * the first of such variants is parsed and checked; the others repeat
+ * its output. The variants that are checked share an IncrementalChecker
+ * (see incremental.h), so a top-level declaration that comes out the
+ * same in several of them, and finds the same globals, is checked once.
+ * Each unique variant is still parsed in full: the parser builds a tree
+ * of its own for it, and only the checks of its declarations are shared.
+ */
+
+#ifndef _H_variants
+#define _H_variants
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Function: ReadVariants()
+ * ------------------------
+ * Reads the variants in the file at path, one to a line, each a list of
+ * macros to define, separated by blanks: NAME, for NAME defined as 1,
+ * or NAME=value. A line that is just "-" is the variant with nothing
+ * defined. Blank lines, and those starting with '#', are skipped.
+ * Returns false if the file can't be read.
+ */
+bool ReadVariants(const char *path, vector<vector<string> > &variants);
+
+/* Function: RunVariants()
+ * -----------------------
+ * Checks the file at path once for each variant, printing a banner and
+ * the diagnostics for each, just as a separate glc run with the macros
+ * predefined would give them, and then a summary with the time the
+ * shared checks took. With compare set, every variant is then checked
+ * again on its own, from scratch, and the summary also gives the time
+ * that took, the time saved if there was any, and the number of
+ * variants whose output differed. Returns 0 only if every variant
+ * checked cleanly (and, with compare, gave the same output both ways).
+ */
+int RunVariants(const char *path, const vector<vector<string> > &variants, bool compare);
+
+#endif